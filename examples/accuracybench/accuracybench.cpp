@@ -0,0 +1,566 @@
+/*
+ *  accuracybench.cpp
+ *  BEAGLE
+ *
+ *  Measures the error each precision and scaling mode introduces, next to
+ *  its speed. Data are simulated under JC+G4 on deep and large trees, where
+ *  site likelihoods underflow, and every combination of precision, scaling
+ *  mode (none, manual, auto, always and dynamic) and CPU implementation
+ *  evaluates the same tree and data. The log likelihood at the root and its
+ *  first and second derivatives along the root edge are compared with those
+ *  of the double precision, always scaled generic implementation.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "libhmsbeagle/beagle.h"
+
+#define GAMMA_CATEGORY_COUNT 4
+// relative lnL error allowed of the scaled double precision modes
+#define DOUBLE_TOLERANCE     1e-6
+
+// discrete gamma rates (category means) for a shape of 0.5
+static const double gammaRates[GAMMA_CATEGORY_COUNT] = {0.03338, 0.25191, 0.82026, 2.89445};
+
+enum ScalingMode {
+    SCALING_NONE = 0,
+    SCALING_MANUAL,
+    SCALING_AUTO,
+    SCALING_ALWAYS,
+    SCALING_DYNAMIC,
+    SCALING_MODE_COUNT
+};
+
+static const char* scalingNames[SCALING_MODE_COUNT] = {"none", "manual", "auto", "always", "dynamic"};
+
+// without scaling the instance is created for manual scaling and no scale factors are written
+static const long scalingFlags[SCALING_MODE_COUNT] = {
+    BEAGLE_FLAG_SCALING_MANUAL, BEAGLE_FLAG_SCALING_MANUAL, BEAGLE_FLAG_SCALING_AUTO,
+    BEAGLE_FLAG_SCALING_ALWAYS, BEAGLE_FLAG_SCALING_DYNAMIC
+};
+
+struct BenchOptions {
+    int taxonCount;
+    int siteCount;
+    int stateCount;
+    double branchLength;
+    std::vector<std::string> shapes;
+    int resource;
+    int nreps;
+    unsigned int seed;
+    long threadingFlags;
+    bool disableVector;
+    bool csv;
+};
+
+/*
+ * Tips are nodes 0 to tipCount - 1 and every internal node has a larger
+ * index than its children, so the root is the last node.
+ */
+struct Tree {
+    int tipCount;
+    int nodeCount;
+    std::vector<int> parent;
+    std::vector<int> children;  // two per node, -1 for tips
+    std::vector<double> length; // of the edge above each node
+};
+
+struct Result {
+    std::string implName;
+    long flags;
+    double time;        // seconds per evaluation, fastest of the reps
+    double logL;
+    double firstDerivative;
+    double secondDerivative;
+};
+
+static void joinNodes(Tree& tree, int node, int child1, int child2) {
+    tree.children[2 * node] = child1;
+    tree.children[2 * node + 1] = child2;
+    tree.parent[child1] = node;
+    tree.parent[child2] = node;
+}
+
+/*
+ * A pectinate tree is as deep as a tree of its size can be, a balanced tree
+ * as shallow; random joins give depths in between.
+ */
+static bool makeTree(const std::string& shape, int tipCount, double branchLength, std::mt19937& rng, Tree& tree) {
+    tree.tipCount = tipCount;
+    tree.nodeCount = 2 * tipCount - 1;
+    tree.parent.assign(tree.nodeCount, -1);
+    tree.children.assign(2 * tree.nodeCount, -1);
+    tree.length.assign(tree.nodeCount, 0.0);
+
+    std::vector<int> active(tipCount);
+    for (int t = 0; t < tipCount; t++)
+        active[t] = t;
+
+    int node = tipCount;
+    if (shape == "pectinate") {
+        joinNodes(tree, node++, 0, 1);
+        for (int t = 2; t < tipCount; t++, node++)
+            joinNodes(tree, node, node - 1, t);
+    } else if (shape == "balanced") {
+        while (active.size() > 1) {
+            std::vector<int> next;
+            for (size_t i = 0; i + 1 < active.size(); i += 2) {
+                joinNodes(tree, node, active[i], active[i + 1]);
+                next.push_back(node++);
+            }
+            if (active.size() % 2 == 1)
+                next.push_back(active.back());
+            active.swap(next);
+        }
+    } else if (shape == "random") {
+        while (active.size() > 1) {
+            const int i = std::uniform_int_distribution<int>(0, (int) active.size() - 1)(rng);
+            int j = std::uniform_int_distribution<int>(0, (int) active.size() - 2)(rng);
+            if (j >= i)
+                j++;
+            joinNodes(tree, node, active[i], active[j]);
+            active[std::min(i, j)] = node++;
+            active.erase(active.begin() + std::max(i, j));
+        }
+    } else {
+        return false;
+    }
+
+    std::exponential_distribution<double> lengths(1.0 / branchLength);
+    for (int n = 0; n < tree.nodeCount - 1; n++)
+        tree.length[n] = lengths(rng);
+    return true;
+}
+
+static int treeDepth(const Tree& tree) {
+    int depth = 0;
+    for (int t = 0; t < tree.tipCount; t++) {
+        int edges = 0;
+        for (int n = t; tree.parent[n] != -1; n = tree.parent[n])
+            edges++;
+        depth = std::max(depth, edges);
+    }
+    return depth;
+}
+
+/*
+ * Tip states simulated under JC with gamma rates: along an edge of length t
+ * at rate r, the state is redrawn uniformly with probability
+ * 1 - exp(-r t n / (n - 1)).
+ */
+static void simulateStates(const Tree& tree, int siteCount, int stateCount, std::mt19937& rng,
+                           std::vector<std::vector<int> >& tipStates) {
+    const double eigenValue = stateCount / (stateCount - 1.0);
+    std::uniform_int_distribution<int> randomState(0, stateCount - 1);
+    std::uniform_int_distribution<int> randomCategory(0, GAMMA_CATEGORY_COUNT - 1);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    tipStates.assign(tree.tipCount, std::vector<int>(siteCount));
+    std::vector<int> states(tree.nodeCount);
+    for (int s = 0; s < siteCount; s++) {
+        const double rate = gammaRates[randomCategory(rng)];
+        states[tree.nodeCount - 1] = randomState(rng);
+        for (int n = tree.nodeCount - 2; n >= 0; n--) {
+            const double change = 1.0 - std::exp(-rate * tree.length[n] * eigenValue);
+            states[n] = (uniform(rng) < change ? randomState(rng) : states[tree.parent[n]]);
+        }
+        for (int t = 0; t < tree.tipCount; t++)
+            tipStates[t][s] = states[t];
+    }
+}
+
+/*
+ * Eigendecomposition of the JC model on any number of states, from the
+ * orthonormal Helmert basis: a constant eigenvector with eigenvalue 0 and
+ * its complement with eigenvalue -n / (n - 1).
+ */
+static void jcEigenSystem(int stateCount, std::vector<double>& eigenVectors,
+                          std::vector<double>& inverseEigenVectors, std::vector<double>& eigenValues) {
+    const int n = stateCount;
+    std::vector<double> helmert(n * n, 0.0);
+    for (int i = 0; i < n; i++)
+        helmert[i] = 1.0 / std::sqrt((double) n);
+    for (int k = 1; k < n; k++) {
+        const double norm = 1.0 / std::sqrt((double) k * (k + 1));
+        for (int i = 0; i < k; i++)
+            helmert[k * n + i] = norm;
+        helmert[k * n + k] = -k * norm;
+    }
+
+    eigenVectors.resize(n * n);
+    inverseEigenVectors.resize(n * n);
+    eigenValues.assign(n, -n / (n - 1.0));
+    eigenValues[0] = 0.0;
+    for (int k = 0; k < n; k++) {
+        for (int i = 0; i < n; i++) {
+            eigenVectors[i * n + k] = helmert[k * n + i];
+            inverseEigenVectors[k * n + i] = helmert[k * n + i];
+        }
+    }
+}
+
+static int createInstance(const BenchOptions& options,
+                          const std::vector<std::vector<int> >& tipStates,
+                          long preferenceFlags,
+                          long requirementFlags,
+                          BeagleInstanceDetails* details) {
+    const int tipCount = options.taxonCount;
+    const int nodeCount = 2 * tipCount - 1;
+    int resource = options.resource;
+    // scale buffers: one per internal node, then the cumulative buffers of the root edge and the root
+    const int instance = beagleCreateInstance(tipCount, tipCount - 1, tipCount, options.stateCount,
+                                              options.siteCount, 1, nodeCount + 3, GAMMA_CATEGORY_COUNT,
+                                              tipCount + 1, &resource, 1, preferenceFlags, requirementFlags,
+                                              details);
+    if (instance < 0)
+        return instance;
+
+    for (int t = 0; t < tipCount; t++)
+        beagleSetTipStates(instance, t, &tipStates[t][0]);
+
+    std::vector<double> eigenVectors, inverseEigenVectors, eigenValues;
+    jcEigenSystem(options.stateCount, eigenVectors, inverseEigenVectors, eigenValues);
+    beagleSetEigenDecomposition(instance, 0, &eigenVectors[0], &inverseEigenVectors[0], &eigenValues[0]);
+
+    const std::vector<double> frequencies(options.stateCount, 1.0 / options.stateCount);
+    const std::vector<double> categoryWeights(GAMMA_CATEGORY_COUNT, 1.0 / GAMMA_CATEGORY_COUNT);
+    const std::vector<double> patternWeights(options.siteCount, 1.0);
+    beagleSetStateFrequencies(instance, 0, &frequencies[0]);
+    beagleSetCategoryWeights(instance, 0, &categoryWeights[0]);
+    beagleSetCategoryRates(instance, gammaRates);
+    beagleSetPatternWeights(instance, &patternWeights[0]);
+    return instance;
+}
+
+/*
+ * One full evaluation in the given scaling mode. The partials of every node
+ * below the root are computed first and integrated along the root edge,
+ * which the reversible model makes equivalent to the root, for the
+ * derivatives; the root partials are computed last for the log likelihood.
+ */
+static void evaluate(int instance, const Tree& tree, ScalingMode mode,
+                     double* logL, double* firstDerivative, double* secondDerivative) {
+    const int tipCount = tree.tipCount;
+    const int root = tree.nodeCount - 1;
+    const int edgeCumulativeIndex = tipCount - 1;
+    const int rootCumulativeIndex = tipCount;
+    const int edgeMatrix = tree.nodeCount;
+    const int edgeFirstDerivativeMatrix = tree.nodeCount + 1;
+    const int edgeSecondDerivativeMatrix = tree.nodeCount + 2;
+    const int zero = 0;
+
+    std::vector<int> nodes(tree.nodeCount - 1);
+    for (int n = 0; n < tree.nodeCount - 1; n++)
+        nodes[n] = n;
+    beagleUpdateTransitionMatrices(instance, 0, &nodes[0], NULL, NULL, &tree.length[0], tree.nodeCount - 1);
+
+    // the partials child of the root is the parent of the root edge
+    int edgeParent = tree.children[2 * root];
+    int edgeChild = tree.children[2 * root + 1];
+    if (edgeParent < tipCount)
+        std::swap(edgeParent, edgeChild);
+    const double edgeLength = tree.length[edgeParent] + tree.length[edgeChild];
+    beagleUpdateTransitionMatrices(instance, 0, &edgeMatrix, &edgeFirstDerivativeMatrix,
+                                   &edgeSecondDerivativeMatrix, &edgeLength, 1);
+
+    const bool writeScale = (mode == SCALING_MANUAL || mode == SCALING_DYNAMIC);
+    std::vector<BeagleOperation> operations;
+    for (int n = tipCount; n <= root; n++) {
+        BeagleOperation operation = {n, (writeScale ? n - tipCount : BEAGLE_OP_NONE),
+                                     (mode == SCALING_DYNAMIC ? n - tipCount : BEAGLE_OP_NONE),
+                                     tree.children[2 * n], tree.children[2 * n],
+                                     tree.children[2 * n + 1], tree.children[2 * n + 1]};
+        operations.push_back(operation);
+    }
+    const int dynamicCumulativeIndex = (mode == SCALING_DYNAMIC ? edgeCumulativeIndex : BEAGLE_OP_NONE);
+    beagleUpdatePartials(instance, &operations[0], (int) operations.size() - 1, dynamicCumulativeIndex);
+
+    std::vector<int> scaleIndices(tipCount - 1);
+    std::vector<int> internalNodes(tipCount - 1);
+    for (int i = 0; i < tipCount - 1; i++) {
+        scaleIndices[i] = i;
+        internalNodes[i] = tipCount + i;
+    }
+
+    int cumulativeIndex = BEAGLE_OP_NONE;
+    if (mode == SCALING_MANUAL) {
+        beagleResetScaleFactors(instance, edgeCumulativeIndex);
+        beagleAccumulateScaleFactors(instance, &scaleIndices[0], tipCount - 2, edgeCumulativeIndex);
+        cumulativeIndex = edgeCumulativeIndex;
+    } else if (mode == SCALING_AUTO) {
+        beagleAccumulateScaleFactors(instance, &internalNodes[0], tipCount - 2, BEAGLE_OP_NONE);
+    } else if (mode == SCALING_DYNAMIC) {
+        cumulativeIndex = edgeCumulativeIndex;
+    }
+    double edgeLogL;
+    beagleCalculateEdgeLogLikelihoods(instance, &edgeParent, &edgeChild, &edgeMatrix,
+                                      &edgeFirstDerivativeMatrix, &edgeSecondDerivativeMatrix,
+                                      &zero, &zero, &cumulativeIndex, 1,
+                                      &edgeLogL, firstDerivative, secondDerivative);
+
+    beagleUpdatePartials(instance, &operations.back(), 1, dynamicCumulativeIndex);
+    if (mode == SCALING_MANUAL) {
+        beagleResetScaleFactors(instance, rootCumulativeIndex);
+        beagleAccumulateScaleFactors(instance, &scaleIndices[0], tipCount - 1, rootCumulativeIndex);
+        cumulativeIndex = rootCumulativeIndex;
+    } else if (mode == SCALING_AUTO) {
+        beagleAccumulateScaleFactors(instance, &internalNodes[0], tipCount - 1, BEAGLE_OP_NONE);
+    }
+    beagleCalculateRootLogLikelihoods(instance, &root, &zero, &zero, &cumulativeIndex, 1, logL);
+}
+
+static bool benchmarkInstance(const BenchOptions& options,
+                              const Tree& tree,
+                              const std::vector<std::vector<int> >& tipStates,
+                              ScalingMode mode,
+                              long preferenceFlags,
+                              long requirementFlags,
+                              Result& result) {
+    BeagleInstanceDetails details;
+    const int instance = createInstance(options, tipStates, preferenceFlags,
+                                        requirementFlags | scalingFlags[mode], &details);
+    if (instance < 0)
+        return false;
+    result.implName = details.implName;
+    result.flags = details.flags;
+
+    if (mode == SCALING_DYNAMIC)
+        beagleResetScaleFactors(instance, tree.tipCount - 1);
+
+    result.time = HUGE_VAL;
+    for (int rep = 0; rep < options.nreps; rep++) {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        evaluate(instance, tree, mode, &result.logL, &result.firstDerivative, &result.secondDerivative);
+        result.time = std::min(result.time,
+                               std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    beagleFinalizeInstance(instance);
+    return true;
+}
+
+static std::string formatError(double value, double reference, bool relative) {
+    if (!std::isfinite(value))
+        return "-";
+    double error = std::fabs(value - reference);
+    if (relative) {
+        if (reference == 0.0)
+            return "-";
+        error /= std::fabs(reference);
+    }
+    std::ostringstream out;
+    out << std::scientific << std::setprecision(2) << error;
+    return out.str();
+}
+
+static std::string formatValue(double value) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(4) << value;
+    return out.str();
+}
+
+static void printHeader(const BenchOptions& options) {
+    if (options.csv) {
+        std::cout << "tree,implementation,precision,scaling,ms,lnL,lnLAbsError,lnLRelError,"
+                     "d1RelError,d2RelError\n";
+        return;
+    }
+    std::cout << std::left << std::setw(28) << "implementation" << std::setw(8) << "prec"
+              << std::setw(9) << "scaling" << std::right << std::setw(10) << "ms"
+              << std::setw(18) << "lnL" << std::setw(11) << "lnL abs" << std::setw(11) << "lnL rel"
+              << std::setw(11) << "d1 rel" << std::setw(11) << "d2 rel" << "\n";
+}
+
+static void printResult(const BenchOptions& options, const std::string& shape, const Result& result,
+                        ScalingMode mode, const Result& reference) {
+    const std::string precision = (result.flags & BEAGLE_FLAG_PRECISION_SINGLE ? "single" : "double");
+    const std::string columns[] = {
+        formatValue(result.logL),
+        formatError(result.logL, reference.logL, false),
+        formatError(result.logL, reference.logL, true),
+        formatError(result.firstDerivative, reference.firstDerivative, true),
+        formatError(result.secondDerivative, reference.secondDerivative, true)
+    };
+
+    if (options.csv) {
+        std::cout << shape << "," << result.implName << "," << precision << "," << scalingNames[mode] << ","
+                  << std::fixed << std::setprecision(3) << result.time * 1000.0;
+        for (int c = 0; c < 5; c++)
+            std::cout << "," << columns[c];
+        std::cout << "\n";
+    } else {
+        std::cout << std::left << std::setw(28) << result.implName << std::setw(8) << precision
+                  << std::setw(9) << scalingNames[mode] << std::right << std::fixed << std::setprecision(3)
+                  << std::setw(10) << result.time * 1000.0 << std::setw(18) << columns[0];
+        for (int c = 1; c < 5; c++)
+            std::cout << std::setw(11) << columns[c];
+        std::cout << "\n";
+    }
+    std::cout.unsetf(std::ios::floatfield);
+}
+
+void helpMessage() {
+    std::cerr << "Usage:\n\n";
+    std::cerr << "accuracybench [--help] [--taxa <integer>] [--sites <integer>] [--states <integer>] [--branchlength <number>] [--tree pectinate|balanced|random] [--reps <integer>] [--rsrc <integer>] [--seed <integer>] [--disablevector] [--enablethreads] [--csv]\n\n";
+    std::cerr << "Data of --sites sites (1000 by default) are simulated under JC+G4 on a tree of --taxa taxa (1000 by default) with exponential branch lengths of mean --branchlength (0.1 by default); --tree may be repeated and defaults to a pectinate and a balanced tree\n\n";
+    std::cerr << "Every available implementation is run in double and single precision with no scaling and with manual, auto, always and dynamic scaling; each evaluation is timed --reps times (5 by default) and the fastest time is reported\n\n";
+    std::cerr << "Errors are absolute and relative to the double precision, always scaled generic CPU implementation, for the log likelihood and its first (d1) and second (d2) derivatives along the root edge; '-' marks a result that underflowed\n\n";
+    std::cerr << "The run fails if a scaled double precision result has a relative lnL error beyond " << DOUBLE_TOLERANCE << "; scaled double precision results that underflow are counted but do not fail the run, since auto and dynamic scaling only rescale partials whose children are both partials\n\n";
+    std::exit(0);
+}
+
+int main(int argc, const char* argv[]) {
+    BenchOptions options;
+    options.taxonCount = 1000;
+    options.siteCount = 1000;
+    options.stateCount = 4;
+    options.branchLength = 0.1;
+    options.resource = 0;
+    options.nreps = 5;
+    options.seed = 1;
+    options.threadingFlags = 0;
+    options.disableVector = false;
+    options.csv = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        const bool hasValue = (i + 1 < argc);
+        if (option == "--help") {
+            helpMessage();
+        } else if (option == "--taxa" && hasValue) {
+            options.taxonCount = atoi(argv[++i]);
+        } else if (option == "--sites" && hasValue) {
+            options.siteCount = atoi(argv[++i]);
+        } else if (option == "--states" && hasValue) {
+            options.stateCount = atoi(argv[++i]);
+        } else if (option == "--branchlength" && hasValue) {
+            options.branchLength = atof(argv[++i]);
+        } else if (option == "--tree" && hasValue) {
+            options.shapes.push_back(argv[++i]);
+        } else if (option == "--reps" && hasValue) {
+            options.nreps = atoi(argv[++i]);
+        } else if (option == "--rsrc" && hasValue) {
+            options.resource = atoi(argv[++i]);
+        } else if (option == "--seed" && hasValue) {
+            options.seed = (unsigned int) atoi(argv[++i]);
+        } else if (option == "--disablevector") {
+            options.disableVector = true;
+        } else if (option == "--enablethreads") {
+            options.threadingFlags = BEAGLE_FLAG_THREADING_CPP;
+        } else if (option == "--csv") {
+            options.csv = true;
+        } else {
+            std::cerr << "Unknown option: " << option << "\n\n";
+            helpMessage();
+        }
+    }
+
+    if (options.taxonCount < 4 || options.siteCount < 1 || options.stateCount < 2 || options.branchLength <= 0.0) {
+        std::cerr << "At least 4 taxa, 1 site, 2 states and a positive branch length are needed\n\n";
+        helpMessage();
+    }
+    if (options.shapes.empty()) {
+        options.shapes.push_back("pectinate");
+        options.shapes.push_back("balanced");
+    }
+    if (options.nreps < 1)
+        options.nreps = 1;
+
+    std::vector<long> precisionFlags;
+    precisionFlags.push_back(BEAGLE_FLAG_PRECISION_DOUBLE);
+    precisionFlags.push_back(BEAGLE_FLAG_PRECISION_SINGLE);
+    std::vector<long> vectorFlags;
+    if (options.resource != 0) {
+        vectorFlags.push_back(0);
+    } else {
+        vectorFlags.push_back(BEAGLE_FLAG_VECTOR_NONE);
+        if (!options.disableVector) {
+            vectorFlags.push_back(BEAGLE_FLAG_VECTOR_SSE);
+            vectorFlags.push_back(BEAGLE_FLAG_VECTOR_AVX);
+        }
+    }
+
+    std::mt19937 rng(options.seed);
+    int failures = 0;
+    int underflows = 0;
+
+    for (size_t s = 0; s < options.shapes.size(); s++) {
+        const std::string& shape = options.shapes[s];
+        Tree tree;
+        if (!makeTree(shape, options.taxonCount, options.branchLength, rng, tree)) {
+            std::cerr << "Unknown tree shape: " << shape << "\n\n";
+            helpMessage();
+        }
+        std::vector<std::vector<int> > tipStates;
+        simulateStates(tree, options.siteCount, options.stateCount, rng, tipStates);
+
+        Result reference;
+        BenchOptions referenceOptions(options);
+        referenceOptions.resource = 0;
+        if (!benchmarkInstance(referenceOptions, tree, tipStates, SCALING_ALWAYS, 0,
+                               BEAGLE_FLAG_FRAMEWORK_CPU | BEAGLE_FLAG_PRECISION_DOUBLE | BEAGLE_FLAG_VECTOR_NONE,
+                               reference)) {
+            std::cerr << "Failed to obtain the reference instance\n";
+            return 1;
+        }
+
+        std::ostream& out = (options.csv ? std::cerr : std::cout);
+        out << "Tree: " << shape << ", " << options.taxonCount << " taxa, depth " << treeDepth(tree)
+            << " edges, " << options.siteCount << " sites, " << options.stateCount << " states\n";
+        out << "Reference: " << reference.implName << ", double precision, always scaled: lnL "
+            << std::setprecision(12) << reference.logL << ", d1 " << reference.firstDerivative
+            << ", d2 " << reference.secondDerivative << std::setprecision(6) << "\n\n";
+
+        if (!options.csv || s == 0)
+            printHeader(options);
+
+        for (size_t p = 0; p < precisionFlags.size(); p++) {
+            std::set<std::string> implNames;
+            for (size_t v = 0; v < vectorFlags.size(); v++) {
+                const long requirementFlags = precisionFlags[p] | vectorFlags[v];
+                bool created = false;
+                for (int mode = 0; mode < SCALING_MODE_COUNT; mode++) {
+                    Result result;
+                    if (!benchmarkInstance(options, tree, tipStates, (ScalingMode) mode, options.threadingFlags,
+                                           requirementFlags, result))
+                        continue;
+                    // vectorization flags an implementation ignores give it again
+                    if (mode == 0 || !created) {
+                        if (implNames.count(result.implName))
+                            break;
+                        implNames.insert(result.implName);
+                        created = true;
+                    }
+                    printResult(options, shape, result, (ScalingMode) mode, reference);
+
+                    if (mode == SCALING_NONE || !(result.flags & BEAGLE_FLAG_PRECISION_DOUBLE))
+                        continue;
+                    if (!std::isfinite(result.logL)) {
+                        underflows++;
+                    } else if (!(std::fabs(result.logL - reference.logL) <= DOUBLE_TOLERANCE * std::fabs(reference.logL))) {
+                        std::cerr << result.implName << " with " << scalingNames[mode]
+                                  << " scaling is off the reference lnL\n";
+                        failures++;
+                    }
+                }
+            }
+        }
+        if (!options.csv)
+            std::cout << "\n";
+    }
+
+    if (underflows > 0)
+        std::cerr << underflows << " scaled double precision result" << (underflows > 1 ? "s" : "")
+                  << " underflowed\n";
+    return (failures > 0 ? 1 : 0);
+}
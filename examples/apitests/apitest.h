@@ -0,0 +1,386 @@
+/*
+ *  apitest.h
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Shared set-up of the API regression tests: a random rooted tree with
+ * random nucleotide data under a GTR+G model, an instance holding it, and a
+ * plain post-order evaluation that the tests compare the calls under test
+ * against. Every test is a separate check program that exits with a nonzero
+ * status on the first failed call or on any result outside its tolerance.
+ */
+
+#ifndef __apitest__
+#define __apitest__
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "libhmsbeagle/beagle.h"
+
+#define STATE_COUNT     4
+#define CATEGORY_COUNT  4
+
+// calls a BEAGLE function and stops the test unless it succeeds
+#define CHECK_BEAGLE(call) checkBeagle(#call, (call))
+
+int testFailures = 0;
+
+void checkBeagle(const char* call,
+                 int returnCode) {
+    if (returnCode < 0) {
+        fprintf(stderr, "FAIL: %s returned error %d\n", call, returnCode);
+        exit(1);
+    }
+}
+
+// records a failure unless actual is within a relative (or, near zero, absolute) tolerance of expected
+void checkClose(const char* what,
+                double expected,
+                double actual,
+                double tolerance) {
+    double scale = std::max(1.0, std::fabs(expected));
+    if (!(std::fabs(actual - expected) <= tolerance * scale)) {
+        fprintf(stderr, "FAIL: %s: expected %.12g, got %.12g\n", what, expected, actual);
+        testFailures++;
+    }
+}
+
+void checkTrue(const char* what,
+               bool condition) {
+    if (!condition) {
+        fprintf(stderr, "FAIL: %s\n", what);
+        testFailures++;
+    }
+}
+
+int finishTest(const char* name) {
+    if (testFailures > 0) {
+        fprintf(stderr, "%s: %d checks failed\n", name, testFailures);
+        return 1;
+    }
+    fprintf(stdout, "%s: all checks passed\n", name);
+    return 0;
+}
+
+/*
+ * A rooted binary tree over tipCount tips and an alignment of patternCount
+ * patterns. Nodes are numbered as the partials buffers that hold them: tips
+ * first, then internal nodes in post-order, so the root is the last node.
+ * The branch above a node uses the transition matrix of the same index.
+ */
+struct TestProblem {
+    int tipCount;
+    int patternCount;
+    int nodeCount;
+    std::vector<int> parents;           // parent of each node, BEAGLE_OP_NONE for the root
+    std::vector<int> children;          // two children of each internal node
+    std::vector<double> edgeLengths;    // length of the branch above each node
+    std::vector<std::vector<int> > tipStates;
+    std::vector<double> patternWeights;
+    std::vector<double> evec;
+    std::vector<double> ivec;
+    std::vector<double> eval;
+    std::vector<double> freqs;
+    std::vector<double> rates;
+    std::vector<double> weights;
+
+    int rootIndex() const { return nodeCount - 1; }
+    int internalCount() const { return tipCount - 1; }
+    int cumulativeScaleIndex() const { return tipCount - 1; }
+};
+
+double uniformRandom() {
+    return rand() / (RAND_MAX + 1.0);
+}
+
+/*
+ * Eigen decomposition of a GTR rate matrix, normalized to one substitution per
+ * unit time, through the symmetric matrix Pi^1/2 Q Pi^-1/2 and Jacobi rotations.
+ */
+void setGTRModel(TestProblem& problem,
+                 const double* exchangeabilities,
+                 const double* freqs) {
+    const int n = STATE_COUNT;
+    double q[n][n];
+    int k = 0;
+    for (int i = 0; i < n; i++) {
+        q[i][i] = 0.0;
+        for (int j = i + 1; j < n; j++) {
+            q[i][j] = exchangeabilities[k] * freqs[j];
+            q[j][i] = exchangeabilities[k] * freqs[i];
+            k++;
+        }
+    }
+    double mu = 0.0;
+    for (int i = 0; i < n; i++) {
+        double rowSum = 0.0;
+        for (int j = 0; j < n; j++)
+            if (j != i)
+                rowSum += q[i][j];
+        q[i][i] = -rowSum;
+        mu += freqs[i] * rowSum;
+    }
+
+    double a[n][n];
+    double u[n][n];
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            a[i][j] = q[i][j] / mu * std::sqrt(freqs[i] / freqs[j]);
+            u[i][j] = (i == j ? 1.0 : 0.0);
+        }
+    }
+    for (int sweep = 0; sweep < 50; sweep++) {
+        for (int p = 0; p < n; p++) {
+            for (int r = p + 1; r < n; r++) {
+                if (std::fabs(a[p][r]) < 1e-300)
+                    continue;
+                double theta = (a[r][r] - a[p][p]) / (2.0 * a[p][r]);
+                double t = (theta >= 0 ? 1.0 : -1.0) / (std::fabs(theta) + std::sqrt(theta * theta + 1.0));
+                double c = 1.0 / std::sqrt(t * t + 1.0);
+                double s = t * c;
+                for (int i = 0; i < n; i++) {
+                    double aip = a[i][p];
+                    double air = a[i][r];
+                    a[i][p] = c * aip - s * air;
+                    a[i][r] = s * aip + c * air;
+                }
+                for (int j = 0; j < n; j++) {
+                    double apj = a[p][j];
+                    double arj = a[r][j];
+                    a[p][j] = c * apj - s * arj;
+                    a[r][j] = s * apj + c * arj;
+                }
+                for (int i = 0; i < n; i++) {
+                    double uip = u[i][p];
+                    double uir = u[i][r];
+                    u[i][p] = c * uip - s * uir;
+                    u[i][r] = s * uip + c * uir;
+                }
+            }
+        }
+    }
+
+    problem.evec.resize(n * n);
+    problem.ivec.resize(n * n);
+    problem.eval.resize(n);
+    problem.freqs.assign(freqs, freqs + n);
+    for (int i = 0; i < n; i++) {
+        problem.eval[i] = a[i][i];
+        for (int j = 0; j < n; j++) {
+            problem.evec[i * n + j] = u[i][j] / std::sqrt(freqs[i]);
+            problem.ivec[i * n + j] = u[j][i] * std::sqrt(freqs[j]);
+        }
+    }
+}
+
+/*
+ * A random tree built by joining random pairs of subtrees, with uniform
+ * random states (a few of them missing) and pattern weights of 1 to 3.
+ */
+TestProblem makeTestProblem(int tipCount,
+                            int patternCount,
+                            unsigned int seed) {
+    srand(seed);
+
+    TestProblem problem;
+    problem.tipCount = tipCount;
+    problem.patternCount = patternCount;
+    problem.nodeCount = 2 * tipCount - 1;
+    problem.parents.assign(problem.nodeCount, BEAGLE_OP_NONE);
+    problem.edgeLengths.assign(problem.nodeCount, 0.0);
+
+    std::vector<int> subtrees;
+    for (int i = 0; i < tipCount; i++)
+        subtrees.push_back(i);
+    for (int node = tipCount; node < problem.nodeCount; node++) {
+        for (int c = 0; c < 2; c++) {
+            int k = rand() % subtrees.size();
+            problem.children.push_back(subtrees[k]);
+            problem.parents[subtrees[k]] = node;
+            subtrees.erase(subtrees.begin() + k);
+        }
+        subtrees.push_back(node);
+    }
+    for (int i = 0; i < problem.nodeCount - 1; i++)
+        problem.edgeLengths[i] = 0.02 + 0.2 * uniformRandom();
+
+    problem.tipStates.resize(tipCount);
+    for (int i = 0; i < tipCount; i++) {
+        for (int p = 0; p < patternCount; p++)
+            problem.tipStates[i].push_back(uniformRandom() < 0.05 ? STATE_COUNT : rand() % STATE_COUNT);
+    }
+    for (int p = 0; p < patternCount; p++)
+        problem.patternWeights.push_back(1 + rand() % 3);
+
+    const double exchangeabilities[6] = {1.0, 2.5, 0.7, 0.9, 3.1, 1.0};
+    const double freqs[STATE_COUNT] = {0.3, 0.2, 0.22, 0.28};
+    setGTRModel(problem, exchangeabilities, freqs);
+
+    // discrete gamma rates for a shape of 0.5
+    const double rates[CATEGORY_COUNT] = {0.0334, 0.2519, 0.8203, 2.8944};
+    problem.rates.assign(rates, rates + CATEGORY_COUNT);
+    problem.weights.assign(CATEGORY_COUNT, 1.0 / CATEGORY_COUNT);
+
+    return problem;
+}
+
+/*
+ * Creates an instance for the problem with extraBuffers partials buffers and
+ * extraMatrices matrix buffers beyond one per node, one scale buffer per
+ * internal node plus the cumulative buffer if scaling, and sets tips, model
+ * and pattern weights.
+ */
+int createTestInstance(const TestProblem& problem,
+                       int extraBuffers,
+                       int extraMatrices,
+                       bool scaling,
+                       long preferenceFlags,
+                       long requirementFlags,
+                       BeagleInstanceDetails* returnInfo = NULL) {
+    BeagleInstanceDetails details;
+    int instance = beagleCreateInstance(problem.tipCount,
+                                        problem.nodeCount + extraBuffers,
+                                        problem.tipCount,
+                                        STATE_COUNT,
+                                        problem.patternCount,
+                                        1,
+                                        problem.nodeCount + extraMatrices,
+                                        CATEGORY_COUNT,
+                                        (scaling ? problem.internalCount() + 1 : 0),
+                                        NULL,
+                                        0,
+                                        preferenceFlags,
+                                        requirementFlags | BEAGLE_FLAG_EIGEN_REAL,
+                                        (returnInfo != NULL ? returnInfo : &details));
+    CHECK_BEAGLE(instance);
+
+    for (int i = 0; i < problem.tipCount; i++)
+        CHECK_BEAGLE(beagleSetTipStates(instance, i, &problem.tipStates[i][0]));
+    CHECK_BEAGLE(beagleSetEigenDecomposition(instance, 0, &problem.evec[0], &problem.ivec[0],
+                                             &problem.eval[0]));
+    CHECK_BEAGLE(beagleSetStateFrequencies(instance, 0, &problem.freqs[0]));
+    CHECK_BEAGLE(beagleSetCategoryWeights(instance, 0, &problem.weights[0]));
+    CHECK_BEAGLE(beagleSetCategoryRates(instance, &problem.rates[0]));
+    CHECK_BEAGLE(beagleSetPatternWeights(instance, &problem.patternWeights[0]));
+
+    return instance;
+}
+
+// the post-order operations of the tree, writing scale buffer k for internal node k if scaling
+std::vector<BeagleOperation> postOrderOperations(const TestProblem& problem,
+                                                 bool scaling) {
+    std::vector<BeagleOperation> operations;
+    for (int k = 0; k < problem.internalCount(); k++) {
+        int child1 = problem.children[2 * k];
+        int child2 = problem.children[2 * k + 1];
+        BeagleOperation operation = {problem.tipCount + k, (scaling ? k : BEAGLE_OP_NONE), BEAGLE_OP_NONE,
+                                     child1, child1, child2, child2};
+        operations.push_back(operation);
+    }
+    return operations;
+}
+
+// the pre-order operations of the tree from the root, with the pre-order buffer of node v at nodeCount + v
+std::vector<BeagleOperation> preOrderOperations(const TestProblem& problem) {
+    std::vector<BeagleOperation> operations;
+    for (int k = problem.internalCount() - 1; k >= 0; k--) {
+        int parent = problem.tipCount + k;
+        for (int c = 0; c < 2; c++) {
+            int child = problem.children[2 * k + c];
+            int sibling = problem.children[2 * k + 1 - c];
+            BeagleOperation operation = {problem.nodeCount + child, BEAGLE_OP_NONE, BEAGLE_OP_NONE,
+                                         problem.nodeCount + parent, child, sibling, sibling};
+            operations.push_back(operation);
+        }
+    }
+    return operations;
+}
+
+// the matrix indices of all branches, which are the node indices below the root
+std::vector<int> branchIndices(const TestProblem& problem) {
+    std::vector<int> indices;
+    for (int i = 0; i < problem.nodeCount - 1; i++)
+        indices.push_back(i);
+    return indices;
+}
+
+void updateTestMatrices(int instance,
+                        const TestProblem& problem) {
+    std::vector<int> indices = branchIndices(problem);
+    CHECK_BEAGLE(beagleUpdateTransitionMatrices(instance, 0, &indices[0], NULL, NULL,
+                                                &problem.edgeLengths[0], indices.size()));
+}
+
+// updates all partials and integrates the root, with the current transition matrices
+double rootLogLikelihood(int instance,
+                         const TestProblem& problem,
+                         bool scaling) {
+    std::vector<BeagleOperation> operations = postOrderOperations(problem, scaling);
+    CHECK_BEAGLE(beagleUpdatePartials(instance, &operations[0], operations.size(), BEAGLE_OP_NONE));
+
+    int cumulativeScaleIndex = BEAGLE_OP_NONE;
+    if (scaling) {
+        cumulativeScaleIndex = problem.cumulativeScaleIndex();
+        std::vector<int> scaleIndices;
+        for (int k = 0; k < problem.internalCount(); k++)
+            scaleIndices.push_back(k);
+        CHECK_BEAGLE(beagleResetScaleFactors(instance, cumulativeScaleIndex));
+        CHECK_BEAGLE(beagleAccumulateScaleFactors(instance, &scaleIndices[0], scaleIndices.size(),
+                                                  cumulativeScaleIndex));
+    }
+
+    int rootIndex = problem.rootIndex();
+    int categoryWeightsIndex = 0;
+    int stateFrequenciesIndex = 0;
+    double logL = 0.0;
+    CHECK_BEAGLE(beagleCalculateRootLogLikelihoods(instance, &rootIndex, &categoryWeightsIndex,
+                                                   &stateFrequenciesIndex, &cumulativeScaleIndex, 1, &logL));
+    return logL;
+}
+
+// integrates the root buffer as it stands, without updating any partials
+double storedRootLogLikelihood(int instance,
+                               const TestProblem& problem,
+                               bool scaling) {
+    int rootIndex = problem.rootIndex();
+    int categoryWeightsIndex = 0;
+    int stateFrequenciesIndex = 0;
+    int cumulativeScaleIndex = (scaling ? problem.cumulativeScaleIndex() : BEAGLE_OP_NONE);
+    double logL = 0.0;
+    CHECK_BEAGLE(beagleCalculateRootLogLikelihoods(instance, &rootIndex, &categoryWeightsIndex,
+                                                   &stateFrequenciesIndex, &cumulativeScaleIndex, 1, &logL));
+    return logL;
+}
+
+// the log likelihood of the tree from a full update of matrices and partials
+double evaluateTestTree(int instance,
+                        const TestProblem& problem,
+                        bool scaling) {
+    updateTestMatrices(instance, problem);
+    return rootLogLikelihood(instance, problem, scaling);
+}
+
+#endif // __apitest__
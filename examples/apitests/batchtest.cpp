@@ -0,0 +1,137 @@
+/*
+ *  batchtest.cpp
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks that a batch of evaluation jobs over several instances gives the log
+ * likelihoods of evaluating each job on its own, for jobs that can run
+ * concurrently on one instance, jobs that share buffers, and failing jobs.
+ */
+
+#include "apitest.h"
+
+// the buffers and matrices of a second copy of the tree above the first
+int shiftedIndex(const TestProblem& problem,
+                 int node) {
+    return (node < problem.tipCount ? node : node + problem.nodeCount);
+}
+
+struct JobData {
+    std::vector<int> probabilityIndices;
+    std::vector<double> edgeLengths;
+    std::vector<BeagleOperation> operations;
+    BeagleEvaluationJob job;
+};
+
+void makeJob(JobData& data,
+             int instance,
+             const TestProblem& problem,
+             bool scaling,
+             bool shifted) {
+    data.probabilityIndices = branchIndices(problem);
+    data.edgeLengths = problem.edgeLengths;
+    data.operations = postOrderOperations(problem, scaling);
+    if (shifted) {
+        for (size_t i = 0; i < data.probabilityIndices.size(); i++)
+            data.probabilityIndices[i] = shiftedIndex(problem, data.probabilityIndices[i]);
+        for (size_t i = 0; i < data.operations.size(); i++) {
+            BeagleOperation& op = data.operations[i];
+            op.destinationPartials = shiftedIndex(problem, op.destinationPartials);
+            op.child1Partials = shiftedIndex(problem, op.child1Partials);
+            op.child1TransitionMatrix = shiftedIndex(problem, op.child1TransitionMatrix);
+            op.child2Partials = shiftedIndex(problem, op.child2Partials);
+            op.child2TransitionMatrix = shiftedIndex(problem, op.child2TransitionMatrix);
+        }
+    }
+    BeagleEvaluationJob job = {instance, 0, &data.probabilityIndices[0], &data.edgeLengths[0],
+                               (int) data.probabilityIndices.size(), &data.operations[0],
+                               (int) data.operations.size(),
+                               (shifted ? shiftedIndex(problem, problem.rootIndex()) : problem.rootIndex()), 0, 0,
+                               (scaling ? problem.cumulativeScaleIndex() : BEAGLE_OP_NONE)};
+    data.job = job;
+}
+
+double separateLogLikelihood(const TestProblem& problem,
+                             bool scaling) {
+    int instance = createTestInstance(problem, 0, 0, scaling, 0, BEAGLE_FLAG_PRECISION_DOUBLE);
+    double logL = evaluateTestTree(instance, problem, scaling);
+    CHECK_BEAGLE(beagleFinalizeInstance(instance));
+    return logL;
+}
+
+int main(int argc, const char* argv[]) {
+    TestProblem problem = makeTestProblem(12, 300, 38);
+    TestProblem longer = problem;
+    for (int i = 0; i < problem.nodeCount - 1; i++)
+        longer.edgeLengths[i] *= 1.5;
+
+    // two trees on disjoint buffers of a threaded instance
+    int threaded = createTestInstance(problem, problem.nodeCount, problem.nodeCount, false,
+                                      BEAGLE_FLAG_THREADING_CPP, BEAGLE_FLAG_PRECISION_DOUBLE);
+    CHECK_BEAGLE(beagleSetCPUThreadCount(threaded, 2));
+    int threadCount = 0;
+    CHECK_BEAGLE(beagleGetCPUThreadCount(threaded, &threadCount));
+    checkTrue("threaded instance", threadCount == 2);
+    // two trees on the same buffers, evaluated in order
+    int shared = createTestInstance(problem, 0, 0, true, 0, BEAGLE_FLAG_PRECISION_DOUBLE);
+    int failing = createTestInstance(problem, 0, 0, false, 0, BEAGLE_FLAG_PRECISION_DOUBLE);
+
+    const int jobCount = 5;
+    JobData data[jobCount];
+    makeJob(data[0], threaded, problem, false, false);
+    makeJob(data[1], threaded, longer, false, true);
+    makeJob(data[2], shared, problem, true, false);
+    makeJob(data[3], shared, longer, true, false);
+    makeJob(data[4], failing, problem, false, false);
+    data[4].probabilityIndices[0] = -1;
+
+    BeagleEvaluationJob jobs[jobCount];
+    for (int j = 0; j < jobCount; j++)
+        jobs[j] = data[j].job;
+
+    double expected[jobCount - 1] = {separateLogLikelihood(problem, false), separateLogLikelihood(longer, false),
+                                     separateLogLikelihood(problem, true), separateLogLikelihood(longer, true)};
+
+    for (int round = 0; round < 2; round++) {
+        double logLs[jobCount];
+        int returnCodes[jobCount];
+        checkTrue("batch returns the error of a job",
+                  beagleEvaluateRootLogLikelihoods(jobs, jobCount, 2, logLs, returnCodes) ==
+                  BEAGLE_ERROR_OUT_OF_RANGE);
+        for (int j = 0; j < jobCount - 1; j++) {
+            checkTrue("job succeeds", returnCodes[j] == BEAGLE_SUCCESS);
+            checkClose("job log likelihood", expected[j], logLs[j], 1e-12);
+        }
+        checkTrue("failing job", returnCodes[jobCount - 1] == BEAGLE_ERROR_OUT_OF_RANGE);
+
+        // without the failing job and its return codes
+        CHECK_BEAGLE(beagleEvaluateRootLogLikelihoods(jobs, jobCount - 1, 0, logLs, NULL));
+        for (int j = 0; j < jobCount - 1; j++)
+            checkClose("job log likelihood without return codes", expected[j], logLs[j], 1e-12);
+    }
+
+    CHECK_BEAGLE(beagleFinalizeInstance(threaded));
+    CHECK_BEAGLE(beagleFinalizeInstance(shared));
+    CHECK_BEAGLE(beagleFinalizeInstance(failing));
+
+    return finishTest("batchtest");
+}
@@ -0,0 +1,74 @@
+/*
+ *  checkpointtest.cpp
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks that rolling back a checkpoint restores the partials, matrices and
+ * scale buffers of the checkpoint and that committing keeps the updates.
+ */
+
+#include "apitest.h"
+
+void runCheckpoint(bool scaling) {
+    TestProblem problem = makeTestProblem(12, 300, 30);
+    TestProblem changed = problem;
+    for (int i = 1; i < problem.nodeCount - 1; i += 2)
+        changed.edgeLengths[i] *= 0.4;
+
+    int instance = createTestInstance(problem, 0, 0, scaling, 0, BEAGLE_FLAG_PRECISION_DOUBLE);
+    int reference = createTestInstance(changed, 0, 0, scaling, 0, BEAGLE_FLAG_PRECISION_DOUBLE);
+    double originalLogL = evaluateTestTree(instance, problem, scaling);
+    double changedLogL = evaluateTestTree(reference, changed, scaling);
+
+    checkTrue("commit without a checkpoint fails", beagleCommitCheckpoint(instance) != BEAGLE_SUCCESS);
+    checkTrue("rollback without a checkpoint fails", beagleRollbackCheckpoint(instance) != BEAGLE_SUCCESS);
+
+    // rejected proposal
+    CHECK_BEAGLE(beagleSetCheckpoint(instance));
+    checkTrue("second checkpoint fails", beagleSetCheckpoint(instance) != BEAGLE_SUCCESS);
+    checkClose("proposal", changedLogL, evaluateTestTree(instance, changed, scaling), 1e-10);
+    CHECK_BEAGLE(beagleRollbackCheckpoint(instance));
+    checkClose("root after rollback", originalLogL, storedRootLogLikelihood(instance, problem, scaling), 1e-12);
+    checkClose("matrices after rollback", originalLogL, rootLogLikelihood(instance, problem, scaling), 1e-12);
+
+    // accepted proposal, with the spare buffers of the first checkpoint reused
+    CHECK_BEAGLE(beagleSetCheckpoint(instance));
+    evaluateTestTree(instance, changed, scaling);
+    CHECK_BEAGLE(beagleCommitCheckpoint(instance));
+    checkClose("root after commit", changedLogL, storedRootLogLikelihood(instance, changed, scaling), 1e-10);
+    checkClose("matrices after commit", changedLogL, rootLogLikelihood(instance, changed, scaling), 1e-10);
+
+    // a rollback with no updates since the checkpoint changes nothing
+    CHECK_BEAGLE(beagleSetCheckpoint(instance));
+    CHECK_BEAGLE(beagleRollbackCheckpoint(instance));
+    checkClose("empty rollback", changedLogL, storedRootLogLikelihood(instance, changed, scaling), 1e-10);
+
+    CHECK_BEAGLE(beagleFinalizeInstance(instance));
+    CHECK_BEAGLE(beagleFinalizeInstance(reference));
+}
+
+int main(int argc, const char* argv[]) {
+    runCheckpoint(false);
+    runCheckpoint(true);
+
+    return finishTest("checkpointtest");
+}
@@ -0,0 +1,74 @@
+/*
+ *  clonetest.cpp
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks that a clone evaluates as its original, that updates on the clone
+ * match a fresh instance and leave the buffers of the original untouched.
+ */
+
+#include "apitest.h"
+
+void runClone(bool scaling) {
+    TestProblem problem = makeTestProblem(12, 300, 29);
+    TestProblem changed = problem;
+    for (int i = 0; i < problem.nodeCount - 1; i += 3)
+        changed.edgeLengths[i] *= 2.5;
+
+    int original = createTestInstance(problem, 0, 0, scaling, 0, BEAGLE_FLAG_PRECISION_DOUBLE);
+    double originalLogL = evaluateTestTree(original, problem, scaling);
+
+    BeagleInstanceDetails details;
+    int clone = beagleCloneInstance(original, &details);
+    CHECK_BEAGLE(clone);
+    checkClose("clone holds the root of the original", originalLogL,
+               storedRootLogLikelihood(clone, problem, scaling), 1e-12);
+
+    double cloneLogL = evaluateTestTree(clone, changed, scaling);
+    checkClose("original after updating the clone", originalLogL,
+               storedRootLogLikelihood(original, problem, scaling), 1e-12);
+    checkClose("original matrices after updating the clone", originalLogL,
+               rootLogLikelihood(original, problem, scaling), 1e-12);
+
+    int fresh = createTestInstance(changed, 0, 0, scaling, 0, BEAGLE_FLAG_PRECISION_DOUBLE);
+    checkClose("clone after an update", evaluateTestTree(fresh, changed, scaling), cloneLogL, 1e-10);
+
+    // model state is copied, not shared
+    std::vector<double> rates(CATEGORY_COUNT, 1.0);
+    CHECK_BEAGLE(beagleSetCategoryRates(clone, &rates[0]));
+    checkClose("original rates after setting the clone's", originalLogL,
+               evaluateTestTree(original, problem, scaling), 1e-12);
+
+    CHECK_BEAGLE(beagleFinalizeInstance(original));
+    checkClose("clone after finalizing the original", cloneLogL,
+               storedRootLogLikelihood(clone, changed, scaling), 1e-12);
+
+    CHECK_BEAGLE(beagleFinalizeInstance(clone));
+    CHECK_BEAGLE(beagleFinalizeInstance(fresh));
+}
+
+int main(int argc, const char* argv[]) {
+    runClone(false);
+    runClone(true);
+
+    return finishTest("clonetest");
+}
@@ -0,0 +1,112 @@
+/*
+ *  countertest.cpp
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks that the performance counters count one call per operation and
+ * evaluation, stay zero while disabled, and are cleared by a reset.
+ */
+
+#include "apitest.h"
+
+void getCounters(int instance,
+                 BeagleKernelCounters* counters) {
+    CHECK_BEAGLE(beagleGetPerformanceCounters(instance, counters, BEAGLE_KERNEL_TYPE_COUNT));
+}
+
+bool allZero(const BeagleKernelCounters* counters) {
+    for (int t = 0; t < BEAGLE_KERNEL_TYPE_COUNT; t++) {
+        if (counters[t].callCount != 0 || counters[t].patternCount != 0 || counters[t].flops != 0.0 ||
+            counters[t].bytes != 0.0 || counters[t].wallTime != 0.0 || counters[t].threadTime != 0.0)
+            return false;
+    }
+    return true;
+}
+
+void checkKernel(const char* what,
+                 const BeagleKernelCounters& kernel,
+                 long expectedCalls,
+                 long expectedPatterns) {
+    if (kernel.callCount != expectedCalls || kernel.patternCount != expectedPatterns) {
+        fprintf(stderr, "%s: expected %ld calls over %ld patterns, got %ld over %ld\n",
+                what, expectedCalls, expectedPatterns, kernel.callCount, kernel.patternCount);
+        testFailures++;
+    }
+    checkTrue(what, expectedCalls == 0 || (kernel.flops > 0.0 && kernel.bytes > 0.0));
+    checkTrue(what, kernel.wallTime >= 0.0 && kernel.threadTime >= 0.0);
+}
+
+int main(int argc, const char* argv[]) {
+    TestProblem problem = makeTestProblem(10, 300, 41);
+    const long patterns = problem.patternCount;
+
+    int instance = createTestInstance(problem, 0, 0, true, 0, BEAGLE_FLAG_PRECISION_DOUBLE);
+    BeagleKernelCounters counters[BEAGLE_KERNEL_TYPE_COUNT];
+
+    evaluateTestTree(instance, problem, true);
+    getCounters(instance, counters);
+    checkTrue("counters are disabled at creation", allZero(counters));
+
+    // every tip is held as compact states
+    long calls[3] = {0, 0, 0};
+    for (int k = 0; k < problem.internalCount(); k++) {
+        int tipChildren = (problem.children[2 * k] < problem.tipCount) +
+                          (problem.children[2 * k + 1] < problem.tipCount);
+        calls[2 - tipChildren]++;
+    }
+
+    CHECK_BEAGLE(beagleSetPerformanceCounters(instance, 1));
+    for (int round = 1; round <= 2; round++) {
+        evaluateTestTree(instance, problem, true);
+        getCounters(instance, counters);
+        checkKernel("states-states", counters[BEAGLE_KERNEL_STATES_STATES], round * calls[0],
+                    round * calls[0] * patterns);
+        checkKernel("states-partials", counters[BEAGLE_KERNEL_STATES_PARTIALS], round * calls[1],
+                    round * calls[1] * patterns);
+        checkKernel("partials-partials", counters[BEAGLE_KERNEL_PARTIALS_PARTIALS], round * calls[2],
+                    round * calls[2] * patterns);
+        checkKernel("rescale", counters[BEAGLE_KERNEL_RESCALE], round * problem.internalCount(),
+                    round * problem.internalCount() * patterns);
+        checkKernel("root integration", counters[BEAGLE_KERNEL_ROOT_INTEGRATION], round, round * patterns);
+        checkKernel("edge integration", counters[BEAGLE_KERNEL_EDGE_INTEGRATION], 0, 0);
+        checkTrue("transition matrices", counters[BEAGLE_KERNEL_TRANSITION_MATRICES].callCount == round);
+    }
+
+    // disabling keeps the counts
+    CHECK_BEAGLE(beagleSetPerformanceCounters(instance, 0));
+    evaluateTestTree(instance, problem, true);
+    BeagleKernelCounters kept[BEAGLE_KERNEL_TYPE_COUNT];
+    getCounters(instance, kept);
+    for (int t = 0; t < BEAGLE_KERNEL_TYPE_COUNT; t++)
+        checkTrue("counts kept while disabled", kept[t].callCount == counters[t].callCount);
+
+    CHECK_BEAGLE(beagleResetPerformanceCounters(instance));
+    getCounters(instance, counters);
+    checkTrue("counters after a reset", allZero(counters));
+
+    checkTrue("too many kernel types",
+              beagleGetPerformanceCounters(instance, counters, BEAGLE_KERNEL_TYPE_COUNT + 1) != BEAGLE_SUCCESS);
+
+    CHECK_BEAGLE(beagleFinalizeInstance(instance));
+
+    return finishTest("countertest");
+}
@@ -0,0 +1,96 @@
+/*
+ *  derivativetest.cpp
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks the edge length derivatives from one post-order and one pre-order
+ * traversal against central finite differences of the log likelihood.
+ */
+
+#include <cmath>
+
+#include "apitest.h"
+
+int main(int argc, const char* argv[]) {
+    TestProblem problem = makeTestProblem(10, 200, 31);
+    int edgeCount = problem.nodeCount - 1;
+
+    // pre-order buffer of node v at nodeCount + v; the unused root matrix serves as scratch
+    int instance = createTestInstance(problem, problem.nodeCount, 1, false, 0, BEAGLE_FLAG_PRECISION_DOUBLE);
+    double logL = evaluateTestTree(instance, problem, false);
+
+    int scratchMatrix = problem.rootIndex();
+    int derivativeMatrix = problem.nodeCount;
+    double zero = 0.0;
+    CHECK_BEAGLE(beagleUpdateTransitionMatrices(instance, 0, &scratchMatrix, &derivativeMatrix, NULL, &zero, 1));
+
+    int rootPreBuffer = problem.nodeCount + problem.rootIndex();
+    int stateFrequenciesIndex = 0;
+    CHECK_BEAGLE(beagleSetRootPrePartials(instance, &rootPreBuffer, &stateFrequenciesIndex, 1));
+
+    std::vector<BeagleOperation> preOperations = preOrderOperations(problem);
+    CHECK_BEAGLE(beagleUpdatePrePartials(instance, &preOperations[0], preOperations.size(), BEAGLE_OP_NONE));
+
+    std::vector<int> postBuffers;
+    std::vector<int> preBuffers;
+    std::vector<int> derivativeMatrices(edgeCount, derivativeMatrix);
+    std::vector<int> categoryWeightsIndices(edgeCount, 0);
+    for (int i = 0; i < edgeCount; i++) {
+        postBuffers.push_back(i);
+        preBuffers.push_back(problem.nodeCount + i);
+    }
+    std::vector<double> siteDerivatives(edgeCount * problem.patternCount);
+    std::vector<double> sumDerivatives(edgeCount);
+    std::vector<double> sumSquaredDerivatives(edgeCount);
+    CHECK_BEAGLE(beagleCalculateEdgeDerivatives(instance, &postBuffers[0], &preBuffers[0], &derivativeMatrices[0],
+                                                &categoryWeightsIndices[0], edgeCount, &siteDerivatives[0],
+                                                &sumDerivatives[0], &sumSquaredDerivatives[0]));
+
+    int fresh = createTestInstance(problem, 0, 0, false, 0, BEAGLE_FLAG_PRECISION_DOUBLE);
+    checkClose("log likelihood", evaluateTestTree(fresh, problem, false), logL, 1e-10);
+
+    for (int i = 0; i < edgeCount; i++) {
+        double sum = 0.0;
+        double sumSquared = 0.0;
+        for (int p = 0; p < problem.patternCount; p++) {
+            double derivative = siteDerivatives[i * problem.patternCount + p];
+            sum += problem.patternWeights[p] * derivative;
+            sumSquared += problem.patternWeights[p] * derivative * derivative;
+        }
+        checkClose("sum of site derivatives", sum, sumDerivatives[i], 1e-10);
+        checkClose("sum of squared site derivatives", sumSquared, sumSquaredDerivatives[i], 1e-10);
+
+        TestProblem shifted = problem;
+        double h = 1e-5 * problem.edgeLengths[i];
+        shifted.edgeLengths[i] = problem.edgeLengths[i] + h;
+        double logLPlus = evaluateTestTree(fresh, shifted, false);
+        shifted.edgeLengths[i] = problem.edgeLengths[i] - h;
+        double logLMinus = evaluateTestTree(fresh, shifted, false);
+        checkClose("derivative against finite differences", (logLPlus - logLMinus) / (2.0 * h),
+                   sumDerivatives[i], 1e-5);
+    }
+
+    CHECK_BEAGLE(beagleFinalizeInstance(instance));
+    CHECK_BEAGLE(beagleFinalizeInstance(fresh));
+
+    return finishTest("derivativetest");
+}
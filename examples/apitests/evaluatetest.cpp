@@ -0,0 +1,81 @@
+/*
+ *  evaluatetest.cpp
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks the one-call evaluation of matrices, partials and root against the
+ * separate calls, and that it reports errors of its parts.
+ */
+
+#include "apitest.h"
+
+double fusedLogLikelihood(int instance,
+                          const TestProblem& problem,
+                          bool scaling) {
+    std::vector<int> indices = branchIndices(problem);
+    std::vector<BeagleOperation> operations = postOrderOperations(problem, scaling);
+    double logL = 0.0;
+    CHECK_BEAGLE(beagleEvaluateRootLogLikelihood(instance, 0, &indices[0], &problem.edgeLengths[0], indices.size(),
+                                                 &operations[0], operations.size(), problem.rootIndex(), 0, 0,
+                                                 (scaling ? problem.cumulativeScaleIndex() : BEAGLE_OP_NONE),
+                                                 &logL));
+    return logL;
+}
+
+void runEvaluate(bool scaling) {
+    TestProblem problem = makeTestProblem(14, 300, 37);
+
+    int fused = createTestInstance(problem, 0, 0, scaling, 0, BEAGLE_FLAG_PRECISION_DOUBLE);
+    int sequential = createTestInstance(problem, 0, 0, scaling, 0, BEAGLE_FLAG_PRECISION_DOUBLE);
+
+    for (int round = 0; round < 3; round++) {
+        double logL = fusedLogLikelihood(fused, problem, scaling);
+        checkClose("fused evaluation", evaluateTestTree(sequential, problem, scaling), logL, 1e-12);
+
+        // the partials and scale factors left behind are those of the separate calls
+        checkClose("root left by the fused evaluation", logL, storedRootLogLikelihood(fused, problem, scaling),
+                   1e-12);
+
+        for (int i = round; i < problem.nodeCount - 1; i += 4)
+            problem.edgeLengths[i] *= 1.3;
+    }
+
+    std::vector<int> indices = branchIndices(problem);
+    std::vector<BeagleOperation> operations = postOrderOperations(problem, scaling);
+    indices[problem.tipCount] = problem.nodeCount;
+    double logL = 0.0;
+    checkTrue("fused evaluation with a matrix out of range",
+              beagleEvaluateRootLogLikelihood(fused, 0, &indices[0], &problem.edgeLengths[0], indices.size(),
+                                              &operations[0], operations.size(), problem.rootIndex(), 0, 0,
+                                              (scaling ? problem.cumulativeScaleIndex() : BEAGLE_OP_NONE),
+                                              &logL) != BEAGLE_SUCCESS);
+
+    CHECK_BEAGLE(beagleFinalizeInstance(fused));
+    CHECK_BEAGLE(beagleFinalizeInstance(sequential));
+}
+
+int main(int argc, const char* argv[]) {
+    runEvaluate(false);
+    runEvaluate(true);
+
+    return finishTest("evaluatetest");
+}
@@ -0,0 +1,95 @@
+/*
+ *  incrementaltest.cpp
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks that incremental re-evaluation after changing single edges matches a
+ * full traversal on a fresh instance and skips exactly the operations off the
+ * path from the edge to the root.
+ */
+
+#include "apitest.h"
+
+void checkSkipped(const char* what,
+                  int instance,
+                  int expectedOperations,
+                  int expectedSkipped) {
+    int operations = -1;
+    int skipped = -1;
+    CHECK_BEAGLE(beagleGetIncrementalUpdateStatistics(instance, &operations, &skipped));
+    if (operations != expectedOperations || skipped != expectedSkipped) {
+        fprintf(stderr, "%s: expected %d operations with %d skipped, got %d with %d\n",
+                what, expectedOperations, expectedSkipped, operations, skipped);
+        testFailures++;
+    }
+}
+
+void runIncremental(bool scaling) {
+    TestProblem problem = makeTestProblem(16, 250, 34);
+    const int operationCount = problem.internalCount();
+
+    int instance = createTestInstance(problem, 0, 0, scaling, 0, BEAGLE_FLAG_PRECISION_DOUBLE);
+    CHECK_BEAGLE(beagleSetIncrementalUpdates(instance, 1));
+    evaluateTestTree(instance, problem, scaling);
+    checkSkipped("first traversal", instance, operationCount, 0);
+
+    evaluateTestTree(instance, problem, scaling);
+    checkSkipped("unchanged tree", instance, operationCount, operationCount);
+
+    // a tip edge, an internal edge and a root edge
+    const int changedNodes[3] = {3, problem.tipCount + 2, problem.children[2 * (operationCount - 1)]};
+    for (int i = 0; i < 3; i++) {
+        int node = changedNodes[i];
+        problem.edgeLengths[node] *= 1.7;
+
+        int ancestors = 0;
+        for (int v = problem.parents[node]; v != BEAGLE_OP_NONE; v = problem.parents[v])
+            ancestors++;
+
+        double logL = evaluateTestTree(instance, problem, scaling);
+        checkSkipped("single edge change", instance, operationCount, operationCount - ancestors);
+
+        int fresh = createTestInstance(problem, 0, 0, scaling, 0, BEAGLE_FLAG_PRECISION_DOUBLE);
+        checkClose("incremental against full traversal", evaluateTestTree(fresh, problem, scaling), logL, 1e-12);
+        CHECK_BEAGLE(beagleFinalizeInstance(fresh));
+    }
+
+    // new rates rewrite every matrix
+    for (int c = 0; c < CATEGORY_COUNT; c++)
+        problem.rates[c] *= 0.8;
+    CHECK_BEAGLE(beagleSetCategoryRates(instance, &problem.rates[0]));
+    double logL = evaluateTestTree(instance, problem, scaling);
+    checkSkipped("new category rates", instance, operationCount, 0);
+
+    int fresh = createTestInstance(problem, 0, 0, scaling, 0, BEAGLE_FLAG_PRECISION_DOUBLE);
+    checkClose("incremental after new rates", evaluateTestTree(fresh, problem, scaling), logL, 1e-12);
+
+    CHECK_BEAGLE(beagleFinalizeInstance(fresh));
+    CHECK_BEAGLE(beagleFinalizeInstance(instance));
+}
+
+int main(int argc, const char* argv[]) {
+    runIncremental(false);
+    runIncremental(true);
+
+    return finishTest("incrementaltest");
+}
@@ -0,0 +1,104 @@
+/*
+ *  insertiontest.cpp
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks the log likelihoods of regrafting a subtree onto every edge against
+ * evaluating each regrafted tree explicitly.
+ */
+
+#include "apitest.h"
+
+int main(int argc, const char* argv[]) {
+    TestProblem problem = makeTestProblem(12, 250, 40);
+    const int edgeCount = problem.nodeCount - 1;
+    const double pendantLength = 0.08;
+
+    // the pruned subtree, as the partials of a sequence with some missing states
+    std::vector<double> subtreePartials(CATEGORY_COUNT * problem.patternCount * STATE_COUNT, 0.0);
+    for (int p = 0; p < problem.patternCount; p++) {
+        int state = rand() % (STATE_COUNT + 1);
+        for (int c = 0; c < CATEGORY_COUNT; c++) {
+            for (int s = 0; s < STATE_COUNT; s++) {
+                subtreePartials[(c * problem.patternCount + p) * STATE_COUNT + s] =
+                    (state == STATE_COUNT || state == s ? 1.0 : 0.0);
+            }
+        }
+    }
+
+    // pre-order buffer of node v at nodeCount + v, then the subtree; the pendant matrix follows the node matrices
+    int instance = createTestInstance(problem, problem.nodeCount + 1, 1, false, 0, BEAGLE_FLAG_PRECISION_DOUBLE);
+    double treeLogL = evaluateTestTree(instance, problem, false);
+
+    int subtreeBuffer = 2 * problem.nodeCount;
+    int pendantMatrix = problem.nodeCount;
+    CHECK_BEAGLE(beagleSetPartials(instance, subtreeBuffer, &subtreePartials[0]));
+    CHECK_BEAGLE(beagleUpdateTransitionMatrices(instance, 0, &pendantMatrix, NULL, NULL, &pendantLength, 1));
+
+    int rootPreBuffer = problem.nodeCount + problem.rootIndex();
+    int stateFrequenciesIndex = 0;
+    CHECK_BEAGLE(beagleSetRootPrePartials(instance, &rootPreBuffer, &stateFrequenciesIndex, 1));
+    std::vector<BeagleOperation> preOperations = preOrderOperations(problem);
+    CHECK_BEAGLE(beagleUpdatePrePartials(instance, &preOperations[0], preOperations.size(), BEAGLE_OP_NONE));
+
+    std::vector<int> postBuffers;
+    std::vector<int> preBuffers;
+    for (int v = 0; v < edgeCount; v++) {
+        postBuffers.push_back(v);
+        preBuffers.push_back(problem.nodeCount + v);
+    }
+    std::vector<double> insertionLogLs(edgeCount);
+    CHECK_BEAGLE(beagleCalculateInsertionLogLikelihoods(instance, &postBuffers[0], &preBuffers[0], NULL, edgeCount,
+                                                        subtreeBuffer, pendantMatrix, 0, &insertionLogLs[0]));
+
+    std::vector<double> treeLogLs(edgeCount);
+    CHECK_BEAGLE(beagleCalculateInsertionLogLikelihoods(instance, &postBuffers[0], &preBuffers[0], NULL, edgeCount,
+                                                        BEAGLE_OP_NONE, pendantMatrix, 0, &treeLogLs[0]));
+    for (int v = 0; v < edgeCount; v++)
+        checkClose("tree log likelihood at an edge", treeLogL, treeLogLs[v], 1e-10);
+
+    // the subtree as a leaf at nodeCount, joined to the edge by a new node at nodeCount + 1
+    int regrafted = createTestInstance(problem, 2, 2, false, 0, BEAGLE_FLAG_PRECISION_DOUBLE);
+    int subtreeNode = problem.nodeCount;
+    int joinNode = problem.nodeCount + 1;
+    CHECK_BEAGLE(beagleSetPartials(regrafted, subtreeNode, &subtreePartials[0]));
+    for (int v = 0; v < edgeCount; v++) {
+        std::vector<int> parents = problem.parents;
+        std::vector<double> edgeLengths = problem.edgeLengths;
+        parents.push_back(joinNode);
+        parents.push_back(problem.parents[v]);
+        edgeLengths.push_back(pendantLength);
+        edgeLengths.push_back(problem.edgeLengths[v]);
+        parents[v] = joinNode;
+        edgeLengths[v] = 0.0;
+
+        CHECK_BEAGLE(beagleSetTree(regrafted, &parents[0], NULL, parents.size(), 0));
+        double logL = 0.0;
+        CHECK_BEAGLE(beagleEvaluateTree(regrafted, 0, &edgeLengths[0], 0, 0, &logL));
+        checkClose("insertion against an explicit regraft", logL, insertionLogLs[v], 1e-10);
+    }
+
+    CHECK_BEAGLE(beagleFinalizeInstance(instance));
+    CHECK_BEAGLE(beagleFinalizeInstance(regrafted));
+
+    return finishTest("insertiontest");
+}
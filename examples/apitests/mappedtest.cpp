@@ -0,0 +1,76 @@
+/*
+ *  mappedtest.cpp
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks that an instance with memory-mapped partials evaluates as one with
+ * partials in memory, with and without scaling.
+ */
+
+#include "apitest.h"
+
+#ifdef BEAGLE_FLAG_PARTIALS_MAPPED
+
+void runMapped(bool scaling) {
+    TestProblem problem = makeTestProblem(16, 500, 26);
+
+    int memory = createTestInstance(problem, 0, 0, scaling, 0, BEAGLE_FLAG_PRECISION_DOUBLE);
+    int mapped = createTestInstance(problem, 0, 0, scaling, 0,
+                                    BEAGLE_FLAG_PRECISION_DOUBLE | BEAGLE_FLAG_PARTIALS_MAPPED);
+
+    BeagleMemoryUsage usage;
+    CHECK_BEAGLE(beagleGetInstanceMemoryUsage(mapped, &usage));
+    checkTrue("partials are mapped", usage.mapped > 0);
+
+    for (int round = 0; round < 2; round++) {
+        checkClose("mapped log likelihood", evaluateTestTree(memory, problem, scaling),
+                   evaluateTestTree(mapped, problem, scaling), 1e-12);
+        for (int i = round; i < problem.nodeCount - 1; i += 2)
+            problem.edgeLengths[i] *= 1.2;
+    }
+
+    std::vector<double> memorySiteLogLs(problem.patternCount);
+    std::vector<double> mappedSiteLogLs(problem.patternCount);
+    CHECK_BEAGLE(beagleGetSiteLogLikelihoods(memory, &memorySiteLogLs[0]));
+    CHECK_BEAGLE(beagleGetSiteLogLikelihoods(mapped, &mappedSiteLogLs[0]));
+    for (int p = 0; p < problem.patternCount; p++)
+        checkClose("mapped site log likelihood", memorySiteLogLs[p], mappedSiteLogLs[p], 1e-12);
+
+    CHECK_BEAGLE(beagleFinalizeInstance(memory));
+    CHECK_BEAGLE(beagleFinalizeInstance(mapped));
+}
+
+int main(int argc, const char* argv[]) {
+    runMapped(false);
+    runMapped(true);
+
+    return finishTest("mappedtest");
+}
+
+#else
+
+int main(int argc, const char* argv[]) {
+    // memory-mapped partials need a 64-bit flags word
+    return 0;
+}
+
+#endif
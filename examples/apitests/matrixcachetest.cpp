@@ -0,0 +1,113 @@
+/*
+ *  matrixcachetest.cpp
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks that an instance with a transition matrix cache evaluates as one
+ * without, that the cache is invalidated by new eigen decompositions and
+ * category rates, and that hits and misses are counted per matrix.
+ */
+
+#include <algorithm>
+
+#include "apitest.h"
+
+void checkStatistics(const char* what,
+                     int instance,
+                     long expectedHits,
+                     long expectedMisses) {
+    long hits = -1;
+    long misses = -1;
+    CHECK_BEAGLE(beagleGetTransitionMatrixCacheStatistics(instance, &hits, &misses));
+    if (hits != expectedHits || misses != expectedMisses) {
+        fprintf(stderr, "%s: expected %ld hits and %ld misses, got %ld and %ld\n",
+                what, expectedHits, expectedMisses, hits, misses);
+        testFailures++;
+    }
+}
+
+void setModel(int instance,
+              const TestProblem& problem) {
+    CHECK_BEAGLE(beagleSetEigenDecomposition(instance, 0, &problem.evec[0], &problem.ivec[0],
+                                             &problem.eval[0]));
+    CHECK_BEAGLE(beagleSetStateFrequencies(instance, 0, &problem.freqs[0]));
+}
+
+int main(int argc, const char* argv[]) {
+    TestProblem problem = makeTestProblem(12, 200, 33);
+    const int edgeCount = problem.nodeCount - 1;
+
+    int cached = createTestInstance(problem, 0, 0, true, 0, BEAGLE_FLAG_PRECISION_DOUBLE);
+    int uncached = createTestInstance(problem, 0, 0, true, 0, BEAGLE_FLAG_PRECISION_DOUBLE);
+    CHECK_BEAGLE(beagleSetTransitionMatrixCacheSize(cached, edgeCount));
+
+    checkClose("first evaluation", evaluateTestTree(uncached, problem, true),
+               evaluateTestTree(cached, problem, true), 1e-12);
+    checkStatistics("first evaluation", cached, 0, edgeCount);
+
+    // matrices already in place
+    checkClose("repeated evaluation", evaluateTestTree(uncached, problem, true),
+               evaluateTestTree(cached, problem, true), 1e-12);
+    checkStatistics("repeated evaluation", cached, edgeCount, edgeCount);
+
+    // matrices copied from the cache
+    std::swap(problem.edgeLengths[0], problem.edgeLengths[problem.tipCount]);
+    checkClose("swapped edges", evaluateTestTree(uncached, problem, true),
+               evaluateTestTree(cached, problem, true), 1e-12);
+    checkStatistics("swapped edges", cached, 2 * edgeCount, edgeCount);
+
+    const double exchangeabilities[6] = {2.0, 4.0, 0.5, 1.2, 6.0, 1.0};
+    const double freqs[STATE_COUNT] = {0.4, 0.1, 0.15, 0.35};
+    setGTRModel(problem, exchangeabilities, freqs);
+    setModel(cached, problem);
+    setModel(uncached, problem);
+    checkClose("new eigen decomposition", evaluateTestTree(uncached, problem, true),
+               evaluateTestTree(cached, problem, true), 1e-12);
+    checkStatistics("new eigen decomposition", cached, 2 * edgeCount, 2 * edgeCount);
+
+    for (int c = 0; c < CATEGORY_COUNT; c++)
+        problem.rates[c] *= 1.5;
+    CHECK_BEAGLE(beagleSetCategoryRates(cached, &problem.rates[0]));
+    CHECK_BEAGLE(beagleSetCategoryRates(uncached, &problem.rates[0]));
+    checkClose("new category rates", evaluateTestTree(uncached, problem, true),
+               evaluateTestTree(cached, problem, true), 1e-12);
+    checkStatistics("new category rates", cached, 2 * edgeCount, 3 * edgeCount);
+
+    // a cache smaller than the tree evicts entries but keeps the matrices in place
+    CHECK_BEAGLE(beagleSetTransitionMatrixCacheSize(cached, 2));
+    checkStatistics("resized cache", cached, 0, 0);
+    std::swap(problem.edgeLengths[1], problem.edgeLengths[2]);
+    checkClose("small cache", evaluateTestTree(uncached, problem, true),
+               evaluateTestTree(cached, problem, true), 1e-12);
+    std::swap(problem.edgeLengths[1], problem.edgeLengths[2]);
+    checkClose("small cache after eviction", evaluateTestTree(uncached, problem, true),
+               evaluateTestTree(cached, problem, true), 1e-12);
+
+    CHECK_BEAGLE(beagleSetTransitionMatrixCacheSize(cached, 0));
+    checkClose("disabled cache", evaluateTestTree(uncached, problem, true),
+               evaluateTestTree(cached, problem, true), 1e-12);
+
+    CHECK_BEAGLE(beagleFinalizeInstance(cached));
+    CHECK_BEAGLE(beagleFinalizeInstance(uncached));
+
+    return finishTest("matrixcachetest");
+}
@@ -0,0 +1,99 @@
+/*
+ *  memorytest.cpp
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks that beagleEstimateMemoryUsage predicts the footprint that
+ * beagleGetInstanceMemoryUsage reports for the same arguments, category by
+ * category, before and after an evaluation.
+ */
+
+#include <cstring>
+
+#include "apitest.h"
+
+void checkUsage(const char* what,
+                const BeagleMemoryUsage& expected,
+                const BeagleMemoryUsage& actual) {
+    const long long expectedFields[9] = {expected.partials, expected.tips, expected.matrices,
+                                         expected.scaleBuffers, expected.model, expected.scratch,
+                                         expected.threadLocal, expected.mapped, expected.total};
+    const long long actualFields[9] = {actual.partials, actual.tips, actual.matrices,
+                                       actual.scaleBuffers, actual.model, actual.scratch,
+                                       actual.threadLocal, actual.mapped, actual.total};
+    const char* names[9] = {"partials", "tips", "matrices", "scaleBuffers", "model", "scratch",
+                            "threadLocal", "mapped", "total"};
+    for (int i = 0; i < 9; i++) {
+        if (expectedFields[i] != actualFields[i]) {
+            fprintf(stderr, "FAIL: %s: %s estimated as %lld bytes, instance holds %lld\n",
+                    what, names[i], expectedFields[i], actualFields[i]);
+            testFailures++;
+        }
+    }
+
+    long long sum = actual.partials + actual.tips + actual.matrices + actual.scaleBuffers + actual.model +
+                    actual.scratch + actual.threadLocal;
+    checkTrue("total is the sum of the in-memory categories", sum == actual.total);
+}
+
+int main(int argc, const char* argv[]) {
+    TestProblem problem = makeTestProblem(12, 300, 27);
+
+    const long preferenceFlags[4] = {0, 0, BEAGLE_FLAG_THREADING_CPP, 0};
+    const long requirementFlags[4] = {BEAGLE_FLAG_PRECISION_DOUBLE,
+                                      BEAGLE_FLAG_PRECISION_SINGLE,
+                                      BEAGLE_FLAG_PRECISION_DOUBLE,
+                                      BEAGLE_FLAG_PRECISION_DOUBLE | BEAGLE_FLAG_VECTOR_NONE};
+
+    for (int f = 0; f < 4; f++) {
+        for (int scaling = 0; scaling < 2; scaling++) {
+            BeagleMemoryUsage estimate;
+            BeagleInstanceDetails estimateDetails;
+            CHECK_BEAGLE(beagleEstimateMemoryUsage(problem.tipCount, problem.nodeCount, problem.tipCount,
+                                                   STATE_COUNT, problem.patternCount, 1, problem.nodeCount,
+                                                   CATEGORY_COUNT,
+                                                   (scaling ? problem.internalCount() + 1 : 0),
+                                                   NULL, 0, preferenceFlags[f],
+                                                   requirementFlags[f] | BEAGLE_FLAG_EIGEN_REAL,
+                                                   &estimate, &estimateDetails));
+
+            BeagleInstanceDetails details;
+            int instance = createTestInstance(problem, 0, 0, scaling, preferenceFlags[f], requirementFlags[f],
+                                              &details);
+            fprintf(stdout, "%s%s\n", details.implName, (scaling ? " with scaling" : ""));
+            checkTrue("estimate selects the implementation that is created",
+                      strcmp(details.implName, estimateDetails.implName) == 0);
+
+            BeagleMemoryUsage usage;
+            CHECK_BEAGLE(beagleGetInstanceMemoryUsage(instance, &usage));
+            checkUsage("after set-up", estimate, usage);
+
+            evaluateTestTree(instance, problem, scaling);
+            CHECK_BEAGLE(beagleGetInstanceMemoryUsage(instance, &usage));
+            checkUsage("after evaluation", estimate, usage);
+
+            CHECK_BEAGLE(beagleFinalizeInstance(instance));
+        }
+    }
+
+    return finishTest("memorytest");
+}
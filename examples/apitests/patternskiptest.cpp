@@ -0,0 +1,127 @@
+/*
+ *  patternskiptest.cpp
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks that skipping zero-weight patterns gives the log likelihoods of a
+ * full update, for whole and partition-wise updates, and that patterns skipped
+ * under one set of weights are computed again under the next.
+ */
+
+#include "apitest.h"
+
+// bootstrap-like weights with runs and isolated patterns of weight zero
+std::vector<double> replicateWeights(const TestProblem& problem,
+                                     int replicate) {
+    std::vector<double> weights(problem.patternCount);
+    for (int p = 0; p < problem.patternCount; p++) {
+        bool inRun = ((p / 17 + replicate) % 3 == 0);
+        weights[p] = (inRun || (p + replicate) % 5 == 0 ? 0.0 : 1.0 + (p + replicate) % 3);
+    }
+    return weights;
+}
+
+double partitionedLogLikelihood(int instance,
+                                const TestProblem& problem) {
+    std::vector<BeagleOperationByPartition> operations;
+    std::vector<BeagleOperation> wholeOperations = postOrderOperations(problem, false);
+    for (int partition = 0; partition < 2; partition++) {
+        for (size_t i = 0; i < wholeOperations.size(); i++) {
+            const BeagleOperation& op = wholeOperations[i];
+            BeagleOperationByPartition operation = {op.destinationPartials, BEAGLE_OP_NONE, BEAGLE_OP_NONE,
+                                                    op.child1Partials, op.child1TransitionMatrix,
+                                                    op.child2Partials, op.child2TransitionMatrix,
+                                                    partition, BEAGLE_OP_NONE};
+            operations.push_back(operation);
+        }
+    }
+    CHECK_BEAGLE(beagleUpdatePartialsByPartition(instance, &operations[0], operations.size()));
+
+    int rootIndex = problem.rootIndex();
+    int categoryWeightsIndex = 0;
+    int stateFrequenciesIndex = 0;
+    int cumulativeScaleIndex = BEAGLE_OP_NONE;
+    double logL = 0.0;
+    CHECK_BEAGLE(beagleCalculateRootLogLikelihoods(instance, &rootIndex, &categoryWeightsIndex,
+                                                   &stateFrequenciesIndex, &cumulativeScaleIndex, 1, &logL));
+    return logL;
+}
+
+void compareSiteLogLikelihoods(const char* what,
+                               int fullInstance,
+                               int skippingInstance,
+                               const std::vector<double>& weights) {
+    std::vector<double> full(weights.size());
+    std::vector<double> skipped(weights.size());
+    CHECK_BEAGLE(beagleGetSiteLogLikelihoods(fullInstance, &full[0]));
+    CHECK_BEAGLE(beagleGetSiteLogLikelihoods(skippingInstance, &skipped[0]));
+    for (size_t p = 0; p < weights.size(); p++)
+        checkClose(what, (weights[p] != 0.0 ? full[p] : 0.0), skipped[p], 1e-12);
+}
+
+int main(int argc, const char* argv[]) {
+    TestProblem problem = makeTestProblem(10, 400, 35);
+
+    int full = createTestInstance(problem, 0, 0, true, 0, BEAGLE_FLAG_PRECISION_DOUBLE);
+    int skipping = createTestInstance(problem, 0, 0, true, 0, BEAGLE_FLAG_PRECISION_DOUBLE);
+    CHECK_BEAGLE(beagleSetZeroWeightPatternSkipping(skipping, 1));
+    updateTestMatrices(full, problem);
+    updateTestMatrices(skipping, problem);
+
+    for (int replicate = 0; replicate < 3; replicate++) {
+        std::vector<double> weights = replicateWeights(problem, replicate);
+        CHECK_BEAGLE(beagleSetPatternWeights(full, &weights[0]));
+        CHECK_BEAGLE(beagleSetPatternWeights(skipping, &weights[0]));
+        checkClose("log likelihood with skipping", rootLogLikelihood(full, problem, true),
+                   rootLogLikelihood(skipping, problem, true), 1e-12);
+        compareSiteLogLikelihoods("site log likelihood with skipping", full, skipping, weights);
+    }
+
+    // partition-wise updates over two partitions of contiguous patterns
+    int fullPartitioned = createTestInstance(problem, 0, 0, false, 0, BEAGLE_FLAG_PRECISION_DOUBLE);
+    int skippingPartitioned = createTestInstance(problem, 0, 0, false, 0, BEAGLE_FLAG_PRECISION_DOUBLE);
+    CHECK_BEAGLE(beagleSetZeroWeightPatternSkipping(skippingPartitioned, 1));
+    std::vector<int> partitions(problem.patternCount);
+    for (int p = 0; p < problem.patternCount; p++)
+        partitions[p] = (p < problem.patternCount / 3 ? 0 : 1);
+    CHECK_BEAGLE(beagleSetPatternPartitions(fullPartitioned, 2, &partitions[0]));
+    CHECK_BEAGLE(beagleSetPatternPartitions(skippingPartitioned, 2, &partitions[0]));
+    updateTestMatrices(fullPartitioned, problem);
+    updateTestMatrices(skippingPartitioned, problem);
+
+    for (int replicate = 0; replicate < 3; replicate++) {
+        std::vector<double> weights = replicateWeights(problem, replicate);
+        CHECK_BEAGLE(beagleSetPatternWeights(fullPartitioned, &weights[0]));
+        CHECK_BEAGLE(beagleSetPatternWeights(skippingPartitioned, &weights[0]));
+        checkClose("partitioned log likelihood with skipping", partitionedLogLikelihood(fullPartitioned, problem),
+                   partitionedLogLikelihood(skippingPartitioned, problem), 1e-12);
+        compareSiteLogLikelihoods("partitioned site log likelihood with skipping", fullPartitioned,
+                                  skippingPartitioned, weights);
+    }
+
+    CHECK_BEAGLE(beagleFinalizeInstance(full));
+    CHECK_BEAGLE(beagleFinalizeInstance(skipping));
+    CHECK_BEAGLE(beagleFinalizeInstance(fullPartitioned));
+    CHECK_BEAGLE(beagleFinalizeInstance(skippingPartitioned));
+
+    return finishTest("patternskiptest");
+}
@@ -0,0 +1,104 @@
+/*
+ *  sumtabletest.cpp
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks the sumtable likelihood and derivatives of an edge against
+ * beagleCalculateEdgeLogLikelihoods and that optimizing the edge length
+ * increases the log likelihood.
+ */
+
+#include <cmath>
+
+#include "apitest.h"
+
+void runSumtable(bool scaling) {
+    TestProblem problem = makeTestProblem(10, 300, 32);
+
+    // matrices for the edge and its derivatives follow the node matrices
+    int instance = createTestInstance(problem, 0, 3, scaling, 0, BEAGLE_FLAG_PRECISION_DOUBLE);
+    double treeLogL = evaluateTestTree(instance, problem, scaling);
+
+    // under a reversible model the two branches below the root form a single edge
+    int k = problem.internalCount() - 1;
+    int parent = problem.children[2 * k];
+    int child = problem.children[2 * k + 1];
+    double rootEdgeLength = problem.edgeLengths[parent] + problem.edgeLengths[child];
+
+    int cumulativeScaleIndex = BEAGLE_OP_NONE;
+    if (scaling) {
+        cumulativeScaleIndex = problem.cumulativeScaleIndex();
+        std::vector<int> scaleIndices;
+        for (int i = 0; i < k; i++)
+            scaleIndices.push_back(i);
+        CHECK_BEAGLE(beagleResetScaleFactors(instance, cumulativeScaleIndex));
+        CHECK_BEAGLE(beagleAccumulateScaleFactors(instance, &scaleIndices[0], scaleIndices.size(),
+                                                  cumulativeScaleIndex));
+    }
+
+    CHECK_BEAGLE(beagleCalculateEdgeSumtable(instance, parent, child, 0, 0, 0, cumulativeScaleIndex));
+
+    int probabilityIndex = problem.nodeCount;
+    int firstDerivativeIndex = problem.nodeCount + 1;
+    int secondDerivativeIndex = problem.nodeCount + 2;
+    int categoryWeightsIndex = 0;
+    int stateFrequenciesIndex = 0;
+    const double lengths[] = {rootEdgeLength, 0.01, 0.3, 1.7};
+    for (int i = 0; i < 4; i++) {
+        CHECK_BEAGLE(beagleUpdateTransitionMatrices(instance, 0, &probabilityIndex, &firstDerivativeIndex,
+                                                    &secondDerivativeIndex, &lengths[i], 1));
+        double edgeLogL, edgeD1, edgeD2;
+        CHECK_BEAGLE(beagleCalculateEdgeLogLikelihoods(instance, &parent, &child, &probabilityIndex,
+                                                       &firstDerivativeIndex, &secondDerivativeIndex,
+                                                       &categoryWeightsIndex, &stateFrequenciesIndex,
+                                                       &cumulativeScaleIndex, 1, &edgeLogL, &edgeD1, &edgeD2));
+        double sumtableLogL, sumtableD1, sumtableD2;
+        CHECK_BEAGLE(beagleCalculateEdgeSumtableLogLikelihood(instance, lengths[i], &sumtableLogL, &sumtableD1,
+                                                              &sumtableD2));
+        checkClose("sumtable log likelihood", edgeLogL, sumtableLogL, 1e-10);
+        checkClose("sumtable first derivative", edgeD1, sumtableD1, 1e-8);
+        checkClose("sumtable second derivative", edgeD2, sumtableD2, 1e-8);
+        if (i == 0)
+            checkClose("sumtable log likelihood of the tree", treeLogL, sumtableLogL, 1e-10);
+    }
+
+    double optimizedLength = 0.01;
+    double optimizedLogL;
+    CHECK_BEAGLE(beagleOptimizeEdgeLength(instance, &optimizedLength, 1e-8, 10.0, 1e-10, 100, &optimizedLogL));
+    double startLogL;
+    CHECK_BEAGLE(beagleCalculateEdgeSumtableLogLikelihood(instance, 0.01, &startLogL, NULL, NULL));
+    checkTrue("optimizing the edge increases the log likelihood", optimizedLogL > startLogL);
+    checkTrue("optimized length is no worse than the tree's", optimizedLogL >= treeLogL - 1e-8);
+    double logL, d1, d2;
+    CHECK_BEAGLE(beagleCalculateEdgeSumtableLogLikelihood(instance, optimizedLength, &logL, &d1, &d2));
+    checkClose("log likelihood at the optimized length", logL, optimizedLogL, 1e-10);
+    checkTrue("optimized length is a maximum", fabs(d1) < 1e-4 && d2 < 0.0);
+
+    CHECK_BEAGLE(beagleFinalizeInstance(instance));
+}
+
+int main(int argc, const char* argv[]) {
+    runSumtable(false);
+    runSumtable(true);
+
+    return finishTest("sumtabletest");
+}
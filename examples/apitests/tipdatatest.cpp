@@ -0,0 +1,95 @@
+/*
+ *  tipdatatest.cpp
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks that instances with shared tip data evaluate as instances with their
+ * own tips, hold less tip memory, and that setting a tip on one of them does
+ * not change the others.
+ */
+
+#include "apitest.h"
+
+int main(int argc, const char* argv[]) {
+    TestProblem problem = makeTestProblem(10, 250, 28);
+
+    int reference = createTestInstance(problem, 0, 0, true, 0, BEAGLE_FLAG_PRECISION_DOUBLE);
+    double expectedLogL = evaluateTestTree(reference, problem, true);
+
+    int tipData = beagleCreateTipData(problem.tipCount, STATE_COUNT, problem.patternCount);
+    CHECK_BEAGLE(tipData);
+    for (int i = 0; i < problem.tipCount; i++)
+        CHECK_BEAGLE(beagleSetTipDataStates(tipData, i, &problem.tipStates[i][0]));
+
+    // instances without tips of their own, attached to the shared data
+    int shared[2];
+    for (int k = 0; k < 2; k++) {
+        BeagleInstanceDetails details;
+        shared[k] = beagleCreateInstance(problem.tipCount, problem.nodeCount, problem.tipCount, STATE_COUNT,
+                                         problem.patternCount, 1, problem.nodeCount, CATEGORY_COUNT,
+                                         problem.internalCount() + 1, NULL, 0, 0,
+                                         BEAGLE_FLAG_PRECISION_DOUBLE | BEAGLE_FLAG_EIGEN_REAL, &details);
+        CHECK_BEAGLE(shared[k]);
+        CHECK_BEAGLE(beagleAttachTipData(shared[k], tipData));
+        CHECK_BEAGLE(beagleSetEigenDecomposition(shared[k], 0, &problem.evec[0], &problem.ivec[0],
+                                                 &problem.eval[0]));
+        CHECK_BEAGLE(beagleSetStateFrequencies(shared[k], 0, &problem.freqs[0]));
+        CHECK_BEAGLE(beagleSetCategoryWeights(shared[k], 0, &problem.weights[0]));
+        CHECK_BEAGLE(beagleSetCategoryRates(shared[k], &problem.rates[0]));
+        CHECK_BEAGLE(beagleSetPatternWeights(shared[k], &problem.patternWeights[0]));
+    }
+    checkTrue("sealed tip data cannot be modified",
+              beagleSetTipDataStates(tipData, 0, &problem.tipStates[1][0]) != BEAGLE_SUCCESS);
+    CHECK_BEAGLE(beagleFinalizeTipData(tipData));
+
+    for (int k = 0; k < 2; k++)
+        checkClose("log likelihood with shared tips", expectedLogL, evaluateTestTree(shared[k], problem, true),
+                   1e-10);
+
+    BeagleMemoryUsage referenceUsage;
+    BeagleMemoryUsage sharedUsage;
+    CHECK_BEAGLE(beagleGetInstanceMemoryUsage(reference, &referenceUsage));
+    CHECK_BEAGLE(beagleGetInstanceMemoryUsage(shared[0], &sharedUsage));
+    checkTrue("shared tips are not counted by the instance", sharedUsage.tips < referenceUsage.tips);
+
+    // a private tip on one instance leaves the shared data and the other instance unchanged
+    TestProblem changed = problem;
+    for (int p = 0; p < problem.patternCount; p++)
+        changed.tipStates[0][p] = (problem.tipStates[0][p] + 1) % (STATE_COUNT + 1);
+    CHECK_BEAGLE(beagleSetTipStates(shared[0], 0, &changed.tipStates[0][0]));
+    CHECK_BEAGLE(beagleSetTipStates(reference, 0, &changed.tipStates[0][0]));
+
+    double changedLogL = evaluateTestTree(reference, changed, true);
+    checkClose("log likelihood after a private tip", changedLogL, evaluateTestTree(shared[0], changed, true),
+               1e-10);
+    checkClose("other instance keeps the shared tip", expectedLogL, evaluateTestTree(shared[1], problem, true),
+               1e-10);
+
+    CHECK_BEAGLE(beagleFinalizeInstance(shared[0]));
+    checkClose("shared tips outlive a finalized instance", expectedLogL,
+               evaluateTestTree(shared[1], problem, true), 1e-10);
+
+    CHECK_BEAGLE(beagleFinalizeInstance(shared[1]));
+    CHECK_BEAGLE(beagleFinalizeInstance(reference));
+
+    return finishTest("tipdatatest");
+}
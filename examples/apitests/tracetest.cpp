@@ -0,0 +1,132 @@
+/*
+ *  tracetest.cpp
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks that a trace is written as Chrome trace JSON holding one event per
+ * traced call, that full rings keep the newest events, and that nothing is
+ * recorded once the trace is stopped.
+ */
+
+#include <string>
+
+#include "apitest.h"
+
+#define TRACE_FILE "tracetest.json"
+
+std::string readTrace() {
+    std::string text;
+    FILE* file = fopen(TRACE_FILE, "r");
+    if (file == NULL)
+        return text;
+    char buffer[4096];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        text.append(buffer, read);
+    fclose(file);
+    return text;
+}
+
+int countOccurrences(const std::string& text,
+                     const char* pattern) {
+    int count = 0;
+    for (size_t at = text.find(pattern); at != std::string::npos; at = text.find(pattern, at + 1))
+        count++;
+    return count;
+}
+
+// whether braces and brackets outside strings nest properly
+bool isBalanced(const std::string& text) {
+    std::string open;
+    bool inString = false;
+    for (size_t i = 0; i < text.size(); i++) {
+        char c = text[i];
+        if (inString) {
+            if (c == '\\')
+                i++;
+            else if (c == '"')
+                inString = false;
+        } else if (c == '"') {
+            inString = true;
+        } else if (c == '{' || c == '[') {
+            open.push_back(c);
+        } else if (c == '}' || c == ']') {
+            if (open.empty() || open[open.size() - 1] != (c == '}' ? '{' : '['))
+                return false;
+            open.erase(open.size() - 1);
+        }
+    }
+    return open.empty() && !inString;
+}
+
+void checkTrace(const char* what,
+                int expectedEvents) {
+    std::string trace = readTrace();
+    checkTrue(what, trace.compare(0, 15, "{\"traceEvents\":") == 0);
+    checkTrue(what, isBalanced(trace));
+    int events = countOccurrences(trace, "\"ph\":\"X\"");
+    if (events != expectedEvents) {
+        fprintf(stderr, "%s: expected %d events, found %d\n", what, expectedEvents, events);
+        testFailures++;
+    }
+}
+
+int main(int argc, const char* argv[]) {
+    TestProblem problem = makeTestProblem(10, 200, 42);
+
+    // each evaluation makes three traced calls
+    int instance = createTestInstance(problem, 0, 0, false, 0, BEAGLE_FLAG_PRECISION_DOUBLE);
+    remove(TRACE_FILE);
+    CHECK_BEAGLE(beagleStartTrace(instance, TRACE_FILE, 1000));
+    evaluateTestTree(instance, problem, false);
+    evaluateTestTree(instance, problem, false);
+    CHECK_BEAGLE(beagleWriteTrace(instance));
+    checkTrace("written trace", 6);
+
+    std::string trace = readTrace();
+    checkTrue("transition matrix events", countOccurrences(trace, "\"beagleUpdateTransitionMatrices\"") == 2);
+    checkTrue("partials events", countOccurrences(trace, "\"beagleUpdatePartials\"") == 2);
+    checkTrue("root events", countOccurrences(trace, "\"beagleCalculateRootLogLikelihoods\"") == 2);
+    checkTrue("api category", countOccurrences(trace, "\"cat\":\"api\"") == 6);
+
+    evaluateTestTree(instance, problem, false);
+    CHECK_BEAGLE(beagleStopTrace(instance));
+    checkTrace("stopped trace", 9);
+
+    evaluateTestTree(instance, problem, false);
+    checkTrace("trace after stopping", 9);
+
+    // rings of two events keep the last two calls
+    CHECK_BEAGLE(beagleStartTrace(instance, TRACE_FILE, 2));
+    evaluateTestTree(instance, problem, false);
+    evaluateTestTree(instance, problem, false);
+    CHECK_BEAGLE(beagleStopTrace(instance));
+    checkTrace("overwritten trace", 2);
+    trace = readTrace();
+    checkTrue("newest events", countOccurrences(trace, "\"beagleCalculateRootLogLikelihoods\"") == 1);
+    checkTrue("overwritten count", countOccurrences(trace, "\"overwrittenEvents\":4") == 1);
+
+    CHECK_BEAGLE(beagleFinalizeInstance(instance));
+    remove(TRACE_FILE);
+
+    return finishTest("tracetest");
+}
@@ -0,0 +1,122 @@
+/*
+ *  treetest.cpp
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks the operations generated by beagleSetTree and the log likelihood of
+ * beagleEvaluateTree against operations built by the client.
+ */
+
+#include "apitest.h"
+
+void checkOperations(int instance,
+                     const TestProblem& problem,
+                     bool scaling) {
+    std::vector<BeagleOperation> operations(problem.internalCount());
+    std::vector<int> levelCounts(problem.internalCount());
+    int operationCount = -1;
+    int rootIndex = -1;
+    int cumulativeScaleIndex = -1;
+    CHECK_BEAGLE(beagleGetTreeOperations(instance, &operations[0], &operationCount, &levelCounts[0], &rootIndex,
+                                         &cumulativeScaleIndex));
+    checkTrue("operation count", operationCount == problem.internalCount());
+    checkTrue("root index", rootIndex == problem.rootIndex());
+    checkTrue("cumulative scale index",
+              cumulativeScaleIndex == (scaling ? problem.internalCount() : BEAGLE_OP_NONE));
+
+    // every level only reads tips and the partials of lower levels
+    std::vector<bool> computed(problem.nodeCount, false);
+    for (int i = 0; i < problem.tipCount; i++)
+        computed[i] = true;
+    int first = 0;
+    for (int level = 0; first < operationCount && level < operationCount; level++) {
+        int last = first + levelCounts[level];
+        checkTrue("level size", last > first && last <= operationCount);
+        if (last <= first || last > operationCount)
+            break;
+        for (int i = first; i < last; i++) {
+            const BeagleOperation& op = operations[i];
+            int v = op.destinationPartials;
+            checkTrue("operation reads computed partials",
+                      computed[op.child1Partials] && computed[op.child2Partials]);
+            checkTrue("operation children", problem.parents[op.child1Partials] == v &&
+                                            problem.parents[op.child2Partials] == v);
+            checkTrue("operation scale buffer", op.destinationScaleWrite ==
+                                                (scaling ? v - problem.tipCount : BEAGLE_OP_NONE));
+        }
+        for (int i = first; i < last; i++)
+            computed[operations[i].destinationPartials] = true;
+        first = last;
+    }
+
+    int countWithoutLevels = -1;
+    CHECK_BEAGLE(beagleGetTreeOperations(instance, &operations[0], &countWithoutLevels, NULL, &rootIndex,
+                                         &cumulativeScaleIndex));
+    checkTrue("operations without level counts", countWithoutLevels == operationCount);
+    checkTrue("missing operation count",
+              beagleGetTreeOperations(instance, &operations[0], NULL, NULL, &rootIndex, &cumulativeScaleIndex) ==
+              BEAGLE_ERROR_OUT_OF_RANGE);
+}
+
+void runTree(bool scaling) {
+    TestProblem problem = makeTestProblem(15, 200, 39);
+
+    int instance = createTestInstance(problem, 0, 0, scaling, 0, BEAGLE_FLAG_PRECISION_DOUBLE);
+    int reference = createTestInstance(problem, 0, 0, scaling, 0, BEAGLE_FLAG_PRECISION_DOUBLE);
+
+    CHECK_BEAGLE(beagleSetTree(instance, &problem.parents[0], NULL, problem.nodeCount, scaling));
+    checkOperations(instance, problem, scaling);
+
+    double logL = 0.0;
+    CHECK_BEAGLE(beagleEvaluateTree(instance, 0, &problem.edgeLengths[0], 0, 0, &logL));
+    checkClose("tree log likelihood", evaluateTestTree(reference, problem, scaling), logL, 1e-12);
+
+    // setting the same tree again keeps its operations
+    for (int i = 0; i < problem.nodeCount - 1; i += 2)
+        problem.edgeLengths[i] *= 0.7;
+    CHECK_BEAGLE(beagleSetTree(instance, &problem.parents[0], NULL, problem.nodeCount, scaling));
+    CHECK_BEAGLE(beagleEvaluateTree(instance, 0, &problem.edgeLengths[0], 0, 0, &logL));
+    checkClose("tree log likelihood after setting it again", evaluateTestTree(reference, problem, scaling), logL,
+               1e-12);
+
+    // matrices in reverse node order
+    std::vector<int> matrixIndices(problem.nodeCount);
+    for (int v = 0; v < problem.nodeCount - 1; v++)
+        matrixIndices[v] = problem.nodeCount - 2 - v;
+    matrixIndices[problem.rootIndex()] = problem.rootIndex();
+    CHECK_BEAGLE(beagleSetTree(instance, &problem.parents[0], &matrixIndices[0], problem.nodeCount, scaling));
+    CHECK_BEAGLE(beagleEvaluateTree(instance, 0, &problem.edgeLengths[0], 0, 0, &logL));
+    checkClose("tree log likelihood with matrix indices", evaluateTestTree(reference, problem, scaling), logL,
+               1e-12);
+
+    checkTrue("tree of two nodes", beagleSetTree(instance, &problem.parents[0], NULL, 2, scaling) != BEAGLE_SUCCESS);
+
+    CHECK_BEAGLE(beagleFinalizeInstance(instance));
+    CHECK_BEAGLE(beagleFinalizeInstance(reference));
+}
+
+int main(int argc, const char* argv[]) {
+    runTree(false);
+    runTree(true);
+
+    return finishTest("treetest");
+}
@@ -0,0 +1,77 @@
+/*
+ *  weightstest.cpp
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks the log likelihoods for many pattern weight vectors against setting
+ * each vector as the pattern weights and integrating the root again.
+ */
+
+#include "apitest.h"
+
+void runWeights(bool scaling) {
+    TestProblem problem = makeTestProblem(10, 300, 36);
+    const int vectorCount = 7;
+
+    int instance = createTestInstance(problem, 0, 0, scaling, 0, BEAGLE_FLAG_PRECISION_DOUBLE);
+    evaluateTestTree(instance, problem, scaling);
+
+    // resampled weights, the first vector being the original ones
+    std::vector<double> weights(vectorCount * problem.patternCount, 0.0);
+    for (int p = 0; p < problem.patternCount; p++)
+        weights[p] = problem.patternWeights[p];
+    for (int v = 1; v < vectorCount; v++) {
+        for (int p = 0; p < problem.patternCount; p++)
+            weights[v * problem.patternCount + rand() % problem.patternCount] += problem.patternWeights[p];
+    }
+
+    int cumulativeScaleIndex = (scaling ? problem.cumulativeScaleIndex() : BEAGLE_OP_NONE);
+    std::vector<double> logLs(vectorCount);
+    CHECK_BEAGLE(beagleCalculateRootLogLikelihoodsForWeights(instance, problem.rootIndex(), 0, 0,
+                                                             cumulativeScaleIndex, &weights[0], vectorCount,
+                                                             &logLs[0]));
+
+    std::vector<double> siteLogLs(problem.patternCount);
+    CHECK_BEAGLE(beagleGetSiteLogLikelihoods(instance, &siteLogLs[0]));
+
+    int reference = createTestInstance(problem, 0, 0, scaling, 0, BEAGLE_FLAG_PRECISION_DOUBLE);
+    std::vector<double> referenceSiteLogLs(problem.patternCount);
+    checkClose("original weights", evaluateTestTree(reference, problem, scaling), logLs[0], 1e-10);
+    CHECK_BEAGLE(beagleGetSiteLogLikelihoods(reference, &referenceSiteLogLs[0]));
+    for (int p = 0; p < problem.patternCount; p++)
+        checkClose("site log likelihood", referenceSiteLogLs[p], siteLogLs[p], 1e-12);
+
+    for (int v = 1; v < vectorCount; v++) {
+        CHECK_BEAGLE(beagleSetPatternWeights(reference, &weights[v * problem.patternCount]));
+        checkClose("resampled weights", rootLogLikelihood(reference, problem, scaling), logLs[v], 1e-10);
+    }
+
+    CHECK_BEAGLE(beagleFinalizeInstance(instance));
+    CHECK_BEAGLE(beagleFinalizeInstance(reference));
+}
+
+int main(int argc, const char* argv[]) {
+    runWeights(false);
+    runWeights(true);
+
+    return finishTest("weightstest");
+}
@@ -0,0 +1,922 @@
+/*
+ *  beaglereplay.cpp
+ *  BEAGLE
+ *
+ *  Replays a record of BEAGLE API calls, written by a run with the environment
+ *  variable BEAGLE_RECORD_FILE set, against any resource and flags, and reports
+ *  the time spent in each function and a checksum of the outputs.
+ */
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "libhmsbeagle/beagle.h"
+#include "libhmsbeagle/BeagleRecorder.h"
+
+using namespace beagle;
+
+struct ReplayOptions {
+    std::vector<int> resources;
+    long preferenceFlags;
+    long requirementFlags;
+    long addedPreferenceFlags;
+    long addedRequirementFlags;
+    bool overrideFlags;
+    int nreps;
+    bool listCalls;
+};
+
+struct CallTiming {
+    long count;
+    long errorCount;
+    double time;
+};
+
+struct ReplayState {
+    std::map<int, int> instances;
+    std::map<int, int> tipData;
+    CallTiming timings[BEAGLE_RECORD_CALL_COUNT];
+    double checksum;
+    long outputCount;
+    long callCount;
+    bool printedDetails;
+};
+
+static int getMapped(const std::map<int, int>& map,
+                     int id) {
+    std::map<int, int>::const_iterator it = map.find(id);
+    return (it != map.end() ? it->second : -1);
+}
+
+static double getTime() {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void printDetails(const BeagleInstanceDetails& details) {
+    std::cout << "Resource: " << details.resourceNumber << " (" << details.resourceName << ")\n";
+    std::cout << "Implementation: " << details.implName << "\n";
+}
+
+/*
+ * Replays the current record of the reader. Returns false if the record is
+ * malformed or of an unknown call.
+ */
+static bool replayCall(BeagleRecordReader& reader,
+                       const ReplayOptions& options,
+                       ReplayState& state) {
+    std::vector<int> ints[10];
+    std::vector<double> doubles[4];
+    std::vector<double> outputs[8];
+    std::vector<int> intOutputs[5];
+    std::vector<BeagleEvaluationJob> jobs;
+    std::vector<std::vector<int> > jobInts;
+    std::vector<std::vector<double> > jobDoubles;
+    BeagleInstanceDetails details;
+
+    std::function<int()> call;
+    int createdId = -1;             // record id of an instance or tip data created by the call
+    std::map<int, int>* createdMap = NULL;
+
+    const int recordedCall = reader.getCall();
+    switch (recordedCall) {
+        case BEAGLE_RECORD_CREATE_INSTANCE: {
+            createdId = reader.getInt();
+            createdMap = &state.instances;
+            int counts[9];
+            for (int i = 0; i < 9; i++)
+                counts[i] = reader.getInt();
+            int* resourceList = (int*) reader.getInts(ints[0]);
+            int resourceCount = reader.getInt();
+            long preferenceFlags = reader.getLong();
+            long requirementFlags = reader.getLong();
+            if (!options.resources.empty()) {
+                ints[0] = options.resources;
+                resourceList = &ints[0][0];
+                resourceCount = options.resources.size();
+            }
+            if (options.overrideFlags) {
+                preferenceFlags = options.preferenceFlags;
+                requirementFlags = options.requirementFlags;
+            }
+            if (options.addedPreferenceFlags & (BEAGLE_FLAG_PRECISION_SINGLE | BEAGLE_FLAG_PRECISION_DOUBLE))
+                preferenceFlags &= ~(BEAGLE_FLAG_PRECISION_SINGLE | BEAGLE_FLAG_PRECISION_DOUBLE);
+            if (options.addedRequirementFlags & (BEAGLE_FLAG_PRECISION_SINGLE | BEAGLE_FLAG_PRECISION_DOUBLE))
+                requirementFlags &= ~(BEAGLE_FLAG_PRECISION_SINGLE | BEAGLE_FLAG_PRECISION_DOUBLE);
+            preferenceFlags |= options.addedPreferenceFlags;
+            requirementFlags |= options.addedRequirementFlags;
+            call = [=, &details]() {
+                return beagleCreateInstance(counts[0], counts[1], counts[2], counts[3], counts[4], counts[5],
+                                            counts[6], counts[7], counts[8], resourceList, resourceCount,
+                                            preferenceFlags, requirementFlags, &details);
+            };
+            break;
+        }
+        case BEAGLE_RECORD_CLONE_INSTANCE: {
+            createdId = reader.getInt();
+            createdMap = &state.instances;
+            int instance = getMapped(state.instances, reader.getInt());
+            call = [=, &details]() { return beagleCloneInstance(instance, &details); };
+            break;
+        }
+        case BEAGLE_RECORD_FINALIZE_INSTANCE: {
+            const int recordedInstance = reader.getInt();
+            int instance = getMapped(state.instances, recordedInstance);
+            state.instances.erase(recordedInstance);
+            call = [=]() { return beagleFinalizeInstance(instance); };
+            break;
+        }
+        case BEAGLE_RECORD_SET_CHECKPOINT: {
+            int instance = getMapped(state.instances, reader.getInt());
+            call = [=]() { return beagleSetCheckpoint(instance); };
+            break;
+        }
+        case BEAGLE_RECORD_COMMIT_CHECKPOINT: {
+            int instance = getMapped(state.instances, reader.getInt());
+            call = [=]() { return beagleCommitCheckpoint(instance); };
+            break;
+        }
+        case BEAGLE_RECORD_ROLLBACK_CHECKPOINT: {
+            int instance = getMapped(state.instances, reader.getInt());
+            call = [=]() { return beagleRollbackCheckpoint(instance); };
+            break;
+        }
+        case BEAGLE_RECORD_SET_CPU_THREAD_COUNT: {
+            int instance = getMapped(state.instances, reader.getInt());
+            int threadCount = reader.getInt();
+            call = [=]() { return beagleSetCPUThreadCount(instance, threadCount); };
+            break;
+        }
+        case BEAGLE_RECORD_SET_TIP_STATES: {
+            int instance = getMapped(state.instances, reader.getInt());
+            int tipIndex = reader.getInt();
+            const int* inStates = reader.getInts(ints[0]);
+            call = [=]() { return beagleSetTipStates(instance, tipIndex, inStates); };
+            break;
+        }
+        case BEAGLE_RECORD_SET_TIP_PARTIALS: {
+            int instance = getMapped(state.instances, reader.getInt());
+            int tipIndex = reader.getInt();
+            const double* inPartials = reader.getDoubles(doubles[0]);
+            call = [=]() { return beagleSetTipPartials(instance, tipIndex, inPartials); };
+            break;
+        }
+        case BEAGLE_RECORD_CREATE_TIP_DATA: {
+            createdId = reader.getInt();
+            createdMap = &state.tipData;
+            int tipCount = reader.getInt();
+            int stateCount = reader.getInt();
+            int patternCount = reader.getInt();
+            call = [=]() { return beagleCreateTipData(tipCount, stateCount, patternCount); };
+            break;
+        }
+        case BEAGLE_RECORD_SET_TIP_DATA_STATES: {
+            int tipData = getMapped(state.tipData, reader.getInt());
+            int tipIndex = reader.getInt();
+            const int* inStates = reader.getInts(ints[0]);
+            call = [=]() { return beagleSetTipDataStates(tipData, tipIndex, inStates); };
+            break;
+        }
+        case BEAGLE_RECORD_SET_TIP_DATA_PARTIALS: {
+            int tipData = getMapped(state.tipData, reader.getInt());
+            int tipIndex = reader.getInt();
+            const double* inPartials = reader.getDoubles(doubles[0]);
+            call = [=]() { return beagleSetTipDataPartials(tipData, tipIndex, inPartials); };
+            break;
+        }
+        case BEAGLE_RECORD_ATTACH_TIP_DATA: {
+            int instance = getMapped(state.instances, reader.getInt());
+            int tipData = getMapped(state.tipData, reader.getInt());
+            call = [=]() { return beagleAttachTipData(instance, tipData); };
+            break;
+        }
+        case BEAGLE_RECORD_FINALIZE_TIP_DATA: {
+            const int recordedTipData = reader.getInt();
+            int tipData = getMapped(state.tipData, recordedTipData);
+            state.tipData.erase(recordedTipData);
+            call = [=]() { return beagleFinalizeTipData(tipData); };
+            break;
+        }
+        case BEAGLE_RECORD_SET_PARTIALS: {
+            int instance = getMapped(state.instances, reader.getInt());
+            int bufferIndex = reader.getInt();
+            const double* inPartials = reader.getDoubles(doubles[0]);
+            call = [=]() { return beagleSetPartials(instance, bufferIndex, inPartials); };
+            break;
+        }
+        case BEAGLE_RECORD_GET_PARTIALS: {
+            int instance = getMapped(state.instances, reader.getInt());
+            int bufferIndex = reader.getInt();
+            int scaleIndex = reader.getInt();
+            double* outPartials = reader.getOutput(outputs[0]);
+            call = [=]() { return beagleGetPartials(instance, bufferIndex, scaleIndex, outPartials); };
+            break;
+        }
+        case BEAGLE_RECORD_SET_EIGEN_DECOMPOSITION: {
+            int instance = getMapped(state.instances, reader.getInt());
+            int eigenIndex = reader.getInt();
+            const double* inEigenVectors = reader.getDoubles(doubles[0]);
+            const double* inInverseEigenVectors = reader.getDoubles(doubles[1]);
+            const double* inEigenValues = reader.getDoubles(doubles[2]);
+            call = [=]() {
+                return beagleSetEigenDecomposition(instance, eigenIndex, inEigenVectors, inInverseEigenVectors,
+                                                   inEigenValues);
+            };
+            break;
+        }
+        case BEAGLE_RECORD_SET_STATE_FREQUENCIES: {
+            int instance = getMapped(state.instances, reader.getInt());
+            int stateFrequenciesIndex = reader.getInt();
+            const double* inStateFrequencies = reader.getDoubles(doubles[0]);
+            call = [=]() { return beagleSetStateFrequencies(instance, stateFrequenciesIndex, inStateFrequencies); };
+            break;
+        }
+        case BEAGLE_RECORD_SET_CATEGORY_WEIGHTS: {
+            int instance = getMapped(state.instances, reader.getInt());
+            int categoryWeightsIndex = reader.getInt();
+            const double* inCategoryWeights = reader.getDoubles(doubles[0]);
+            call = [=]() { return beagleSetCategoryWeights(instance, categoryWeightsIndex, inCategoryWeights); };
+            break;
+        }
+        case BEAGLE_RECORD_SET_CATEGORY_RATES: {
+            int instance = getMapped(state.instances, reader.getInt());
+            const double* inCategoryRates = reader.getDoubles(doubles[0]);
+            call = [=]() { return beagleSetCategoryRates(instance, inCategoryRates); };
+            break;
+        }
+        case BEAGLE_RECORD_SET_CATEGORY_RATES_WITH_INDEX: {
+            int instance = getMapped(state.instances, reader.getInt());
+            int categoryRatesIndex = reader.getInt();
+            const double* inCategoryRates = reader.getDoubles(doubles[0]);
+            call = [=]() { return beagleSetCategoryRatesWithIndex(instance, categoryRatesIndex, inCategoryRates); };
+            break;
+        }
+        case BEAGLE_RECORD_SET_PATTERN_WEIGHTS: {
+            int instance = getMapped(state.instances, reader.getInt());
+            const double* inPatternWeights = reader.getDoubles(doubles[0]);
+            call = [=]() { return beagleSetPatternWeights(instance, inPatternWeights); };
+            break;
+        }
+        case BEAGLE_RECORD_SET_ZERO_WEIGHT_PATTERN_SKIPPING: {
+            int instance = getMapped(state.instances, reader.getInt());
+            int enabled = reader.getInt();
+            call = [=]() { return beagleSetZeroWeightPatternSkipping(instance, enabled); };
+            break;
+        }
+        case BEAGLE_RECORD_SET_PATTERN_PARTITIONS: {
+            int instance = getMapped(state.instances, reader.getInt());
+            int partitionCount = reader.getInt();
+            const int* inPatternPartitions = reader.getInts(ints[0]);
+            call = [=]() { return beagleSetPatternPartitions(instance, partitionCount, inPatternPartitions); };
+            break;
+        }
+        case BEAGLE_RECORD_CONVOLVE_TRANSITION_MATRICES: {
+            int instance = getMapped(state.instances, reader.getInt());
+            const int* firstIndices = reader.getInts(ints[0]);
+            const int* secondIndices = reader.getInts(ints[1]);
+            const int* resultIndices = reader.getInts(ints[2]);
+            int matrixCount = reader.getInt();
+            call = [=]() {
+                return beagleConvolveTransitionMatrices(instance, firstIndices, secondIndices, resultIndices,
+                                                        matrixCount);
+            };
+            break;
+        }
+        case BEAGLE_RECORD_UPDATE_TRANSITION_MATRICES: {
+            int instance = getMapped(state.instances, reader.getInt());
+            int eigenIndex = reader.getInt();
+            const int* probabilityIndices = reader.getInts(ints[0]);
+            const int* firstDerivativeIndices = reader.getInts(ints[1]);
+            const int* secondDerivativeIndices = reader.getInts(ints[2]);
+            const double* edgeLengths = reader.getDoubles(doubles[0]);
+            int count = reader.getInt();
+            call = [=]() {
+                return beagleUpdateTransitionMatrices(instance, eigenIndex, probabilityIndices,
+                                                      firstDerivativeIndices, secondDerivativeIndices,
+                                                      edgeLengths, count);
+            };
+            break;
+        }
+        case BEAGLE_RECORD_UPDATE_TRANSITION_MATRICES_MULTIPLE_MODELS: {
+            int instance = getMapped(state.instances, reader.getInt());
+            const int* eigenIndices = reader.getInts(ints[0]);
+            const int* categoryRateIndices = reader.getInts(ints[1]);
+            const int* probabilityIndices = reader.getInts(ints[2]);
+            const int* firstDerivativeIndices = reader.getInts(ints[3]);
+            const int* secondDerivativeIndices = reader.getInts(ints[4]);
+            const double* edgeLengths = reader.getDoubles(doubles[0]);
+            int count = reader.getInt();
+            call = [=]() {
+                return beagleUpdateTransitionMatricesWithMultipleModels(instance, eigenIndices, categoryRateIndices,
+                                                                        probabilityIndices, firstDerivativeIndices,
+                                                                        secondDerivativeIndices, edgeLengths,
+                                                                        count);
+            };
+            break;
+        }
+        case BEAGLE_RECORD_SET_TRANSITION_MATRIX_CACHE_SIZE: {
+            int instance = getMapped(state.instances, reader.getInt());
+            int cacheSize = reader.getInt();
+            call = [=]() { return beagleSetTransitionMatrixCacheSize(instance, cacheSize); };
+            break;
+        }
+        case BEAGLE_RECORD_SET_TRANSITION_MATRIX: {
+            int instance = getMapped(state.instances, reader.getInt());
+            int matrixIndex = reader.getInt();
+            const double* inMatrix = reader.getDoubles(doubles[0]);
+            double paddedValue = reader.getDouble();
+            call = [=]() { return beagleSetTransitionMatrix(instance, matrixIndex, inMatrix, paddedValue); };
+            break;
+        }
+        case BEAGLE_RECORD_GET_TRANSITION_MATRIX: {
+            int instance = getMapped(state.instances, reader.getInt());
+            int matrixIndex = reader.getInt();
+            double* outMatrix = reader.getOutput(outputs[0]);
+            call = [=]() { return beagleGetTransitionMatrix(instance, matrixIndex, outMatrix); };
+            break;
+        }
+        case BEAGLE_RECORD_SET_TRANSITION_MATRICES: {
+            int instance = getMapped(state.instances, reader.getInt());
+            const int* matrixIndices = reader.getInts(ints[0]);
+            const double* inMatrices = reader.getDoubles(doubles[0]);
+            const double* paddedValues = reader.getDoubles(doubles[1]);
+            int count = reader.getInt();
+            call = [=]() { return beagleSetTransitionMatrices(instance, matrixIndices, inMatrices, paddedValues, count); };
+            break;
+        }
+        case BEAGLE_RECORD_UPDATE_PARTIALS:
+        case BEAGLE_RECORD_UPDATE_PRE_PARTIALS: {
+            int instance = getMapped(state.instances, reader.getInt());
+            const BeagleOperation* operations = (const BeagleOperation*) reader.getInts(ints[0]);
+            int operationCount = reader.getInt();
+            int cumulativeScaleIndex = reader.getInt();
+            if (recordedCall == BEAGLE_RECORD_UPDATE_PARTIALS)
+                call = [=]() { return beagleUpdatePartials(instance, operations, operationCount, cumulativeScaleIndex); };
+            else
+                call = [=]() { return beagleUpdatePrePartials(instance, operations, operationCount, cumulativeScaleIndex); };
+            break;
+        }
+        case BEAGLE_RECORD_UPDATE_PARTIALS_BY_PARTITION: {
+            int instance = getMapped(state.instances, reader.getInt());
+            const BeagleOperationByPartition* operations = (const BeagleOperationByPartition*) reader.getInts(ints[0]);
+            int operationCount = reader.getInt();
+            call = [=]() { return beagleUpdatePartialsByPartition(instance, operations, operationCount); };
+            break;
+        }
+        case BEAGLE_RECORD_SET_INCREMENTAL_UPDATES: {
+            int instance = getMapped(state.instances, reader.getInt());
+            int enabled = reader.getInt();
+            call = [=]() { return beagleSetIncrementalUpdates(instance, enabled); };
+            break;
+        }
+        case BEAGLE_RECORD_SET_ROOT_PRE_PARTIALS: {
+            int instance = getMapped(state.instances, reader.getInt());
+            const int* bufferIndices = reader.getInts(ints[0]);
+            const int* stateFrequenciesIndices = reader.getInts(ints[1]);
+            int count = reader.getInt();
+            call = [=]() { return beagleSetRootPrePartials(instance, bufferIndices, stateFrequenciesIndices, count); };
+            break;
+        }
+        case BEAGLE_RECORD_CALCULATE_EDGE_DERIVATIVES: {
+            int instance = getMapped(state.instances, reader.getInt());
+            const int* postBufferIndices = reader.getInts(ints[0]);
+            const int* preBufferIndices = reader.getInts(ints[1]);
+            const int* derivativeMatrixIndices = reader.getInts(ints[2]);
+            const int* categoryWeightsIndices = reader.getInts(ints[3]);
+            int count = reader.getInt();
+            double* outDerivatives = reader.getOutput(outputs[0]);
+            double* outSumDerivatives = reader.getOutput(outputs[1]);
+            double* outSumSquaredDerivatives = reader.getOutput(outputs[2]);
+            call = [=]() {
+                return beagleCalculateEdgeDerivatives(instance, postBufferIndices, preBufferIndices,
+                                                      derivativeMatrixIndices, categoryWeightsIndices, count,
+                                                      outDerivatives, outSumDerivatives, outSumSquaredDerivatives);
+            };
+            break;
+        }
+        case BEAGLE_RECORD_WAIT_FOR_PARTIALS: {
+            int instance = getMapped(state.instances, reader.getInt());
+            const int* destinationPartials = reader.getInts(ints[0]);
+            int destinationPartialsCount = reader.getInt();
+            call = [=]() { return beagleWaitForPartials(instance, destinationPartials, destinationPartialsCount); };
+            break;
+        }
+        case BEAGLE_RECORD_ACCUMULATE_SCALE_FACTORS:
+        case BEAGLE_RECORD_REMOVE_SCALE_FACTORS: {
+            int instance = getMapped(state.instances, reader.getInt());
+            const int* scaleIndices = reader.getInts(ints[0]);
+            int count = reader.getInt();
+            int cumulativeScaleIndex = reader.getInt();
+            if (recordedCall == BEAGLE_RECORD_ACCUMULATE_SCALE_FACTORS)
+                call = [=]() { return beagleAccumulateScaleFactors(instance, scaleIndices, count, cumulativeScaleIndex); };
+            else
+                call = [=]() { return beagleRemoveScaleFactors(instance, scaleIndices, count, cumulativeScaleIndex); };
+            break;
+        }
+        case BEAGLE_RECORD_ACCUMULATE_SCALE_FACTORS_BY_PARTITION:
+        case BEAGLE_RECORD_REMOVE_SCALE_FACTORS_BY_PARTITION: {
+            int instance = getMapped(state.instances, reader.getInt());
+            const int* scaleIndices = reader.getInts(ints[0]);
+            int count = reader.getInt();
+            int cumulativeScaleIndex = reader.getInt();
+            int partitionIndex = reader.getInt();
+            if (recordedCall == BEAGLE_RECORD_ACCUMULATE_SCALE_FACTORS_BY_PARTITION)
+                call = [=]() {
+                    return beagleAccumulateScaleFactorsByPartition(instance, scaleIndices, count,
+                                                                   cumulativeScaleIndex, partitionIndex);
+                };
+            else
+                call = [=]() {
+                    return beagleRemoveScaleFactorsByPartition(instance, scaleIndices, count,
+                                                               cumulativeScaleIndex, partitionIndex);
+                };
+            break;
+        }
+        case BEAGLE_RECORD_RESET_SCALE_FACTORS: {
+            int instance = getMapped(state.instances, reader.getInt());
+            int cumulativeScaleIndex = reader.getInt();
+            call = [=]() { return beagleResetScaleFactors(instance, cumulativeScaleIndex); };
+            break;
+        }
+        case BEAGLE_RECORD_RESET_SCALE_FACTORS_BY_PARTITION: {
+            int instance = getMapped(state.instances, reader.getInt());
+            int cumulativeScaleIndex = reader.getInt();
+            int partitionIndex = reader.getInt();
+            call = [=]() { return beagleResetScaleFactorsByPartition(instance, cumulativeScaleIndex, partitionIndex); };
+            break;
+        }
+        case BEAGLE_RECORD_COPY_SCALE_FACTORS: {
+            int instance = getMapped(state.instances, reader.getInt());
+            int destScalingIndex = reader.getInt();
+            int srcScalingIndex = reader.getInt();
+            call = [=]() { return beagleCopyScaleFactors(instance, destScalingIndex, srcScalingIndex); };
+            break;
+        }
+        case BEAGLE_RECORD_GET_SCALE_FACTORS: {
+            int instance = getMapped(state.instances, reader.getInt());
+            int srcScalingIndex = reader.getInt();
+            double* outScaleFactors = reader.getOutput(outputs[0]);
+            call = [=]() { return beagleGetScaleFactors(instance, srcScalingIndex, outScaleFactors); };
+            break;
+        }
+        case BEAGLE_RECORD_CALCULATE_ROOT_LOG_LIKELIHOODS: {
+            int instance = getMapped(state.instances, reader.getInt());
+            const int* bufferIndices = reader.getInts(ints[0]);
+            const int* categoryWeightsIndices = reader.getInts(ints[1]);
+            const int* stateFrequenciesIndices = reader.getInts(ints[2]);
+            const int* cumulativeScaleIndices = reader.getInts(ints[3]);
+            int count = reader.getInt();
+            double* outSumLogLikelihood = reader.getOutput(outputs[0]);
+            call = [=]() {
+                return beagleCalculateRootLogLikelihoods(instance, bufferIndices, categoryWeightsIndices,
+                                                         stateFrequenciesIndices, cumulativeScaleIndices, count,
+                                                         outSumLogLikelihood);
+            };
+            break;
+        }
+        case BEAGLE_RECORD_CALCULATE_ROOT_LOG_LIKELIHOODS_BY_PARTITION: {
+            int instance = getMapped(state.instances, reader.getInt());
+            const int* bufferIndices = reader.getInts(ints[0]);
+            const int* categoryWeightsIndices = reader.getInts(ints[1]);
+            const int* stateFrequenciesIndices = reader.getInts(ints[2]);
+            const int* cumulativeScaleIndices = reader.getInts(ints[3]);
+            const int* partitionIndices = reader.getInts(ints[4]);
+            int partitionCount = reader.getInt();
+            int count = reader.getInt();
+            double* outSumLogLikelihoodByPartition = reader.getOutput(outputs[0]);
+            double* outSumLogLikelihood = reader.getOutput(outputs[1]);
+            call = [=]() {
+                return beagleCalculateRootLogLikelihoodsByPartition(instance, bufferIndices, categoryWeightsIndices,
+                                                                    stateFrequenciesIndices, cumulativeScaleIndices,
+                                                                    partitionIndices, partitionCount, count,
+                                                                    outSumLogLikelihoodByPartition,
+                                                                    outSumLogLikelihood);
+            };
+            break;
+        }
+        case BEAGLE_RECORD_EVALUATE_ROOT_LOG_LIKELIHOOD: {
+            int instance = getMapped(state.instances, reader.getInt());
+            int eigenIndex = reader.getInt();
+            const int* probabilityIndices = reader.getInts(ints[0]);
+            const double* edgeLengths = reader.getDoubles(doubles[0]);
+            int matrixCount = reader.getInt();
+            const BeagleOperation* operations = (const BeagleOperation*) reader.getInts(ints[1]);
+            int operationCount = reader.getInt();
+            int rootBufferIndex = reader.getInt();
+            int categoryWeightsIndex = reader.getInt();
+            int stateFrequenciesIndex = reader.getInt();
+            int cumulativeScaleIndex = reader.getInt();
+            double* outSumLogLikelihood = reader.getOutput(outputs[0]);
+            call = [=]() {
+                return beagleEvaluateRootLogLikelihood(instance, eigenIndex, probabilityIndices, edgeLengths,
+                                                       matrixCount, operations, operationCount, rootBufferIndex,
+                                                       categoryWeightsIndex, stateFrequenciesIndex,
+                                                       cumulativeScaleIndex, outSumLogLikelihood);
+            };
+            break;
+        }
+        case BEAGLE_RECORD_EVALUATE_ROOT_LOG_LIKELIHOODS: {
+            int jobCount = reader.getInt();
+            int threadCount = reader.getInt();
+            jobs.resize(jobCount > 0 ? jobCount : 0);
+            jobInts.resize(2 * jobs.size());
+            jobDoubles.resize(jobs.size());
+            for (size_t i = 0; i < jobs.size(); i++) {
+                BeagleEvaluationJob& job = jobs[i];
+                job.instance = getMapped(state.instances, reader.getInt());
+                job.eigenIndex = reader.getInt();
+                job.probabilityIndices = reader.getInts(jobInts[2 * i]);
+                job.edgeLengths = reader.getDoubles(jobDoubles[i]);
+                job.matrixCount = reader.getInt();
+                job.operations = (const BeagleOperation*) reader.getInts(jobInts[2 * i + 1]);
+                job.operationCount = reader.getInt();
+                job.rootBufferIndex = reader.getInt();
+                job.categoryWeightsIndex = reader.getInt();
+                job.stateFrequenciesIndex = reader.getInt();
+                job.cumulativeScaleIndex = reader.getInt();
+            }
+            const BeagleEvaluationJob* jobList = (jobs.empty() ? NULL : &jobs[0]);
+            double* outSumLogLikelihoods = reader.getOutput(outputs[0]);
+            int* outReturnCodes = reader.getOutput(intOutputs[0]);
+            call = [=]() {
+                return beagleEvaluateRootLogLikelihoods(jobList, jobCount, threadCount, outSumLogLikelihoods,
+                                                        outReturnCodes);
+            };
+            break;
+        }
+        case BEAGLE_RECORD_SET_TREE: {
+            int instance = getMapped(state.instances, reader.getInt());
+            const int* parentIndices = reader.getInts(ints[0]);
+            const int* matrixIndices = reader.getInts(ints[1]);
+            int nodeCount = reader.getInt();
+            int useScaling = reader.getInt();
+            call = [=]() { return beagleSetTree(instance, parentIndices, matrixIndices, nodeCount, useScaling); };
+            break;
+        }
+        case BEAGLE_RECORD_GET_TREE_OPERATIONS: {
+            int instance = getMapped(state.instances, reader.getInt());
+            BeagleOperation* outOperations = (BeagleOperation*) reader.getOutput(intOutputs[0]);
+            int* outOperationCount = reader.getOutput(intOutputs[1]);
+            int* outLevelCounts = reader.getOutput(intOutputs[2]);
+            int* outRootIndex = reader.getOutput(intOutputs[3]);
+            int* outCumulativeScaleIndex = reader.getOutput(intOutputs[4]);
+            call = [=]() {
+                return beagleGetTreeOperations(instance, outOperations, outOperationCount, outLevelCounts,
+                                               outRootIndex, outCumulativeScaleIndex);
+            };
+            break;
+        }
+        case BEAGLE_RECORD_EVALUATE_TREE: {
+            int instance = getMapped(state.instances, reader.getInt());
+            int eigenIndex = reader.getInt();
+            const double* edgeLengths = reader.getDoubles(doubles[0]);
+            int categoryWeightsIndex = reader.getInt();
+            int stateFrequenciesIndex = reader.getInt();
+            double* outSumLogLikelihood = reader.getOutput(outputs[0]);
+            call = [=]() {
+                return beagleEvaluateTree(instance, eigenIndex, edgeLengths, categoryWeightsIndex,
+                                          stateFrequenciesIndex, outSumLogLikelihood);
+            };
+            break;
+        }
+        case BEAGLE_RECORD_CALCULATE_ROOT_LOG_LIKELIHOODS_FOR_WEIGHTS: {
+            int instance = getMapped(state.instances, reader.getInt());
+            int bufferIndex = reader.getInt();
+            int categoryWeightsIndex = reader.getInt();
+            int stateFrequenciesIndex = reader.getInt();
+            int cumulativeScaleIndex = reader.getInt();
+            const double* inPatternWeights = reader.getDoubles(doubles[0]);
+            int weightVectorCount = reader.getInt();
+            double* outSumLogLikelihoods = reader.getOutput(outputs[0]);
+            call = [=]() {
+                return beagleCalculateRootLogLikelihoodsForWeights(instance, bufferIndex, categoryWeightsIndex,
+                                                                   stateFrequenciesIndex, cumulativeScaleIndex,
+                                                                   inPatternWeights, weightVectorCount,
+                                                                   outSumLogLikelihoods);
+            };
+            break;
+        }
+        case BEAGLE_RECORD_CALCULATE_EDGE_LOG_LIKELIHOODS: {
+            int instance = getMapped(state.instances, reader.getInt());
+            const int* indices[8];
+            for (int i = 0; i < 8; i++)
+                indices[i] = reader.getInts(ints[i]);
+            int count = reader.getInt();
+            double* outSumLogLikelihood = reader.getOutput(outputs[0]);
+            double* outSumFirstDerivative = reader.getOutput(outputs[1]);
+            double* outSumSecondDerivative = reader.getOutput(outputs[2]);
+            call = [=]() {
+                return beagleCalculateEdgeLogLikelihoods(instance, indices[0], indices[1], indices[2], indices[3],
+                                                         indices[4], indices[5], indices[6], indices[7], count,
+                                                         outSumLogLikelihood, outSumFirstDerivative,
+                                                         outSumSecondDerivative);
+            };
+            break;
+        }
+        case BEAGLE_RECORD_CALCULATE_EDGE_LOG_LIKELIHOODS_BY_PARTITION: {
+            int instance = getMapped(state.instances, reader.getInt());
+            const int* indices[9];
+            for (int i = 0; i < 9; i++)
+                indices[i] = reader.getInts(ints[i]);
+            int partitionCount = reader.getInt();
+            int count = reader.getInt();
+            double* sums[6];
+            for (int i = 0; i < 6; i++)
+                sums[i] = reader.getOutput(outputs[i]);
+            call = [=]() {
+                return beagleCalculateEdgeLogLikelihoodsByPartition(instance, indices[0], indices[1], indices[2],
+                                                                    indices[3], indices[4], indices[5], indices[6],
+                                                                    indices[7], indices[8], partitionCount, count,
+                                                                    sums[0], sums[1], sums[2], sums[3], sums[4],
+                                                                    sums[5]);
+            };
+            break;
+        }
+        case BEAGLE_RECORD_CALCULATE_EDGE_SUMTABLE: {
+            int instance = getMapped(state.instances, reader.getInt());
+            int indices[6];
+            for (int i = 0; i < 6; i++)
+                indices[i] = reader.getInt();
+            call = [=]() {
+                return beagleCalculateEdgeSumtable(instance, indices[0], indices[1], indices[2], indices[3],
+                                                   indices[4], indices[5]);
+            };
+            break;
+        }
+        case BEAGLE_RECORD_CALCULATE_EDGE_SUMTABLE_LOG_LIKELIHOOD: {
+            int instance = getMapped(state.instances, reader.getInt());
+            double edgeLength = reader.getDouble();
+            double* outSumLogLikelihood = reader.getOutput(outputs[0]);
+            double* outSumFirstDerivative = reader.getOutput(outputs[1]);
+            double* outSumSecondDerivative = reader.getOutput(outputs[2]);
+            call = [=]() {
+                return beagleCalculateEdgeSumtableLogLikelihood(instance, edgeLength, outSumLogLikelihood,
+                                                                outSumFirstDerivative, outSumSecondDerivative);
+            };
+            break;
+        }
+        case BEAGLE_RECORD_OPTIMIZE_EDGE_LENGTH: {
+            int instance = getMapped(state.instances, reader.getInt());
+            double* inOutEdgeLength = (reader.getDoubles(outputs[0]) != NULL ? &outputs[0][0] : NULL);
+            double minEdgeLength = reader.getDouble();
+            double maxEdgeLength = reader.getDouble();
+            double tolerance = reader.getDouble();
+            int maxIterations = reader.getInt();
+            double* outSumLogLikelihood = reader.getOutput(outputs[1]);
+            call = [=]() {
+                return beagleOptimizeEdgeLength(instance, inOutEdgeLength, minEdgeLength, maxEdgeLength, tolerance,
+                                                maxIterations, outSumLogLikelihood);
+            };
+            break;
+        }
+        case BEAGLE_RECORD_CALCULATE_INSERTION_LOG_LIKELIHOODS: {
+            int instance = getMapped(state.instances, reader.getInt());
+            const int* postBufferIndices = reader.getInts(ints[0]);
+            const int* preBufferIndices = reader.getInts(ints[1]);
+            const int* cumulativeScaleIndices = reader.getInts(ints[2]);
+            int count = reader.getInt();
+            int subtreeBufferIndex = reader.getInt();
+            int subtreeMatrixIndex = reader.getInt();
+            int categoryWeightsIndex = reader.getInt();
+            double* outSumLogLikelihoods = reader.getOutput(outputs[0]);
+            call = [=]() {
+                return beagleCalculateInsertionLogLikelihoods(instance, postBufferIndices, preBufferIndices,
+                                                              cumulativeScaleIndices, count, subtreeBufferIndex,
+                                                              subtreeMatrixIndex, categoryWeightsIndex,
+                                                              outSumLogLikelihoods);
+            };
+            break;
+        }
+        case BEAGLE_RECORD_OPTIMIZE_INSERTION_LOG_LIKELIHOODS: {
+            int instance = getMapped(state.instances, reader.getInt());
+            const int* postBufferIndices = reader.getInts(ints[0]);
+            const int* preBufferIndices = reader.getInts(ints[1]);
+            const int* cumulativeScaleIndices = reader.getInts(ints[2]);
+            int count = reader.getInt();
+            int subtreeBufferIndex = reader.getInt();
+            int eigenIndex = reader.getInt();
+            int categoryWeightsIndex = reader.getInt();
+            double* inOutPendantLengths = (reader.getDoubles(outputs[0]) != NULL ? &outputs[0][0] : NULL);
+            double minEdgeLength = reader.getDouble();
+            double maxEdgeLength = reader.getDouble();
+            double tolerance = reader.getDouble();
+            int maxIterations = reader.getInt();
+            double* outSumLogLikelihoods = reader.getOutput(outputs[1]);
+            call = [=]() {
+                return beagleOptimizeInsertionLogLikelihoods(instance, postBufferIndices, preBufferIndices,
+                                                             cumulativeScaleIndices, count, subtreeBufferIndex,
+                                                             eigenIndex, categoryWeightsIndex, inOutPendantLengths,
+                                                             minEdgeLength, maxEdgeLength, tolerance,
+                                                             maxIterations, outSumLogLikelihoods);
+            };
+            break;
+        }
+        case BEAGLE_RECORD_GET_LOG_LIKELIHOOD: {
+            int instance = getMapped(state.instances, reader.getInt());
+            double* outSumLogLikelihood = reader.getOutput(outputs[0]);
+            call = [=]() { return beagleGetLogLikelihood(instance, outSumLogLikelihood); };
+            break;
+        }
+        case BEAGLE_RECORD_GET_DERIVATIVES: {
+            int instance = getMapped(state.instances, reader.getInt());
+            double* outSumFirstDerivative = reader.getOutput(outputs[0]);
+            double* outSumSecondDerivative = reader.getOutput(outputs[1]);
+            call = [=]() { return beagleGetDerivatives(instance, outSumFirstDerivative, outSumSecondDerivative); };
+            break;
+        }
+        case BEAGLE_RECORD_GET_SITE_LOG_LIKELIHOODS: {
+            int instance = getMapped(state.instances, reader.getInt());
+            double* outLogLikelihoods = reader.getOutput(outputs[0]);
+            call = [=]() { return beagleGetSiteLogLikelihoods(instance, outLogLikelihoods); };
+            break;
+        }
+        case BEAGLE_RECORD_GET_SITE_DERIVATIVES: {
+            int instance = getMapped(state.instances, reader.getInt());
+            double* outFirstDerivatives = reader.getOutput(outputs[0]);
+            double* outSecondDerivatives = reader.getOutput(outputs[1]);
+            call = [=]() { return beagleGetSiteDerivatives(instance, outFirstDerivatives, outSecondDerivatives); };
+            break;
+        }
+        default:
+            std::cerr << "Unknown call " << recordedCall << " in record\n";
+            return false;
+    }
+
+    if (!reader.isValid()) {
+        std::cerr << "Malformed record of " << getRecordedCallName(recordedCall) << "\n";
+        return false;
+    }
+
+    const double startTime = getTime();
+    const int returnValue = call();
+    const double endTime = getTime();
+
+    CallTiming& timing = state.timings[recordedCall];
+    timing.count++;
+    timing.time += endTime - startTime;
+    if (returnValue < 0)
+        timing.errorCount++;
+    state.callCount++;
+
+    if (createdMap != NULL && returnValue >= 0) {
+        (*createdMap)[createdId] = returnValue;
+        if (createdMap == &state.instances && !state.printedDetails) {
+            printDetails(details);
+            state.printedDetails = true;
+        }
+    }
+
+    for (int i = 0; i < 8; i++) {
+        for (size_t j = 0; j < outputs[i].size(); j++) {
+            if (std::isfinite(outputs[i][j]))
+                state.checksum += outputs[i][j];
+        }
+        state.outputCount += outputs[i].size();
+    }
+
+    return true;
+}
+
+void helpMessage() {
+    std::cerr << "Usage:\n\n";
+    std::cerr << "beaglereplay <record file> [--help] [--rsrc <integer>] [--reps <integer>] [--flags <integer>] [--requirements <integer>] [--singleprecision] [--doubleprecision] [--disablevector] [--enablethreads] [--calls]\n\n";
+    std::cerr << "Replays the BEAGLE calls recorded by a run with the environment variable BEAGLE_RECORD_FILE set to the record file\n\n";
+    std::cerr << "If --rsrc is specified, instances are created on the given resources instead of the recorded ones\n\n";
+    std::cerr << "If --flags or --requirements is specified, they replace the recorded preference or requirement flags; the other options add to them\n\n";
+    std::cerr << "If --calls is specified, the time spent in each function is listed\n\n";
+    std::exit(0);
+}
+
+int main(int argc, const char* argv[]) {
+    ReplayOptions options;
+    options.preferenceFlags = 0;
+    options.requirementFlags = 0;
+    options.addedPreferenceFlags = 0;
+    options.addedRequirementFlags = 0;
+    options.overrideFlags = false;
+    options.nreps = 1;
+    options.listCalls = false;
+
+    const char* fileName = NULL;
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        const bool hasValue = (i + 1 < argc);
+        if (option == "--help") {
+            helpMessage();
+        } else if (option == "--rsrc" && hasValue) {
+            options.resources.push_back(atoi(argv[++i]));
+        } else if (option == "--reps" && hasValue) {
+            options.nreps = atoi(argv[++i]);
+        } else if (option == "--flags" && hasValue) {
+            options.preferenceFlags = strtol(argv[++i], NULL, 0);
+            options.overrideFlags = true;
+        } else if (option == "--requirements" && hasValue) {
+            options.requirementFlags = strtol(argv[++i], NULL, 0);
+            options.overrideFlags = true;
+        } else if (option == "--singleprecision") {
+            options.addedRequirementFlags |= BEAGLE_FLAG_PRECISION_SINGLE;
+        } else if (option == "--doubleprecision") {
+            options.addedRequirementFlags |= BEAGLE_FLAG_PRECISION_DOUBLE;
+        } else if (option == "--disablevector") {
+            options.addedPreferenceFlags |= BEAGLE_FLAG_VECTOR_NONE;
+        } else if (option == "--enablethreads") {
+            options.addedPreferenceFlags |= BEAGLE_FLAG_THREADING_CPP;
+        } else if (option == "--calls") {
+            options.listCalls = true;
+        } else if (fileName == NULL && option[0] != '-') {
+            fileName = argv[i];
+        } else {
+            std::cerr << "Unknown option: " << option << "\n\n";
+            helpMessage();
+        }
+    }
+
+    if (fileName == NULL)
+        helpMessage();
+
+    BeagleRecordReader reader(fileName);
+    if (!reader.isOpen()) {
+        std::cerr << "Cannot read record file " << fileName << "\n";
+        return 1;
+    }
+
+    ReplayState state;
+    memset(state.timings, 0, sizeof(state.timings));
+    state.printedDetails = false;
+
+    double firstChecksum = 0.0;
+    double bestTime = 0.0;
+    bool reproducible = true;
+
+    std::cout << std::setprecision(6) << std::fixed;
+
+    for (int rep = 0; rep < options.nreps; rep++) {
+        state.checksum = 0.0;
+        state.outputCount = 0;
+        state.callCount = 0;
+
+        reader.rewind();
+        const double startTime = getTime();
+        while (reader.next()) {
+            if (!replayCall(reader, options, state))
+                return 1;
+        }
+        const double time = getTime() - startTime;
+
+        // release what the recorded run left to the end of the process
+        for (std::map<int, int>::iterator it = state.instances.begin(); it != state.instances.end(); ++it)
+            beagleFinalizeInstance(it->second);
+        state.instances.clear();
+        for (std::map<int, int>::iterator it = state.tipData.begin(); it != state.tipData.end(); ++it)
+            beagleFinalizeTipData(it->second);
+        state.tipData.clear();
+
+        if (rep == 0) {
+            firstChecksum = state.checksum;
+            bestTime = time;
+        } else {
+            reproducible = reproducible && (state.checksum == firstChecksum);
+            if (time < bestTime)
+                bestTime = time;
+        }
+        std::cout << "Replay " << rep + 1 << ": " << state.callCount << " calls, " << time << " ms\n";
+    }
+
+    std::cout << "Best replay time: " << bestTime << " ms\n";
+
+    if (options.listCalls) {
+        std::cout << "\n" << std::left << std::setw(50) << "function" << std::right << std::setw(10) << "calls"
+                  << std::setw(16) << "total ms" << std::setw(14) << "mean us" << std::setw(8) << "errors" << "\n";
+        for (int call = 1; call < BEAGLE_RECORD_CALL_COUNT; call++) {
+            const CallTiming& timing = state.timings[call];
+            if (timing.count == 0)
+                continue;
+            std::cout << std::left << std::setw(50) << getRecordedCallName(call) << std::right
+                      << std::setw(10) << timing.count << std::setw(16) << timing.time
+                      << std::setw(14) << 1000.0 * timing.time / timing.count
+                      << std::setw(8) << timing.errorCount << "\n";
+        }
+        std::cout << "\n";
+    }
+
+    long errorCount = 0;
+    for (int call = 1; call < BEAGLE_RECORD_CALL_COUNT; call++)
+        errorCount += state.timings[call].errorCount;
+    if (errorCount > 0)
+        std::cout << "Calls returning an error: " << errorCount << "\n";
+
+    std::cout << std::scientific << std::setprecision(12);
+    std::cout << "Output checksum: " << firstChecksum << " (" << state.outputCount << " values)";
+    if (!reproducible)
+        std::cout << ", differs between replays";
+    std::cout << "\n";
+
+    return 0;
+}
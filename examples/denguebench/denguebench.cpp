@@ -0,0 +1,1507 @@
+/*
+ *  denguebench.cpp
+ *  BEAGLE
+ *
+ *  Replays the likelihood workload of the BEAST analyses in
+ *  benchmarks/v3-app-note on the Dengue997 alignment, with the library
+ *  alone. The NEXUS matrix is split into the ten genes of the BEAST XML
+ *  inputs and analysed either as nucleotides, each gene under its own
+ *  HKY+G4 model (Dengue997_s3_AMVN_BTL.xml with one instance per gene,
+ *  Dengue997_s3_AMVN_MPDLD.xml with one partitioned instance), or as codons
+ *  of all genes under a single Goldman-Yang+G4 model with discretized
+ *  lognormal branch rates (Dengue997_s3_codon.xml).
+ *
+ *  The starting tree is the UPGMA tree of JC distances, as in the XML
+ *  inputs. Each move then changes the tree or the model the way one of the
+ *  MCMC operators of the analysis does, drawn with the operator weights, and
+ *  only the transition matrices and partials the move invalidates are
+ *  recomputed before the root log likelihood. Moves are always kept: a
+ *  rejected proposal costs the library the same work as an accepted one.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "libhmsbeagle/beagle.h"
+
+#define DENGUE_GENE_COUNT       10
+#define GAMMA_CATEGORY_COUNT    4
+#define NUCLEOTIDE_STATE_COUNT  4
+#define CODON_STATE_COUNT       61
+// JC distance given to pairs of sequences too divergent for the correction
+#define UPGMA_MAX_DISTANCE      10.0
+// coalescent time unit of --randomtree, in substitutions per site
+#define RANDOM_TREE_SCALE       0.01
+// scale factor of the BEAST scale operators
+#define SCALE_OPERATOR_FACTOR   0.75
+// standard deviation of a subtree slide, as a fraction of the tree height
+#define SUBTREE_SLIDE_SIZE      0.1
+// tries at a random exchange before falling back to a node height move
+#define EXCHANGE_ATTEMPTS       100
+
+struct Gene {
+    const char* name;
+    int firstSite;  // 1-based, inclusive
+    int lastSite;
+};
+
+// gene boundaries of the alignments in the BEAST XML inputs
+static const Gene dengueGenes[DENGUE_GENE_COUNT] = {
+    {"capsid",           1,   342},
+    {"glycoprotein",   343,   834},
+    {"envelope",       835,  2325},
+    {"NS1",           2325,  3381},
+    {"NS2A",          3382,  4038},
+    {"NS2B",          4039,  4428},
+    {"NS3",           4429,  6285},
+    {"NS4A",          6286,  6735},
+    {"NS4B",          6736,  7482},
+    {"NS5",           7483, 10188}
+};
+
+// amino acids of the codons AAA, AAC, AAG, ..., TTT under the universal code, '*' for stop codons
+static const char universalCode[] = "KNKNTTTTRSRSIIMIQHQHPPPPRRRRLLLLEDEDAAAAGGGGVVVV*Y*YSSSS*CWCLFLF";
+
+enum MoveType {
+    MOVE_NODE_HEIGHT = 0,   // uniformOperator on internal node heights
+    MOVE_ROOT_HEIGHT,       // scaleOperator on the root height
+    MOVE_SUBTREE_SLIDE,
+    MOVE_NARROW_EXCHANGE,
+    MOVE_WIDE_EXCHANGE,
+    MOVE_WILSON_BALDING,
+    MOVE_ALL_HEIGHTS,       // upDownOperator on the clock rate and node heights
+    MOVE_MODEL,             // substitution and site rate model parameters
+    MOVE_BRANCH_RATE,       // integer operators on one branch rate category
+    MOVE_BRANCH_RATE_SWAP,  // swapOperator on two branch rate categories
+    MOVE_BRANCH_RATE_SPREAD,// scaleOperator on ucld.stdev
+    MOVE_TYPE_COUNT
+};
+
+static const char* moveNames[MOVE_TYPE_COUNT] = {
+    "node-height", "root-height", "subtree-slide", "narrow-exchange", "wide-exchange",
+    "wilson-balding", "all-heights", "model", "branch-rate", "branch-rate-swap", "branch-rate-spread"
+};
+
+// operator weights of Dengue997_s3_AMVN_MPDLD.xml and Dengue997_s3_codon.xml; operators on
+// parameters of the tree prior alone do not touch the likelihood and are left out
+static const double nucleotideMoveWeights[MOVE_TYPE_COUNT] = {
+    30, 3, 15, 15, 3, 3, 3, 49, 0, 0, 0
+};
+static const double codonMoveWeights[MOVE_TYPE_COUNT] = {
+    30, 10, 15, 15, 3, 3, 0, 14, 20, 10, 3
+};
+
+struct BenchOptions {
+    std::string nexusFile;
+    bool codon;
+    bool partitioned;
+    bool randomTree;
+    int taxonCount;
+    int moveCount;
+    int resource;
+    unsigned int seed;
+    long preferenceFlags;
+    long requirementFlags;
+};
+
+struct Alignment {
+    std::vector<std::string> names;
+    std::vector<std::string> sequences;
+};
+
+struct Partition {
+    std::string name;
+    int siteCount;
+    int patternCount;
+    std::vector<double> patternWeights;
+    std::vector<std::vector<int> > tipStates;   // by tip, then pattern
+    std::vector<double> frequencies;
+};
+
+struct SubstitutionModel {
+    double kappa;
+    double omega;
+    double alpha;
+    double mu;
+    std::vector<double> eigenVectors;
+    std::vector<double> inverseEigenVectors;
+    std::vector<double> eigenValues;
+    std::vector<double> categoryRates;
+};
+
+struct Tree {
+    int tipCount;
+    int nodeCount;
+    int root;
+    std::vector<int> parent;            // -1 for the root
+    std::vector<int> children;          // two per node, -1 for tips
+    std::vector<double> height;
+    double clockRate;
+    std::vector<int> rateCategory;      // branch rate category of the edge above each node
+    std::vector<double> categoryRates;  // empty for a strict clock
+    double rateStdev;
+};
+
+// what a move invalidated since the last evaluation
+struct Changes {
+    bool models;
+    std::vector<char> matrices;
+    std::vector<char> partials;
+};
+
+struct Likelihood {
+    bool partitioned;
+    int stateCount;
+    int tipCount;
+    int nodeCount;
+    int totalPatternCount;
+    std::vector<int> instances;
+    std::string implName;
+    long flags;
+    long long memory;
+    // work done since creation
+    long matrixCount;
+    long operationCount;
+    double partialsCount;
+};
+
+static double uniform(std::mt19937& rng, double lower, double upper) {
+    return std::uniform_real_distribution<double>(lower, upper)(rng);
+}
+
+static int randomInteger(std::mt19937& rng, int count) {
+    return std::uniform_int_distribution<int>(0, count - 1)(rng);
+}
+
+static double scaleFactor(std::mt19937& rng) {
+    return SCALE_OPERATOR_FACTOR + uniform(rng, 0.0, 1.0) * (1.0 / SCALE_OPERATOR_FACTOR - SCALE_OPERATOR_FACTOR);
+}
+
+/*
+ * Reads the names and sequences of the MATRIX command of a NEXUS DATA or
+ * CHARACTERS block; interleaved matrices are joined.
+ */
+static bool readNexus(const std::string& fileName, Alignment& alignment) {
+    std::ifstream in(fileName.c_str());
+    if (!in) {
+        std::cerr << "Cannot read " << fileName << "\n";
+        return false;
+    }
+    std::stringstream contents;
+    contents << in.rdbuf();
+    std::string text = contents.str();
+
+    // drop [comments]
+    std::string stripped;
+    stripped.reserve(text.size());
+    int depth = 0;
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] == '[')
+            depth++;
+        else if (text[i] == ']' && depth > 0)
+            depth--;
+        else if (depth == 0)
+            stripped += text[i];
+    }
+
+    std::string upper(stripped);
+    std::transform(upper.begin(), upper.end(), upper.begin(), ::toupper);
+    size_t start = upper.find("MATRIX");
+    if (start == std::string::npos) {
+        std::cerr << fileName << " has no MATRIX command\n";
+        return false;
+    }
+    size_t end = stripped.find(';', start);
+    if (end == std::string::npos)
+        end = stripped.size();
+
+    std::map<std::string, int> taxonIndex;
+    std::istringstream lines(stripped.substr(start + 6, end - start - 6));
+    std::string line;
+    while (std::getline(lines, line)) {
+        std::istringstream tokens(line);
+        std::string name, sequence, piece;
+        if (!(tokens >> name))
+            continue;
+        while (tokens >> piece)
+            sequence += piece;
+        std::map<std::string, int>::iterator found = taxonIndex.find(name);
+        if (found == taxonIndex.end()) {
+            taxonIndex[name] = (int) alignment.names.size();
+            alignment.names.push_back(name);
+            alignment.sequences.push_back(sequence);
+        } else {
+            alignment.sequences[found->second] += sequence;
+        }
+    }
+
+    if (alignment.names.empty()) {
+        std::cerr << fileName << " has an empty MATRIX\n";
+        return false;
+    }
+    return true;
+}
+
+static int nucleotideState(char c) {
+    switch (c) {
+        case 'A': case 'a':
+            return 0;
+        case 'C': case 'c':
+            return 1;
+        case 'G': case 'g':
+            return 2;
+        case 'T': case 't': case 'U': case 'u':
+            return 3;
+        default:
+            return NUCLEOTIDE_STATE_COUNT;  // ambiguous, gap or missing
+    }
+}
+
+static void addPattern(Partition& partition, std::map<std::string, int>& patternIndex, const std::string& column) {
+    std::map<std::string, int>::iterator found = patternIndex.find(column);
+    if (found != patternIndex.end()) {
+        partition.patternWeights[found->second] += 1.0;
+        return;
+    }
+    patternIndex[column] = partition.patternCount++;
+    partition.patternWeights.push_back(1.0);
+    for (size_t t = 0; t < column.size(); t++)
+        partition.tipStates[t].push_back((unsigned char) column[t]);
+}
+
+static Partition nucleotidePartition(const Alignment& alignment, const Gene& gene) {
+    const int tipCount = (int) alignment.names.size();
+    Partition partition;
+    partition.name = gene.name;
+    partition.siteCount = gene.lastSite - gene.firstSite + 1;
+    partition.patternCount = 0;
+    partition.tipStates.resize(tipCount);
+
+    std::map<std::string, int> patternIndex;
+    std::string column(tipCount, 0);
+    std::vector<double> counts(NUCLEOTIDE_STATE_COUNT, 0.0);
+    for (int site = gene.firstSite - 1; site < gene.lastSite; site++) {
+        for (int t = 0; t < tipCount; t++) {
+            const int state = nucleotideState(alignment.sequences[t][site]);
+            column[t] = (char) state;
+            if (state < NUCLEOTIDE_STATE_COUNT)
+                counts[state] += 1.0;
+        }
+        addPattern(partition, patternIndex, column);
+    }
+
+    double total = 0.0;
+    for (int s = 0; s < NUCLEOTIDE_STATE_COUNT; s++)
+        total += counts[s];
+    for (int s = 0; s < NUCLEOTIDE_STATE_COUNT; s++)
+        partition.frequencies.push_back(total > 0.0 ? counts[s] / total : 1.0 / NUCLEOTIDE_STATE_COUNT);
+    return partition;
+}
+
+/*
+ * The whole codons of every gene as one partition. Codons with an ambiguous
+ * nucleotide or a stop codon are missing data.
+ */
+static Partition codonPartition(const Alignment& alignment) {
+    const int tipCount = (int) alignment.names.size();
+    Partition partition;
+    partition.name = "codons";
+    partition.siteCount = 0;
+    partition.patternCount = 0;
+    partition.tipStates.resize(tipCount);
+
+    int senseIndex[64];
+    for (int c = 0, sense = 0; c < 64; c++)
+        senseIndex[c] = (universalCode[c] == '*' ? -1 : sense++);
+
+    std::map<std::string, int> patternIndex;
+    std::string column(tipCount, 0);
+    std::vector<double> counts(CODON_STATE_COUNT, 0.0);
+    for (int g = 0; g < DENGUE_GENE_COUNT; g++) {
+        const Gene& gene = dengueGenes[g];
+        const int codonCount = (gene.lastSite - gene.firstSite + 1) / 3;
+        for (int c = 0; c < codonCount; c++) {
+            const int site = gene.firstSite - 1 + 3 * c;
+            for (int t = 0; t < tipCount; t++) {
+                const std::string& sequence = alignment.sequences[t];
+                const int n1 = nucleotideState(sequence[site]);
+                const int n2 = nucleotideState(sequence[site + 1]);
+                const int n3 = nucleotideState(sequence[site + 2]);
+                int state = CODON_STATE_COUNT;
+                if (n1 < NUCLEOTIDE_STATE_COUNT && n2 < NUCLEOTIDE_STATE_COUNT && n3 < NUCLEOTIDE_STATE_COUNT &&
+                    senseIndex[16 * n1 + 4 * n2 + n3] >= 0) {
+                    state = senseIndex[16 * n1 + 4 * n2 + n3];
+                    counts[state] += 1.0;
+                }
+                column[t] = (char) state;
+            }
+            addPattern(partition, patternIndex, column);
+        }
+        partition.siteCount += codonCount;
+    }
+
+    // with one pseudocount, so that no codon has zero frequency
+    double total = CODON_STATE_COUNT;
+    for (int s = 0; s < CODON_STATE_COUNT; s++)
+        total += counts[s];
+    for (int s = 0; s < CODON_STATE_COUNT; s++)
+        partition.frequencies.push_back((counts[s] + 1.0) / total);
+    return partition;
+}
+
+/*
+ * Eigensystem of a symmetric matrix by cyclic Jacobi rotations; the
+ * eigenvectors are the columns of vectors.
+ */
+static void jacobiEigen(int n, std::vector<double>& a, std::vector<double>& values, std::vector<double>& vectors) {
+    vectors.assign(n * n, 0.0);
+    for (int i = 0; i < n; i++)
+        vectors[i * n + i] = 1.0;
+
+    for (int sweep = 0; sweep < 100; sweep++) {
+        double offDiagonal = 0.0;
+        for (int p = 0; p < n; p++)
+            for (int q = p + 1; q < n; q++)
+                offDiagonal += a[p * n + q] * a[p * n + q];
+        if (offDiagonal < 1e-30)
+            break;
+
+        for (int p = 0; p < n; p++) {
+            for (int q = p + 1; q < n; q++) {
+                const double apq = a[p * n + q];
+                if (std::fabs(apq) < 1e-300)
+                    continue;
+                const double theta = (a[q * n + q] - a[p * n + p]) / (2.0 * apq);
+                const double t = (theta >= 0.0 ? 1.0 : -1.0) / (std::fabs(theta) + std::sqrt(theta * theta + 1.0));
+                const double c = 1.0 / std::sqrt(t * t + 1.0);
+                const double s = t * c;
+                for (int k = 0; k < n; k++) {
+                    const double akp = a[k * n + p];
+                    const double akq = a[k * n + q];
+                    a[k * n + p] = c * akp - s * akq;
+                    a[k * n + q] = s * akp + c * akq;
+                }
+                for (int k = 0; k < n; k++) {
+                    const double apk = a[p * n + k];
+                    const double aqk = a[q * n + k];
+                    a[p * n + k] = c * apk - s * aqk;
+                    a[q * n + k] = s * apk + c * aqk;
+                }
+                for (int k = 0; k < n; k++) {
+                    const double vkp = vectors[k * n + p];
+                    const double vkq = vectors[k * n + q];
+                    vectors[k * n + p] = c * vkp - s * vkq;
+                    vectors[k * n + q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+
+    values.resize(n);
+    for (int i = 0; i < n; i++)
+        values[i] = a[i * n + i];
+}
+
+/*
+ * Eigendecomposition of the reversible rate matrix with the given symmetric
+ * exchangeabilities and stationary frequencies, normalized to one expected
+ * substitution per unit time. The matrix is symmetrized by the square roots
+ * of the frequencies so that a symmetric solver applies.
+ */
+static void decomposeReversible(int n,
+                                const std::vector<double>& exchangeabilities,
+                                const std::vector<double>& frequencies,
+                                SubstitutionModel& model) {
+    std::vector<double> diagonal(n, 0.0);
+    double meanRate = 0.0;
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            if (i != j)
+                diagonal[i] -= exchangeabilities[i * n + j] * frequencies[j];
+        }
+        meanRate -= frequencies[i] * diagonal[i];
+    }
+
+    std::vector<double> symmetric(n * n);
+    std::vector<double> rootFrequencies(n);
+    for (int i = 0; i < n; i++)
+        rootFrequencies[i] = std::sqrt(frequencies[i]);
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            if (i == j)
+                symmetric[i * n + j] = diagonal[i] / meanRate;
+            else
+                symmetric[i * n + j] = exchangeabilities[i * n + j] * rootFrequencies[i] * rootFrequencies[j] / meanRate;
+        }
+    }
+
+    std::vector<double> vectors;
+    jacobiEigen(n, symmetric, model.eigenValues, vectors);
+
+    model.eigenVectors.resize(n * n);
+    model.inverseEigenVectors.resize(n * n);
+    for (int i = 0; i < n; i++) {
+        for (int k = 0; k < n; k++) {
+            model.eigenVectors[i * n + k] = vectors[i * n + k] / rootFrequencies[i];
+            model.inverseEigenVectors[k * n + i] = vectors[i * n + k] * rootFrequencies[i];
+        }
+    }
+}
+
+static void hkyExchangeabilities(double kappa, std::vector<double>& exchangeabilities) {
+    const int n = NUCLEOTIDE_STATE_COUNT;
+    exchangeabilities.assign(n * n, 1.0);
+    // A<->G and C<->T
+    exchangeabilities[0 * n + 2] = exchangeabilities[2 * n + 0] = kappa;
+    exchangeabilities[1 * n + 3] = exchangeabilities[3 * n + 1] = kappa;
+}
+
+static void codonExchangeabilities(double kappa, double omega, std::vector<double>& exchangeabilities) {
+    int senseCodons[CODON_STATE_COUNT];
+    for (int c = 0, sense = 0; c < 64; c++) {
+        if (universalCode[c] != '*')
+            senseCodons[sense++] = c;
+    }
+
+    const int n = CODON_STATE_COUNT;
+    exchangeabilities.assign(n * n, 0.0);
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            const int ci = senseCodons[i];
+            const int cj = senseCodons[j];
+            int differences = 0;
+            bool transition = false;
+            for (int position = 0; position < 3; position++) {
+                const int shift = 2 * (2 - position);
+                const int ni = (ci >> shift) & 3;
+                const int nj = (cj >> shift) & 3;
+                if (ni != nj) {
+                    differences++;
+                    transition = ((ni ^ nj) == 2);    // A<->G and C<->T
+                }
+            }
+            if (differences != 1)
+                continue;
+            double rate = (transition ? kappa : 1.0);
+            if (universalCode[ci] != universalCode[cj])
+                rate *= omega;
+            exchangeabilities[i * n + j] = rate;
+        }
+    }
+}
+
+// regularized lower incomplete gamma function
+static double incompleteGamma(double a, double x) {
+    if (x <= 0.0)
+        return 0.0;
+    const double logPrefix = a * std::log(x) - x - std::lgamma(a);
+    if (x < a + 1.0) {
+        double term = 1.0 / a;
+        double sum = term;
+        for (int n = 1; n < 1000 && term > sum * 1e-15; n++) {
+            term *= x / (a + n);
+            sum += term;
+        }
+        return sum * std::exp(logPrefix);
+    }
+    // continued fraction for the upper function
+    double b = x + 1.0 - a;
+    double c = 1.0 / 1e-300;
+    double d = 1.0 / b;
+    double h = d;
+    for (int n = 1; n < 1000; n++) {
+        const double an = -n * (n - a);
+        b += 2.0;
+        d = an * d + b;
+        if (std::fabs(d) < 1e-300)
+            d = 1e-300;
+        c = b + an / c;
+        if (std::fabs(c) < 1e-300)
+            c = 1e-300;
+        d = 1.0 / d;
+        const double delta = d * c;
+        h *= delta;
+        if (std::fabs(delta - 1.0) < 1e-15)
+            break;
+    }
+    return 1.0 - std::exp(logPrefix) * h;
+}
+
+/*
+ * Rates of the discrete gamma categories at the category medians, normalized
+ * to a mean of one, as BEAST's GammaSiteRateModel computes them.
+ */
+static void gammaCategoryRates(double alpha, std::vector<double>& rates) {
+    rates.resize(GAMMA_CATEGORY_COUNT);
+    double sum = 0.0;
+    for (int k = 0; k < GAMMA_CATEGORY_COUNT; k++) {
+        const double p = (2.0 * k + 1.0) / (2.0 * GAMMA_CATEGORY_COUNT);
+        double lower = 0.0;
+        double upper = alpha + 1.0;
+        while (incompleteGamma(alpha, upper) < p)
+            upper *= 2.0;
+        for (int i = 0; i < 200 && upper - lower > 1e-14 * upper; i++) {
+            const double middle = 0.5 * (lower + upper);
+            if (incompleteGamma(alpha, middle) < p)
+                lower = middle;
+            else
+                upper = middle;
+        }
+        rates[k] = 0.5 * (lower + upper);
+        sum += rates[k];
+    }
+    for (int k = 0; k < GAMMA_CATEGORY_COUNT; k++)
+        rates[k] *= GAMMA_CATEGORY_COUNT / sum;
+}
+
+static double normalQuantile(double p) {
+    double lower = -40.0;
+    double upper = 40.0;
+    for (int i = 0; i < 200 && upper - lower > 1e-14; i++) {
+        const double middle = 0.5 * (lower + upper);
+        if (0.5 * std::erfc(-middle / std::sqrt(2.0)) < p)
+            lower = middle;
+        else
+            upper = middle;
+    }
+    return 0.5 * (lower + upper);
+}
+
+// rates of the categories of a lognormal distribution with mean one, normalized to a mean of one
+static void discretizedLogNormalRates(int count, double stdev, std::vector<double>& rates) {
+    rates.resize(count);
+    double sum = 0.0;
+    for (int k = 0; k < count; k++) {
+        rates[k] = std::exp(-0.5 * stdev * stdev + stdev * normalQuantile((k + 0.5) / count));
+        sum += rates[k];
+    }
+    for (int k = 0; k < count; k++)
+        rates[k] *= count / sum;
+}
+
+static void updateModel(SubstitutionModel& model, const Partition& partition, bool codon) {
+    std::vector<double> exchangeabilities;
+    if (codon)
+        codonExchangeabilities(model.kappa, model.omega, exchangeabilities);
+    else
+        hkyExchangeabilities(model.kappa, exchangeabilities);
+    decomposeReversible((int) partition.frequencies.size(), exchangeabilities, partition.frequencies, model);
+    gammaCategoryRates(model.alpha, model.categoryRates);
+}
+
+static void initTree(int tipCount, Tree& tree) {
+    tree.tipCount = tipCount;
+    tree.nodeCount = 2 * tipCount - 1;
+    tree.root = tree.nodeCount - 1;
+    tree.parent.assign(tree.nodeCount, -1);
+    tree.children.assign(2 * tree.nodeCount, -1);
+    tree.height.assign(tree.nodeCount, 0.0);
+    tree.clockRate = 1.0;
+    tree.rateStdev = 0.0;
+}
+
+static void joinNodes(Tree& tree, int node, int child1, int child2, double height) {
+    tree.children[2 * node] = child1;
+    tree.children[2 * node + 1] = child2;
+    tree.parent[child1] = node;
+    tree.parent[child2] = node;
+    tree.height[node] = std::max(height, std::max(tree.height[child1], tree.height[child2]));
+}
+
+/*
+ * UPGMA tree of the JC distances between the nucleotide sequences, over the
+ * sites where both are unambiguous.
+ */
+static void upgmaTree(const std::vector<Partition>& partitions, Tree& tree) {
+    const int tipCount = (int) partitions[0].tipStates.size();
+    initTree(tipCount, tree);
+
+    std::vector<std::vector<unsigned char> > states(tipCount);
+    std::vector<int> weights;
+    for (size_t p = 0; p < partitions.size(); p++) {
+        for (int t = 0; t < tipCount; t++)
+            states[t].insert(states[t].end(), partitions[p].tipStates[t].begin(), partitions[p].tipStates[t].end());
+        for (int k = 0; k < partitions[p].patternCount; k++)
+            weights.push_back((int) partitions[p].patternWeights[k]);
+    }
+    const int patternCount = (int) weights.size();
+
+    std::vector<double> distance(tipCount * tipCount, 0.0);
+    for (int a = 0; a < tipCount; a++) {
+        const unsigned char* sa = &states[a][0];
+        for (int b = a + 1; b < tipCount; b++) {
+            const unsigned char* sb = &states[b][0];
+            int known = 0;
+            int differ = 0;
+            for (int k = 0; k < patternCount; k++) {
+                const int both = (sa[k] < NUCLEOTIDE_STATE_COUNT) & (sb[k] < NUCLEOTIDE_STATE_COUNT);
+                known += weights[k] * both;
+                differ += weights[k] * (both & (sa[k] != sb[k]));
+            }
+            const double p = (known > 0 ? (double) differ / known : 0.0);
+            const double x = 1.0 - 4.0 * p / 3.0;
+            const double d = (x > 0.0 ? std::min(-0.75 * std::log(x), UPGMA_MAX_DISTANCE) : UPGMA_MAX_DISTANCE);
+            distance[a * tipCount + b] = distance[b * tipCount + a] = d;
+        }
+    }
+
+    std::vector<int> clusterNode(tipCount);
+    std::vector<int> clusterSize(tipCount, 1);
+    std::vector<int> active(tipCount);
+    for (int t = 0; t < tipCount; t++)
+        clusterNode[t] = active[t] = t;
+
+    for (int node = tipCount; node < tree.nodeCount; node++) {
+        int bestI = 0;
+        int bestJ = 1;
+        double best = distance[active[0] * tipCount + active[1]];
+        for (size_t i = 0; i < active.size(); i++) {
+            const double* row = &distance[active[i] * tipCount];
+            for (size_t j = i + 1; j < active.size(); j++) {
+                if (row[active[j]] < best) {
+                    best = row[active[j]];
+                    bestI = (int) i;
+                    bestJ = (int) j;
+                }
+            }
+        }
+
+        const int ci = active[bestI];
+        const int cj = active[bestJ];
+        joinNodes(tree, node, clusterNode[ci], clusterNode[cj], 0.5 * best);
+
+        for (size_t k = 0; k < active.size(); k++) {
+            const int ck = active[k];
+            if (ck == ci || ck == cj)
+                continue;
+            const double merged = (clusterSize[ci] * distance[ci * tipCount + ck] +
+                                   clusterSize[cj] * distance[cj * tipCount + ck]) /
+                                  (clusterSize[ci] + clusterSize[cj]);
+            distance[ci * tipCount + ck] = distance[ck * tipCount + ci] = merged;
+        }
+        clusterNode[ci] = node;
+        clusterSize[ci] += clusterSize[cj];
+        active.erase(active.begin() + bestJ);
+    }
+    tree.root = tree.nodeCount - 1;
+}
+
+// coalescent tree of random pairs, for a quick start
+static void randomTree(int tipCount, std::mt19937& rng, Tree& tree) {
+    initTree(tipCount, tree);
+    std::vector<int> active(tipCount);
+    for (int t = 0; t < tipCount; t++)
+        active[t] = t;
+
+    double height = 0.0;
+    for (int node = tipCount; node < tree.nodeCount; node++) {
+        const double lineages = (double) active.size();
+        height += std::exponential_distribution<double>(lineages * (lineages - 1.0) / 2.0)(rng) * RANDOM_TREE_SCALE;
+        const int i = randomInteger(rng, (int) active.size());
+        int j = randomInteger(rng, (int) active.size() - 1);
+        if (j >= i)
+            j++;
+        joinNodes(tree, node, active[i], active[j], height);
+        active[std::min(i, j)] = node;
+        active.erase(active.begin() + std::max(i, j));
+    }
+    tree.root = tree.nodeCount - 1;
+}
+
+static void setBranchRates(Tree& tree, double stdev) {
+    tree.rateStdev = stdev;
+    discretizedLogNormalRates(tree.nodeCount - 1, stdev, tree.categoryRates);
+}
+
+static double branchLength(const Tree& tree, int node) {
+    double rate = tree.clockRate;
+    if (!tree.categoryRates.empty())
+        rate *= tree.categoryRates[tree.rateCategory[node]];
+    return (tree.height[tree.parent[node]] - tree.height[node]) * rate;
+}
+
+static int sibling(const Tree& tree, int node) {
+    const int parent = tree.parent[node];
+    return (tree.children[2 * parent] == node ? tree.children[2 * parent + 1] : tree.children[2 * parent]);
+}
+
+static void replaceChild(Tree& tree, int node, int oldChild, int newChild) {
+    if (tree.children[2 * node] == oldChild)
+        tree.children[2 * node] = newChild;
+    else
+        tree.children[2 * node + 1] = newChild;
+    if (newChild != -1)
+        tree.parent[newChild] = node;
+}
+
+static int randomNonRoot(const Tree& tree, std::mt19937& rng, bool internalOnly) {
+    while (true) {
+        const int node = (internalOnly ? tree.tipCount + randomInteger(rng, tree.tipCount - 1) :
+                                         randomInteger(rng, tree.nodeCount));
+        if (node != tree.root)
+            return node;
+    }
+}
+
+/*
+ * Marks the matrix of the edge above node and the partials of its ancestors.
+ * Every marked node has its path to the root marked, so the walk stops at
+ * the first ancestor already marked.
+ */
+static void invalidateEdge(const Tree& tree, Changes& changes, int node) {
+    changes.matrices[node] = 1;
+    for (int ancestor = tree.parent[node]; ancestor != -1 && !changes.partials[ancestor];
+         ancestor = tree.parent[ancestor])
+        changes.partials[ancestor] = 1;
+}
+
+static void invalidateHeight(const Tree& tree, Changes& changes, int node) {
+    invalidateEdge(tree, changes, tree.children[2 * node]);
+    invalidateEdge(tree, changes, tree.children[2 * node + 1]);
+    if (node != tree.root)
+        invalidateEdge(tree, changes, node);
+    else
+        changes.partials[node] = 1;
+}
+
+static void invalidateAll(const Tree& tree, Changes& changes) {
+    std::fill(changes.matrices.begin(), changes.matrices.end(), 1);
+    std::fill(changes.partials.begin() + tree.tipCount, changes.partials.end(), 1);
+}
+
+// detaches node and its parent from the tree; returns the former sibling of node
+static int pruneSubtree(Tree& tree, int node) {
+    const int parent = tree.parent[node];
+    const int other = sibling(tree, node);
+    const int grandparent = tree.parent[parent];
+    if (grandparent == -1) {
+        tree.root = other;
+        tree.parent[other] = -1;
+    } else {
+        replaceChild(tree, grandparent, parent, other);
+    }
+    replaceChild(tree, parent, other, -1);
+    tree.parent[parent] = -1;
+    return other;
+}
+
+// reattaches the parent of a pruned node on the edge above target, at height
+static void regraftSubtree(Tree& tree, int node, int target, double height) {
+    const int parent = tree.parent[node];
+    const int targetParent = tree.parent[target];
+    if (targetParent == -1) {
+        tree.root = parent;
+        tree.parent[parent] = -1;
+    } else {
+        replaceChild(tree, targetParent, target, parent);
+    }
+    replaceChild(tree, parent, -1, target);
+    tree.height[parent] = height;
+}
+
+// nodes of the tree whose edge, or the space above the root, passes the given height range
+static void edgesAcross(const Tree& tree, double lower, double upper, std::vector<int>& nodes) {
+    nodes.clear();
+    std::vector<int> stack(1, tree.root);
+    while (!stack.empty()) {
+        const int node = stack.back();
+        stack.pop_back();
+        const double top = (node == tree.root ? HUGE_VAL : tree.height[tree.parent[node]]);
+        if (tree.height[node] < upper && top > lower)
+            nodes.push_back(node);
+        if (node >= tree.tipCount && tree.height[node] > lower) {
+            stack.push_back(tree.children[2 * node]);
+            stack.push_back(tree.children[2 * node + 1]);
+        }
+    }
+}
+
+static void invalidateRegraft(const Tree& tree, Changes& changes, int node, int oldSibling, int target) {
+    const int parent = tree.parent[node];
+    invalidateEdge(tree, changes, oldSibling);
+    invalidateEdge(tree, changes, target);
+    invalidateEdge(tree, changes, node);
+    if (parent != tree.root)
+        invalidateEdge(tree, changes, parent);
+    else
+        changes.partials[parent] = 1;
+}
+
+static void moveNodeHeight(Tree& tree, std::mt19937& rng, Changes& changes) {
+    const int node = randomNonRoot(tree, rng, true);
+    const double lower = std::max(tree.height[tree.children[2 * node]], tree.height[tree.children[2 * node + 1]]);
+    tree.height[node] = uniform(rng, lower, tree.height[tree.parent[node]]);
+    invalidateHeight(tree, changes, node);
+}
+
+// scales the part of the root height above its older child
+static void moveRootHeight(Tree& tree, std::mt19937& rng, Changes& changes) {
+    const int root = tree.root;
+    const double lower = std::max(tree.height[tree.children[2 * root]], tree.height[tree.children[2 * root + 1]]);
+    tree.height[root] = lower + (tree.height[root] - lower) * scaleFactor(rng);
+    invalidateHeight(tree, changes, root);
+}
+
+static void moveAllHeights(Tree& tree, std::mt19937& rng, Changes& changes) {
+    const double factor = scaleFactor(rng);
+    for (int node = tree.tipCount; node < tree.nodeCount; node++)
+        tree.height[node] *= factor;
+    tree.clockRate /= factor;
+    invalidateAll(tree, changes);
+}
+
+static bool moveNarrowExchange(Tree& tree, std::mt19937& rng, Changes& changes) {
+    for (int attempt = 0; attempt < EXCHANGE_ATTEMPTS; attempt++) {
+        const int node = randomNonRoot(tree, rng, true);
+        const int uncle = sibling(tree, node);
+        if (tree.height[uncle] >= tree.height[node])
+            continue;
+        const int parent = tree.parent[node];
+        const int child = tree.children[2 * node + randomInteger(rng, 2)];
+        replaceChild(tree, node, child, uncle);
+        replaceChild(tree, parent, uncle, child);
+        invalidateEdge(tree, changes, child);
+        invalidateEdge(tree, changes, uncle);
+        return true;
+    }
+    return false;
+}
+
+static bool moveWideExchange(Tree& tree, std::mt19937& rng, Changes& changes) {
+    for (int attempt = 0; attempt < EXCHANGE_ATTEMPTS; attempt++) {
+        const int i = randomNonRoot(tree, rng, false);
+        const int j = randomNonRoot(tree, rng, false);
+        const int pi = tree.parent[i];
+        const int pj = tree.parent[j];
+        // the heights also rule out one node being an ancestor of the other
+        if (i == j || pi == pj || tree.height[j] >= tree.height[pi] || tree.height[i] >= tree.height[pj])
+            continue;
+        replaceChild(tree, pi, i, j);
+        replaceChild(tree, pj, j, i);
+        invalidateEdge(tree, changes, i);
+        invalidateEdge(tree, changes, j);
+        return true;
+    }
+    return false;
+}
+
+// moves the parent of a random node by a gaussian step, across edges it passes
+static void moveSubtreeSlide(Tree& tree, std::mt19937& rng, Changes& changes) {
+    const int node = randomNonRoot(tree, rng, false);
+    const int parent = tree.parent[node];
+    double height = tree.height[parent] +
+                    std::normal_distribution<double>(0.0, std::max(SUBTREE_SLIDE_SIZE * tree.height[tree.root], 1e-10))(rng);
+    if (height < tree.height[node])
+        height = 2.0 * tree.height[node] - height;
+
+    const int oldSibling = pruneSubtree(tree, node);
+    std::vector<int> targets;
+    edgesAcross(tree, height, height, targets);
+    int target = oldSibling;
+    if (targets.empty())
+        height = std::max(height, tree.height[oldSibling]);
+    else
+        target = targets[randomInteger(rng, (int) targets.size())];
+    regraftSubtree(tree, node, target, height);
+    invalidateRegraft(tree, changes, node, oldSibling, target);
+}
+
+// regrafts the parent of a random node on a random edge above the node
+static void moveWilsonBalding(Tree& tree, std::mt19937& rng, Changes& changes) {
+    const int node = randomNonRoot(tree, rng, false);
+    const int oldSibling = pruneSubtree(tree, node);
+    std::vector<int> targets;
+    edgesAcross(tree, tree.height[node], HUGE_VAL, targets);
+    const int target = targets[randomInteger(rng, (int) targets.size())];
+    const double lower = std::max(tree.height[node], tree.height[target]);
+    const double upper = (target == tree.root ? lower + 0.1 * tree.height[target] : tree.height[tree.parent[target]]);
+    regraftSubtree(tree, node, target, uniform(rng, lower, upper));
+    invalidateRegraft(tree, changes, node, oldSibling, target);
+}
+
+/*
+ * New values of every model parameter, drawn around the starting values
+ * rather than walked from the current ones since the chain never rejects.
+ */
+static void moveModel(std::vector<SubstitutionModel>& models,
+                      const std::vector<SubstitutionModel>& startModels,
+                      const std::vector<Partition>& partitions,
+                      bool codon,
+                      const Tree& tree,
+                      std::mt19937& rng,
+                      Changes& changes) {
+    double weightedMu = 0.0;
+    double siteCount = 0.0;
+    for (size_t p = 0; p < models.size(); p++) {
+        models[p].kappa = startModels[p].kappa * scaleFactor(rng);
+        models[p].omega = startModels[p].omega * scaleFactor(rng);
+        models[p].alpha = startModels[p].alpha * scaleFactor(rng);
+        models[p].mu = startModels[p].mu * scaleFactor(rng);
+        weightedMu += models[p].mu * partitions[p].siteCount;
+        siteCount += partitions[p].siteCount;
+    }
+    // the relative rates of the partitions keep a mean of one over sites
+    for (size_t p = 0; p < models.size(); p++) {
+        models[p].mu *= siteCount / weightedMu;
+        updateModel(models[p], partitions[p], codon);
+    }
+    changes.models = true;
+    invalidateAll(tree, changes);
+}
+
+static void moveBranchRate(Tree& tree, std::mt19937& rng, Changes& changes) {
+    const int node = randomNonRoot(tree, rng, false);
+    tree.rateCategory[node] = randomInteger(rng, (int) tree.categoryRates.size());
+    invalidateEdge(tree, changes, node);
+}
+
+static void moveBranchRateSwap(Tree& tree, std::mt19937& rng, Changes& changes) {
+    const int i = randomNonRoot(tree, rng, false);
+    const int j = randomNonRoot(tree, rng, false);
+    std::swap(tree.rateCategory[i], tree.rateCategory[j]);
+    invalidateEdge(tree, changes, i);
+    invalidateEdge(tree, changes, j);
+}
+
+static void moveBranchRateSpread(Tree& tree, double startStdev, std::mt19937& rng, Changes& changes) {
+    setBranchRates(tree, startStdev * scaleFactor(rng));
+    invalidateAll(tree, changes);
+}
+
+static bool createLikelihood(const BenchOptions& options,
+                             const std::vector<Partition>& partitions,
+                             Likelihood& likelihood) {
+    const int partitionCount = (int) partitions.size();
+    const int tipCount = (int) partitions[0].tipStates.size();
+    const int internalCount = tipCount - 1;
+
+    likelihood.partitioned = (options.partitioned && partitionCount > 1);
+    likelihood.stateCount = (int) partitions[0].frequencies.size();
+    likelihood.tipCount = tipCount;
+    likelihood.nodeCount = 2 * tipCount - 1;
+    likelihood.totalPatternCount = 0;
+    for (int p = 0; p < partitionCount; p++)
+        likelihood.totalPatternCount += partitions[p].patternCount;
+    likelihood.memory = 0;
+    likelihood.matrixCount = 0;
+    likelihood.operationCount = 0;
+    likelihood.partialsCount = 0.0;
+
+    const int instanceCount = (likelihood.partitioned ? 1 : partitionCount);
+    const int modelCount = (likelihood.partitioned ? partitionCount : 1);
+    for (int i = 0; i < instanceCount; i++) {
+        std::vector<const Partition*> members;
+        if (likelihood.partitioned) {
+            for (int p = 0; p < partitionCount; p++)
+                members.push_back(&partitions[p]);
+        } else {
+            members.push_back(&partitions[i]);
+        }
+
+        std::vector<double> patternWeights;
+        std::vector<int> patternPartitions;
+        for (size_t m = 0; m < members.size(); m++) {
+            patternWeights.insert(patternWeights.end(), members[m]->patternWeights.begin(),
+                                  members[m]->patternWeights.end());
+            patternPartitions.insert(patternPartitions.end(), members[m]->patternCount, (int) m);
+        }
+        const int patternCount = (int) patternWeights.size();
+
+        BeagleInstanceDetails details;
+        int resource = options.resource;
+        const int instance = beagleCreateInstance(tipCount, internalCount, tipCount, likelihood.stateCount,
+                                                  patternCount, modelCount, modelCount * likelihood.nodeCount,
+                                                  GAMMA_CATEGORY_COUNT, internalCount + 1, &resource, 1,
+                                                  options.preferenceFlags, options.requirementFlags, &details);
+        if (instance < 0) {
+            std::cerr << "Failed to obtain BEAGLE instance\n";
+            return false;
+        }
+        likelihood.instances.push_back(instance);
+        likelihood.implName = details.implName;
+        likelihood.flags = details.flags;
+
+        for (int t = 0; t < tipCount; t++) {
+            std::vector<int> states;
+            for (size_t m = 0; m < members.size(); m++)
+                states.insert(states.end(), members[m]->tipStates[t].begin(), members[m]->tipStates[t].end());
+            beagleSetTipStates(instance, t, &states[0]);
+        }
+        beagleSetPatternWeights(instance, &patternWeights[0]);
+        if (likelihood.partitioned &&
+            beagleSetPatternPartitions(instance, partitionCount, &patternPartitions[0]) != BEAGLE_SUCCESS) {
+            std::cerr << likelihood.implName << " does not support pattern partitions\n";
+            return false;
+        }
+
+        const std::vector<double> categoryWeights(GAMMA_CATEGORY_COUNT, 1.0 / GAMMA_CATEGORY_COUNT);
+        for (int m = 0; m < modelCount; m++) {
+            beagleSetCategoryWeights(instance, m, &categoryWeights[0]);
+            beagleSetStateFrequencies(instance, m, &members[m]->frequencies[0]);
+        }
+
+        BeagleMemoryUsage memory;
+        if (beagleGetInstanceMemoryUsage(instance, &memory) == BEAGLE_SUCCESS)
+            likelihood.memory += memory.total;
+    }
+    return true;
+}
+
+static void finalizeLikelihood(Likelihood& likelihood) {
+    for (size_t i = 0; i < likelihood.instances.size(); i++)
+        beagleFinalizeInstance(likelihood.instances[i]);
+    likelihood.instances.clear();
+}
+
+static void setModels(Likelihood& likelihood, const std::vector<SubstitutionModel>& models) {
+    for (size_t p = 0; p < models.size(); p++) {
+        const int instance = likelihood.instances[likelihood.partitioned ? 0 : p];
+        const int index = (likelihood.partitioned ? (int) p : 0);
+        beagleSetEigenDecomposition(instance, index, &models[p].eigenVectors[0],
+                                    &models[p].inverseEigenVectors[0], &models[p].eigenValues[0]);
+        if (likelihood.partitioned)
+            beagleSetCategoryRatesWithIndex(instance, index, &models[p].categoryRates[0]);
+        else
+            beagleSetCategoryRates(instance, &models[p].categoryRates[0]);
+    }
+}
+
+// invalidated internal nodes, children before parents
+static void invalidatedPostOrder(const Tree& tree, const Changes& changes, std::vector<int>& order) {
+    order.clear();
+    std::vector<int> stack(1, tree.root);
+    while (!stack.empty()) {
+        const int node = stack.back();
+        stack.pop_back();
+        if (node < tree.tipCount || !changes.partials[node])
+            continue;
+        order.push_back(node);
+        stack.push_back(tree.children[2 * node]);
+        stack.push_back(tree.children[2 * node + 1]);
+    }
+    std::reverse(order.begin(), order.end());
+}
+
+/*
+ * Recomputes what the last moves invalidated and returns the log likelihood.
+ * Every operation rescales, and the cumulative scale factors are summed
+ * again over all internal nodes.
+ */
+static double evaluate(Likelihood& likelihood,
+                       const std::vector<SubstitutionModel>& models,
+                       const Tree& tree,
+                       Changes& changes) {
+    const int partitionCount = (int) models.size();
+    const int nodeCount = likelihood.nodeCount;
+    const int internalCount = likelihood.tipCount - 1;
+    const int cumulativeIndex = internalCount;
+
+    if (changes.models)
+        setModels(likelihood, models);
+
+    std::vector<int> nodes;
+    std::vector<double> lengths;
+    for (int node = 0; node < nodeCount; node++) {
+        if (node != tree.root && changes.matrices[node]) {
+            nodes.push_back(node);
+            lengths.push_back(branchLength(tree, node));
+        }
+    }
+    const int matrixCount = (int) nodes.size();
+
+    std::vector<int> order;
+    invalidatedPostOrder(tree, changes, order);
+
+    double logL = 0.0;
+    if (likelihood.partitioned) {
+        const int instance = likelihood.instances[0];
+        if (matrixCount > 0) {
+            std::vector<int> modelIndices(matrixCount * partitionCount);
+            std::vector<int> matrixIndices(matrixCount * partitionCount);
+            std::vector<double> edgeLengths(matrixCount * partitionCount);
+            for (int p = 0; p < partitionCount; p++) {
+                for (int k = 0; k < matrixCount; k++) {
+                    modelIndices[p * matrixCount + k] = p;
+                    matrixIndices[p * matrixCount + k] = p * nodeCount + nodes[k];
+                    edgeLengths[p * matrixCount + k] = lengths[k] * models[p].mu;
+                }
+            }
+            beagleUpdateTransitionMatricesWithMultipleModels(instance, &modelIndices[0], &modelIndices[0],
+                                                             &matrixIndices[0], NULL, NULL, &edgeLengths[0],
+                                                             matrixCount * partitionCount);
+        }
+
+        if (!order.empty()) {
+            std::vector<BeagleOperationByPartition> operations;
+            for (size_t k = 0; k < order.size(); k++) {
+                const int node = order[k];
+                const int child1 = tree.children[2 * node];
+                const int child2 = tree.children[2 * node + 1];
+                for (int p = 0; p < partitionCount; p++) {
+                    BeagleOperationByPartition operation = {node, node - likelihood.tipCount, BEAGLE_OP_NONE,
+                                                            child1, p * nodeCount + child1,
+                                                            child2, p * nodeCount + child2,
+                                                            p, BEAGLE_OP_NONE};
+                    operations.push_back(operation);
+                }
+            }
+            beagleUpdatePartialsByPartition(instance, &operations[0], (int) operations.size());
+        }
+    } else {
+        std::vector<BeagleOperation> operations;
+        for (size_t k = 0; k < order.size(); k++) {
+            const int node = order[k];
+            const int child1 = tree.children[2 * node];
+            const int child2 = tree.children[2 * node + 1];
+            BeagleOperation operation = {node, node - likelihood.tipCount, BEAGLE_OP_NONE,
+                                         child1, child1, child2, child2};
+            operations.push_back(operation);
+        }
+
+        for (int p = 0; p < partitionCount; p++) {
+            const int instance = likelihood.instances[p];
+            if (matrixCount > 0) {
+                std::vector<double> edgeLengths(lengths);
+                for (int k = 0; k < matrixCount; k++)
+                    edgeLengths[k] *= models[p].mu;
+                beagleUpdateTransitionMatrices(instance, 0, &nodes[0], NULL, NULL, &edgeLengths[0], matrixCount);
+            }
+            if (!operations.empty())
+                beagleUpdatePartials(instance, &operations[0], (int) operations.size(), BEAGLE_OP_NONE);
+        }
+    }
+
+    std::vector<int> scaleIndices(internalCount);
+    for (int i = 0; i < internalCount; i++)
+        scaleIndices[i] = i;
+    for (size_t i = 0; i < likelihood.instances.size(); i++) {
+        beagleResetScaleFactors(likelihood.instances[i], cumulativeIndex);
+        beagleAccumulateScaleFactors(likelihood.instances[i], &scaleIndices[0], internalCount, cumulativeIndex);
+    }
+
+    if (likelihood.partitioned) {
+        std::vector<int> rootIndices(partitionCount, tree.root);
+        std::vector<int> modelIndices(partitionCount);
+        std::vector<int> cumulativeIndices(partitionCount, cumulativeIndex);
+        std::vector<double> partitionLogL(partitionCount);
+        for (int p = 0; p < partitionCount; p++)
+            modelIndices[p] = p;
+        beagleCalculateRootLogLikelihoodsByPartition(likelihood.instances[0], &rootIndices[0], &modelIndices[0],
+                                                     &modelIndices[0], &cumulativeIndices[0], &modelIndices[0],
+                                                     partitionCount, 1, &partitionLogL[0], &logL);
+    } else {
+        const int zero = 0;
+        for (int p = 0; p < partitionCount; p++) {
+            double partitionLogL = 0.0;
+            beagleCalculateRootLogLikelihoods(likelihood.instances[p], &tree.root, &zero, &zero,
+                                              &cumulativeIndex, 1, &partitionLogL);
+            logL += partitionLogL;
+        }
+    }
+
+    likelihood.matrixCount += (long) matrixCount * partitionCount;
+    likelihood.operationCount += (long) order.size() * partitionCount;
+    likelihood.partialsCount += (double) order.size() * likelihood.totalPatternCount *
+                                likelihood.stateCount * GAMMA_CATEGORY_COUNT;
+
+    changes.models = false;
+    std::fill(changes.matrices.begin(), changes.matrices.end(), 0);
+    std::fill(changes.partials.begin(), changes.partials.end(), 0);
+    return logL;
+}
+
+static double secondsSince(const std::chrono::steady_clock::time_point& start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void helpMessage() {
+    std::cerr << "Usage:\n\n";
+    std::cerr << "denguebench [--help] [--nexus <file>] [--model nucleotide|codon] [--partitioned] [--taxa <integer>] [--moves <integer>] [--randomtree] [--seed <integer>] [--rsrc <integer>] [--singleprecision] [--disablevector] [--enablethreads]\n\n";
+    std::cerr << "--nexus gives the Dengue997 alignment (Dengue997.nex in the current directory by default); --taxa keeps only its first taxa\n\n";
+    std::cerr << "The nucleotide model has one HKY+G4 model per gene and one instance per gene, or a single instance with a pattern partition per gene with --partitioned; the codon model has one Goldman-Yang+G4 model over the codons of all genes with discretized lognormal branch rates\n\n";
+    std::cerr << "The starting tree is the UPGMA tree of the alignment, or a random coalescent tree with --randomtree; --moves MCMC moves (1000 by default) are then made with the operator weights of the BEAST analysis and the likelihood is updated after each\n\n";
+    std::cerr << "Compact tip states are used, so ambiguous nucleotides are treated as missing data\n\n";
+    std::exit(0);
+}
+
+int main(int argc, const char* argv[]) {
+    BenchOptions options;
+    options.nexusFile = "Dengue997.nex";
+    options.codon = false;
+    options.partitioned = false;
+    options.randomTree = false;
+    options.taxonCount = 0;
+    options.moveCount = 1000;
+    options.resource = 0;
+    options.seed = 1;
+    bool singlePrecision = false;
+    bool disableVector = false;
+    bool enableThreads = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        const bool hasValue = (i + 1 < argc);
+        if (option == "--help") {
+            helpMessage();
+        } else if (option == "--nexus" && hasValue) {
+            options.nexusFile = argv[++i];
+        } else if (option == "--model" && hasValue) {
+            std::string model = argv[++i];
+            if (model == "codon") {
+                options.codon = true;
+            } else if (model != "nucleotide") {
+                std::cerr << "Unknown model: " << model << "\n\n";
+                helpMessage();
+            }
+        } else if (option == "--partitioned") {
+            options.partitioned = true;
+        } else if (option == "--taxa" && hasValue) {
+            options.taxonCount = atoi(argv[++i]);
+        } else if (option == "--moves" && hasValue) {
+            options.moveCount = atoi(argv[++i]);
+        } else if (option == "--randomtree") {
+            options.randomTree = true;
+        } else if (option == "--seed" && hasValue) {
+            options.seed = (unsigned int) atoi(argv[++i]);
+        } else if (option == "--rsrc" && hasValue) {
+            options.resource = atoi(argv[++i]);
+        } else if (option == "--singleprecision") {
+            singlePrecision = true;
+        } else if (option == "--doubleprecision") {
+            singlePrecision = false;
+        } else if (option == "--disablevector") {
+            disableVector = true;
+        } else if (option == "--enablethreads") {
+            enableThreads = true;
+        } else {
+            std::cerr << "Unknown option: " << option << "\n\n";
+            helpMessage();
+        }
+    }
+
+    options.preferenceFlags = (enableThreads ? BEAGLE_FLAG_THREADING_CPP : 0);
+    options.requirementFlags = BEAGLE_FLAG_SCALING_MANUAL |
+                               (singlePrecision ? BEAGLE_FLAG_PRECISION_SINGLE : BEAGLE_FLAG_PRECISION_DOUBLE) |
+                               (disableVector ? BEAGLE_FLAG_VECTOR_NONE : 0);
+    if (options.moveCount < 0)
+        options.moveCount = 0;
+
+    Alignment alignment;
+    if (!readNexus(options.nexusFile, alignment))
+        return 1;
+    if (options.taxonCount > 0 && options.taxonCount < (int) alignment.names.size()) {
+        alignment.names.resize(options.taxonCount);
+        alignment.sequences.resize(options.taxonCount);
+    }
+    const int tipCount = (int) alignment.names.size();
+    size_t siteCount = alignment.sequences[0].size();
+    for (int t = 1; t < tipCount; t++)
+        siteCount = std::min(siteCount, alignment.sequences[t].size());
+    if (tipCount < 4) {
+        std::cerr << "At least 4 taxa are needed\n";
+        return 1;
+    }
+    if ((int) siteCount < dengueGenes[DENGUE_GENE_COUNT - 1].lastSite) {
+        std::cerr << options.nexusFile << " has " << siteCount << " sites, the Dengue genes span "
+                  << dengueGenes[DENGUE_GENE_COUNT - 1].lastSite << "\n";
+        return 1;
+    }
+
+    std::vector<Partition> nucleotidePartitions;
+    for (int g = 0; g < DENGUE_GENE_COUNT; g++)
+        nucleotidePartitions.push_back(nucleotidePartition(alignment, dengueGenes[g]));
+
+    std::vector<Partition> partitions;
+    if (options.codon)
+        partitions.push_back(codonPartition(alignment));
+    else
+        partitions = nucleotidePartitions;
+
+    int patternCount = 0;
+    for (size_t p = 0; p < partitions.size(); p++)
+        patternCount += partitions[p].patternCount;
+
+    std::cout << options.nexusFile << ": " << tipCount << " taxa, " << siteCount << " sites\n";
+    if (options.codon)
+        std::cout << "Model: codon, Goldman-Yang+G4 with discretized lognormal branch rates, "
+                  << partitions[0].siteCount << " codons, " << patternCount << " patterns\n";
+    else
+        std::cout << "Model: nucleotide, " << partitions.size() << " genes under HKY+G4, "
+                  << patternCount << " patterns\n";
+
+    std::mt19937 rng(options.seed);
+
+    Tree tree;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (options.randomTree)
+        randomTree(tipCount, rng, tree);
+    else
+        upgmaTree(nucleotidePartitions, tree);
+    std::cout << "Starting tree: " << (options.randomTree ? "random" : "UPGMA") << ", root height "
+              << tree.height[tree.root] << " (" << std::fixed << std::setprecision(3)
+              << secondsSince(start) << " s)\n";
+    std::cout.unsetf(std::ios::floatfield);
+    std::cout << std::setprecision(6);
+
+    // starting values of the XML inputs
+    const double startRateStdev = 1.0 / 3.0;
+    if (options.codon) {
+        tree.rateCategory.resize(tree.nodeCount);
+        setBranchRates(tree, startRateStdev);
+        for (int node = 0; node < tree.nodeCount; node++)
+            tree.rateCategory[node] = randomInteger(rng, (int) tree.categoryRates.size());
+    }
+
+    std::vector<SubstitutionModel> startModels(partitions.size());
+    for (size_t p = 0; p < partitions.size(); p++) {
+        startModels[p].kappa = 2.0;
+        startModels[p].omega = 0.5;
+        startModels[p].alpha = 0.5;
+        startModels[p].mu = 1.0;
+        updateModel(startModels[p], partitions[p], options.codon);
+    }
+    std::vector<SubstitutionModel> models(startModels);
+
+    Likelihood likelihood;
+    if (!createLikelihood(options, partitions, likelihood))
+        return 1;
+    std::cout << "Implementation: " << likelihood.implName << ", "
+              << (options.codon ? "one instance" :
+                  (likelihood.partitioned ? "one partitioned instance" : "one instance per gene"))
+              << ", " << likelihood.memory / (1024 * 1024) << " MB\n";
+
+    Changes changes;
+    changes.models = true;
+    changes.matrices.assign(tree.nodeCount, 0);
+    changes.partials.assign(tree.nodeCount, 0);
+    invalidateAll(tree, changes);
+
+    start = std::chrono::steady_clock::now();
+    double logL = evaluate(likelihood, models, tree, changes);
+    const double fullTime = secondsSince(start);
+    std::cout << "Starting lnL: " << std::setprecision(10) << logL << std::setprecision(6)
+              << " (full evaluation " << std::fixed << std::setprecision(3) << fullTime * 1000.0 << " ms)\n\n";
+    std::cout.unsetf(std::ios::floatfield);
+
+    const double* moveWeights = (options.codon ? codonMoveWeights : nucleotideMoveWeights);
+    std::discrete_distribution<int> moveDistribution(moveWeights, moveWeights + MOVE_TYPE_COUNT);
+
+    std::vector<int> moveCounts(MOVE_TYPE_COUNT, 0);
+    std::vector<long> moveMatrices(MOVE_TYPE_COUNT, 0);
+    std::vector<long> moveOperations(MOVE_TYPE_COUNT, 0);
+    std::vector<double> moveTimes(MOVE_TYPE_COUNT, 0.0);
+    const long startMatrices = likelihood.matrixCount;
+    const long startOperations = likelihood.operationCount;
+    const double startPartials = likelihood.partialsCount;
+    double totalTime = 0.0;
+
+    for (int m = 0; m < options.moveCount; m++) {
+        int move = moveDistribution(rng);
+        switch (move) {
+            case MOVE_NODE_HEIGHT:
+                moveNodeHeight(tree, rng, changes);
+                break;
+            case MOVE_ROOT_HEIGHT:
+                moveRootHeight(tree, rng, changes);
+                break;
+            case MOVE_SUBTREE_SLIDE:
+                moveSubtreeSlide(tree, rng, changes);
+                break;
+            case MOVE_NARROW_EXCHANGE:
+                if (!moveNarrowExchange(tree, rng, changes)) {
+                    move = MOVE_NODE_HEIGHT;
+                    moveNodeHeight(tree, rng, changes);
+                }
+                break;
+            case MOVE_WIDE_EXCHANGE:
+                if (!moveWideExchange(tree, rng, changes)) {
+                    move = MOVE_NODE_HEIGHT;
+                    moveNodeHeight(tree, rng, changes);
+                }
+                break;
+            case MOVE_WILSON_BALDING:
+                moveWilsonBalding(tree, rng, changes);
+                break;
+            case MOVE_ALL_HEIGHTS:
+                moveAllHeights(tree, rng, changes);
+                break;
+            case MOVE_MODEL:
+                moveModel(models, startModels, partitions, options.codon, tree, rng, changes);
+                break;
+            case MOVE_BRANCH_RATE:
+                moveBranchRate(tree, rng, changes);
+                break;
+            case MOVE_BRANCH_RATE_SWAP:
+                moveBranchRateSwap(tree, rng, changes);
+                break;
+            case MOVE_BRANCH_RATE_SPREAD:
+                moveBranchRateSpread(tree, startRateStdev, rng, changes);
+                break;
+        }
+
+        const long matrices = likelihood.matrixCount;
+        const long operations = likelihood.operationCount;
+        start = std::chrono::steady_clock::now();
+        logL = evaluate(likelihood, models, tree, changes);
+        const double time = secondsSince(start);
+
+        moveCounts[move]++;
+        moveMatrices[move] += likelihood.matrixCount - matrices;
+        moveOperations[move] += likelihood.operationCount - operations;
+        moveTimes[move] += time;
+        totalTime += time;
+    }
+
+    std::cout << std::left << std::setw(20) << "move" << std::right << std::setw(8) << "count"
+              << std::setw(12) << "matrices" << std::setw(12) << "partials" << std::setw(12) << "ms/move" << "\n";
+    std::cout << std::fixed;
+    for (int move = 0; move < MOVE_TYPE_COUNT; move++) {
+        if (moveCounts[move] == 0)
+            continue;
+        std::cout << std::left << std::setw(20) << moveNames[move] << std::right << std::setw(8) << moveCounts[move]
+                  << std::setprecision(1)
+                  << std::setw(12) << (double) moveMatrices[move] / moveCounts[move]
+                  << std::setw(12) << (double) moveOperations[move] / moveCounts[move]
+                  << std::setprecision(3)
+                  << std::setw(12) << moveTimes[move] * 1000.0 / moveCounts[move] << "\n";
+    }
+    std::cout << "\n";
+
+    if (options.moveCount > 0) {
+        const double partials = likelihood.partialsCount - startPartials;
+        std::cout << "Moves: " << options.moveCount << " in " << std::setprecision(3) << totalTime << " s, "
+                  << totalTime * 1000.0 / options.moveCount << " ms/move\n";
+        std::cout << "Work: " << std::setprecision(1)
+                  << (double) (likelihood.matrixCount - startMatrices) / options.moveCount << " matrices and "
+                  << (double) (likelihood.operationCount - startOperations) / options.moveCount
+                  << " partials operations per move\n";
+        std::cout << "Throughput: " << std::setprecision(2)
+                  << (totalTime > 0.0 ? partials / totalTime / 1000000.0 : 0.0) << " M partials/second\n";
+    }
+    std::cout.unsetf(std::ios::floatfield);
+
+    // the updates after each move must leave what a full evaluation computes
+    const double updatedLogL = logL;
+    changes.models = true;
+    invalidateAll(tree, changes);
+    const double fullLogL = evaluate(likelihood, models, tree, changes);
+    std::cout << "Final lnL: " << std::setprecision(10) << updatedLogL << " (full evaluation " << fullLogL << ")\n";
+
+    finalizeLikelihood(likelihood);
+
+    if (!(std::fabs(updatedLogL - fullLogL) <= 1e-6 * std::fabs(fullLogL))) {
+        std::cerr << "Updated and full log likelihoods differ\n";
+        return 1;
+    }
+    return 0;
+}
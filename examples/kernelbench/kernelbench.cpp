@@ -0,0 +1,678 @@
+/*
+ *  kernelbench.cpp
+ *  BEAGLE
+ *
+ *  Times the individual likelihood kernels of each CPU implementation over a
+ *  sweep of state, category and pattern counts. Each kernel is driven by a
+ *  single-operation call and timed by the performance counters of the
+ *  instance, so the call overhead is left out.
+ *
+ *  With --roofline, the peak memory bandwidth and multiply-add throughput of
+ *  the host are measured first and each kernel is placed on the roofline its
+ *  flop and byte counts give. With --perf, the cycles, instructions and cache
+ *  misses of the calling thread are read from the hardware counters on Linux.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+    #include <linux/perf_event.h>
+    #include <sys/ioctl.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+#include "libhmsbeagle/beagle.h"
+
+// doubles in each array of the bandwidth measurement, well beyond the caches
+#define ROOFLINE_BANDWIDTH_LENGTH (1 << 23)
+// passes over the accumulators of the multiply-add measurement
+#define ROOFLINE_FLOP_ITERATIONS  (1 << 22)
+#define ROOFLINE_REPLICATES       3
+
+struct RooflinePeaks {
+    double bandwidth;       // GB/s
+    double doubleGflops;    // GFLOP/s
+    double singleGflops;
+};
+
+struct BenchOptions {
+    std::vector<int> stateCounts;
+    std::vector<int> categoryCounts;
+    std::vector<int> patternCounts;
+    std::vector<long> precisionFlags;
+    std::vector<long> vectorFlags;
+    long threadingFlags;
+    int resource;
+    int nreps;
+    bool csv;
+    bool roofline;
+    bool perf;
+    RooflinePeaks peaks;
+};
+
+enum PerfEvents {
+    PERF_CYCLES = 0,
+    PERF_INSTRUCTIONS,
+    PERF_CACHE_MISSES,
+    PERF_EVENT_COUNT
+};
+
+enum BenchKernels {
+    BENCH_STATES_STATES = 0,
+    BENCH_STATES_PARTIALS,
+    BENCH_PARTIALS_PARTIALS,
+    BENCH_STATES_STATES_FIXED_SCALING,
+    BENCH_STATES_PARTIALS_FIXED_SCALING,
+    BENCH_PARTIALS_PARTIALS_FIXED_SCALING,
+    BENCH_RESCALE,
+    BENCH_ROOT_INTEGRATION,
+    BENCH_EDGE_INTEGRATION,
+    BENCH_TRANSITION_MATRICES,
+    BENCH_KERNEL_COUNT
+};
+
+static const char* kernelNames[BENCH_KERNEL_COUNT] = {
+    "states-states",
+    "states-partials",
+    "partials-partials",
+    "states-states-fixed-scaling",
+    "states-partials-fixed-scaling",
+    "partials-partials-fixed-scaling",
+    "rescale",
+    "root-integration",
+    "edge-integration",
+    "transition-matrices"
+};
+
+// the performance counter that times each benchmarked kernel
+static const int kernelCounters[BENCH_KERNEL_COUNT] = {
+    BEAGLE_KERNEL_STATES_STATES,
+    BEAGLE_KERNEL_STATES_PARTIALS,
+    BEAGLE_KERNEL_PARTIALS_PARTIALS,
+    BEAGLE_KERNEL_STATES_STATES,
+    BEAGLE_KERNEL_STATES_PARTIALS,
+    BEAGLE_KERNEL_PARTIALS_PARTIALS,
+    BEAGLE_KERNEL_RESCALE,
+    BEAGLE_KERNEL_ROOT_INTEGRATION,
+    BEAGLE_KERNEL_EDGE_INTEGRATION,
+    BEAGLE_KERNEL_TRANSITION_MATRICES
+};
+
+/*
+ * Buffers of the benchmark instance: compact tips 0 and 1, partials 2 = (0, 1),
+ * 3 = (0, 2) and 4 = (2, 3), one scale buffer and matrices 0 to 2.
+ */
+static const int tipCount = 2;
+static const int partialsBufferCount = 5;
+static const int matrixCount = 3;
+
+/*
+ * Runs work on threadCount threads at once and returns the seconds until the
+ * last one finishes.
+ */
+template <typename Work>
+static double timeThreads(int threadCount,
+                          Work work) {
+    std::vector<std::thread> threads;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 1; i < threadCount; i++)
+        threads.push_back(std::thread(work, i));
+    work(0);
+    for (size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// STREAM triad a = b + s * c, counting the three arrays once
+static double measureBandwidth(int threadCount) {
+    std::vector<double*> arrays(3);
+    for (int i = 0; i < 3; i++)
+        arrays[i] = new double[ROOFLINE_BANDWIDTH_LENGTH];
+    const int chunk = ROOFLINE_BANDWIDTH_LENGTH / threadCount;
+
+    // each thread first touches the part it streams, so that it is local to it
+    timeThreads(threadCount, [&arrays, chunk](int thread) {
+        for (int i = 0; i < 3; i++)
+            std::fill(arrays[i] + thread * chunk, arrays[i] + (thread + 1) * chunk, 1.0);
+    });
+
+    double best = 0.0;
+    for (int rep = 0; rep < ROOFLINE_REPLICATES; rep++) {
+        double time = timeThreads(threadCount, [&arrays, chunk](int thread) {
+            double* a = arrays[0] + thread * chunk;
+            const double* b = arrays[1] + thread * chunk;
+            const double* c = arrays[2] + thread * chunk;
+            for (int i = 0; i < chunk; i++)
+                a[i] = b[i] + 0.5 * c[i];
+        });
+        if (rep == 0 || time < best)
+            best = time;
+    }
+
+    for (int i = 0; i < 3; i++)
+        delete[] arrays[i];
+
+    return 3.0 * sizeof(double) * chunk * threadCount / best / 1e9;
+}
+
+// independent multiply-add chains, enough to fill the vector registers
+template <typename REALTYPE>
+static double measureGflops(int threadCount) {
+    const int accumulatorCount = 512 / sizeof(REALTYPE);
+    double best = 0.0;
+    for (int rep = 0; rep < ROOFLINE_REPLICATES; rep++) {
+        double time = timeThreads(threadCount, [](int thread) {
+            REALTYPE accumulators[accumulatorCount];
+            volatile REALTYPE factor = (REALTYPE) 0.999999;
+            const REALTYPE multiplier = factor;
+            const REALTYPE addend = (REALTYPE) 1e-7;
+            for (int j = 0; j < accumulatorCount; j++)
+                accumulators[j] = (REALTYPE) (j + thread);
+            for (long i = 0; i < ROOFLINE_FLOP_ITERATIONS; i++)
+                for (int j = 0; j < accumulatorCount; j++)
+                    accumulators[j] = accumulators[j] * multiplier + addend;
+            REALTYPE sum = 0;
+            for (int j = 0; j < accumulatorCount; j++)
+                sum += accumulators[j];
+            volatile REALTYPE result = sum;
+            (void) result;
+        });
+        if (rep == 0 || time < best)
+            best = time;
+    }
+    return 2.0 * accumulatorCount * ROOFLINE_FLOP_ITERATIONS * threadCount / best / 1e9;
+}
+
+/*
+ * Hardware counters of the calling thread; threads started by the library
+ * are not counted.
+ */
+struct PerfCounters {
+    int fds[PERF_EVENT_COUNT];
+
+    PerfCounters() {
+        for (int i = 0; i < PERF_EVENT_COUNT; i++)
+            fds[i] = -1;
+    }
+
+    ~PerfCounters() {
+#ifdef __linux__
+        for (int i = 0; i < PERF_EVENT_COUNT; i++)
+            if (fds[i] >= 0)
+                close(fds[i]);
+#endif
+    }
+
+    // returns false if the counters cannot be read on this host
+    bool open() {
+#ifdef __linux__
+        const unsigned long long configs[PERF_EVENT_COUNT] = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES
+        };
+        for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[i];
+            attr.disabled = (i == 0);
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fds[i] = syscall(__NR_perf_event_open, &attr, 0, -1, (i == 0 ? -1 : fds[0]), 0);
+            if (fds[i] < 0)
+                return false;
+        }
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void start() {
+#ifdef __linux__
+        ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+    }
+
+    void stop(long long* values) {
+#ifdef __linux__
+        ioctl(fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        for (int i = 0; i < PERF_EVENT_COUNT; i++)
+            if (read(fds[i], &values[i], sizeof(long long)) != sizeof(long long))
+                values[i] = 0;
+#endif
+    }
+};
+
+static int runKernel(int instance,
+                     int kernel) {
+    const int zero = 0;
+    const int none = BEAGLE_OP_NONE;
+    int returnValue;
+
+    switch (kernel) {
+        case BENCH_STATES_STATES:
+        case BENCH_STATES_STATES_FIXED_SCALING: {
+            const int scaleRead = (kernel == BENCH_STATES_STATES ? BEAGLE_OP_NONE : 0);
+            BeagleOperation operation = {2, BEAGLE_OP_NONE, scaleRead, 0, 0, 1, 1};
+            returnValue = beagleUpdatePartials(instance, &operation, 1, BEAGLE_OP_NONE);
+            break;
+        }
+        case BENCH_STATES_PARTIALS:
+        case BENCH_STATES_PARTIALS_FIXED_SCALING: {
+            const int scaleRead = (kernel == BENCH_STATES_PARTIALS ? BEAGLE_OP_NONE : 0);
+            BeagleOperation operation = {3, BEAGLE_OP_NONE, scaleRead, 0, 0, 2, 1};
+            returnValue = beagleUpdatePartials(instance, &operation, 1, BEAGLE_OP_NONE);
+            break;
+        }
+        case BENCH_PARTIALS_PARTIALS:
+        case BENCH_PARTIALS_PARTIALS_FIXED_SCALING: {
+            const int scaleRead = (kernel == BENCH_PARTIALS_PARTIALS ? BEAGLE_OP_NONE : 0);
+            BeagleOperation operation = {4, BEAGLE_OP_NONE, scaleRead, 2, 0, 3, 1};
+            returnValue = beagleUpdatePartials(instance, &operation, 1, BEAGLE_OP_NONE);
+            break;
+        }
+        case BENCH_RESCALE: {
+            BeagleOperation operation = {4, 0, BEAGLE_OP_NONE, 2, 0, 3, 1};
+            returnValue = beagleUpdatePartials(instance, &operation, 1, BEAGLE_OP_NONE);
+            break;
+        }
+        case BENCH_ROOT_INTEGRATION: {
+            const int rootIndex = 4;
+            double logL;
+            returnValue = beagleCalculateRootLogLikelihoods(instance, &rootIndex, &zero, &zero, &none, 1, &logL);
+            break;
+        }
+        case BENCH_EDGE_INTEGRATION: {
+            const int parentIndex = 4;
+            const int childIndex = 3;
+            const int firstDerivativeIndex = 1;
+            const int secondDerivativeIndex = 2;
+            double logL, firstDerivative, secondDerivative;
+            returnValue = beagleCalculateEdgeLogLikelihoods(instance, &parentIndex, &childIndex, &zero,
+                                                            &firstDerivativeIndex, &secondDerivativeIndex,
+                                                            &zero, &zero, &none, 1,
+                                                            &logL, &firstDerivative, &secondDerivative);
+            break;
+        }
+        case BENCH_TRANSITION_MATRICES: {
+            const int probabilityIndices[matrixCount] = {0, 1, 2};
+            const double edgeLengths[matrixCount] = {0.05, 0.1, 0.2};
+            returnValue = beagleUpdateTransitionMatrices(instance, 0, probabilityIndices, NULL, NULL,
+                                                         edgeLengths, matrixCount);
+            break;
+        }
+        default:
+            returnValue = BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+
+    return returnValue;
+}
+
+static void setInstanceData(int instance,
+                            int stateCount,
+                            int patternCount,
+                            int categoryCount) {
+    std::vector<int> states(patternCount);
+    for (int tip = 0; tip < tipCount; tip++) {
+        for (int i = 0; i < patternCount; i++)
+            states[i] = rand() % stateCount;
+        beagleSetTipStates(instance, tip, &states[0]);
+    }
+
+    // a diagonal decomposition keeps the partials away from underflow
+    std::vector<double> eigenVectors(stateCount * stateCount, 0.0);
+    std::vector<double> eigenValues(stateCount);
+    for (int i = 0; i < stateCount; i++) {
+        eigenVectors[i * stateCount + i] = 1.0;
+        eigenValues[i] = -(double) i / stateCount;
+    }
+    beagleSetEigenDecomposition(instance, 0, &eigenVectors[0], &eigenVectors[0], &eigenValues[0]);
+
+    std::vector<double> frequencies(stateCount, 1.0 / stateCount);
+    beagleSetStateFrequencies(instance, 0, &frequencies[0]);
+
+    std::vector<double> rates(categoryCount);
+    std::vector<double> weights(categoryCount, 1.0 / categoryCount);
+    for (int i = 0; i < categoryCount; i++)
+        rates[i] = 2.0 * (i + 0.5) / categoryCount;
+    beagleSetCategoryRates(instance, &rates[0]);
+    beagleSetCategoryWeights(instance, 0, &weights[0]);
+
+    std::vector<double> patternWeights(patternCount, 1.0);
+    beagleSetPatternWeights(instance, &patternWeights[0]);
+}
+
+static void printHeader(const BenchOptions& options) {
+    if (options.csv) {
+        std::cout << "implementation,states,categories,patterns,kernel,calls,items,ns_per_item,gb_per_s,gflop_per_s";
+        if (options.roofline)
+            std::cout << ",flop_per_byte,roofline_gflop_per_s,roofline_fraction,bound";
+        if (options.perf)
+            std::cout << ",cycles,instructions,cache_misses";
+        std::cout << "\n";
+    } else {
+        std::cout << std::left << std::setw(28) << "implementation" << std::right << std::setw(7) << "states"
+                  << std::setw(6) << "cats" << std::setw(9) << "patterns" << "  " << std::left << std::setw(32)
+                  << "kernel" << std::right << std::setw(12) << "ns/pattern" << std::setw(10) << "GB/s"
+                  << std::setw(10) << "GFLOP/s";
+        if (options.roofline)
+            std::cout << std::setw(8) << "flop/B" << std::setw(8) << "%roof" << std::setw(9) << "bound";
+        if (options.perf)
+            std::cout << std::setw(8) << "IPC" << std::setw(12) << "misses/pat";
+        std::cout << "\n";
+    }
+}
+
+static void printPeaks(const BenchOptions& options) {
+    // the table goes to stdout, so the peaks of a CSV run go to stderr
+    std::ostream& out = (options.csv ? std::cerr : std::cout);
+    out << std::fixed << std::setprecision(2) << "Peak bandwidth " << options.peaks.bandwidth
+        << " GB/s, peak multiply-add throughput " << options.peaks.doubleGflops << " GFLOP/s double and "
+        << options.peaks.singleGflops << " GFLOP/s single\n\n";
+    out.unsetf(std::ios::floatfield);
+}
+
+static void printResult(const BenchOptions& options,
+                        const char* implName,
+                        bool singlePrecision,
+                        int stateCount,
+                        int categoryCount,
+                        int patternCount,
+                        int kernel,
+                        const BeagleKernelCounters& counters,
+                        const long long* perfValues) {
+    // transition matrices are counted per matrix rather than per pattern
+    const long items = (kernel == BENCH_TRANSITION_MATRICES ? counters.callCount * matrixCount :
+                                                              counters.patternCount);
+    const double time = counters.wallTime;
+    const double nsPerItem = (items > 0 ? 1e9 * time / items : 0.0);
+    const double gbPerSecond = (time > 0.0 ? counters.bytes / time / 1e9 : 0.0);
+    const double gflopPerSecond = (time > 0.0 ? counters.flops / time / 1e9 : 0.0);
+
+    // the roofline bounds the throughput by the peak compute rate or by the
+    // rate the peak bandwidth can feed at the kernel's arithmetic intensity
+    const double peakGflops = (singlePrecision ? options.peaks.singleGflops : options.peaks.doubleGflops);
+    const double intensity = (counters.bytes > 0.0 ? counters.flops / counters.bytes : 0.0);
+    const bool memoryBound = (intensity * options.peaks.bandwidth < peakGflops);
+    const double rooflineGflops = (memoryBound ? intensity * options.peaks.bandwidth : peakGflops);
+    const double rooflineFraction = (rooflineGflops > 0.0 ? gflopPerSecond / rooflineGflops : 0.0);
+
+    const double ipc = (options.perf && perfValues[PERF_CYCLES] > 0 ?
+                        (double) perfValues[PERF_INSTRUCTIONS] / perfValues[PERF_CYCLES] : 0.0);
+    const double missesPerItem = (options.perf && items > 0 ? (double) perfValues[PERF_CACHE_MISSES] / items :
+                                                              0.0);
+
+    if (options.csv) {
+        std::cout << implName << "," << stateCount << "," << categoryCount << "," << patternCount << ","
+                  << kernelNames[kernel] << "," << counters.callCount << "," << items << ","
+                  << nsPerItem << "," << gbPerSecond << "," << gflopPerSecond;
+        if (options.roofline)
+            std::cout << "," << intensity << "," << rooflineGflops << "," << rooflineFraction << ","
+                      << (memoryBound ? "memory" : "compute");
+        if (options.perf)
+            std::cout << "," << perfValues[PERF_CYCLES] << "," << perfValues[PERF_INSTRUCTIONS] << ","
+                      << perfValues[PERF_CACHE_MISSES];
+        std::cout << "\n";
+    } else {
+        std::cout << std::left << std::setw(28) << implName << std::right << std::setw(7) << stateCount
+                  << std::setw(6) << categoryCount << std::setw(9) << patternCount << "  " << std::left
+                  << std::setw(32) << kernelNames[kernel] << std::right << std::fixed << std::setprecision(3)
+                  << std::setw(12) << nsPerItem << std::setprecision(2) << std::setw(10) << gbPerSecond
+                  << std::setw(10) << gflopPerSecond;
+        if (options.roofline)
+            std::cout << std::setw(8) << intensity << std::setprecision(1) << std::setw(8)
+                      << 100.0 * rooflineFraction << std::setw(9) << (memoryBound ? "memory" : "compute");
+        if (options.perf)
+            std::cout << std::setprecision(2) << std::setw(8) << ipc << std::setw(12) << missesPerItem;
+        std::cout << "\n";
+        std::cout.unsetf(std::ios::floatfield);
+    }
+}
+
+/*
+ * Benchmarks every kernel of one instance and returns false if the
+ * instance could not be created.
+ */
+static bool benchmarkInstance(const BenchOptions& options,
+                              int stateCount,
+                              int categoryCount,
+                              int patternCount,
+                              long flags,
+                              std::set<std::string>& implNames) {
+    BeagleInstanceDetails details;
+    int resourceList[1] = {options.resource};
+    const long requirementFlags = flags | BEAGLE_FLAG_SCALING_MANUAL;
+    const long preferenceFlags = requirementFlags | options.threadingFlags;
+
+    int instance = beagleCreateInstance(tipCount, partialsBufferCount, tipCount, stateCount, patternCount,
+                                        1, matrixCount, categoryCount, 1,
+                                        (options.resource >= 0 ? resourceList : NULL),
+                                        (options.resource >= 0 ? 1 : 0),
+                                        preferenceFlags, requirementFlags, &details);
+    if (instance < 0)
+        return false;
+
+    // an implementation chosen for several flag combinations is timed once
+    if (!implNames.insert(details.implName).second) {
+        beagleFinalizeInstance(instance);
+        return true;
+    }
+
+    setInstanceData(instance, stateCount, patternCount, categoryCount);
+
+    if (beagleSetPerformanceCounters(instance, 1) != BEAGLE_SUCCESS) {
+        std::cerr << details.implName << " does not count kernels, skipped\n";
+        beagleFinalizeInstance(instance);
+        return true;
+    }
+
+    // one untimed pass fills every buffer a kernel reads, the scale buffer
+    // of the fixed scaling kernels by the rescale kernel
+    const int warmupOrder[BENCH_KERNEL_COUNT] = {
+        BENCH_TRANSITION_MATRICES, BENCH_STATES_STATES, BENCH_STATES_PARTIALS, BENCH_PARTIALS_PARTIALS,
+        BENCH_RESCALE, BENCH_ROOT_INTEGRATION, BENCH_EDGE_INTEGRATION, BENCH_STATES_STATES_FIXED_SCALING,
+        BENCH_STATES_PARTIALS_FIXED_SCALING, BENCH_PARTIALS_PARTIALS_FIXED_SCALING
+    };
+    for (int i = 0; i < BENCH_KERNEL_COUNT; i++)
+        runKernel(instance, warmupOrder[i]);
+
+    PerfCounters perfCounters;
+    const bool perf = (options.perf && perfCounters.open());
+
+    BeagleKernelCounters allCounters[BEAGLE_KERNEL_TYPE_COUNT];
+    for (int kernel = 0; kernel < BENCH_KERNEL_COUNT; kernel++) {
+        BeagleKernelCounters best;
+        memset(&best, 0, sizeof(best));
+        long long bestPerfValues[PERF_EVENT_COUNT] = {0, 0, 0};
+        bool failed = false;
+
+        for (int rep = 0; rep < options.nreps && !failed; rep++) {
+            long long perfValues[PERF_EVENT_COUNT];
+            beagleResetPerformanceCounters(instance);
+            if (perf)
+                perfCounters.start();
+            int returnValue = runKernel(instance, kernel);
+            if (perf)
+                perfCounters.stop(perfValues);
+            if (returnValue != BEAGLE_SUCCESS ||
+                beagleGetPerformanceCounters(instance, allCounters, BEAGLE_KERNEL_TYPE_COUNT) != BEAGLE_SUCCESS) {
+                failed = true;
+                break;
+            }
+            const BeagleKernelCounters& counters = allCounters[kernelCounters[kernel]];
+            if (rep == 0 || counters.wallTime < best.wallTime) {
+                best = counters;
+                if (perf)
+                    memcpy(bestPerfValues, perfValues, sizeof(bestPerfValues));
+            }
+        }
+
+        if (failed) {
+            std::cerr << details.implName << " failed on " << kernelNames[kernel] << "\n";
+            continue;
+        }
+
+        printResult(options, details.implName, (details.flags & BEAGLE_FLAG_PRECISION_SINGLE) != 0,
+                    stateCount, categoryCount, patternCount, kernel, best, bestPerfValues);
+    }
+
+    beagleFinalizeInstance(instance);
+
+    return true;
+}
+
+void helpMessage() {
+    std::cerr << "Usage:\n\n";
+    std::cerr << "kernelbench [--help] [--states <integer>] [--categories <integer>] [--patterns <integer>] [--reps <integer>] [--rsrc <integer>] [--singleprecision] [--doubleprecision] [--disablevector] [--enablethreads] [--csv] [--roofline] [--peakbandwidth <GB/s>] [--peakgflops <GFLOP/s>] [--perf]\n\n";
+    std::cerr << "--states, --categories and --patterns may be repeated to sweep several counts; by default states 2, 4, 20 and 61, categories 1, 4 and 8 and patterns 100, 1000 and 10000 are swept\n\n";
+    std::cerr << "Every CPU implementation available for the precision and vectorization options is timed; each kernel is timed --reps times (10 by default) and the fastest time is reported\n\n";
+    std::cerr << "Times are per site pattern, except for transition-matrices where they are per matrix\n\n";
+    std::cerr << "If --csv is specified, the results are written as comma-separated values\n\n";
+    std::cerr << "If --roofline is specified, the peak memory bandwidth and double and single precision multiply-add throughput of the host (on all cores with --enablethreads) are measured, and each kernel is reported with its flops per byte, its throughput as a percentage of the roofline bound and whether that bound is set by memory or compute; kernels whose data fit in cache can exceed 100%\n\n";
+    std::cerr << "--peakbandwidth and --peakgflops replace the measured peaks with known ones, --peakgflops giving the double precision peak (single precision is taken as twice that)\n\n";
+    std::cerr << "If --perf is specified, the instructions per cycle and cache misses per pattern of the calling thread are read from the Linux hardware counters\n\n";
+    std::exit(0);
+}
+
+int main(int argc, const char* argv[]) {
+    BenchOptions options;
+    options.threadingFlags = 0;
+    options.resource = 0;
+    options.nreps = 10;
+    options.csv = false;
+    options.roofline = false;
+    options.perf = false;
+    options.peaks.bandwidth = 0.0;
+    options.peaks.doubleGflops = 0.0;
+    options.peaks.singleGflops = 0.0;
+    bool disableVector = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        const bool hasValue = (i + 1 < argc);
+        if (option == "--help") {
+            helpMessage();
+        } else if (option == "--states" && hasValue) {
+            options.stateCounts.push_back(atoi(argv[++i]));
+        } else if (option == "--categories" && hasValue) {
+            options.categoryCounts.push_back(atoi(argv[++i]));
+        } else if (option == "--patterns" && hasValue) {
+            options.patternCounts.push_back(atoi(argv[++i]));
+        } else if (option == "--reps" && hasValue) {
+            options.nreps = atoi(argv[++i]);
+        } else if (option == "--rsrc" && hasValue) {
+            options.resource = atoi(argv[++i]);
+        } else if (option == "--singleprecision") {
+            options.precisionFlags.push_back(BEAGLE_FLAG_PRECISION_SINGLE);
+        } else if (option == "--doubleprecision") {
+            options.precisionFlags.push_back(BEAGLE_FLAG_PRECISION_DOUBLE);
+        } else if (option == "--disablevector") {
+            disableVector = true;
+        } else if (option == "--enablethreads") {
+            options.threadingFlags = BEAGLE_FLAG_THREADING_CPP;
+        } else if (option == "--csv") {
+            options.csv = true;
+        } else if (option == "--roofline") {
+            options.roofline = true;
+        } else if (option == "--peakbandwidth" && hasValue) {
+            options.roofline = true;
+            options.peaks.bandwidth = atof(argv[++i]);
+        } else if (option == "--peakgflops" && hasValue) {
+            options.roofline = true;
+            options.peaks.doubleGflops = atof(argv[++i]);
+            options.peaks.singleGflops = 2.0 * options.peaks.doubleGflops;
+        } else if (option == "--perf") {
+            options.perf = true;
+        } else {
+            std::cerr << "Unknown option: " << option << "\n\n";
+            helpMessage();
+        }
+    }
+
+    if (options.stateCounts.empty()) {
+        const int stateCounts[] = {2, 4, 20, 61};
+        options.stateCounts.assign(stateCounts, stateCounts + 4);
+    }
+    if (options.categoryCounts.empty()) {
+        const int categoryCounts[] = {1, 4, 8};
+        options.categoryCounts.assign(categoryCounts, categoryCounts + 3);
+    }
+    if (options.patternCounts.empty()) {
+        const int patternCounts[] = {100, 1000, 10000};
+        options.patternCounts.assign(patternCounts, patternCounts + 3);
+    }
+    if (options.precisionFlags.empty()) {
+        options.precisionFlags.push_back(BEAGLE_FLAG_PRECISION_DOUBLE);
+        options.precisionFlags.push_back(BEAGLE_FLAG_PRECISION_SINGLE);
+    }
+    options.vectorFlags.push_back(BEAGLE_FLAG_VECTOR_NONE);
+    if (!disableVector) {
+        options.vectorFlags.push_back(BEAGLE_FLAG_VECTOR_SSE);
+        options.vectorFlags.push_back(BEAGLE_FLAG_VECTOR_AVX);
+    }
+    if (options.nreps < 1)
+        options.nreps = 1;
+
+    if (options.roofline) {
+        const int threadCount = (options.threadingFlags != 0 ? std::max(1, (int) std::thread::hardware_concurrency()) : 1);
+        if (options.peaks.bandwidth <= 0.0)
+            options.peaks.bandwidth = measureBandwidth(threadCount);
+        if (options.peaks.doubleGflops <= 0.0) {
+            options.peaks.doubleGflops = measureGflops<double>(threadCount);
+            options.peaks.singleGflops = measureGflops<float>(threadCount);
+        }
+        printPeaks(options);
+    }
+
+    if (options.perf) {
+        PerfCounters probe;
+        if (!probe.open()) {
+            std::cerr << "Hardware counters are not available, --perf is ignored\n\n";
+            options.perf = false;
+        }
+    }
+
+    srand(1);
+
+    printHeader(options);
+
+    for (size_t s = 0; s < options.stateCounts.size(); s++) {
+        for (size_t c = 0; c < options.categoryCounts.size(); c++) {
+            for (size_t p = 0; p < options.patternCounts.size(); p++) {
+                std::set<std::string> implNames;
+                bool created = false;
+                for (size_t f = 0; f < options.precisionFlags.size(); f++) {
+                    for (size_t v = 0; v < options.vectorFlags.size(); v++) {
+                        const long flags = BEAGLE_FLAG_FRAMEWORK_CPU | options.precisionFlags[f] |
+                                           options.vectorFlags[v];
+                        if (benchmarkInstance(options, options.stateCounts[s], options.categoryCounts[c],
+                                              options.patternCounts[p], flags, implNames))
+                            created = true;
+                    }
+                }
+                if (!created) {
+                    std::cerr << "No CPU implementation for " << options.stateCounts[s] << " states, "
+                              << options.categoryCounts[c] << " categories and "
+                              << options.patternCounts[p] << " patterns\n";
+                    return 1;
+                }
+            }
+        }
+    }
+
+    beagleFinalize();
+
+    return 0;
+}
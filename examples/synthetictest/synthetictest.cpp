@@ -40,6 +40,19 @@
 #define MAX_DIFF    0.01        //max discrepancy in scoring between reps
 #define GT_RAND_MAX 0x7fffffff
 
+#define TIMING_PHASE_COUNT 6    // phases timed in each rep, written by --json
+
+// not available where long is 32 bits (see beagle.h)
+#ifndef BEAGLE_FLAG_PARTIALS_MAPPED
+#define BEAGLE_FLAG_PARTIALS_MAPPED 0L
+#endif
+#ifndef BEAGLE_FLAG_AUTOTUNE
+#define BEAGLE_FLAG_AUTOTUNE 0L
+#endif
+
+const char* timingPhaseNames[TIMING_PHASE_COUNT] = {"total", "setPartitions", "transMats", "partials",
+                                                    "accScalers", "rootLnL"};
+
 #ifdef _WIN32
     //From January 1, 1601 (UTC). to January 1,1970
     #define FACTOR 0x19db1ded53e8000 
@@ -730,6 +743,29 @@ double getTimeDiff(struct timeval t1,
     return ((double)(t2.tv_sec - t1.tv_sec)*1000.0 + (double)(t2.tv_usec-t1.tv_usec)/1000.0);
 }
 
+const char* jsonBool(bool value) {
+    return (value ? "true" : "false");
+}
+
+// writes the best and median times of a phase (in ms) and the time of every rep
+void printJsonTiming(FILE* jsonFile,
+                     const char* phaseName,
+                     const std::vector<double>& times) {
+    std::vector<double> sortedTimes(times);
+    std::sort(sortedTimes.begin(), sortedTimes.end());
+    double median = 0.0;
+    if (!sortedTimes.empty()) {
+        size_t middle = sortedTimes.size() / 2;
+        median = (sortedTimes.size() % 2 == 1 ? sortedTimes[middle] :
+                                                (sortedTimes[middle - 1] + sortedTimes[middle]) / 2.0);
+    }
+    fprintf(jsonFile, "\"%s\": {\"min\": %.6f, \"median\": %.6f, \"runs\": [", phaseName,
+            (sortedTimes.empty() ? 0.0 : sortedTimes[0]), median);
+    for (size_t i = 0; i < times.size(); i++)
+        fprintf(jsonFile, "%s%.6f", (i > 0 ? ", " : ""), times[i]);
+    fprintf(jsonFile, "]}");
+}
+
 /* Given a binary tree, print its nodes according to the
 "bottom-up" postorder traversal. */
 void traversePostorder(node* currentNode, std::deque <node*> &S)
@@ -962,6 +998,10 @@ void generateNewTree(int ntaxa,
     std::vector <node*> nodes;
     node* root = NULL;
 
+#ifndef HAVE_NCL
+    char* treenewick = NULL;
+#endif
+
     if (!treenewick) {
         nodes.push_back(createNewNode(0));
         int tipsAdded = 1;
@@ -999,7 +1039,9 @@ void generateNewTree(int ntaxa,
         root->data = rootIndex;
     } else {
         root = createNewNode(0);
+#ifdef HAVE_NCL
         ncl_generateTreeFromNewick(treenewick, ntaxa, nodes, root);
+#endif
     }
 
     if (rerootTrees) {
@@ -1475,6 +1517,8 @@ void printFlags(long inFlags) {
     if (inFlags & BEAGLE_FLAG_FRAMEWORK_CPU      ) fprintf(stdout, " FRAMEWORK_CPU"      );
     if (inFlags & BEAGLE_FLAG_PARALLELOPS_STREAMS) fprintf(stdout, " PARALLELOPS_STREAMS");
     if (inFlags & BEAGLE_FLAG_PARALLELOPS_GRID   ) fprintf(stdout, " PARALLELOPS_GRID"   );
+    if (inFlags & BEAGLE_FLAG_PARTIALS_MAPPED    ) fprintf(stdout, " PARTIALS_MAPPED"    );
+    if (inFlags & BEAGLE_FLAG_AUTOTUNE           ) fprintf(stdout, " AUTOTUNE"           );
 }
 
 
@@ -1492,6 +1536,8 @@ void runBeagle(int resource,
                bool requireDoublePrecision,
                bool disableVector,
                bool enableThreads,
+               bool outOfCore,
+               bool autotune,
                int compactTipCount,
                int randomSeed,
                int rescaleFrequency,
@@ -1521,7 +1567,8 @@ void runBeagle(int resource,
                int* resourceList,
                int  resourceCount,
                bool alignmentFromFile,
-               char* treenewick)
+               char* treenewick,
+               char* jsonFileName)
 {
 
     int instanceCount = 1;
@@ -1553,6 +1600,7 @@ void runBeagle(int resource,
     int modelCount = eigenCount * partitionCount;
     
     BeagleInstanceDetails instDetails;
+    int instanceThreadCount = 0;
     
 
     if (benchmarklist) {
@@ -1569,7 +1617,8 @@ void runBeagle(int resource,
                 benchmarkFlags = BEAGLE_BENCHFLAG_SCALING_ALWAYS;
         }
 
-        long preferenceFlags = (enableThreads ? BEAGLE_FLAG_THREADING_CPP : 0);
+        long preferenceFlags = (enableThreads ? BEAGLE_FLAG_THREADING_CPP : 0) |
+                               (outOfCore ? BEAGLE_FLAG_PARTIALS_MAPPED : 0);
         long requirementFlags =
         (requireDoublePrecision ? BEAGLE_FLAG_PRECISION_DOUBLE : BEAGLE_FLAG_PRECISION_SINGLE) |
 	  (disableVector ? BEAGLE_FLAG_VECTOR_NONE : 0);
@@ -1671,6 +1720,8 @@ void runBeagle(int resource,
                     &instanceResource,        /**< List of potential resource on which this instance is allowed (input, NULL implies no restriction */
                     1,                /**< Length of resourceList list (input) */
                     (enableThreads ? BEAGLE_FLAG_THREADING_CPP : 0) |
+                    (outOfCore ? BEAGLE_FLAG_PARTIALS_MAPPED : 0) |
+                    (autotune ? BEAGLE_FLAG_AUTOTUNE : 0) |
                     (multiRsrc ? BEAGLE_FLAG_COMPUTATION_ASYNCH : 0) |
 		    (multiRsrc ? BEAGLE_FLAG_PARALLELOPS_STREAMS : 0),         /**< Bit-flags indicating preferred implementation charactertistics, see BeagleFlags (input) */
                     (disableVector ? BEAGLE_FLAG_VECTOR_NONE : 0) |
@@ -1695,7 +1746,11 @@ void runBeagle(int resource,
             fprintf(stdout, "\tImpl Name : %s\n", instDetails.implName);    
             fprintf(stdout, "\tFlags:");
             printFlags(instDetails.flags);
-            fprintf(stdout, "\n\n");
+            fprintf(stdout, "\n");
+            beagleGetCPUThreadCount(instance, &instanceThreadCount);
+            if (instDetails.flags & BEAGLE_FLAG_AUTOTUNE)
+                fprintf(stdout, "\tThreads   : %d\n", instanceThreadCount);
+            fprintf(stdout, "\n");
 
             if (inst+1 < instanceCount) {
                 fprintf(stdout, "and\n\n");
@@ -1703,6 +1758,7 @@ void runBeagle(int resource,
 
             if (threadCount > 1) {
                 beagleSetCPUThreadCount(instance, threadCount);
+                beagleGetCPUThreadCount(instance, &instanceThreadCount);
             }
 
         }
@@ -1965,6 +2021,7 @@ void runBeagle(int resource,
 
     struct timeval time0, time1, time2, time3, time4, time5;
     double bestTimeSetPartitions, bestTimeUpdateTransitionMatrices, bestTimeUpdatePartials, bestTimeAccumulateScaleFactors, bestTimeCalculateRootLogLikelihoods, bestTimeTotal;
+    std::vector<double> repTimes[TIMING_PHASE_COUNT];
 
     int timePrecision = 4;
     int speedupPrecision = 2;
@@ -2322,6 +2379,13 @@ void runBeagle(int resource,
             // unsigned long long flopsTotal = partialsTotal * flopsPerPartial;
             // std::cout << " compute throughput:   " << (flopsTotal/getTimeDiff(time2, time3))/1000000.0 << " GFLOPS " << std::endl;
     
+        repTimes[0].push_back(getTimeDiff(time0, time5));
+        repTimes[1].push_back(getTimeDiff(time0, time1));
+        repTimes[2].push_back(getTimeDiff(time1, time2));
+        repTimes[3].push_back(getTimeDiff(time2, time3));
+        repTimes[4].push_back(getTimeDiff(time3, time4));
+        repTimes[5].push_back(getTimeDiff(time4, time5));
+
         if (i == 0 || getTimeDiff(time0, time5) < bestTimeTotal || (treenewick && i == (nreps-1)))  {
             bestTimeTotal = getTimeDiff(time0, time5);
             bestTimeSetPartitions = getTimeDiff(time0, time1);
@@ -2469,9 +2533,57 @@ void runBeagle(int resource,
 
         std::cout << " tree throughput total:   " << (partialsTotal/bestTimeTotal)/1000.0 << " M partials/second " << std::endl;
 
+        BeagleMemoryUsage memoryUsage;
+        if (beagleGetInstanceMemoryUsage(instances[0], &memoryUsage) == BEAGLE_SUCCESS) {
+            std::cout << " memory footprint:   " << memoryUsage.total/1048576.0 << " MB";
+            std::cout << " (partials " << memoryUsage.partials/1048576.0 << " MB";
+            if (memoryUsage.mapped > 0)
+                std::cout << ", mapped " << memoryUsage.mapped/1048576.0 << " MB";
+            std::cout << ")" << std::endl;
+        }
+
     }
     std::cout << "\n";
-    
+
+    if (jsonFileName != NULL) {
+        FILE* jsonFile = fopen(jsonFileName, "a");
+        if (jsonFile == NULL) {
+            fprintf(stderr, "Cannot open %s for the JSON results\n", jsonFileName);
+        } else {
+            fprintf(jsonFile, "{\"program\": \"synthetictest\", \"version\": \"%s\"", beagleGetVersion());
+            fprintf(jsonFile, ", \"configuration\": {\"states\": %d, \"taxa\": %d, \"sites\": %d, \"rates\": %d"
+                              ", \"reps\": %d, \"rsrc\": %d, \"precision\": \"%s\", \"scaling\": \"%s\""
+                              ", \"rescalefrequency\": %d, \"compacttips\": %d, \"seed\": %d, \"unrooted\": %s"
+                              ", \"calcderivs\": %s, \"logscalers\": %s, \"eigencount\": %d, \"eigencomplex\": %s"
+                              ", \"ievectrans\": %s, \"setmatrix\": %s, \"partitions\": %d, \"disablevector\": %s"
+                              ", \"enablethreads\": %s, \"threads\": %d, \"outofcore\": %s, \"autotune\": %s, \"randomtree\": %s"
+                              ", \"newdata\": %s, \"newtree\": %s, \"newparameters\": %s}",
+                    stateCount, ntaxa, nsites, rateCategoryCount, nreps, resource,
+                    (requireDoublePrecision ? "double" : "single"),
+                    (manualScaling ? "manual" : (autoScaling ? "auto" : (dynamicScaling ? "dynamic" : "none"))),
+                    rescaleFrequency, compactTipCount, randomSeed, jsonBool(unrooted), jsonBool(calcderivs),
+                    jsonBool(logscalers), eigenCount, jsonBool(eigencomplex), jsonBool(ievectrans),
+                    jsonBool(setmatrix), partitionCount, jsonBool(disableVector), jsonBool(enableThreads),
+                    threadCount, jsonBool(outOfCore), jsonBool(autotune), jsonBool(randomTree), jsonBool(newDataPerRep),
+                    jsonBool(newTreePerRep), jsonBool(newParametersPerRep));
+            fprintf(jsonFile, ", \"implementation\": {\"resource\": %d, \"resourceName\": \"%s\", \"implName\": \"%s\""
+                              ", \"flags\": %ld, \"threadCount\": %d}",
+                    instDetails.resourceNumber, instDetails.resourceName, instDetails.implName, instDetails.flags,
+                    instanceThreadCount);
+            fprintf(jsonFile, ", \"logL\": %.10g", logL);
+            if (calcderivs)
+                fprintf(jsonFile, ", \"d1\": %.10g, \"d2\": %.10g", deriv1, deriv2);
+            fprintf(jsonFile, ", \"timings\": {");
+            for (int phase = 0; phase < TIMING_PHASE_COUNT; phase++) {
+                printJsonTiming(jsonFile, timingPhaseNames[phase], repTimes[phase]);
+                if (phase < TIMING_PHASE_COUNT - 1)
+                    fprintf(jsonFile, ", ");
+            }
+            fprintf(jsonFile, "}}\n");
+            fclose(jsonFile);
+        }
+    }
+
     for(int inst=0; inst<instanceCount; inst++) {
         beagleFinalizeInstance(instances[inst]);
     }
@@ -2748,7 +2860,7 @@ void printResourceList() {
 
 void helpMessage() {
     std::cerr << "Usage:\n\n";
-    std::cerr << "synthetictest [--help] [--resourcelist] [--benchmarklist] [--states <integer>] [--taxa <integer>] [--sites <integer>] [--rates <integer>] [--manualscale] [--autoscale] [--dynamicscale] [--rsrc <integer>] [--reps <integer>] [--doubleprecision] [--disablevector] [--enablethreads] [--compacttips <integer>] [--seed <integer>] [--rescalefrequency <integer>] [--fulltiming] [--unrooted] [--calcderivs] [--logscalers] [--eigencount <integer>] [--eigencomplex] [--ievectrans] [--setmatrix] [--opencl] [--partitions <integer>] [--sitelikes] [--newdata] [--randomtree] [--reroot] [--stdrand] [--pectinate] [--multirsrc] [--postorder] [--newtree] [--newparameters] [--threads]";
+    std::cerr << "synthetictest [--help] [--resourcelist] [--benchmarklist] [--states <integer>] [--taxa <integer>] [--sites <integer>] [--rates <integer>] [--manualscale] [--autoscale] [--dynamicscale] [--rsrc <integer>] [--reps <integer>] [--doubleprecision] [--disablevector] [--enablethreads] [--outofcore] [--autotune] [--compacttips <integer>] [--seed <integer>] [--rescalefrequency <integer>] [--fulltiming] [--unrooted] [--calcderivs] [--logscalers] [--eigencount <integer>] [--eigencomplex] [--ievectrans] [--setmatrix] [--opencl] [--partitions <integer>] [--sitelikes] [--newdata] [--randomtree] [--reroot] [--stdrand] [--pectinate] [--multirsrc] [--postorder] [--newtree] [--newparameters] [--threads] [--json <file>]";
 #ifdef HAVE_PLL
     std::cerr << " [--plltest]";
     std::cerr << " [--pllonly]";
@@ -2762,7 +2874,10 @@ void helpMessage() {
     std::cerr << "\n\n";
     std::cerr << "If --help is specified, this usage message is shown\n\n";
     std::cerr << "If --manualscale, --autoscale, or --dynamicscale is specified, BEAGLE will rescale the partials during computation\n\n";
+    std::cerr << "If --outofcore is specified, BEAGLE will prefer to keep internal partials in a memory-mapped scratch file (in $BEAGLE_SCRATCH_DIR or $TMPDIR)\n\n";
+    std::cerr << "If --autotune is specified, BEAGLE will time the available implementations and thread counts on the problem and use the fastest\n\n";
     std::cerr << "If --fulltiming is specified, you will see more detailed timing results (requires BEAGLE_DEBUG_SYNCH defined to report accurate values)\n\n";
+    std::cerr << "If --json is specified, the configuration, implementation, lnL and the times of each phase in every rep are appended to the file as one line of JSON\n\n";
     std::exit(0);
 }
 
@@ -2780,6 +2895,8 @@ void interpretCommandLineParameters(int argc, const char* argv[],
                                     bool* requireDoublePrecision,
                                     bool* disableVector,
                                     bool* enableThreads,
+                                    bool* outOfCore,
+                                    bool* autotune,
                                     int* compactTipCount,
                                     int* randomSeed,
                                     int* rescaleFrequency,
@@ -2808,7 +2925,8 @@ void interpretCommandLineParameters(int argc, const char* argv[],
                                     int* threadCount,
                                     char** alignmentdna,
                                     bool* compress,
-                                    char** treenewick)    {
+                                    char** treenewick,
+                                    char** jsonFileName)    {
     bool expecting_stateCount = false;
     bool expecting_ntaxa = false;
     bool expecting_nsites = false;
@@ -2823,6 +2941,7 @@ void interpretCommandLineParameters(int argc, const char* argv[],
     bool expecting_threads = false;
     bool expecting_alignmentdna = false;
     bool expecting_treenewick = false;
+    bool expecting_json = false;
     
     for (unsigned i = 1; i < argc; ++i) {
         std::string option = argv[i];
@@ -2877,6 +2996,10 @@ void interpretCommandLineParameters(int argc, const char* argv[],
             *treenewick = (char*) malloc(sizeof(char) * sizeof(option.c_str()));
             strcpy(*treenewick, option.c_str());
             expecting_treenewick = false;
+        } else if (expecting_json) {
+            *jsonFileName = (char*) malloc(sizeof(char) * (option.size() + 1));
+            strcpy(*jsonFileName, option.c_str());
+            expecting_json = false;
         } else if (option == "--help") {
             helpMessage();
         } else if (option == "--resourcelist") {
@@ -2915,6 +3038,14 @@ void interpretCommandLineParameters(int argc, const char* argv[],
             *disableVector = true;
         } else if (option == "--enablethreads") {
             *enableThreads = true;
+        } else if (option == "--outofcore") {
+            if (BEAGLE_FLAG_PARTIALS_MAPPED == 0)
+                abort("--outofcore needs a build where long is wider than 32 bits");
+            *outOfCore = true;
+        } else if (option == "--autotune") {
+            if (BEAGLE_FLAG_AUTOTUNE == 0)
+                abort("--autotune needs a build where long is wider than 32 bits");
+            *autotune = true;
         } else if (option == "--unrooted") {
             *unrooted = true;
         } else if (option == "--calcderivs") {
@@ -2964,6 +3095,8 @@ void interpretCommandLineParameters(int argc, const char* argv[],
             *newParametersPerRep = true;
         } else if (option == "--threads") {
             expecting_threads = true;
+        } else if (option == "--json") {
+            expecting_json = true;
 #ifdef HAVE_NCL
         } else if (option == "--alignmentdna") {
             expecting_alignmentdna = true;
@@ -3012,6 +3145,9 @@ void interpretCommandLineParameters(int argc, const char* argv[],
     if (expecting_partitions)
         abort("read last command line option without finding value associated with --partitions");
 
+    if (expecting_json)
+        abort("read last command line option without finding value associated with --json");
+
     if (*stateCount < 2)
         abort("invalid number of states supplied on the command line");
         
@@ -3091,6 +3227,8 @@ int main( int argc, const char* argv[] )
     bool requireDoublePrecision = false;
     bool disableVector = false;
     bool enableThreads = false;
+    bool outOfCore = false;
+    bool autotune = false;
     bool unrooted = false;
     bool calcderivs = false;
     int compactTipCount = 0;
@@ -3122,6 +3260,7 @@ int main( int argc, const char* argv[] )
     bool alignmentFromFile = false;
     bool compress = false;
     char* treenewick = NULL;
+    char* jsonFileName = NULL;
 
     std::vector<int> rsrc;
     rsrc.push_back(-1);
@@ -3136,12 +3275,12 @@ int main( int argc, const char* argv[] )
     
     interpretCommandLineParameters(argc, argv, &stateCount, &ntaxa, &nsites, &manualScaling, &autoScaling,
                                    &dynamicScaling, &rateCategoryCount, &rsrc, &nreps, &fullTiming,
-                                   &requireDoublePrecision, &disableVector, &enableThreads, &compactTipCount, &randomSeed,
+                                   &requireDoublePrecision, &disableVector, &enableThreads, &outOfCore, &autotune, &compactTipCount, &randomSeed,
                                    &rescaleFrequency, &unrooted, &calcderivs, &logscalers,
                                    &eigenCount, &eigencomplex, &ievectrans, &setmatrix, &opencl,
                                    &partitions, &sitelikes, &newDataPerRep, &randomTree, &rerootTrees, &pectinate, &benchmarklist, &pllTest, &pllSiteRepeats, &pllOnly, &multiRsrc,
                                    &postorderTraversal, &newTreePerRep, &newParametersPerRep,
-                                   &threadCount, &alignmentdna, &compress, &treenewick);
+                                   &threadCount, &alignmentdna, &compress, &treenewick, &jsonFileName);
 
     if (alignmentdna == NULL) {
         std::cout << "\nSimulating genomic ";
@@ -3202,6 +3341,8 @@ int main( int argc, const char* argv[] )
                           requireDoublePrecision,
                           disableVector,
                           enableThreads,
+                          outOfCore,
+                          autotune,
                           compactTipCount,
                           randomSeed,
                           rescaleFrequency,
@@ -3231,7 +3372,8 @@ int main( int argc, const char* argv[] )
                           rsrcList,
                           rsrcCount,
                           alignmentFromFile,
-                          treenewick);
+                          treenewick,
+                          jsonFileName);
             }
         }
     } else {
@@ -40,7 +40,11 @@ public enum BeagleFlag {
     FRAMEWORK_CPU(1 << 27, "use CPU implementation"),
 
     PARALLELOPS_STREAMS(1 << 28, "Operations in updatePartials may be assigned to separate device streams"),
-    PARALLELOPS_GRID(1 << 29, "Operations in updatePartials may be folded into single kernel launch (necessary for partitions; typically performs better for problems with fewer pattern sites)");
+    PARALLELOPS_GRID(1 << 29, "Operations in updatePartials may be folded into single kernel launch (necessary for partitions; typically performs better for problems with fewer pattern sites)"),
+
+    PARTIALS_MAPPED(1L << 31, "internal partials buffers are stored in a memory-mapped scratch file (out-of-core computation)"),
+
+    AUTOTUNE(1L << 32, "choose the implementation and thread count by timing the candidates (preference only)");
 
     BeagleFlag(long mask, String meaning) {
         this.mask = mask;
@@ -0,0 +1,198 @@
+/*
+ *  BeagleCounters.h
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __beagle_counters__
+#define __beagle_counters__
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <time.h>
+
+#include "libhmsbeagle/beagle.h"
+
+namespace beagle {
+
+/*
+ * Performance counters of an instance, one set per kernel type.
+ *
+ * Counting is off by default and then costs one test per kernel call. When it
+ * is on, kernels collect their totals in a BeagleCounterBlock on the stack of
+ * the thread running them, and the block is merged into the instance counters
+ * under a lock once, when it goes out of scope, so that worker threads can
+ * count concurrently.
+ */
+class BeagleCounters
+{
+public:
+    BeagleCounters()
+    : enabled(false) {
+        memset(counters, 0, sizeof(counters));
+    }
+
+    // a copy, as held by a cloned instance, counts from zero
+    BeagleCounters(const BeagleCounters& other)
+    : enabled(other.isEnabled()) {
+        memset(counters, 0, sizeof(counters));
+    }
+
+    bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+    void setEnabled(bool isEnabled) { enabled.store(isEnabled, std::memory_order_relaxed); }
+
+    void reset() {
+        std::lock_guard<std::mutex> lock(mutex);
+        memset(counters, 0, sizeof(counters));
+    }
+
+    void add(const BeagleKernelCounters* blockCounters) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int type = 0; type < BEAGLE_KERNEL_TYPE_COUNT; type++) {
+            counters[type].callCount += blockCounters[type].callCount;
+            counters[type].patternCount += blockCounters[type].patternCount;
+            counters[type].flops += blockCounters[type].flops;
+            counters[type].bytes += blockCounters[type].bytes;
+            counters[type].wallTime += blockCounters[type].wallTime;
+            counters[type].threadTime += blockCounters[type].threadTime;
+        }
+    }
+
+    void get(BeagleKernelCounters* outCounters,
+             int count) {
+        std::lock_guard<std::mutex> lock(mutex);
+        memcpy(outCounters, counters, sizeof(BeagleKernelCounters) * count);
+    }
+
+    /*
+     * Seconds on a monotonic clock.
+     */
+    static double getWallTime() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /*
+     * Seconds of CPU time used by the calling thread, or wall time where the
+     * platform has no per-thread clock.
+     */
+    static double getThreadTime() {
+#ifdef CLOCK_THREAD_CPUTIME_ID
+        struct timespec ts;
+        if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+            return ts.tv_sec + 1e-9 * ts.tv_nsec;
+#endif
+        return getWallTime();
+    }
+
+private:
+    std::atomic<bool> enabled;
+    std::mutex mutex;
+    BeagleKernelCounters counters[BEAGLE_KERNEL_TYPE_COUNT];
+};
+
+/*
+ * Unsynchronized counters of one thread, merged into the instance counters
+ * on destruction. Each kernel call is bracketed by start() and stop().
+ */
+class BeagleCounterBlock
+{
+public:
+    explicit BeagleCounterBlock(BeagleCounters& instanceCounters)
+    : target(instanceCounters),
+      active(instanceCounters.isEnabled()),
+      startWallTime(0.0),
+      startThreadTime(0.0) {
+        if (active)
+            memset(counters, 0, sizeof(counters));
+    }
+
+    ~BeagleCounterBlock() {
+        if (active)
+            target.add(counters);
+    }
+
+    bool isActive() const { return active; }
+
+    void start() {
+        startWallTime = BeagleCounters::getWallTime();
+        startThreadTime = BeagleCounters::getThreadTime();
+    }
+
+    void stop(int type,
+              long patternCount,
+              double flops,
+              double bytes) {
+        BeagleKernelCounters& kernel = counters[type];
+        kernel.callCount++;
+        kernel.patternCount += patternCount;
+        kernel.flops += flops;
+        kernel.bytes += bytes;
+        kernel.wallTime += BeagleCounters::getWallTime() - startWallTime;
+        kernel.threadTime += BeagleCounters::getThreadTime() - startThreadTime;
+    }
+
+private:
+    BeagleCounters& target;
+    const bool active;
+    double startWallTime;
+    double startThreadTime;
+    BeagleKernelCounters counters[BEAGLE_KERNEL_TYPE_COUNT];
+};
+
+/*
+ * Counts a single call of one kernel type from construction to destruction,
+ * for routines with several exits.
+ */
+class BeagleCounterTimer
+{
+public:
+    BeagleCounterTimer(BeagleCounters& instanceCounters,
+                       int type,
+                       long patternCount,
+                       double flops,
+                       double bytes)
+    : block(instanceCounters),
+      kType(type),
+      kPatternCount(patternCount),
+      kFlops(flops),
+      kBytes(bytes) {
+        if (block.isActive())
+            block.start();
+    }
+
+    ~BeagleCounterTimer() {
+        if (block.isActive())
+            block.stop(kType, kPatternCount, kFlops, kBytes);
+    }
+
+private:
+    BeagleCounterBlock block;
+    const int kType;
+    const long kPatternCount;
+    const double kFlops;
+    const double kBytes;
+};
+
+}	// namespace beagle
+
+#endif // __beagle_counters__
@@ -29,6 +29,15 @@
 #define __beagle_impl__
 
 #include "libhmsbeagle/beagle.h"
+#include "libhmsbeagle/BeagleTipData.h"
+
+// flags that need a long wider than 32 bits are never set where long is 32 bits (see beagle.h)
+#ifndef BEAGLE_FLAG_PARTIALS_MAPPED
+#define BEAGLE_FLAG_PARTIALS_MAPPED 0L
+#endif
+#ifndef BEAGLE_FLAG_AUTOTUNE
+#define BEAGLE_FLAG_AUTOTUNE 0L
+#endif
 
 #ifdef DOUBLE_PRECISION
 #define REAL    double
@@ -58,14 +67,43 @@ public:
                                long requirementFlags) = 0;
     
     virtual int getInstanceDetails(BeagleInstanceDetails* returnInfo) = 0;
+
+    virtual int getMemoryUsage(BeagleMemoryUsage* outMemoryUsage) = 0;
+
+    virtual int setPerformanceCounters(bool enabled) = 0;
+
+    virtual int getPerformanceCounters(BeagleKernelCounters* outCounters,
+                                       int count) = 0;
+
+    virtual int resetPerformanceCounters() = 0;
+
+    virtual int startTrace(const char* fileName,
+                           int eventsPerThread) = 0;
+
+    virtual int writeTrace() = 0;
+
+    virtual int stopTrace() = 0;
+
+    // returns a new implementation holding a copy of the full state, or NULL if unsupported
+    virtual BeagleImpl* clone() = 0;
+
+    virtual int setCheckpoint() = 0;
+
+    virtual int commitCheckpoint() = 0;
+
+    virtual int rollbackCheckpoint() = 0;
     
     virtual int setCPUThreadCount(int threadCount) = 0;
 
+    virtual int getCPUThreadCount(int* outThreadCount) = 0;
+
     virtual int setTipStates(int tipIndex,
                              const int* inStates) = 0;
 
     virtual int setTipPartials(int tipIndex,
                                const double* inPartials) = 0;
+
+    virtual int attachTipData(BeagleTipData* tipData) = 0;
     
     virtual int setPartials(int bufferIndex,
                             const double* inPartials) = 0;
@@ -87,6 +125,8 @@ public:
     
     virtual int setPatternWeights(const double* inPatternWeights) = 0;
 
+    virtual int setZeroWeightPatternSkipping(bool enabled) = 0;
+
     virtual int setPatternPartitions(int partitionCount,
                                      const int* inPatternPartitions) = 0;
     
@@ -130,6 +170,11 @@ public:
                                                            const int* secondDerivativeIndices,
                                                            const double* edgeLengths,
                                                            int count) = 0;
+
+    virtual int setTransitionMatrixCacheSize(int cacheSize) = 0;
+
+    virtual int getTransitionMatrixCacheStatistics(long* outHitCount,
+                                                   long* outMissCount) = 0;
     
     virtual int updatePartials(const int* operations,
                                int operationCount,
@@ -137,6 +182,70 @@ public:
 
     virtual int updatePartialsByPartition(const int* operations,
                                           int operationCount) = 0;
+
+    virtual int setIncrementalUpdates(bool enabled) = 0;
+
+    virtual int getIncrementalUpdateStatistics(int* outOperationCount,
+                                               int* outSkippedCount) = 0;
+
+    virtual int setRootPrePartials(const int* bufferIndices,
+                                   const int* stateFrequenciesIndices,
+                                   int count) = 0;
+
+    virtual int updatePrePartials(const int* operations,
+                                  int operationCount,
+                                  int cumulativeScalingIndex) = 0;
+
+    virtual int calculateEdgeSumtable(int parentBufferIndex,
+                                      int childBufferIndex,
+                                      int eigenIndex,
+                                      int categoryWeightsIndex,
+                                      int stateFrequenciesIndex,
+                                      int cumulativeScaleIndex) = 0;
+
+    virtual int calculateEdgeSumtableLogLikelihood(double edgeLength,
+                                                   double* outSumLogLikelihood,
+                                                   double* outSumFirstDerivative,
+                                                   double* outSumSecondDerivative) = 0;
+
+    virtual int optimizeEdgeLength(double* inOutEdgeLength,
+                                   double minEdgeLength,
+                                   double maxEdgeLength,
+                                   double tolerance,
+                                   int maxIterations,
+                                   double* outSumLogLikelihood) = 0;
+
+    virtual int calculateInsertionLogLikelihoods(const int* postBufferIndices,
+                                                 const int* preBufferIndices,
+                                                 const int* cumulativeScaleIndices,
+                                                 int count,
+                                                 int subtreeBufferIndex,
+                                                 int subtreeMatrixIndex,
+                                                 int categoryWeightsIndex,
+                                                 double* outSumLogLikelihoods) = 0;
+
+    virtual int optimizeInsertionLogLikelihoods(const int* postBufferIndices,
+                                                const int* preBufferIndices,
+                                                const int* cumulativeScaleIndices,
+                                                int count,
+                                                int subtreeBufferIndex,
+                                                int eigenIndex,
+                                                int categoryWeightsIndex,
+                                                double* inOutPendantLengths,
+                                                double minEdgeLength,
+                                                double maxEdgeLength,
+                                                double tolerance,
+                                                int maxIterations,
+                                                double* outSumLogLikelihoods) = 0;
+
+    virtual int calculateEdgeDerivatives(const int* postBufferIndices,
+                                         const int* preBufferIndices,
+                                         const int* derivativeMatrixIndices,
+                                         const int* categoryWeightsIndices,
+                                         int count,
+                                         double* outDerivatives,
+                                         double* outSumDerivatives,
+                                         double* outSumSquaredDerivatives) = 0;
     
     virtual int waitForPartials(const int* destinationPartials,
                                 int destinationPartialsCount) = 0;
@@ -186,6 +295,31 @@ public:
                                                        int count,
                                                        double* outSumLogLikelihoodByPartition,
                                                        double* outSumLogLikelihood) = 0;
+
+    virtual int evaluateRootLogLikelihood(int eigenIndex,
+                                          const int* probabilityIndices,
+                                          const double* edgeLengths,
+                                          int matrixCount,
+                                          const int* operations,
+                                          int operationCount,
+                                          int rootBufferIndex,
+                                          int categoryWeightsIndex,
+                                          int stateFrequenciesIndex,
+                                          int cumulativeScaleIndex,
+                                          double* outSumLogLikelihood) = 0;
+
+    virtual int evaluateRootLogLikelihoods(const BeagleEvaluationJob* jobs,
+                                           int jobCount,
+                                           double* outSumLogLikelihoods,
+                                           int* outReturnCodes) = 0;
+
+    virtual int calculateRootLogLikelihoodsForWeights(int bufferIndex,
+                                                      int categoryWeightsIndex,
+                                                      int stateFrequenciesIndex,
+                                                      int cumulativeScaleIndex,
+                                                      const double* inPatternWeights,
+                                                      int weightVectorCount,
+                                                      double* outSumLogLikelihoods) = 0;
     
     virtual int calculateEdgeLogLikelihoods(const int* parentBufferIndices,
                                             const int* childBufferIndices,
@@ -247,6 +381,23 @@ public:
                                    long preferenceFlags,
                                    long requirementFlags,
                                    int* errorCode) = 0; // pure virtual
+
+    // reports the footprint an instance created with these arguments would have, without
+    // allocating it; returns BEAGLE_ERROR_NO_IMPLEMENTATION if createImpl would not accept them
+    virtual int estimateMemoryUsage(int tipCount,
+                                    int partialsBufferCount,
+                                    int compactBufferCount,
+                                    int stateCount,
+                                    int patternCount,
+                                    int eigenBufferCount,
+                                    int matrixBufferCount,
+                                    int categoryCount,
+                                    int scaleBufferCount,
+                                    long preferenceFlags,
+                                    long requirementFlags,
+                                    BeagleMemoryUsage* outMemoryUsage) {
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    }
     
     virtual const char* getName() = 0; // pure virtual
     
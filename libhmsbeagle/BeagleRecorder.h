@@ -0,0 +1,513 @@
+/*
+ *  BeagleRecorder.h
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __beagle_recorder__
+#define __beagle_recorder__
+
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "libhmsbeagle/beagle.h"
+
+#define BEAGLE_RECORD_VERSION       1
+#define BEAGLE_RECORD_BYTE_ORDER    0x01020304
+
+namespace beagle {
+
+/*
+ * Record of the API calls of a process, written when the environment variable
+ * BEAGLE_RECORD_FILE names a file, and replayed by examples/beaglereplay.
+ *
+ * The file is a header followed by one record per call, in the order in which
+ * the calls were made. A record holds the call, the byte length of its fields
+ * and the fields: the arguments in declaration order, each input array with
+ * its length, and the length of each output array so that a replay can
+ * allocate it. A length of -1 stands for a NULL pointer. Values are written in
+ * the byte order of the recording machine, with 32-bit ints and 64-bit lengths
+ * and flags. The numbers of the calls are part of the format and must not
+ * change.
+ */
+enum BeagleRecordedCalls {
+    BEAGLE_RECORD_CREATE_INSTANCE                             = 1,
+    BEAGLE_RECORD_CLONE_INSTANCE                              = 2,
+    BEAGLE_RECORD_FINALIZE_INSTANCE                           = 3,
+    BEAGLE_RECORD_SET_CHECKPOINT                              = 4,
+    BEAGLE_RECORD_COMMIT_CHECKPOINT                           = 5,
+    BEAGLE_RECORD_ROLLBACK_CHECKPOINT                         = 6,
+    BEAGLE_RECORD_SET_CPU_THREAD_COUNT                        = 7,
+    BEAGLE_RECORD_SET_TIP_STATES                              = 8,
+    BEAGLE_RECORD_SET_TIP_PARTIALS                            = 9,
+    BEAGLE_RECORD_CREATE_TIP_DATA                             = 10,
+    BEAGLE_RECORD_SET_TIP_DATA_STATES                         = 11,
+    BEAGLE_RECORD_SET_TIP_DATA_PARTIALS                       = 12,
+    BEAGLE_RECORD_ATTACH_TIP_DATA                             = 13,
+    BEAGLE_RECORD_FINALIZE_TIP_DATA                           = 14,
+    BEAGLE_RECORD_SET_PARTIALS                                = 15,
+    BEAGLE_RECORD_GET_PARTIALS                                = 16,
+    BEAGLE_RECORD_SET_EIGEN_DECOMPOSITION                     = 17,
+    BEAGLE_RECORD_SET_STATE_FREQUENCIES                       = 18,
+    BEAGLE_RECORD_SET_CATEGORY_WEIGHTS                        = 19,
+    BEAGLE_RECORD_SET_CATEGORY_RATES                          = 20,
+    BEAGLE_RECORD_SET_CATEGORY_RATES_WITH_INDEX               = 21,
+    BEAGLE_RECORD_SET_PATTERN_WEIGHTS                         = 22,
+    BEAGLE_RECORD_SET_ZERO_WEIGHT_PATTERN_SKIPPING            = 23,
+    BEAGLE_RECORD_SET_PATTERN_PARTITIONS                      = 24,
+    BEAGLE_RECORD_CONVOLVE_TRANSITION_MATRICES                = 25,
+    BEAGLE_RECORD_UPDATE_TRANSITION_MATRICES                  = 26,
+    BEAGLE_RECORD_UPDATE_TRANSITION_MATRICES_MULTIPLE_MODELS  = 27,
+    BEAGLE_RECORD_SET_TRANSITION_MATRIX_CACHE_SIZE            = 28,
+    BEAGLE_RECORD_SET_TRANSITION_MATRIX                       = 29,
+    BEAGLE_RECORD_GET_TRANSITION_MATRIX                       = 30,
+    BEAGLE_RECORD_SET_TRANSITION_MATRICES                     = 31,
+    BEAGLE_RECORD_UPDATE_PARTIALS                             = 32,
+    BEAGLE_RECORD_UPDATE_PARTIALS_BY_PARTITION                = 33,
+    BEAGLE_RECORD_SET_INCREMENTAL_UPDATES                     = 34,
+    BEAGLE_RECORD_SET_ROOT_PRE_PARTIALS                       = 35,
+    BEAGLE_RECORD_UPDATE_PRE_PARTIALS                         = 36,
+    BEAGLE_RECORD_CALCULATE_EDGE_DERIVATIVES                  = 37,
+    BEAGLE_RECORD_WAIT_FOR_PARTIALS                           = 38,
+    BEAGLE_RECORD_ACCUMULATE_SCALE_FACTORS                    = 39,
+    BEAGLE_RECORD_ACCUMULATE_SCALE_FACTORS_BY_PARTITION       = 40,
+    BEAGLE_RECORD_REMOVE_SCALE_FACTORS                        = 41,
+    BEAGLE_RECORD_REMOVE_SCALE_FACTORS_BY_PARTITION           = 42,
+    BEAGLE_RECORD_RESET_SCALE_FACTORS                         = 43,
+    BEAGLE_RECORD_RESET_SCALE_FACTORS_BY_PARTITION            = 44,
+    BEAGLE_RECORD_COPY_SCALE_FACTORS                          = 45,
+    BEAGLE_RECORD_GET_SCALE_FACTORS                           = 46,
+    BEAGLE_RECORD_CALCULATE_ROOT_LOG_LIKELIHOODS              = 47,
+    BEAGLE_RECORD_CALCULATE_ROOT_LOG_LIKELIHOODS_BY_PARTITION = 48,
+    BEAGLE_RECORD_EVALUATE_ROOT_LOG_LIKELIHOOD                = 49,
+    BEAGLE_RECORD_EVALUATE_ROOT_LOG_LIKELIHOODS               = 50,
+    BEAGLE_RECORD_SET_TREE                                    = 51,
+    BEAGLE_RECORD_GET_TREE_OPERATIONS                         = 52,
+    BEAGLE_RECORD_EVALUATE_TREE                               = 53,
+    BEAGLE_RECORD_CALCULATE_ROOT_LOG_LIKELIHOODS_FOR_WEIGHTS  = 54,
+    BEAGLE_RECORD_CALCULATE_EDGE_LOG_LIKELIHOODS              = 55,
+    BEAGLE_RECORD_CALCULATE_EDGE_LOG_LIKELIHOODS_BY_PARTITION = 56,
+    BEAGLE_RECORD_CALCULATE_EDGE_SUMTABLE                     = 57,
+    BEAGLE_RECORD_CALCULATE_EDGE_SUMTABLE_LOG_LIKELIHOOD      = 58,
+    BEAGLE_RECORD_OPTIMIZE_EDGE_LENGTH                        = 59,
+    BEAGLE_RECORD_CALCULATE_INSERTION_LOG_LIKELIHOODS         = 60,
+    BEAGLE_RECORD_OPTIMIZE_INSERTION_LOG_LIKELIHOODS          = 61,
+    BEAGLE_RECORD_GET_LOG_LIKELIHOOD                          = 62,
+    BEAGLE_RECORD_GET_DERIVATIVES                             = 63,
+    BEAGLE_RECORD_GET_SITE_LOG_LIKELIHOODS                    = 64,
+    BEAGLE_RECORD_GET_SITE_DERIVATIVES                        = 65,
+    BEAGLE_RECORD_CALL_COUNT                                  = 66
+};
+
+/*
+ * The name of the API function of a recorded call.
+ */
+inline const char* getRecordedCallName(int call) {
+    static const char* const names[BEAGLE_RECORD_CALL_COUNT] = {
+        "unknown",
+        "beagleCreateInstance",
+        "beagleCloneInstance",
+        "beagleFinalizeInstance",
+        "beagleSetCheckpoint",
+        "beagleCommitCheckpoint",
+        "beagleRollbackCheckpoint",
+        "beagleSetCPUThreadCount",
+        "beagleSetTipStates",
+        "beagleSetTipPartials",
+        "beagleCreateTipData",
+        "beagleSetTipDataStates",
+        "beagleSetTipDataPartials",
+        "beagleAttachTipData",
+        "beagleFinalizeTipData",
+        "beagleSetPartials",
+        "beagleGetPartials",
+        "beagleSetEigenDecomposition",
+        "beagleSetStateFrequencies",
+        "beagleSetCategoryWeights",
+        "beagleSetCategoryRates",
+        "beagleSetCategoryRatesWithIndex",
+        "beagleSetPatternWeights",
+        "beagleSetZeroWeightPatternSkipping",
+        "beagleSetPatternPartitions",
+        "beagleConvolveTransitionMatrices",
+        "beagleUpdateTransitionMatrices",
+        "beagleUpdateTransitionMatricesWithMultipleModels",
+        "beagleSetTransitionMatrixCacheSize",
+        "beagleSetTransitionMatrix",
+        "beagleGetTransitionMatrix",
+        "beagleSetTransitionMatrices",
+        "beagleUpdatePartials",
+        "beagleUpdatePartialsByPartition",
+        "beagleSetIncrementalUpdates",
+        "beagleSetRootPrePartials",
+        "beagleUpdatePrePartials",
+        "beagleCalculateEdgeDerivatives",
+        "beagleWaitForPartials",
+        "beagleAccumulateScaleFactors",
+        "beagleAccumulateScaleFactorsByPartition",
+        "beagleRemoveScaleFactors",
+        "beagleRemoveScaleFactorsByPartition",
+        "beagleResetScaleFactors",
+        "beagleResetScaleFactorsByPartition",
+        "beagleCopyScaleFactors",
+        "beagleGetScaleFactors",
+        "beagleCalculateRootLogLikelihoods",
+        "beagleCalculateRootLogLikelihoodsByPartition",
+        "beagleEvaluateRootLogLikelihood",
+        "beagleEvaluateRootLogLikelihoods",
+        "beagleSetTree",
+        "beagleGetTreeOperations",
+        "beagleEvaluateTree",
+        "beagleCalculateRootLogLikelihoodsForWeights",
+        "beagleCalculateEdgeLogLikelihoods",
+        "beagleCalculateEdgeLogLikelihoodsByPartition",
+        "beagleCalculateEdgeSumtable",
+        "beagleCalculateEdgeSumtableLogLikelihood",
+        "beagleOptimizeEdgeLength",
+        "beagleCalculateInsertionLogLikelihoods",
+        "beagleOptimizeInsertionLogLikelihoods",
+        "beagleGetLogLikelihood",
+        "beagleGetDerivatives",
+        "beagleGetSiteLogLikelihoods",
+        "beagleGetSiteDerivatives"
+    };
+    return (call > 0 && call < BEAGLE_RECORD_CALL_COUNT ? names[call] : names[0]);
+}
+
+/*
+ * The sizes of the arrays passed to an instance or to shared tip data, taken
+ * from the arguments with which it was created.
+ */
+struct BeagleRecordedDimensions {
+    int tipCount;
+    int stateCount;
+    int patternCount;
+    int categoryCount;
+    int eigenValueCount;
+};
+
+/*
+ * Writes the record file. Every call is assembled in a BeagleRecord and
+ * appended in one piece, so calls on different instances can be recorded from
+ * several threads.
+ */
+class BeagleRecorder
+{
+public:
+    explicit BeagleRecorder(const char* fileName)
+    : file(NULL) {
+        if (fileName == NULL || fileName[0] == '\0')
+            return;
+
+        file = fopen(fileName, "wb");
+        if (file == NULL) {
+            fprintf(stderr, "BEAGLE: cannot open record file %s\n", fileName);
+            return;
+        }
+
+        fwrite("BEAGLREC", 1, 8, file);
+        const int32_t header[2] = {BEAGLE_RECORD_VERSION, BEAGLE_RECORD_BYTE_ORDER};
+        fwrite(header, sizeof(int32_t), 2, file);
+    }
+
+    ~BeagleRecorder() {
+        if (file != NULL)
+            fclose(file);
+    }
+
+    bool isOpen() const { return file != NULL; }
+
+    void append(const std::vector<char>& record) {
+        std::lock_guard<std::mutex> lock(mutex);
+        fwrite(&record[0], 1, record.size(), file);
+    }
+
+    void setInstanceDimensions(int instance,
+                               const BeagleRecordedDimensions& dimensions) {
+        std::lock_guard<std::mutex> lock(mutex);
+        instanceDimensions[instance] = dimensions;
+    }
+
+    BeagleRecordedDimensions getInstanceDimensions(int instance) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return instanceDimensions[instance];
+    }
+
+    void setTipDataDimensions(int tipData,
+                              const BeagleRecordedDimensions& dimensions) {
+        std::lock_guard<std::mutex> lock(mutex);
+        tipDataDimensions[tipData] = dimensions;
+    }
+
+    BeagleRecordedDimensions getTipDataDimensions(int tipData) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return tipDataDimensions[tipData];
+    }
+
+private:
+    FILE* file;
+    std::mutex mutex;
+    std::map<int, BeagleRecordedDimensions> instanceDimensions;
+    std::map<int, BeagleRecordedDimensions> tipDataDimensions;
+};
+
+/*
+ * One recorded call, appended to the file on destruction.
+ */
+class BeagleRecord
+{
+public:
+    BeagleRecord(BeagleRecorder& recorder,
+                 int call)
+    : recorder(recorder) {
+        putInt(call);
+        putInt(0); // byte length of the fields, set on destruction
+    }
+
+    ~BeagleRecord() {
+        const int32_t length = buffer.size() - 2 * sizeof(int32_t);
+        memcpy(&buffer[sizeof(int32_t)], &length, sizeof(int32_t));
+        recorder.append(buffer);
+    }
+
+    void putInt(int value) {
+        const int32_t field = value;
+        put(&field, sizeof(int32_t));
+    }
+
+    void putLong(long value) {
+        const int64_t field = value;
+        put(&field, sizeof(int64_t));
+    }
+
+    void putDouble(double value) {
+        put(&value, sizeof(double));
+    }
+
+    void putInts(const int* values,
+                 long count) {
+        if (putLength(values, count))
+            put(values, sizeof(int) * count);
+    }
+
+    void putDoubles(const double* values,
+                    long count) {
+        if (putLength(values, count))
+            put(values, sizeof(double) * count);
+    }
+
+    void putString(const char* value) {
+        if (putLength(value, (value != NULL ? strlen(value) : 0)))
+            put(value, strlen(value));
+    }
+
+    // the length of an output array, -1 if it is NULL
+    void putOutput(const void* pointer,
+                   long count) {
+        putLength(pointer, count);
+    }
+
+private:
+    bool putLength(const void* pointer,
+                   long count) {
+        putLong(pointer != NULL ? count : -1);
+        return (pointer != NULL);
+    }
+
+    void put(const void* data,
+             size_t size) {
+        const char* bytes = (const char*) data;
+        buffer.insert(buffer.end(), bytes, bytes + size);
+    }
+
+    BeagleRecorder& recorder;
+    std::vector<char> buffer;
+};
+
+/*
+ * Depth of the API calls the library makes on its own behalf on this thread,
+ * such as the instances created by benchmarking and autotuning. These calls
+ * are not recorded: a replay repeats only the calls of the client.
+ */
+inline int& getBeagleInternalCallDepth() {
+    static thread_local int depth = 0;
+    return depth;
+}
+
+/*
+ * Marks the API calls made during its lifetime on this thread as internal.
+ */
+class BeagleInternalCall
+{
+public:
+    BeagleInternalCall() { getBeagleInternalCallDepth()++; }
+    ~BeagleInternalCall() { getBeagleInternalCallDepth()--; }
+
+private:
+    BeagleInternalCall(const BeagleInternalCall&);
+    BeagleInternalCall& operator=(const BeagleInternalCall&);
+};
+
+/*
+ * Reads a record file, one call at a time. Reading past the end of a record
+ * yields zeros and empty arrays and clears isValid().
+ */
+class BeagleRecordReader
+{
+public:
+    explicit BeagleRecordReader(const char* fileName)
+    : file(fopen(fileName, "rb")),
+      kStart(0),
+      kCall(0),
+      position(0),
+      valid(false) {
+        if (file == NULL)
+            return;
+
+        char magic[8];
+        int32_t header[2];
+        if (fread(magic, 1, 8, file) != 8 || memcmp(magic, "BEAGLREC", 8) != 0 ||
+            fread(header, sizeof(int32_t), 2, file) != 2 ||
+            header[0] != BEAGLE_RECORD_VERSION || header[1] != BEAGLE_RECORD_BYTE_ORDER) {
+            fclose(file);
+            file = NULL;
+            return;
+        }
+        kStart = ftell(file);
+    }
+
+    ~BeagleRecordReader() {
+        if (file != NULL)
+            fclose(file);
+    }
+
+    bool isOpen() const { return file != NULL; }
+
+    // whether every field read from the current record was in the record
+    bool isValid() const { return valid; }
+
+    int getCall() const { return kCall; }
+
+    void rewind() {
+        fseek(file, kStart, SEEK_SET);
+    }
+
+    /*
+     * Reads the next record, returning false at the end of the file.
+     */
+    bool next() {
+        int32_t header[2];
+        if (fread(header, sizeof(int32_t), 2, file) != 2 || header[1] < 0)
+            return false;
+        kCall = header[0];
+        buffer.resize(header[1]);
+        position = 0;
+        valid = (fread(&buffer[0], 1, header[1], file) == (size_t) header[1]);
+        return valid;
+    }
+
+    int getInt() {
+        int32_t field = 0;
+        get(&field, sizeof(int32_t));
+        return field;
+    }
+
+    long getLong() {
+        int64_t field = 0;
+        get(&field, sizeof(int64_t));
+        return field;
+    }
+
+    double getDouble() {
+        double field = 0.0;
+        get(&field, sizeof(double));
+        return field;
+    }
+
+    // an input array, or NULL if NULL was passed
+    const int* getInts(std::vector<int>& values) {
+        const long count = getLength(sizeof(int));
+        values.resize(count > 0 ? count : 1);
+        if (count > 0)
+            get(&values[0], sizeof(int) * count);
+        return (count >= 0 ? &values[0] : NULL);
+    }
+
+    const double* getDoubles(std::vector<double>& values) {
+        const long count = getLength(sizeof(double));
+        values.resize(count > 0 ? count : 1);
+        if (count > 0)
+            get(&values[0], sizeof(double) * count);
+        return (count >= 0 ? &values[0] : NULL);
+    }
+
+    const char* getString(std::string& value) {
+        const long count = getLength(1);
+        value.assign(count > 0 ? count : 0, '\0');
+        if (count > 0)
+            get(&value[0], count);
+        return (count >= 0 ? value.c_str() : NULL);
+    }
+
+    // an output array of the recorded length, or NULL if NULL was passed
+    template <typename T>
+    T* getOutput(std::vector<T>& values) {
+        const long count = getLength(0);
+        values.assign(count > 0 ? count : 1, T());
+        return (count >= 0 ? &values[0] : NULL);
+    }
+
+private:
+    // the length of an array whose elements of elementSize bytes follow, or of an output
+    long getLength(size_t elementSize) {
+        const long count = getLong();
+        if (count < -1 || (count > 0 && count * elementSize > buffer.size() - position)) {
+            valid = false;
+            return -1;
+        }
+        return count;
+    }
+
+    void get(void* data,
+             size_t size) {
+        if (size > buffer.size() - position) {
+            valid = false;
+            return;
+        }
+        memcpy(data, &buffer[position], size);
+        position += size;
+    }
+
+    FILE* file;
+    long kStart;
+    int kCall;
+    std::vector<char> buffer;
+    size_t position;
+    bool valid;
+};
+
+}	// namespace beagle
+
+#endif // __beagle_recorder__
@@ -0,0 +1,186 @@
+/*
+ *  BeagleTipData.h
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __beagle_tip_data__
+#define __beagle_tip_data__
+
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "libhmsbeagle/beagle.h"
+
+namespace beagle {
+
+/*
+ * Reference-counted, read-only tip data shared by several instances.
+ *
+ * The client fills in tip states or partials once; the data is sealed when it
+ * is first attached to an instance. Implementations convert the tips to their
+ * own buffer layout at most once per layout and keep the result here, so all
+ * instances with the same layout point at the same buffers. Everything is
+ * header-only because the object is created by the library and used from
+ * within dynamically loaded plugins.
+ */
+class BeagleTipData
+{
+public:
+    BeagleTipData(int tipCount,
+                  int stateCount,
+                  int patternCount)
+    : kTipCount(tipCount),
+      kStateCount(stateCount),
+      kPatternCount(patternCount),
+      gTipStates(tipCount, (int*) NULL),
+      gTipPartials(tipCount, (double*) NULL),
+      sealed(false),
+      referenceCount(1) {
+    }
+
+    ~BeagleTipData() {
+        for (int i = 0; i < kTipCount; i++) {
+            free(gTipStates[i]);
+            free(gTipPartials[i]);
+        }
+        for (LayoutMap::iterator it = gLayouts.begin(); it != gLayouts.end(); ++it) {
+            for (size_t i = 0; i < it->second.size(); i++)
+                free(it->second[i]);
+        }
+    }
+
+    int getTipCount() const { return kTipCount; }
+
+    int getStateCount() const { return kStateCount; }
+
+    int getPatternCount() const { return kPatternCount; }
+
+    int setTipStates(int tipIndex,
+                     const int* inStates) {
+        if (tipIndex < 0 || tipIndex >= kTipCount)
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+        if (sealed)
+            return BEAGLE_ERROR_GENERAL;
+        if (gTipStates[tipIndex] == NULL) {
+            gTipStates[tipIndex] = (int*) malloc(sizeof(int) * kPatternCount);
+            if (gTipStates[tipIndex] == NULL)
+                return BEAGLE_ERROR_OUT_OF_MEMORY;
+        }
+        memcpy(gTipStates[tipIndex], inStates, sizeof(int) * kPatternCount);
+        free(gTipPartials[tipIndex]);
+        gTipPartials[tipIndex] = NULL;
+        return BEAGLE_SUCCESS;
+    }
+
+    int setTipPartials(int tipIndex,
+                       const double* inPartials) {
+        if (tipIndex < 0 || tipIndex >= kTipCount)
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+        if (sealed)
+            return BEAGLE_ERROR_GENERAL;
+        if (gTipPartials[tipIndex] == NULL) {
+            gTipPartials[tipIndex] = (double*) malloc(sizeof(double) * kPatternCount * kStateCount);
+            if (gTipPartials[tipIndex] == NULL)
+                return BEAGLE_ERROR_OUT_OF_MEMORY;
+        }
+        memcpy(gTipPartials[tipIndex], inPartials, sizeof(double) * kPatternCount * kStateCount);
+        free(gTipStates[tipIndex]);
+        gTipStates[tipIndex] = NULL;
+        return BEAGLE_SUCCESS;
+    }
+
+    const int* getTipStates(int tipIndex) const { return gTipStates[tipIndex]; }
+
+    const double* getTipPartials(int tipIndex) const { return gTipPartials[tipIndex]; }
+
+    /*
+     * Must be held while converting tips into, or looking up, a layout.
+     */
+    std::mutex& getMutex() { return layoutMutex; }
+
+    /*
+     * Returns the buffer previously stored for (layout, tipIndex), or NULL.
+     */
+    void* getLayoutBuffer(const std::string& layout,
+                          int tipIndex) {
+        LayoutMap::iterator it = gLayouts.find(layout);
+        if (it == gLayouts.end())
+            return NULL;
+        return it->second[tipIndex];
+    }
+
+    /*
+     * Takes ownership of a malloc'ed buffer holding tipIndex in the given layout.
+     */
+    void setLayoutBuffer(const std::string& layout,
+                         int tipIndex,
+                         void* buffer) {
+        LayoutMap::iterator it = gLayouts.find(layout);
+        if (it == gLayouts.end())
+            it = gLayouts.insert(std::make_pair(layout, std::vector<void*>(kTipCount, (void*) NULL))).first;
+        it->second[tipIndex] = buffer;
+    }
+
+    bool isLayoutBuffer(const void* buffer) {
+        std::lock_guard<std::mutex> lock(layoutMutex);
+        for (LayoutMap::iterator it = gLayouts.begin(); it != gLayouts.end(); ++it) {
+            for (size_t i = 0; i < it->second.size(); i++) {
+                if (it->second[i] == buffer)
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    void seal() { sealed = true; }
+
+    void retain() { referenceCount++; }
+
+    void release() {
+        if (--referenceCount == 0)
+            delete this;
+    }
+
+private:
+    typedef std::map<std::string, std::vector<void*> > LayoutMap;
+
+    const int kTipCount;
+    const int kStateCount;
+    const int kPatternCount;
+
+    std::vector<int*> gTipStates;
+    std::vector<double*> gTipPartials;
+
+    LayoutMap gLayouts;
+    std::mutex layoutMutex;
+
+    bool sealed;
+    std::atomic<int> referenceCount;
+};
+
+}	// namespace beagle
+
+#endif // __beagle_tip_data__
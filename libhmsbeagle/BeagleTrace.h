@@ -0,0 +1,357 @@
+/*
+ *  BeagleTrace.h
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __beagle_trace__
+#define __beagle_trace__
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libhmsbeagle/beagle.h"
+
+namespace beagle {
+
+/*
+ * Timeline of the calls and thread-pool tasks of an instance, written in the
+ * Chrome trace event format (chrome://tracing, Perfetto).
+ *
+ * Every thread that records an event owns a ring buffer of fixed capacity,
+ * claimed on its first event, so recording takes no lock: the owner is the only
+ * writer and publishes each event by advancing the head of its ring. Once a
+ * ring is full the oldest events are overwritten. Rings are read by write() and
+ * freed by stop(); both must be called while no other call on the instance is
+ * running. Event names and categories must be string literals.
+ */
+class BeagleTracer
+{
+public:
+    BeagleTracer()
+    : active(false),
+      kSessionId(0),
+      kEventCapacity(0),
+      kStartTime(0.0),
+      ringCount(0),
+      droppedCount(0) {
+        for (int i = 0; i < kMaxRingCount; i++)
+            rings[i].store(NULL, std::memory_order_relaxed);
+    }
+
+    // a copy, as held by a cloned instance, is not tracing
+    BeagleTracer(const BeagleTracer& /*other*/)
+    : active(false),
+      kSessionId(0),
+      kEventCapacity(0),
+      kStartTime(0.0),
+      ringCount(0),
+      droppedCount(0) {
+        for (int i = 0; i < kMaxRingCount; i++)
+            rings[i].store(NULL, std::memory_order_relaxed);
+    }
+
+    ~BeagleTracer() {
+        stop();
+    }
+
+    bool isActive() const { return active.load(std::memory_order_relaxed); }
+
+    /*
+     * Starts recording up to eventsPerThread events per thread, to be written to
+     * fileName. A trace already running is written and stopped first.
+     */
+    int start(const char* fileName,
+              int eventsPerThread,
+              const char* processName) {
+        if (fileName == NULL || eventsPerThread <= 0)
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+
+        stop();
+
+        kFileName = fileName;
+        kProcessName = (processName != NULL ? processName : "BEAGLE");
+        kEventCapacity = eventsPerThread;
+        kSessionId = ++getSessionCounter();
+        kStartTime = getTime();
+        ringCount.store(0, std::memory_order_relaxed);
+        droppedCount.store(0, std::memory_order_relaxed);
+        active.store(true, std::memory_order_release);
+
+        return BEAGLE_SUCCESS;
+    }
+
+    /*
+     * Writes the events held in the rings, oldest first per thread, and keeps
+     * recording.
+     */
+    int write() {
+        if (kSessionId == 0)
+            return BEAGLE_ERROR_GENERAL;
+
+        FILE* file = fopen(kFileName.c_str(), "w");
+        if (file == NULL)
+            return BEAGLE_ERROR_GENERAL;
+
+        fprintf(file, "{\"traceEvents\":[\n");
+        fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"%s\"}}",
+                kProcessName.c_str());
+
+        unsigned long overwrittenCount = 0;
+        const int count = getRingCount();
+        for (int r = 0; r < count; r++) {
+            const TraceRing* ring = rings[r].load(std::memory_order_acquire);
+            if (ring == NULL)
+                continue;
+
+            const unsigned long head = ring->head.load(std::memory_order_acquire);
+            const unsigned long first = (head > (unsigned long) kEventCapacity ? head - kEventCapacity : 0);
+            overwrittenCount += first;
+
+            // pool threads run tasks, callers do not
+            bool runsTasks = false;
+            for (unsigned long e = first; e < head && !runsTasks; e++)
+                runsTasks = (strcmp(ring->events[e % kEventCapacity].category, "task") == 0);
+
+            fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                          "\"args\":{\"name\":\"%s %d\"}}", r, (runsTasks ? "worker" : "caller"), r);
+            for (unsigned long e = first; e < head; e++) {
+                const TraceEvent& event = ring->events[e % kEventCapacity];
+                fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                              "\"ts\":%.3f,\"dur\":%.3f",
+                        event.name, event.category, r, event.beginTime - kStartTime,
+                        event.endTime - event.beginTime);
+                if (event.count >= 0)
+                    fprintf(file, ",\"args\":{\"count\":%ld}", event.count);
+                fprintf(file, "}");
+            }
+        }
+
+        fprintf(file, "\n],\n\"displayTimeUnit\":\"ms\",\n");
+        fprintf(file, "\"otherData\":{\"overwrittenEvents\":%lu,\"droppedEvents\":%lu}}\n",
+                overwrittenCount, droppedCount.load(std::memory_order_relaxed));
+
+        return (fclose(file) == 0 ? BEAGLE_SUCCESS : BEAGLE_ERROR_GENERAL);
+    }
+
+    /*
+     * Writes the trace and stops recording.
+     */
+    int stop() {
+        if (kSessionId == 0)
+            return BEAGLE_ERROR_GENERAL;
+
+        active.store(false, std::memory_order_release);
+        int returnCode = write();
+
+        const int count = getRingCount();
+        for (int r = 0; r < count; r++)
+            delete rings[r].exchange(NULL, std::memory_order_acq_rel);
+        ringCount.store(0, std::memory_order_relaxed);
+        kSessionId = 0;
+
+        return returnCode;
+    }
+
+    void record(const char* name,
+                const char* category,
+                double beginTime,
+                double endTime,
+                long count) {
+        TraceRing* ring = getRing();
+        if (ring == NULL) {
+            droppedCount.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        const unsigned long head = ring->head.load(std::memory_order_relaxed);
+        TraceEvent& event = ring->events[head % kEventCapacity];
+        event.name = name;
+        event.category = category;
+        event.beginTime = beginTime;
+        event.endTime = endTime;
+        event.count = count;
+        ring->head.store(head + 1, std::memory_order_release);
+    }
+
+    /*
+     * Microseconds on a monotonic clock.
+     */
+    static double getTime() {
+        return std::chrono::duration<double, std::micro>(
+                   std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+private:
+    enum { kMaxRingCount = 256 };
+
+    struct TraceEvent {
+        const char* name;
+        const char* category;
+        double beginTime;
+        double endTime;
+        long count;
+    };
+
+    struct TraceRing {
+        TraceRing(int capacity)
+        : owner(std::this_thread::get_id()),
+          events(capacity),
+          head(0) {
+        }
+
+        const std::thread::id owner;
+        std::vector<TraceEvent> events;
+        std::atomic<unsigned long> head;
+    };
+
+    struct RingCache {
+        unsigned long sessionId;
+        TraceRing* ring;
+    };
+
+    static std::atomic<unsigned long>& getSessionCounter() {
+        static std::atomic<unsigned long> sessionCounter(0);
+        return sessionCounter;
+    }
+
+    static RingCache& getRingCache() {
+        static thread_local RingCache ringCache = {0, NULL};
+        return ringCache;
+    }
+
+    int getRingCount() const {
+        const int count = ringCount.load(std::memory_order_acquire);
+        return (count < kMaxRingCount ? count : kMaxRingCount);
+    }
+
+    // the ring of the calling thread, claimed on its first event of the session
+    TraceRing* getRing() {
+        RingCache& cache = getRingCache();
+        if (cache.sessionId == kSessionId && cache.ring != NULL)
+            return cache.ring;
+
+        const std::thread::id self = std::this_thread::get_id();
+        TraceRing* ring = NULL;
+        const int count = getRingCount();
+        for (int r = 0; r < count && ring == NULL; r++) {
+            TraceRing* candidate = rings[r].load(std::memory_order_acquire);
+            if (candidate != NULL && candidate->owner == self)
+                ring = candidate;
+        }
+
+        if (ring == NULL) {
+            const int index = ringCount.fetch_add(1, std::memory_order_acq_rel);
+            if (index >= kMaxRingCount)
+                return NULL;
+            ring = new TraceRing(kEventCapacity);
+            rings[index].store(ring, std::memory_order_release);
+        }
+
+        cache.sessionId = kSessionId;
+        cache.ring = ring;
+
+        return ring;
+    }
+
+    std::atomic<bool> active;
+    unsigned long kSessionId;
+    int kEventCapacity;
+    double kStartTime;
+    std::string kFileName;
+    std::string kProcessName;
+
+    std::atomic<TraceRing*> rings[kMaxRingCount];
+    std::atomic<int> ringCount;
+    std::atomic<unsigned long> droppedCount;
+};
+
+/*
+ * Records the time from construction to destruction as one event, if the
+ * tracer was recording at construction.
+ */
+class BeagleTraceScope
+{
+public:
+    BeagleTraceScope(BeagleTracer& tracer,
+                     const char* name,
+                     const char* category,
+                     long count = -1)
+    : tracer(tracer),
+      name(name),
+      category(category),
+      kCount(count),
+      beginTime(tracer.isActive() ? BeagleTracer::getTime() : -1.0) {
+    }
+
+    ~BeagleTraceScope() {
+        if (beginTime >= 0.0 && tracer.isActive())
+            tracer.record(name, category, beginTime, BeagleTracer::getTime(), kCount);
+    }
+
+private:
+    BeagleTracer& tracer;
+    const char* name;
+    const char* category;
+    const long kCount;
+    const double beginTime;
+};
+
+/*
+ * A thread-pool task that records its run as a "task" event.
+ */
+template <typename Task>
+class BeagleTracedTask
+{
+public:
+    BeagleTracedTask(BeagleTracer& tracer,
+                     const char* name,
+                     Task task)
+    : tracer(&tracer),
+      name(name),
+      task(task) {
+    }
+
+    void operator()() {
+        BeagleTraceScope scope(*tracer, name, "task");
+        task();
+    }
+
+private:
+    BeagleTracer* tracer;
+    const char* name;
+    Task task;
+};
+
+template <typename Task>
+BeagleTracedTask<Task> makeTracedTask(BeagleTracer& tracer,
+                                      const char* name,
+                                      Task task) {
+    return BeagleTracedTask<Task>(tracer, name, task);
+}
+
+}	// namespace beagle
+
+#endif // __beagle_trace__
@@ -0,0 +1,233 @@
+/*
+ *  BeagleTree.h
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __beagle_tree__
+#define __beagle_tree__
+
+#include <algorithm>
+#include <vector>
+
+#include "libhmsbeagle/beagle.h"
+
+namespace beagle {
+
+/*
+ * A rooted binary tree, given as the parent of each node, and the partials
+ * operations that compute its root.
+ *
+ * Nodes are identified by their partials buffer. The operations are ordered
+ * level by level: an internal node is placed by its height above the leaves,
+ * so all operations of a level are independent of each other, and within a
+ * level by its position in a post-order traversal, which only makes the
+ * order deterministic. With scaling, internal nodes
+ * write scale buffers 0, 1, ... in increasing node order and the cumulative
+ * scale buffer follows them. The schedule is kept until the topology or
+ * branch matrices change.
+ */
+class BeagleTree
+{
+public:
+    BeagleTree()
+    : kNodeCount(0),
+      kRootIndex(BEAGLE_OP_NONE),
+      kCumulativeScaleIndex(BEAGLE_OP_NONE),
+      kUseScaling(false),
+      kScheduleCount(0) {
+    }
+
+    int setTopology(const int* parentIndices,
+                    const int* matrixIndices,
+                    int nodeCount,
+                    bool useScaling) {
+        if (nodeCount < 3)
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+
+        std::vector<int> matrices(nodeCount);
+        for (int i = 0; i < nodeCount; i++)
+            matrices[i] = (matrixIndices != NULL ? matrixIndices[i] : i);
+
+        if (nodeCount == kNodeCount && useScaling == kUseScaling &&
+            std::equal(parentIndices, parentIndices + nodeCount, gParents.begin()) &&
+            matrices == gNodeMatrices)
+            return BEAGLE_SUCCESS;
+
+        // children in increasing node order; a binary tree has exactly two below every internal node
+        std::vector<int> child1(nodeCount, BEAGLE_OP_NONE);
+        std::vector<int> child2(nodeCount, BEAGLE_OP_NONE);
+        int rootIndex = BEAGLE_OP_NONE;
+        for (int i = 0; i < nodeCount; i++) {
+            const int parent = parentIndices[i];
+            if (parent == BEAGLE_OP_NONE) {
+                if (rootIndex != BEAGLE_OP_NONE)
+                    return BEAGLE_ERROR_GENERAL;
+                rootIndex = i;
+            } else if (parent < 0 || parent >= nodeCount || parent == i) {
+                return BEAGLE_ERROR_OUT_OF_RANGE;
+            } else if (child1[parent] == BEAGLE_OP_NONE) {
+                child1[parent] = i;
+            } else if (child2[parent] == BEAGLE_OP_NONE) {
+                child2[parent] = i;
+            } else {
+                return BEAGLE_ERROR_GENERAL;
+            }
+            if (parent != BEAGLE_OP_NONE && matrices[i] < 0)
+                return BEAGLE_ERROR_OUT_OF_RANGE;
+        }
+        if (rootIndex == BEAGLE_OP_NONE)
+            return BEAGLE_ERROR_GENERAL;
+
+        // heights and post-order ranks from the root; a node left unvisited lies on a cycle
+        std::vector<int> heights(nodeCount, 0);
+        std::vector<int> postOrder(nodeCount, -1);
+        std::vector<int> stack(1, rootIndex);
+        std::vector<bool> expanded(nodeCount, false);
+        int visited = 0;
+        while (!stack.empty()) {
+            const int node = stack.back();
+            if (child1[node] != BEAGLE_OP_NONE && child2[node] == BEAGLE_OP_NONE)
+                return BEAGLE_ERROR_GENERAL;
+            if (child1[node] != BEAGLE_OP_NONE && !expanded[node]) {
+                expanded[node] = true;
+                stack.push_back(child2[node]);
+                stack.push_back(child1[node]);
+                continue;
+            }
+            stack.pop_back();
+            if (child1[node] != BEAGLE_OP_NONE)
+                heights[node] = 1 + std::max(heights[child1[node]], heights[child2[node]]);
+            postOrder[node] = visited++;
+        }
+        if (visited != nodeCount)
+            return BEAGLE_ERROR_GENERAL;
+
+        std::vector<int> internalNodes;
+        std::vector<int> scaleIndices(nodeCount, BEAGLE_OP_NONE);
+        for (int i = 0; i < nodeCount; i++) {
+            if (child1[i] != BEAGLE_OP_NONE) {
+                if (useScaling)
+                    scaleIndices[i] = internalNodes.size();
+                internalNodes.push_back(i);
+            }
+        }
+        std::sort(internalNodes.begin(), internalNodes.end(), LevelOrder(heights, postOrder));
+
+        gOperations.resize(internalNodes.size() * BEAGLE_OP_COUNT);
+        gLevelCounts.assign(heights[rootIndex], 0);
+        for (size_t op = 0; op < internalNodes.size(); op++) {
+            const int node = internalNodes[op];
+            int* operation = &gOperations[op * BEAGLE_OP_COUNT];
+            operation[0] = node;
+            operation[1] = scaleIndices[node];
+            operation[2] = BEAGLE_OP_NONE;
+            operation[3] = child1[node];
+            operation[4] = matrices[child1[node]];
+            operation[5] = child2[node];
+            operation[6] = matrices[child2[node]];
+            gLevelCounts[heights[node] - 1]++;
+        }
+
+        gBranchMatrices.clear();
+        gBranchNodes.clear();
+        for (int i = 0; i < nodeCount; i++) {
+            if (i != rootIndex) {
+                gBranchMatrices.push_back(matrices[i]);
+                gBranchNodes.push_back(i);
+            }
+        }
+
+        gParents.assign(parentIndices, parentIndices + nodeCount);
+        gNodeMatrices.swap(matrices);
+        kNodeCount = nodeCount;
+        kRootIndex = rootIndex;
+        kUseScaling = useScaling;
+        kCumulativeScaleIndex = (useScaling ? (int) internalNodes.size() : BEAGLE_OP_NONE);
+        kScheduleCount++;
+
+        return BEAGLE_SUCCESS;
+    }
+
+    bool hasTopology() const { return kNodeCount > 0; }
+
+    int getNodeCount() const { return kNodeCount; }
+
+    int getRootIndex() const { return kRootIndex; }
+
+    int getCumulativeScaleIndex() const { return kCumulativeScaleIndex; }
+
+    /*
+     * Operations in BEAGLE_OP_COUNT layout, ordered level by level from the leaves.
+     */
+    const int* getOperations() const { return &gOperations[0]; }
+
+    int getOperationCount() const { return gOperations.size() / BEAGLE_OP_COUNT; }
+
+    /*
+     * Number of operations in each level, starting with the parents of leaves only.
+     */
+    const std::vector<int>& getLevelCounts() const { return gLevelCounts; }
+
+    /*
+     * Matrix of the branch above each non-root node, and that node.
+     */
+    const std::vector<int>& getBranchMatrices() const { return gBranchMatrices; }
+
+    const std::vector<int>& getBranchNodes() const { return gBranchNodes; }
+
+    /*
+     * Number of times the operations were generated.
+     */
+    int getScheduleCount() const { return kScheduleCount; }
+
+private:
+    struct LevelOrder {
+        LevelOrder(const std::vector<int>& heights,
+                   const std::vector<int>& postOrder)
+        : heights(heights), postOrder(postOrder) {}
+
+        bool operator()(int a, int b) const {
+            if (heights[a] != heights[b])
+                return heights[a] < heights[b];
+            return postOrder[a] < postOrder[b];
+        }
+
+        const std::vector<int>& heights;
+        const std::vector<int>& postOrder;
+    };
+
+    int kNodeCount;
+    int kRootIndex;
+    int kCumulativeScaleIndex;
+    bool kUseScaling;
+    int kScheduleCount;
+
+    std::vector<int> gParents;
+    std::vector<int> gNodeMatrices;
+    std::vector<int> gOperations;
+    std::vector<int> gLevelCounts;
+    std::vector<int> gBranchMatrices;
+    std::vector<int> gBranchNodes;
+};
+
+}	// namespace beagle
+
+#endif // __beagle_tree__
@@ -77,7 +77,9 @@ public:
 	virtual const long getFlags();
     
 protected:
-    virtual int getPaddedPatternsModulus();  
+    virtual int getPaddedPatternsModulus();
+
+    virtual BeagleCPUImpl<BEAGLE_CPU_4_AVX_FLOAT>* newCopy();  
     
 private:
     
@@ -159,6 +161,8 @@ public:
     
 protected:
     virtual int getPaddedPatternsModulus();
+
+    virtual BeagleCPUImpl<BEAGLE_CPU_4_AVX_DOUBLE>* newCopy();
     
 private:
     
@@ -230,6 +234,19 @@ public:
                                    long requirementFlags,
                                    int* errorCode);
 
+    virtual int estimateMemoryUsage(int tipCount,
+                                    int partialsBufferCount,
+                                    int compactBufferCount,
+                                    int stateCount,
+                                    int patternCount,
+                                    int eigenBufferCount,
+                                    int matrixBufferCount,
+                                    int categoryCount,
+                                    int scaleBufferCount,
+                                    long preferenceFlags,
+                                    long requirementFlags,
+                                    BeagleMemoryUsage* outMemoryUsage);
+
     virtual const char* getName();
     virtual const long getFlags();
 };
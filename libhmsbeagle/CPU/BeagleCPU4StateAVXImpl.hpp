@@ -695,11 +695,21 @@ int BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_DOUBLE>::getPaddedPatternsModulus()
 	return 1;  // We currently do not vectorize across patterns
 }
 
+BEAGLE_CPU_4_AVX_TEMPLATE
+BeagleCPUImpl<BEAGLE_CPU_4_AVX_FLOAT>* BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_FLOAT>::newCopy() {
+    return new BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_FLOAT>(*this);
+}
+
 BEAGLE_CPU_4_AVX_TEMPLATE
 const char* BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_FLOAT>::getName() {
 	return  getBeagleCPU4StateAVXName<float>();
 }
 
+BEAGLE_CPU_4_AVX_TEMPLATE
+BeagleCPUImpl<BEAGLE_CPU_4_AVX_DOUBLE>* BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_DOUBLE>::newCopy() {
+    return new BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_DOUBLE>(*this);
+}
+
 BEAGLE_CPU_4_AVX_TEMPLATE
 const char* BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_DOUBLE>::getName() {
     return  getBeagleCPU4StateAVXName<double>();
@@ -775,6 +785,30 @@ BeagleImpl* BeagleCPU4StateAVXImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::createImp
     return NULL;
 }
 
+BEAGLE_CPU_FACTORY_TEMPLATE
+int BeagleCPU4StateAVXImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::estimateMemoryUsage(int tipCount,
+                                             int partialsBufferCount,
+                                             int compactBufferCount,
+                                             int stateCount,
+                                             int patternCount,
+                                             int eigenBufferCount,
+                                             int matrixBufferCount,
+                                             int categoryCount,
+                                             int scaleBufferCount,
+                                             long preferenceFlags,
+                                             long requirementFlags,
+                                             BeagleMemoryUsage* outMemoryUsage) {
+
+    if (stateCount != 4 || !CPUSupportsAVX()) {
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    }
+
+    return BeagleCPU4StateAVXImpl<REALTYPE, T_PAD_4_AVX_DEFAULT, P_PAD_4_AVX_DEFAULT>::estimateMemoryUsage(tipCount,
+                partialsBufferCount, compactBufferCount, stateCount, patternCount, eigenBufferCount,
+                matrixBufferCount, categoryCount, scaleBufferCount, preferenceFlags, requirementFlags,
+                outMemoryUsage);
+}
+
 BEAGLE_CPU_FACTORY_TEMPLATE
 const char* BeagleCPU4StateAVXImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getName() {
 	return getBeagleCPU4StateAVXName<BEAGLE_CPU_FACTORY_GENERIC>();
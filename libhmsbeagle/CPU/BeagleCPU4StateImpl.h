@@ -70,6 +70,11 @@ public:
     virtual ~BeagleCPU4StateImpl();
     virtual const char* getName();
 
+protected:
+    virtual BeagleCPUImpl<BEAGLE_CPU_GENERIC>* newCopy();
+
+public:
+
 
     virtual void calcStatesStates(REALTYPE* destP,
                                     const int* states1,
@@ -95,6 +100,38 @@ public:
                                       int startPattern,
                                       int endPattern);
 
+    virtual void calcPrePartialsPartials(REALTYPE* destP,
+                                         const REALTYPE* partials1,
+                                         const REALTYPE* matrices1,
+                                         const REALTYPE* partials2,
+                                         const REALTYPE* matrices2,
+                                         int startPattern,
+                                         int endPattern);
+
+    virtual void calcPrePartialsStates(REALTYPE* destP,
+                                       const REALTYPE* partials1,
+                                       const REALTYPE* matrices1,
+                                       const int* states2,
+                                       const REALTYPE* matrices2,
+                                       int startPattern,
+                                       int endPattern);
+
+    virtual void calcEdgeDerivativesPartials(REALTYPE* outDerivatives,
+                                             const REALTYPE* postPartials,
+                                             const REALTYPE* prePartials,
+                                             const REALTYPE* derivativeMatrices,
+                                             const REALTYPE* categoryWeights,
+                                             int startPattern,
+                                             int endPattern);
+
+    virtual void calcEdgeDerivativesStates(REALTYPE* outDerivatives,
+                                           const int* postStates,
+                                           const REALTYPE* prePartials,
+                                           const REALTYPE* derivativeMatrices,
+                                           const REALTYPE* categoryWeights,
+                                           int startPattern,
+                                           int endPattern);
+
     virtual int calcRootLogLikelihoods(const int bufferIndex,
                                         const int categoryWeightsIndex,
                                         const int stateFrequenciesIndex,
@@ -213,6 +250,19 @@ public:
                                    long requirementFlags,
                                    int* errorCode);
 
+    virtual int estimateMemoryUsage(int tipCount,
+                                    int partialsBufferCount,
+                                    int compactBufferCount,
+                                    int stateCount,
+                                    int patternCount,
+                                    int eigenBufferCount,
+                                    int matrixBufferCount,
+                                    int categoryCount,
+                                    int scaleBufferCount,
+                                    long preferenceFlags,
+                                    long requirementFlags,
+                                    BeagleMemoryUsage* outMemoryUsage);
+
     virtual const char* getName();
     virtual const long getFlags();
 };
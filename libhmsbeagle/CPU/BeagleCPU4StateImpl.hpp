@@ -344,6 +344,163 @@ void BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcPartialsPartials(REALTYPE* des
     }
 }
     
+BEAGLE_CPU_TEMPLATE
+void BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcPrePartialsPartials(REALTYPE* destP,
+                                                                      const REALTYPE* partials1,
+                                                                      const REALTYPE* matrices1,
+                                                                      const REALTYPE* partials2,
+                                                                      const REALTYPE* matrices2,
+                                                                      int startPattern,
+                                                                      int endPattern) {
+
+    for (int l = 0; l < kCategoryCount; l++) {
+        int u = l*4*kPaddedPatternCount + 4*startPattern;
+        int w = l*4*OFFSET;
+
+        PREFETCH_MATRIX(1,matrices1,w);
+        PREFETCH_MATRIX(2,matrices2,w);
+        for (int k = startPattern; k < endPattern; k++) {
+            PREFETCH_PARTIALS(1,partials1,u);
+            PREFETCH_PARTIALS(2,partials2,u);
+
+            DO_INTEGRATION(2); // defines sum20, sum21, sum22, sum23
+
+            const REALTYPE tmp0 = p10 * sum20;
+            const REALTYPE tmp1 = p11 * sum21;
+            const REALTYPE tmp2 = p12 * sum22;
+            const REALTYPE tmp3 = p13 * sum23;
+
+            // Own branch is applied transposed
+            destP[u    ] = m100 * tmp0 + m110 * tmp1 + m120 * tmp2 + m130 * tmp3;
+            destP[u + 1] = m101 * tmp0 + m111 * tmp1 + m121 * tmp2 + m131 * tmp3;
+            destP[u + 2] = m102 * tmp0 + m112 * tmp1 + m122 * tmp2 + m132 * tmp3;
+            destP[u + 3] = m103 * tmp0 + m113 * tmp1 + m123 * tmp2 + m133 * tmp3;
+
+            u += 4;
+        }
+    }
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcPrePartialsStates(REALTYPE* destP,
+                                                                    const REALTYPE* partials1,
+                                                                    const REALTYPE* matrices1,
+                                                                    const int* states2,
+                                                                    const REALTYPE* matrices2,
+                                                                    int startPattern,
+                                                                    int endPattern) {
+
+    for (int l = 0; l < kCategoryCount; l++) {
+        int u = l*4*kPaddedPatternCount + 4*startPattern;
+        int w = l*4*OFFSET;
+
+        PREFETCH_MATRIX(1,matrices1,w);
+        for (int k = startPattern; k < endPattern; k++) {
+            const int state2 = states2[k];
+            PREFETCH_PARTIALS(1,partials1,u);
+
+            const REALTYPE tmp0 = p10 * matrices2[w            + state2];
+            const REALTYPE tmp1 = p11 * matrices2[w + OFFSET*1 + state2];
+            const REALTYPE tmp2 = p12 * matrices2[w + OFFSET*2 + state2];
+            const REALTYPE tmp3 = p13 * matrices2[w + OFFSET*3 + state2];
+
+            destP[u    ] = m100 * tmp0 + m110 * tmp1 + m120 * tmp2 + m130 * tmp3;
+            destP[u + 1] = m101 * tmp0 + m111 * tmp1 + m121 * tmp2 + m131 * tmp3;
+            destP[u + 2] = m102 * tmp0 + m112 * tmp1 + m122 * tmp2 + m132 * tmp3;
+            destP[u + 3] = m103 * tmp0 + m113 * tmp1 + m123 * tmp2 + m133 * tmp3;
+
+            u += 4;
+        }
+    }
+}
+
+/*
+ * Accumulates the weighted numerators and denominators over categories in
+ * integrationTmp; the pattern range keeps concurrent partitions disjoint.
+ */
+BEAGLE_CPU_TEMPLATE
+void BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcEdgeDerivativesPartials(REALTYPE* outDerivatives,
+                                                                          const REALTYPE* postPartials,
+                                                                          const REALTYPE* prePartials,
+                                                                          const REALTYPE* derivativeMatrices,
+                                                                          const REALTYPE* categoryWeights,
+                                                                          int startPattern,
+                                                                          int endPattern) {
+
+    REALTYPE* numerators = integrationTmp;
+    REALTYPE* denominators = integrationTmp + kPatternCount;
+
+    for (int k = startPattern; k < endPattern; k++) {
+        numerators[k] = 0.0;
+        denominators[k] = 0.0;
+    }
+
+    for (int l = 0; l < kCategoryCount; l++) {
+        int u = l*4*kPaddedPatternCount + 4*startPattern;
+        int w = l*4*OFFSET;
+        const REALTYPE weight = categoryWeights[l];
+
+        PREFETCH_MATRIX(1,derivativeMatrices,w);
+        for (int k = startPattern; k < endPattern; k++) {
+            PREFETCH_PARTIALS(1,postPartials,u);
+            PREFETCH_PARTIALS(2,prePartials,u);
+
+            DO_INTEGRATION(1); // defines sum10, sum11, sum12, sum13
+
+            numerators[k] += weight * (p20 * sum10 + p21 * sum11 + p22 * sum12 + p23 * sum13);
+            denominators[k] += weight * (p20 * p10 + p21 * p11 + p22 * p12 + p23 * p13);
+
+            u += 4;
+        }
+    }
+
+    for (int k = startPattern; k < endPattern; k++)
+        outDerivatives[k] = numerators[k] / denominators[k];
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcEdgeDerivativesStates(REALTYPE* outDerivatives,
+                                                                        const int* postStates,
+                                                                        const REALTYPE* prePartials,
+                                                                        const REALTYPE* derivativeMatrices,
+                                                                        const REALTYPE* categoryWeights,
+                                                                        int startPattern,
+                                                                        int endPattern) {
+
+    REALTYPE* numerators = integrationTmp;
+    REALTYPE* denominators = integrationTmp + kPatternCount;
+
+    for (int k = startPattern; k < endPattern; k++) {
+        numerators[k] = 0.0;
+        denominators[k] = 0.0;
+    }
+
+    for (int l = 0; l < kCategoryCount; l++) {
+        int u = l*4*kPaddedPatternCount + 4*startPattern;
+        int w = l*4*OFFSET;
+        const REALTYPE weight = categoryWeights[l];
+
+        for (int k = startPattern; k < endPattern; k++) {
+            const int state = postStates[k];
+            PREFETCH_PARTIALS(2,prePartials,u);
+
+            numerators[k] += weight * (p20 * derivativeMatrices[w            + state] +
+                                       p21 * derivativeMatrices[w + OFFSET*1 + state] +
+                                       p22 * derivativeMatrices[w + OFFSET*2 + state] +
+                                       p23 * derivativeMatrices[w + OFFSET*3 + state]);
+            if (state < 4)
+                denominators[k] += weight * prePartials[u + state];
+            else
+                denominators[k] += weight * (p20 + p21 + p22 + p23);
+
+            u += 4;
+        }
+    }
+
+    for (int k = startPattern; k < endPattern; k++)
+        outDerivatives[k] = numerators[k] / denominators[k];
+}
+
 BEAGLE_CPU_TEMPLATE
 void BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcPartialsPartialsAutoScaling(REALTYPE* destP,
                                                                     const REALTYPE* partials1,
@@ -1052,6 +1209,11 @@ int BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcRootLogLikelihoodsMulti(const i
 }
     
 
+BEAGLE_CPU_TEMPLATE
+BeagleCPUImpl<BEAGLE_CPU_GENERIC>* BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::newCopy() {
+    return new BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>(*this);
+}
+
 BEAGLE_CPU_TEMPLATE
 const char* BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::getName() {
 	return getBeagleCPU4StateName<BEAGLE_CPU_FACTORY_GENERIC>();
@@ -1102,6 +1264,30 @@ BeagleImpl* BeagleCPU4StateImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::createImpl(i
     return NULL;
 }
 
+BEAGLE_CPU_FACTORY_TEMPLATE
+int BeagleCPU4StateImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::estimateMemoryUsage(int tipCount,
+                                             int partialsBufferCount,
+                                             int compactBufferCount,
+                                             int stateCount,
+                                             int patternCount,
+                                             int eigenBufferCount,
+                                             int matrixBufferCount,
+                                             int categoryCount,
+                                             int scaleBufferCount,
+                                             long preferenceFlags,
+                                             long requirementFlags,
+                                             BeagleMemoryUsage* outMemoryUsage) {
+
+    if (stateCount != 4) {
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    }
+
+    return BeagleCPU4StateImpl<REALTYPE, T_PAD_DEFAULT, P_PAD_DEFAULT>::estimateMemoryUsage(tipCount,
+                partialsBufferCount, compactBufferCount, stateCount, patternCount, eigenBufferCount,
+                matrixBufferCount, categoryCount, scaleBufferCount, preferenceFlags, requirementFlags,
+                outMemoryUsage);
+}
+
 BEAGLE_CPU_FACTORY_TEMPLATE
 const char* BeagleCPU4StateImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getName() {
 	return getBeagleCPU4StateName<BEAGLE_CPU_FACTORY_GENERIC>();
@@ -1118,6 +1304,9 @@ const long BeagleCPU4StateImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getFlags() {
                   BEAGLE_FLAG_EIGEN_COMPLEX | BEAGLE_FLAG_EIGEN_REAL |
                   BEAGLE_FLAG_INVEVEC_STANDARD | BEAGLE_FLAG_INVEVEC_TRANSPOSED |
                   BEAGLE_FLAG_FRAMEWORK_CPU;
+#ifdef HAVE_SYS_MMAN_H
+    flags |= BEAGLE_FLAG_PARTIALS_MAPPED;
+#endif
     
     if (DOUBLE_PRECISION)
     	flags |= BEAGLE_FLAG_PRECISION_DOUBLE;
@@ -809,11 +809,21 @@ int BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_DOUBLE>::getPaddedPatternsModulus()
 	return 1;  // We currently do not vectorize across patterns
 }
 
+BEAGLE_CPU_4_SSE_TEMPLATE
+BeagleCPUImpl<BEAGLE_CPU_4_SSE_FLOAT>* BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_FLOAT>::newCopy() {
+    return new BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_FLOAT>(*this);
+}
+
 BEAGLE_CPU_4_SSE_TEMPLATE
 const char* BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_FLOAT>::getName() {
 	return  getBeagleCPU4StateSSEName<float>();
 }
 
+BEAGLE_CPU_4_SSE_TEMPLATE
+BeagleCPUImpl<BEAGLE_CPU_4_SSE_DOUBLE>* BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_DOUBLE>::newCopy() {
+    return new BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_DOUBLE>(*this);
+}
+
 BEAGLE_CPU_4_SSE_TEMPLATE
 const char* BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_DOUBLE>::getName() {
     return  getBeagleCPU4StateSSEName<double>();
@@ -891,6 +901,30 @@ BeagleImpl* BeagleCPU4StateSSEImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::createImp
     return NULL;
 }
 
+BEAGLE_CPU_FACTORY_TEMPLATE
+int BeagleCPU4StateSSEImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::estimateMemoryUsage(int tipCount,
+                                             int partialsBufferCount,
+                                             int compactBufferCount,
+                                             int stateCount,
+                                             int patternCount,
+                                             int eigenBufferCount,
+                                             int matrixBufferCount,
+                                             int categoryCount,
+                                             int scaleBufferCount,
+                                             long preferenceFlags,
+                                             long requirementFlags,
+                                             BeagleMemoryUsage* outMemoryUsage) {
+
+    if (stateCount != 4 || !CPUSupportsSSE()) {
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    }
+
+    return BeagleCPU4StateSSEImpl<REALTYPE, T_PAD_4_SSE_DEFAULT, P_PAD_4_SSE_DEFAULT>::estimateMemoryUsage(tipCount,
+                partialsBufferCount, compactBufferCount, stateCount, patternCount, eigenBufferCount,
+                matrixBufferCount, categoryCount, scaleBufferCount, preferenceFlags, requirementFlags,
+                outMemoryUsage);
+}
+
 BEAGLE_CPU_FACTORY_TEMPLATE
 const char* BeagleCPU4StateSSEImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getName() {
 	return getBeagleCPU4StateSSEName<BEAGLE_CPU_FACTORY_GENERIC>();
@@ -85,6 +85,8 @@ public:
 protected:
     virtual int getPaddedPatternsModulus();
 
+    virtual BeagleCPUImpl<BEAGLE_CPU_AVX_FLOAT>* newCopy();
+
 private:
 	virtual void calcStatesStates(float* destP,
                                      const int* states1,
@@ -159,6 +161,8 @@ public:
 protected:
     virtual int getPaddedPatternsModulus();
 
+    virtual BeagleCPUImpl<BEAGLE_CPU_AVX_DOUBLE>* newCopy();
+
 private:
 	virtual void calcStatesStates(double* destP,
                                      const int* states1,
@@ -220,6 +224,19 @@ public:
                                    long requirementFlags,
                                    int* errorCode);
 
+    virtual int estimateMemoryUsage(int tipCount,
+                                    int partialsBufferCount,
+                                    int compactBufferCount,
+                                    int stateCount,
+                                    int patternCount,
+                                    int eigenBufferCount,
+                                    int matrixBufferCount,
+                                    int categoryCount,
+                                    int scaleBufferCount,
+                                    long preferenceFlags,
+                                    long requirementFlags,
+                                    BeagleMemoryUsage* outMemoryUsage);
+
     virtual const char* getName();
     virtual const long getFlags();
 };
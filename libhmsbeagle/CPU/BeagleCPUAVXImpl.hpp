@@ -523,11 +523,21 @@ int BeagleCPUAVXImpl<BEAGLE_CPU_AVX_DOUBLE>::getPaddedPatternsModulus() {
 	return 1;  // We currently do not vectorize across patterns
 }
     
+BEAGLE_CPU_AVX_TEMPLATE
+BeagleCPUImpl<BEAGLE_CPU_AVX_FLOAT>* BeagleCPUAVXImpl<BEAGLE_CPU_AVX_FLOAT>::newCopy() {
+    return new BeagleCPUAVXImpl<BEAGLE_CPU_AVX_FLOAT>(*this);
+}
+
 BEAGLE_CPU_AVX_TEMPLATE
 const char* BeagleCPUAVXImpl<BEAGLE_CPU_AVX_FLOAT>::getName() {
 	return  getBeagleCPUAVXName<float>();
 }
 
+BEAGLE_CPU_AVX_TEMPLATE
+BeagleCPUImpl<BEAGLE_CPU_AVX_DOUBLE>* BeagleCPUAVXImpl<BEAGLE_CPU_AVX_DOUBLE>::newCopy() {
+    return new BeagleCPUAVXImpl<BEAGLE_CPU_AVX_DOUBLE>(*this);
+}
+
 BEAGLE_CPU_AVX_TEMPLATE
 const char* BeagleCPUAVXImpl<BEAGLE_CPU_AVX_DOUBLE>::getName() {
     return  getBeagleCPUAVXName<double>();
@@ -617,6 +627,36 @@ BeagleImpl* BeagleCPUAVXImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::createImpl(int
     return NULL;
 }
 
+BEAGLE_CPU_FACTORY_TEMPLATE
+int BeagleCPUAVXImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::estimateMemoryUsage(int tipCount,
+                                             int partialsBufferCount,
+                                             int compactBufferCount,
+                                             int stateCount,
+                                             int patternCount,
+                                             int eigenBufferCount,
+                                             int matrixBufferCount,
+                                             int categoryCount,
+                                             int scaleBufferCount,
+                                             long preferenceFlags,
+                                             long requirementFlags,
+                                             BeagleMemoryUsage* outMemoryUsage) {
+
+    if (!CPUSupportsAVX())
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+
+    if (stateCount & 1) { // is odd
+        return BeagleCPUAVXImpl<REALTYPE, T_PAD_AVX_ODD, P_PAD_AVX_ODD>::estimateMemoryUsage(tipCount,
+                partialsBufferCount, compactBufferCount, stateCount, patternCount, eigenBufferCount,
+                matrixBufferCount, categoryCount, scaleBufferCount, preferenceFlags, requirementFlags,
+                outMemoryUsage);
+    } else {
+        return BeagleCPUAVXImpl<REALTYPE, T_PAD_AVX_EVEN, P_PAD_AVX_EVEN>::estimateMemoryUsage(tipCount,
+                partialsBufferCount, compactBufferCount, stateCount, patternCount, eigenBufferCount,
+                matrixBufferCount, categoryCount, scaleBufferCount, preferenceFlags, requirementFlags,
+                outMemoryUsage);
+    }
+}
+
 BEAGLE_CPU_FACTORY_TEMPLATE
 const char* BeagleCPUAVXImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getName() {
 	return getBeagleCPUAVXName<BEAGLE_CPU_FACTORY_GENERIC>();
@@ -33,6 +33,8 @@
 #endif
 
 #include "libhmsbeagle/BeagleImpl.h"
+#include "libhmsbeagle/BeagleCounters.h"
+#include "libhmsbeagle/BeagleTrace.h"
 #include "libhmsbeagle/CPU/Precision.h"
 #include "libhmsbeagle/CPU/EigenDecomposition.h"
 
@@ -43,6 +45,10 @@
 #include <condition_variable>
 #include <mutex>
 #include <functional>
+#include <map>
+#include <list>
+#include <atomic>
+#include <cstring>
 
 #define BEAGLE_CPU_GENERIC	REALTYPE, T_PAD, P_PAD
 #define BEAGLE_CPU_TEMPLATE	template <typename REALTYPE, int T_PAD, int P_PAD>
@@ -60,9 +66,64 @@
 #define BEAGLE_CPU_ASYNC_MIN_PATTERN_COUNT_HIGH       768  // do not use CPU auto-threading for problems with fewer patterns on CPUs with few cores
 #define BEAGLE_CPU_ASYNC_LIMIT_PATTERN_COUNT       262144  // do not use all CPU cores for problems with fewer patterns
 
+#define BEAGLE_CPU_MAPPED_PREFETCH_DEPTH                2  // number of upcoming operations whose child partials are prefetched when partials are memory-mapped
+
 namespace beagle {
 namespace cpu {
 
+/*
+ * Owner counts for buffers that an instance shares copy-on-write with its
+ * clones. A buffer that is not in the table belongs to a single instance.
+ * One table is shared by an instance and all clones derived from it.
+ */
+class SharedBufferTable
+{
+public:
+    SharedBufferTable() : referenceCount(1) {}
+
+    void share(const void* buffer) {
+        std::lock_guard<std::mutex> lock(tableMutex);
+        std::map<const void*, int>::iterator it = owners.find(buffer);
+        if (it == owners.end())
+            owners[buffer] = 2;
+        else
+            it->second++;
+    }
+
+    bool isShared(const void* buffer) {
+        std::lock_guard<std::mutex> lock(tableMutex);
+        return owners.find(buffer) != owners.end();
+    }
+
+    // Drops one owner; returns true if other owners still hold the buffer.
+    // If copy is not NULL it is filled with copyBytes of the buffer first.
+    bool release(const void* buffer,
+                 void* copy = NULL,
+                 size_t copyBytes = 0) {
+        std::lock_guard<std::mutex> lock(tableMutex);
+        std::map<const void*, int>::iterator it = owners.find(buffer);
+        if (it == owners.end())
+            return false;
+        if (copy != NULL)
+            memcpy(copy, buffer, copyBytes);
+        if (--it->second == 1)
+            owners.erase(it);
+        return true;
+    }
+
+    void retain() { referenceCount++; }
+
+    void releaseTable() {
+        if (--referenceCount == 0)
+            delete this;
+    }
+
+private:
+    std::map<const void*, int> owners;
+    std::mutex tableMutex;
+    std::atomic<int> referenceCount;
+};
+
 BEAGLE_CPU_TEMPLATE
 class BeagleCPUImpl : public BeagleImpl {
 
@@ -116,6 +177,53 @@ protected:
     REALTYPE** gPartials;
     int** gTipStates;
     REALTYPE** gScaleBuffers;
+
+    char* gMappedPartials; /// base of the scratch file mapping backing internal partials (BEAGLE_FLAG_PARTIALS_MAPPED)
+    size_t kMappedPartialsStride; /// page-aligned size in bytes of each mapped partials buffer
+    size_t kMappedPartialsBytes;
+
+    BeagleTipData* gTipData; /// shared tip data whose buffers some tips point into, or NULL
+
+    SharedBufferTable* gSharedBuffers; /// buffers shared copy-on-write with clones, or NULL if never cloned
+
+    bool kCheckpointActive;
+    typedef std::pair<REALTYPE**, int> BufferSlot; /// buffer table and index within it
+    std::map<BufferSlot, REALTYPE*> gCheckpointBuffers; /// checkpointed buffers of the slots written since setCheckpoint
+    std::map<REALTYPE**, std::vector<REALTYPE*> > gSpareBuffers; /// recycled buffers per table, reused by later checkpoints
+
+    REALTYPE* gSumtable; /// weighted edge sumtable in the eigenbasis, per pattern and category, or NULL until first needed
+    REALTYPE* gSumtableRates; /// eigen values scaled by each category rate, followed by evaluation scratch
+    int kSumtableScaleIndex; /// cumulative scale buffer added to the sumtable site log likelihoods
+
+    typedef std::pair<int, double> MatrixCacheKey; /// eigen index and edge length
+    typedef std::list<std::pair<MatrixCacheKey, std::vector<REALTYPE> > > MatrixCacheList;
+    int kMatrixCacheSize; /// maximum number of cached probability matrices, 0 if the cache is disabled
+    long kMatrixCacheHits;
+    long kMatrixCacheMisses;
+    MatrixCacheList gMatrixCache; /// cached probability matrices, most recently used first
+    std::map<MatrixCacheKey, typename MatrixCacheList::iterator> gMatrixCacheIndex;
+    std::vector<MatrixCacheKey> gMatrixCacheKeys; /// what each transition matrix holds, if known
+
+    struct PartialsRecord {
+        int operation[BEAGLE_OP_COUNT]; /// the operation that last computed the buffer, BEAGLE_OP_NONE if unknown
+        unsigned long versions[7]; /// child 1, matrix 1, child 2, matrix 2, read scale, destination and write scale
+    };
+    bool kIncrementalUpdates;
+    unsigned long kVersionClock;
+    std::vector<unsigned long> gPartialsVersions; /// stamp of the last write to each buffer, only kept in incremental mode
+    std::vector<unsigned long> gMatrixVersions;
+    std::vector<unsigned long> gScaleVersions;
+    std::vector<PartialsRecord> gPartialsRecords;
+    std::vector<int> gIncrementalOperations; /// the operations of the current call that must run
+    std::vector<char> gIncrementalWritten;
+    int kIncrementalOperationCount; /// operations passed to the last updatePartials call
+    int kIncrementalSkippedCount; /// of which were skipped because their inputs were unchanged
+
+    BeagleCounters gCounters; /// performance counters, shared by the worker threads
+    BeagleTracer gTracer; /// timeline of calls and tasks, written when the instance is finalized
+
+    bool kSkipZeroWeightPatterns;
+    std::vector<int> gActivePatternRuns; /// start and end of each run of patterns with nonzero weight, empty if all are active
     
     signed short** gAutoScaleBuffers;
     
@@ -159,6 +267,10 @@ protected:
     double* gAutoPartitionOutSumLogLikelihoods;
     std::shared_future<void>* gFutures;
 
+    int kCPUThreadCount; /// thread count set by setCPUThreadCount, 0 for the hardware default
+    threadData* gJobThreads; /// threads for batches of jobs when patterns are not partitioned
+    int kJobThreadCount;
+
 public:
     virtual ~BeagleCPUImpl();
 
@@ -180,8 +292,55 @@ public:
     // initialization of instance,  returnInfo can be null
     int getInstanceDetails(BeagleInstanceDetails* returnInfo);
 
+    int getMemoryUsage(BeagleMemoryUsage* outMemoryUsage);
+
+    // per-kernel call, pattern, flop, byte and time counts
+    int setPerformanceCounters(bool enabled);
+
+    int getPerformanceCounters(BeagleKernelCounters* outCounters,
+                               int count);
+
+    int resetPerformanceCounters();
+
+    // timeline of calls and thread-pool tasks in Chrome trace format
+    int startTrace(const char* fileName,
+                   int eventsPerThread);
+
+    int writeTrace();
+
+    int stopTrace();
+
+    // returns a copy of this instance that shares partials, tip states, transition
+    // matrices and scale buffers copy-on-write
+    virtual BeagleImpl* clone();
+
+    // transactions over partials, transition matrices and scale buffers; a write
+    // after setCheckpoint moves the checkpointed buffer aside instead of copying it
+    int setCheckpoint();
+
+    int commitCheckpoint();
+
+    int rollbackCheckpoint();
+
+    // footprint of an instance created with these arguments once all tips and model
+    // parameters are set, without allocating it
+    static int estimateMemoryUsage(int tipCount,
+                                   int partialsBufferCount,
+                                   int compactBufferCount,
+                                   int stateCount,
+                                   int patternCount,
+                                   int eigenDecompositionCount,
+                                   int matrixCount,
+                                   int categoryCount,
+                                   int scaleBufferCount,
+                                   long preferenceFlags,
+                                   long requirementFlags,
+                                   BeagleMemoryUsage* outMemoryUsage);
+
     int setCPUThreadCount(int threadCount);
 
+    int getCPUThreadCount(int* outThreadCount);
+
     // set the states for a given tip
     //
     // tipIndex the index of the tip
@@ -196,6 +355,9 @@ public:
     int setTipPartials(int tipIndex,
                        const double* inPartials);
 
+    // points tips at the buffers of shared, read-only tip data instead of
+    // keeping a private copy
+    int attachTipData(BeagleTipData* tipData);
 
     int setPartials(int bufferIndex,
                     const double* inPartials);
@@ -268,6 +430,12 @@ public:
                                  const double* edgeLengths,
                                  int count);
 
+    // keep up to cacheSize probability matrices keyed by eigen index and edge length
+    int setTransitionMatrixCacheSize(int cacheSize);
+
+    int getTransitionMatrixCacheStatistics(long* outHitCount,
+                                           long* outMissCount);
+
     int updateTransitionMatricesWithMultipleModels(const int* eigenIndices,
                                                    const int* categoryRateIndices,
                                                    const int* probabilityIndices,
@@ -289,6 +457,85 @@ public:
     int updatePartialsByPartition(const int* operations,
                                   int operationCount);
 
+    // skip operations of updatePartials whose inputs are unchanged since they last ran
+    int setIncrementalUpdates(bool enabled);
+
+    int getIncrementalUpdateStatistics(int* outOperationCount,
+                                       int* outSkippedCount);
+
+    // leave patterns of zero weight out of updatePartials
+    int setZeroWeightPatternSkipping(bool enabled);
+
+    // fill the pre-order partials of the root with the state frequencies
+    int setRootPrePartials(const int* bufferIndices,
+                           const int* stateFrequenciesIndices,
+                           int count);
+
+    // calculate pre-order partials; for each operation child1 holds the pre-order
+    // partials of the parent, child1TransitionMatrix the matrix of the destination
+    // branch and child2 the post-order partials of the sibling
+    int updatePrePartials(const int* operations,
+                          int operationCount,
+                          int cumulativeScalingIndex);
+
+    // project the partials on both ends of an edge into the eigenbasis once so
+    // that the edge can be evaluated for any length without matrix products
+    int calculateEdgeSumtable(int parentBufferIndex,
+                              int childBufferIndex,
+                              int eigenIndex,
+                              int categoryWeightsIndex,
+                              int stateFrequenciesIndex,
+                              int cumulativeScaleIndex);
+
+    // possible nulls: outSumFirstDerivative, outSumSecondDerivative
+    int calculateEdgeSumtableLogLikelihood(double edgeLength,
+                                           double* outSumLogLikelihood,
+                                           double* outSumFirstDerivative,
+                                           double* outSumSecondDerivative);
+
+    // Newton-Raphson on the length of the sumtable edge, safeguarded by step halving
+    int optimizeEdgeLength(double* inOutEdgeLength,
+                           double minEdgeLength,
+                           double maxEdgeLength,
+                           double tolerance,
+                           int maxIterations,
+                           double* outSumLogLikelihood);
+
+    // regraft a pruned subtree at the bottom of each edge, given post- and pre-order partials
+    int calculateInsertionLogLikelihoods(const int* postBufferIndices,
+                                         const int* preBufferIndices,
+                                         const int* cumulativeScaleIndices,
+                                         int count,
+                                         int subtreeBufferIndex,
+                                         int subtreeMatrixIndex,
+                                         int categoryWeightsIndex,
+                                         double* outSumLogLikelihoods);
+
+    // as above, with the pendant length of each edge optimized on its own sumtable
+    int optimizeInsertionLogLikelihoods(const int* postBufferIndices,
+                                        const int* preBufferIndices,
+                                        const int* cumulativeScaleIndices,
+                                        int count,
+                                        int subtreeBufferIndex,
+                                        int eigenIndex,
+                                        int categoryWeightsIndex,
+                                        double* inOutPendantLengths,
+                                        double minEdgeLength,
+                                        double maxEdgeLength,
+                                        double tolerance,
+                                        int maxIterations,
+                                        double* outSumLogLikelihoods);
+
+    // possible nulls: outDerivatives, outSumSquaredDerivatives
+    int calculateEdgeDerivatives(const int* postBufferIndices,
+                                 const int* preBufferIndices,
+                                 const int* derivativeMatrixIndices,
+                                 const int* categoryWeightsIndices,
+                                 int count,
+                                 double* outDerivatives,
+                                 double* outSumDerivatives,
+                                 double* outSumSquaredDerivatives);
+
     // Block until all calculations that write to the specified partials have completed.
     //
     // This function is optional and only has to be called by clients that "recycle" partials.
@@ -355,6 +602,34 @@ public:
                                                double* outSumLogLikelihoodByPartition,
                                                double* outSumLogLikelihood);
 
+    // update matrices and partials and integrate the root in one scheduled pass
+    int evaluateRootLogLikelihood(int eigenIndex,
+                                  const int* probabilityIndices,
+                                  const double* edgeLengths,
+                                  int matrixCount,
+                                  const int* operations,
+                                  int operationCount,
+                                  int rootBufferIndex,
+                                  int categoryWeightsIndex,
+                                  int stateFrequenciesIndex,
+                                  int cumulativeScaleIndex,
+                                  double* outSumLogLikelihood);
+
+    // evaluate the jobs in order, or their partials operations concurrently if they are independent
+    int evaluateRootLogLikelihoods(const BeagleEvaluationJob* jobs,
+                                   int jobCount,
+                                   double* outSumLogLikelihoods,
+                                   int* outReturnCodes);
+
+    // integrate the root once and return one log likelihood for each pattern weight vector
+    int calculateRootLogLikelihoodsForWeights(int bufferIndex,
+                                              int categoryWeightsIndex,
+                                              int stateFrequenciesIndex,
+                                              int cumulativeScaleIndex,
+                                              const double* inPatternWeights,
+                                              int weightVectorCount,
+                                              double* outSumLogLikelihoods);
+
     // possible nulls: firstDerivativeIndices, secondDerivativeIndices,
     //                 outFirstDerivatives, outSecondDerivatives
     int calculateEdgeLogLikelihoods(const int* parentBufferIndices,
@@ -415,8 +690,14 @@ protected:
                                                  int count,
                                                  int cumulativeScaleIndex);
 
+    virtual int upPrePartials(bool byPartition,
+                              const int* operations,
+                              int operationCount,
+                              int cumulativeScalingIndex);
+
     virtual int upPartialsByPartitionAsync(const int* operations,
-                                           int operationCount);
+                                           int operationCount,
+                                           bool preOrder);
 
     virtual int reorderPatternsByPartition();
 
@@ -445,6 +726,48 @@ protected:
                                       int startPattern,
                                       int endPattern);
 
+    virtual void calcPrePartialsPartials(REALTYPE* destP,
+                                         const REALTYPE* partials1,
+                                         const REALTYPE* matrices1,
+                                         const REALTYPE* partials2,
+                                         const REALTYPE* matrices2,
+                                         int startPattern,
+                                         int endPattern);
+
+    virtual void calcPrePartialsStates(REALTYPE* destP,
+                                       const REALTYPE* partials1,
+                                       const REALTYPE* matrices1,
+                                       const int* states2,
+                                       const REALTYPE* matrices2,
+                                       int startPattern,
+                                       int endPattern);
+
+    virtual void calcEdgeDerivativesPartials(REALTYPE* outDerivatives,
+                                             const REALTYPE* postPartials,
+                                             const REALTYPE* prePartials,
+                                             const REALTYPE* derivativeMatrices,
+                                             const REALTYPE* categoryWeights,
+                                             int startPattern,
+                                             int endPattern);
+
+    virtual void calcEdgeDerivativesStates(REALTYPE* outDerivatives,
+                                           const int* postStates,
+                                           const REALTYPE* prePartials,
+                                           const REALTYPE* derivativeMatrices,
+                                           const REALTYPE* categoryWeights,
+                                           int startPattern,
+                                           int endPattern);
+
+    virtual void calcEdgeDerivativesByPartition(const int* postBufferIndices,
+                                                const int* preBufferIndices,
+                                                const int* derivativeMatrixIndices,
+                                                const int* categoryWeightsIndices,
+                                                int count,
+                                                int partitionIndex,
+                                                double* outDerivatives,
+                                                double* outSumDerivatives,
+                                                double* outSumSquaredDerivatives);
+
     virtual int calcRootLogLikelihoods(const int bufferIndex,
                                         const int categoryWeightsIndex,
                                         const int stateFrequenciesIndex,
@@ -459,6 +782,73 @@ protected:
                                                        int partitionCount,
                                                        double* outSumLogLikelihoodByPartition);
 
+    void calcPartialsAndRootByPartition(const int* operations,
+                                        int count,
+                                        int rootBufferIndex,
+                                        int categoryWeightsIndex,
+                                        int stateFrequenciesIndex,
+                                        int cumulativeScaleIndex,
+                                        int threadIndex);
+
+    bool jobsAreIndependent(const BeagleEvaluationJob* jobs,
+                            int jobCount);
+
+    int getJobThreads(threadData** threads);
+
+    void getKernelWork(int kernelType,
+                       long count,
+                       double* outFlops,
+                       double* outBytes);
+
+    template <typename Evaluate>
+    static int maximizeEdgeLength(Evaluate evaluate,
+                                  double* inOutEdgeLength,
+                                  double minEdgeLength,
+                                  double maxEdgeLength,
+                                  double tolerance,
+                                  int maxIterations,
+                                  double* outSumLogLikelihood);
+
+    int checkInsertionEdges(const int* postBufferIndices,
+                            const int* preBufferIndices,
+                            const int* cumulativeScaleIndices,
+                            int count,
+                            int subtreeBufferIndex,
+                            int categoryWeightsIndex);
+
+    int runInsertionEdges(const int* postBufferIndices,
+                          const int* preBufferIndices,
+                          const int* cumulativeScaleIndices,
+                          int count,
+                          const REALTYPE* subtreeTable,
+                          const REALTYPE* scaledEigenValues,
+                          int categoryWeightsIndex,
+                          double* inOutPendantLengths,
+                          const double* lengthBounds,
+                          int maxIterations,
+                          double* outSumLogLikelihoods);
+
+    void calcInsertionEdges(const int* postBufferIndices,
+                            const int* preBufferIndices,
+                            const int* cumulativeScaleIndices,
+                            int startEdge,
+                            int endEdge,
+                            const REALTYPE* subtreeTable,
+                            const REALTYPE* scaledEigenValues,
+                            int categoryWeightsIndex,
+                            double* inOutPendantLengths,
+                            const double* lengthBounds,
+                            int maxIterations,
+                            double* outSumLogLikelihoods,
+                            int* outReturnCodes);
+
+    void stopJobThreads();
+
+    void calcWeightedSiteSums(const double* siteLogLikelihoods,
+                              const double* patternWeights,
+                              int weightVectorCount,
+                              double* outSums);
+
     virtual void calcRootLogLikelihoodsByAutoPartitionAsync(const int* bufferIndices,
                                                             const int* categoryWeightsIndices,
                                                             const int* stateFrequenciesIndices,
@@ -616,6 +1006,90 @@ protected:
 
     void* mallocAligned(size_t size);
 
+    void fillTipStates(int* destination,
+                       const int* inStates);
+
+    void fillTipPartials(REALTYPE* destination,
+                         const double* inPartials);
+
+    bool isSharedTipBuffer(int bufferIndex,
+                           const void* buffer);
+
+    // shallow copy of this object with the same dynamic type; subclasses override
+    virtual BeagleCPUImpl<BEAGLE_CPU_GENERIC>* newCopy();
+
+    BeagleImpl* cloneInto(BeagleCPUImpl<BEAGLE_CPU_GENERIC>* copy);
+
+    bool releaseSharedBuffer(const void* buffer);
+
+    bool checkpointBuffer(REALTYPE** buffers,
+                          int index,
+                          int size,
+                          bool copyContents);
+
+    void recycleBuffer(REALTYPE** buffers,
+                       int index,
+                       REALTYPE* buffer);
+
+    void unshareBuffer(REALTYPE** buffers,
+                       int index,
+                       int size,
+                       bool copyContents);
+
+    int updateTransitionMatricesCached(int eigenIndex,
+                                       const int* probabilityIndices,
+                                       const double* edgeLengths,
+                                       int count);
+
+    void clearMatrixCache(int eigenIndex);
+
+    void touchBuffer(REALTYPE** buffers,
+                     int index);
+
+    const int* skipUnchangedOperations(const int* operations,
+                                       int* count,
+                                       int cumulativeScaleIndex);
+
+    void recordOperations(const int* operations,
+                          int count);
+
+    void forgetPartialsRecords();
+
+    void updateActivePatterns();
+
+    void fillInactivePatterns(REALTYPE* destP,
+                              int startPattern,
+                              int endPattern);
+
+    void unsharePartialsOperations(const int* operations,
+                                   int count,
+                                   int cumulativeScaleIndex,
+                                   bool byPartition);
+
+    static int getAutoPartitionCount(int stateCount,
+                                     int patternCount,
+                                     int* minPatternCount);
+
+    static long long getEigenDecompositionBytes(int eigenDecompositionCount,
+                                                int stateCount,
+                                                long flags);
+
+    static long long getThreadingBytes(int threadCount,
+                                       int bufferCount,
+                                       int patternCount,
+                                       int partitionCount,
+                                       bool autoPartitioning,
+                                       bool autoRootPartitioning);
+
+    bool mapPartialsBuffers();
+
+    void unmapPartialsBuffers();
+
+    void prefetchMappedPartials(const int* operations,
+                                int op,
+                                int count,
+                                int numOps);
+
     void threadWaiting(threadData* tData);
 
 };
@@ -638,6 +1112,19 @@ public:
                                    long requirementFlags,
                                    int* errorCode);
 
+    virtual int estimateMemoryUsage(int tipCount,
+                                    int partialsBufferCount,
+                                    int compactBufferCount,
+                                    int stateCount,
+                                    int patternCount,
+                                    int eigenBufferCount,
+                                    int matrixBufferCount,
+                                    int categoryCount,
+                                    int scaleBufferCount,
+                                    long preferenceFlags,
+                                    long requirementFlags,
+                                    BeagleMemoryUsage* outMemoryUsage);
+
     virtual const char* getName();
     virtual const long getFlags();
 };
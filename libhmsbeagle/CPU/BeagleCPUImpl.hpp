@@ -78,8 +78,15 @@
 #include <cstring>
 #include <cmath>
 #include <cassert>
+#include <algorithm>
 #include <vector>
 #include <cfloat>
+#include <string>
+
+#ifdef HAVE_SYS_MMAN_H
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
 
 #include "libhmsbeagle/beagle.h"
 #include "libhmsbeagle/CPU/Precision.h"
@@ -130,6 +137,14 @@ BeagleCPUImpl<BEAGLE_CPU_GENERIC>::~BeagleCPUImpl() {
     // If you delete partials, make sure not to delete the last element
     // which is TEMP_SCRATCH_PARTIAL twice.
 
+    if (kCheckpointActive)
+        commitCheckpoint();
+    for (typename std::map<REALTYPE**, std::vector<REALTYPE*> >::iterator it = gSpareBuffers.begin();
+         it != gSpareBuffers.end(); ++it) {
+        for (size_t i = 0; i < it->second.size(); i++)
+            free(it->second[i]);
+    }
+
     for(unsigned int i=0; i<kEigenDecompCount; i++) {
         if (gCategoryWeights[i] != NULL)
             free(gCategoryWeights[i]);
@@ -138,19 +153,27 @@ BeagleCPUImpl<BEAGLE_CPU_GENERIC>::~BeagleCPUImpl() {
     }
 
     for(unsigned int i=0; i<kMatrixCount; i++) {
-        if (gTransitionMatrices[i] != NULL)
+        if (gTransitionMatrices[i] != NULL && !releaseSharedBuffer(gTransitionMatrices[i]))
             free(gTransitionMatrices[i]);
     }
     free(gTransitionMatrices);
 
+    if (gMappedPartials != NULL)
+        unmapPartialsBuffers();
+
     for(unsigned int i=0; i<kBufferCount; i++) {
-        if (gPartials[i] != NULL)
+        if (gPartials[i] != NULL && !isSharedTipBuffer(i, gPartials[i]) &&
+            !releaseSharedBuffer(gPartials[i]))
             free(gPartials[i]);
-        if (gTipStates[i] != NULL)
+        if (gTipStates[i] != NULL && !isSharedTipBuffer(i, gTipStates[i]) &&
+            !releaseSharedBuffer(gTipStates[i]))
             free(gTipStates[i]);
     }
     free(gPartials);
     free(gTipStates);
+
+    if (gTipData != NULL)
+        gTipData->release();
     
     if (kFlags & BEAGLE_FLAG_SCALING_AUTO) {
         for(unsigned int i=0; i<kScaleBufferCount; i++) {
@@ -164,7 +187,7 @@ BeagleCPUImpl<BEAGLE_CPU_GENERIC>::~BeagleCPUImpl() {
             free(gScaleBuffers[0]);
     } else {
         for(unsigned int i=0; i<kScaleBufferCount; i++) {
-            if (gScaleBuffers[i] != NULL)
+            if (gScaleBuffers[i] != NULL && !releaseSharedBuffer(gScaleBuffers[i]))
                 free(gScaleBuffers[i]);
         }        
     }
@@ -172,6 +195,9 @@ BeagleCPUImpl<BEAGLE_CPU_GENERIC>::~BeagleCPUImpl() {
     if (gScaleBuffers)
         free(gScaleBuffers);
 
+    if (gSharedBuffers != NULL)
+        gSharedBuffers->releaseTable();
+
     free(gCategoryRates);
     free(gPatternWeights);
 
@@ -191,6 +217,9 @@ BeagleCPUImpl<BEAGLE_CPU_GENERIC>::~BeagleCPUImpl() {
     free(outFirstDerivativesTmp);
     free(outSecondDerivativesTmp);
 
+    free(gSumtable);
+    free(gSumtableRates);
+
     free(ones);
     free(zeros);
 
@@ -228,6 +257,8 @@ BeagleCPUImpl<BEAGLE_CPU_GENERIC>::~BeagleCPUImpl() {
             free(gAutoPartitionOutSumLogLikelihoods);
         }
     }
+
+    stopJobThreads();
 }
 
 BEAGLE_CPU_TEMPLATE
@@ -366,12 +397,40 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::createInstance(int tipCount,
         gTipStates[i] = NULL;
     }
 
-    for (int i = kTipCount; i < kBufferCount; i++) {
-        gPartials[i] = (REALTYPE*) mallocAligned(sizeof(REALTYPE) * kPartialsSize);
-        if (gPartials[i] == NULL)
+    gMappedPartials = NULL;
+    gTipData = NULL;
+    gSharedBuffers = NULL;
+    kCheckpointActive = false;
+    gSumtable = NULL;
+    gSumtableRates = NULL;
+    kSumtableScaleIndex = BEAGLE_OP_NONE;
+    kMatrixCacheSize = 0;
+    kMatrixCacheHits = 0;
+    kMatrixCacheMisses = 0;
+    kIncrementalUpdates = false;
+    kVersionClock = 0;
+    kIncrementalOperationCount = 0;
+    kIncrementalSkippedCount = 0;
+    kSkipZeroWeightPatterns = false;
+    kCPUThreadCount = 0;
+    gJobThreads = NULL;
+    kJobThreadCount = 0;
+
+    if (requirementFlags & BEAGLE_FLAG_PARTIALS_MAPPED || preferenceFlags & BEAGLE_FLAG_PARTIALS_MAPPED) {
+        if (mapPartialsBuffers())
+            kFlags |= BEAGLE_FLAG_PARTIALS_MAPPED;
+        else if (requirementFlags & BEAGLE_FLAG_PARTIALS_MAPPED)
             throw std::bad_alloc();
     }
 
+    if (!(kFlags & BEAGLE_FLAG_PARTIALS_MAPPED)) {
+        for (int i = kTipCount; i < kBufferCount; i++) {
+            gPartials[i] = (REALTYPE*) mallocAligned(sizeof(REALTYPE) * kPartialsSize);
+            if (gPartials[i] == NULL)
+                throw std::bad_alloc();
+        }
+    }
+
     gScaleBuffers = NULL;
 
     gAutoScaleBuffers = NULL;
@@ -436,24 +495,8 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::createInstance(int tipCount,
     kThreadingEnabled = false;
     kAutoPartitioningEnabled = false;
     if (kFlags & BEAGLE_FLAG_THREADING_CPP) {
-        int hardwareThreads = std::thread::hardware_concurrency();
-        if (kStateCount <= 4) {
-            kMinPatternCount = BEAGLE_CPU_ASYNC_MIN_PATTERN_COUNT_LOW;
-            if (hardwareThreads < BEAGLE_CPU_ASYNC_HW_THREAD_COUNT_THRESHOLD) {
-                kMinPatternCount = BEAGLE_CPU_ASYNC_MIN_PATTERN_COUNT_HIGH;
-            } else if (kPatternCount < BEAGLE_CPU_ASYNC_LIMIT_PATTERN_COUNT) {
-                hardwareThreads = BEAGLE_CPU_ASYNC_HW_THREAD_COUNT_THRESHOLD;
-            }
-        } else {
-            // todo: assess minimum pattern count for efficient auto-threading
-            //       for higher state-count values
-            kMinPatternCount = 2;
-        }
-        if (kPatternCount >= kMinPatternCount && hardwareThreads > 2) {
-            int partitionCount = kPatternCount/(kMinPatternCount/2);
-            if (partitionCount > hardwareThreads/2) {
-                partitionCount = hardwareThreads/2;
-            } 
+        int partitionCount = getAutoPartitionCount(kStateCount, kPatternCount, &kMinPatternCount);
+        if (partitionCount > 0) {
             int* patternPartitions = (int*) malloc(sizeof(int) * kPatternCount);
             int partitionSize = kPatternCount/partitionCount;
             for (int i=0; i<kPatternCount; i++) {
@@ -505,12 +548,525 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getInstanceDetails(BeagleInstanceDetails*
     return BEAGLE_SUCCESS;
 }
 
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getMemoryUsage(BeagleMemoryUsage* outMemoryUsage) {
+    const long long partialsBytes = (long long) sizeof(REALTYPE) * kPartialsSize;
+    const long long tipStatesBytes = (long long) sizeof(int) * kPaddedPatternCount;
+    const long long scaleBytes = (long long) sizeof(REALTYPE) * kPaddedPatternCount;
+
+    BeagleMemoryUsage usage;
+
+    usage.partials = sizeof(REALTYPE*) * kBufferCount;
+    usage.tips = sizeof(int*) * kBufferCount;
+    usage.mapped = 0;
+    for (int i = 0; i < kBufferCount; i++) {
+        if (gTipStates[i] != NULL && !isSharedTipBuffer(i, gTipStates[i]))
+            usage.tips += tipStatesBytes;
+        if (gPartials[i] != NULL && !isSharedTipBuffer(i, gPartials[i])) {
+            if (i < kTipCount)
+                usage.tips += partialsBytes;
+            else if (gMappedPartials == NULL)
+                usage.partials += partialsBytes;
+        }
+    }
+    if (gMappedPartials != NULL) {
+        usage.partials += kMappedPartialsBytes;
+        usage.mapped = kMappedPartialsBytes;
+    }
+
+    usage.matrices = (sizeof(REALTYPE*) + (long long) sizeof(REALTYPE) * kMatrixSize * kCategoryCount) * kMatrixCount;
+
+    if (kFlags & BEAGLE_FLAG_SCALING_AUTO) {
+        usage.scaleBuffers = (sizeof(signed short*) + (long long) sizeof(signed short) * kPaddedPatternCount) * kScaleBufferCount +
+                             sizeof(int) * kInternalPartialsBufferCount +
+                             sizeof(REALTYPE*) + scaleBytes;
+    } else {
+        usage.scaleBuffers = (sizeof(REALTYPE*) + scaleBytes) * kScaleBufferCount;
+    }
+
+    // buffers held by the checkpoint or kept for the next one
+    const long long matrixBytes = (long long) sizeof(REALTYPE) * kMatrixSize * kCategoryCount;
+    for (typename std::map<BufferSlot, REALTYPE*>::iterator it = gCheckpointBuffers.begin();
+         it != gCheckpointBuffers.end(); ++it) {
+        if (it->second == NULL || isSharedTipBuffer(it->first.second, it->second))
+            continue;
+        if (it->first.first == gPartials)
+            usage.partials += partialsBytes;
+        else if (it->first.first == gTransitionMatrices)
+            usage.matrices += matrixBytes;
+        else
+            usage.scaleBuffers += scaleBytes;
+    }
+    usage.partials += partialsBytes * gSpareBuffers[gPartials].size();
+    usage.matrices += matrixBytes * gSpareBuffers[gTransitionMatrices].size();
+    usage.matrices += matrixBytes * gMatrixCache.size();
+    usage.scaleBuffers += scaleBytes * gSpareBuffers[gScaleBuffers].size();
+
+    usage.model = getEigenDecompositionBytes(kEigenDecompCount, kStateCount, kFlags) +
+                  (sizeof(double*) + 2 * sizeof(REALTYPE*)) * kEigenDecompCount +
+                  (long long) sizeof(double) * kPatternCount;
+    for (int i = 0; i < kEigenDecompCount; i++) {
+        if (gCategoryRates[i] != NULL)
+            usage.model += sizeof(double) * kCategoryCount;
+        if (gCategoryWeights[i] != NULL)
+            usage.model += sizeof(REALTYPE) * kCategoryCount;
+        if (gStateFrequencies[i] != NULL)
+            usage.model += sizeof(REALTYPE) * kStateCount;
+    }
+
+    usage.scratch = (long long) sizeof(REALTYPE) * (6LL * kPatternCount * kStateCount + 2 * kPaddedPatternCount);
+    if (gSumtable != NULL)
+        usage.scratch += (long long) sizeof(REALTYPE) * (kPatternCount + 4) * kCategoryCount * kStateCount;
+    if (kIncrementalUpdates)
+        usage.scratch += (long long) (sizeof(PartialsRecord) + sizeof(unsigned long) + 1) * kBufferCount +
+                         (long long) sizeof(unsigned long) * (kMatrixCount + kScaleBufferCount) +
+                         (long long) sizeof(int) * gIncrementalOperations.capacity();
+    usage.scratch += (long long) sizeof(int) * gActivePatternRuns.capacity();
+
+    usage.threadLocal = getThreadingBytes((kThreadingEnabled ? kNumThreads : 0),
+                                          kBufferCount,
+                                          kPatternCount,
+                                          (kPartitionsInitialised ? kPartitionCount : 0),
+                                          kAutoPartitioningEnabled,
+                                          kAutoRootPartitioningEnabled);
+    if (kPatternsReordered)
+        usage.threadLocal += (long long) sizeof(int) * kPatternCount;
+    usage.threadLocal += (long long) sizeof(threadData) * kJobThreadCount;
+
+    usage.total = usage.partials + usage.tips + usage.matrices + usage.scaleBuffers +
+                  usage.model + usage.scratch + usage.threadLocal;
+
+    *outMemoryUsage = usage;
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setPerformanceCounters(bool enabled) {
+    gCounters.setEnabled(enabled);
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getPerformanceCounters(BeagleKernelCounters* outCounters,
+                                                              int count) {
+    if (count < 0 || count > BEAGLE_KERNEL_TYPE_COUNT)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+
+    gCounters.get(outCounters, count);
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::resetPerformanceCounters() {
+    gCounters.reset();
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::startTrace(const char* fileName,
+                                                  int eventsPerThread) {
+    return gTracer.start(fileName, eventsPerThread, getName());
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::writeTrace() {
+    return gTracer.write();
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::stopTrace() {
+    return gTracer.stop();
+}
+
+/*
+ * Operation and byte counts of one kernel call over count patterns (matrices
+ * for transition matrices), from the inner loops of the generic kernels.
+ * Transition matrices are read once per call.
+ */
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getKernelWork(int kernelType,
+                                                      long count,
+                                                      double* outFlops,
+                                                      double* outBytes) {
+    const double n = (double) count;
+    const double states = kStateCount;
+    const double categories = kCategoryCount;
+    const double partialsBytes = categories * kPartialsPaddedStateCount * sizeof(REALTYPE);
+    const double matricesBytes = categories * kMatrixSize * sizeof(REALTYPE);
+
+    switch (kernelType) {
+        case BEAGLE_KERNEL_STATES_STATES:
+            *outFlops = n * categories * states;
+            *outBytes = n * (partialsBytes + 2 * sizeof(int)) + 2 * matricesBytes;
+            break;
+        case BEAGLE_KERNEL_STATES_PARTIALS:
+            *outFlops = n * categories * (2 * states * states + states);
+            *outBytes = n * (2 * partialsBytes + sizeof(int)) + 2 * matricesBytes;
+            break;
+        case BEAGLE_KERNEL_PARTIALS_PARTIALS:
+            *outFlops = n * categories * (4 * states * states + states);
+            *outBytes = n * 3 * partialsBytes + 2 * matricesBytes;
+            break;
+        case BEAGLE_KERNEL_RESCALE:
+            *outFlops = n * (2 * categories * states + 1);
+            *outBytes = n * (2 * partialsBytes + sizeof(REALTYPE));
+            break;
+        case BEAGLE_KERNEL_ROOT_INTEGRATION:
+            *outFlops = n * (2 * categories * states + categories + 2);
+            *outBytes = n * (partialsBytes + sizeof(REALTYPE));
+            break;
+        case BEAGLE_KERNEL_EDGE_INTEGRATION:
+            *outFlops = n * (categories * (2 * states * states + 2 * states) + 2);
+            *outBytes = n * (2 * partialsBytes + sizeof(REALTYPE)) + matricesBytes;
+            break;
+        case BEAGLE_KERNEL_TRANSITION_MATRICES:
+            *outFlops = n * categories * (2 * states * states * states + states);
+            *outBytes = n * matricesBytes + states * states * states * sizeof(REALTYPE);
+            break;
+        default:
+            *outFlops = 0.0;
+            *outBytes = 0.0;
+    }
+}
+
+BEAGLE_CPU_TEMPLATE
+BeagleImpl* BeagleCPUImpl<BEAGLE_CPU_GENERIC>::clone() {
+    // internal partials live in this instance's scratch file mapping
+    if (gMappedPartials != NULL)
+        return NULL;
+
+    return cloneInto(newCopy());
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setCheckpoint() {
+    if (kCheckpointActive)
+        return BEAGLE_ERROR_GENERAL;
+
+    // mapped partials cannot be swapped with heap buffers, and auto-scaling
+    // factors are not tracked
+    if (gMappedPartials != NULL || (kFlags & BEAGLE_FLAG_SCALING_AUTO))
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+
+    kCheckpointActive = true;
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::commitCheckpoint() {
+    if (!kCheckpointActive)
+        return BEAGLE_ERROR_GENERAL;
+
+    for (typename std::map<BufferSlot, REALTYPE*>::iterator it = gCheckpointBuffers.begin();
+         it != gCheckpointBuffers.end(); ++it)
+        recycleBuffer(it->first.first, it->first.second, it->second);
+
+    gCheckpointBuffers.clear();
+    kCheckpointActive = false;
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::rollbackCheckpoint() {
+    if (!kCheckpointActive)
+        return BEAGLE_ERROR_GENERAL;
+
+    for (typename std::map<BufferSlot, REALTYPE*>::iterator it = gCheckpointBuffers.begin();
+         it != gCheckpointBuffers.end(); ++it) {
+        REALTYPE** buffers = it->first.first;
+        int index = it->first.second;
+        recycleBuffer(buffers, index, buffers[index]);
+        buffers[index] = it->second;
+        if (buffers == gTransitionMatrices && !gMatrixCacheKeys.empty())
+            gMatrixCacheKeys[index] = MatrixCacheKey(BEAGLE_OP_NONE, 0.0);
+        if (kIncrementalUpdates)
+            touchBuffer(buffers, index);
+    }
+
+    gCheckpointBuffers.clear();
+    kCheckpointActive = false;
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+BeagleCPUImpl<BEAGLE_CPU_GENERIC>* BeagleCPUImpl<BEAGLE_CPU_GENERIC>::newCopy() {
+    return new BeagleCPUImpl<BEAGLE_CPU_GENERIC>(*this);
+}
+
+/*
+ * Completes a shallow copy of this instance: large buffers are shared
+ * copy-on-write, small model and bookkeeping arrays are duplicated and
+ * threads are started afresh.
+ */
+BEAGLE_CPU_TEMPLATE
+BeagleImpl* BeagleCPUImpl<BEAGLE_CPU_GENERIC>::cloneInto(BeagleCPUImpl<BEAGLE_CPU_GENERIC>* copy) {
+    if (gSharedBuffers == NULL) {
+        gSharedBuffers = new SharedBufferTable();
+        copy->gSharedBuffers = gSharedBuffers;
+    }
+    gSharedBuffers->retain();
+
+    if (gTipData != NULL)
+        gTipData->retain();
+
+    copy->gPartials = (REALTYPE**) malloc(sizeof(REALTYPE*) * kBufferCount);
+    copy->gTipStates = (int**) malloc(sizeof(int*) * kBufferCount);
+    if (copy->gPartials == NULL || copy->gTipStates == NULL)
+        throw std::bad_alloc();
+    for (int i = 0; i < kBufferCount; i++) {
+        copy->gPartials[i] = gPartials[i];
+        if (gPartials[i] != NULL && !isSharedTipBuffer(i, gPartials[i]))
+            gSharedBuffers->share(gPartials[i]);
+        copy->gTipStates[i] = gTipStates[i];
+        if (gTipStates[i] != NULL && !isSharedTipBuffer(i, gTipStates[i]))
+            gSharedBuffers->share(gTipStates[i]);
+    }
+
+    copy->gTransitionMatrices = (REALTYPE**) malloc(sizeof(REALTYPE*) * kMatrixCount);
+    if (copy->gTransitionMatrices == NULL)
+        throw std::bad_alloc();
+    for (int i = 0; i < kMatrixCount; i++) {
+        copy->gTransitionMatrices[i] = gTransitionMatrices[i];
+        gSharedBuffers->share(gTransitionMatrices[i]);
+    }
+
+    if (kFlags & BEAGLE_FLAG_SCALING_AUTO) {
+        // compact auto-scaling factors are small enough to copy outright
+        copy->gAutoScaleBuffers = (signed short**) malloc(sizeof(signed short*) * kScaleBufferCount);
+        if (copy->gAutoScaleBuffers == NULL)
+            throw std::bad_alloc();
+        for (int i = 0; i < kScaleBufferCount; i++) {
+            copy->gAutoScaleBuffers[i] = (signed short*) malloc(sizeof(signed short) * kPaddedPatternCount);
+            if (copy->gAutoScaleBuffers[i] == NULL)
+                throw std::bad_alloc();
+            memcpy(copy->gAutoScaleBuffers[i], gAutoScaleBuffers[i], sizeof(signed short) * kPaddedPatternCount);
+        }
+        copy->gActiveScalingFactors = (int*) malloc(sizeof(int) * kInternalPartialsBufferCount);
+        memcpy(copy->gActiveScalingFactors, gActiveScalingFactors, sizeof(int) * kInternalPartialsBufferCount);
+        copy->gScaleBuffers = (REALTYPE**) malloc(sizeof(REALTYPE*));
+        copy->gScaleBuffers[0] = (REALTYPE*) malloc(sizeof(REALTYPE) * kPaddedPatternCount);
+        memcpy(copy->gScaleBuffers[0], gScaleBuffers[0], sizeof(REALTYPE) * kPaddedPatternCount);
+    } else {
+        copy->gScaleBuffers = (REALTYPE**) malloc(sizeof(REALTYPE*) * kScaleBufferCount);
+        if (copy->gScaleBuffers == NULL)
+            throw std::bad_alloc();
+        for (int i = 0; i < kScaleBufferCount; i++) {
+            copy->gScaleBuffers[i] = gScaleBuffers[i];
+            gSharedBuffers->share(gScaleBuffers[i]);
+        }
+    }
+
+    copy->gEigenDecomposition = gEigenDecomposition->clone();
+
+    copy->gCategoryRates = (double**) calloc(sizeof(double), kEigenDecompCount);
+    copy->gStateFrequencies = (REALTYPE**) calloc(sizeof(REALTYPE*), kEigenDecompCount);
+    copy->gCategoryWeights = (REALTYPE**) calloc(sizeof(REALTYPE*), kEigenDecompCount);
+    if (copy->gCategoryRates == NULL || copy->gStateFrequencies == NULL || copy->gCategoryWeights == NULL)
+        throw std::bad_alloc();
+    for (int i = 0; i < kEigenDecompCount; i++) {
+        if (gCategoryRates[i] != NULL) {
+            copy->gCategoryRates[i] = (double*) malloc(sizeof(double) * kCategoryCount);
+            memcpy(copy->gCategoryRates[i], gCategoryRates[i], sizeof(double) * kCategoryCount);
+        }
+        if (gStateFrequencies[i] != NULL) {
+            copy->gStateFrequencies[i] = (REALTYPE*) malloc(sizeof(REALTYPE) * kStateCount);
+            memcpy(copy->gStateFrequencies[i], gStateFrequencies[i], sizeof(REALTYPE) * kStateCount);
+        }
+        if (gCategoryWeights[i] != NULL) {
+            copy->gCategoryWeights[i] = (REALTYPE*) malloc(sizeof(REALTYPE) * kCategoryCount);
+            memcpy(copy->gCategoryWeights[i], gCategoryWeights[i], sizeof(REALTYPE) * kCategoryCount);
+        }
+    }
+
+    copy->gPatternWeights = (double*) malloc(sizeof(double) * kPatternCount);
+    if (copy->gPatternWeights == NULL)
+        throw std::bad_alloc();
+    memcpy(copy->gPatternWeights, gPatternWeights, sizeof(double) * kPatternCount);
+
+    copy->integrationTmp = (REALTYPE*) mallocAligned(sizeof(REALTYPE) * kPatternCount * kStateCount);
+    copy->firstDerivTmp = (REALTYPE*) malloc(sizeof(REALTYPE) * kPatternCount * kStateCount);
+    copy->secondDerivTmp = (REALTYPE*) malloc(sizeof(REALTYPE) * kPatternCount * kStateCount);
+
+    copy->outLogLikelihoodsTmp = (REALTYPE*) malloc(sizeof(REALTYPE) * kPatternCount * kStateCount);
+    copy->outFirstDerivativesTmp = (REALTYPE*) malloc(sizeof(REALTYPE) * kPatternCount * kStateCount);
+    copy->outSecondDerivativesTmp = (REALTYPE*) malloc(sizeof(REALTYPE) * kPatternCount * kStateCount);
+    memcpy(copy->outLogLikelihoodsTmp, outLogLikelihoodsTmp, sizeof(REALTYPE) * kPatternCount * kStateCount);
+    memcpy(copy->outFirstDerivativesTmp, outFirstDerivativesTmp, sizeof(REALTYPE) * kPatternCount * kStateCount);
+    memcpy(copy->outSecondDerivativesTmp, outSecondDerivativesTmp, sizeof(REALTYPE) * kPatternCount * kStateCount);
+
+    copy->zeros = (REALTYPE*) malloc(sizeof(REALTYPE) * kPaddedPatternCount);
+    copy->ones = (REALTYPE*) malloc(sizeof(REALTYPE) * kPaddedPatternCount);
+    for(int i = 0; i < kPaddedPatternCount; i++) {
+        copy->zeros[i] = 0.0;
+        copy->ones[i] = 1.0;
+    }
+
+    // the sumtable is rebuilt on demand
+    copy->gSumtable = NULL;
+    copy->gSumtableRates = NULL;
+    copy->kSumtableScaleIndex = BEAGLE_OP_NONE;
+
+    // the cached matrices were copied, their index must point into the copy
+    copy->gMatrixCacheIndex.clear();
+    for (typename MatrixCacheList::iterator it = copy->gMatrixCache.begin();
+         it != copy->gMatrixCache.end(); ++it)
+        copy->gMatrixCacheIndex[it->first] = it;
+
+    // the checkpoint and its spare buffers stay with this instance
+    copy->kCheckpointActive = false;
+    copy->gCheckpointBuffers.clear();
+    copy->gSpareBuffers.clear();
+
+    // threads and partitions are rebuilt for the copy
+    copy->kThreadingEnabled = false;
+    copy->kAutoPartitioningEnabled = false;
+    copy->kAutoRootPartitioningEnabled = false;
+    copy->kPartitionsInitialised = false;
+    copy->kPatternsReordered = false;
+    copy->gThreads = NULL;
+    copy->gJobThreads = NULL;
+    copy->kJobThreadCount = 0;
+    copy->gFutures = NULL;
+    copy->gThreadOperations = NULL;
+    copy->gThreadOpCounts = NULL;
+    copy->gAutoPartitionOperations = NULL;
+    copy->gAutoPartitionIndices = NULL;
+    copy->gAutoPartitionOutSumLogLikelihoods = NULL;
+    copy->gPatternPartitions = NULL;
+    copy->gPatternPartitionsStartPatterns = NULL;
+    copy->gPatternsNewOrder = NULL;
+
+    if (kPartitionsInitialised) {
+        // patterns of this instance are already in partition order, so no reordering happens here
+        copy->setPatternPartitions(kPartitionCount, gPatternPartitions);
+
+        if (kPatternsReordered) {
+            copy->gPatternsNewOrder = (int*) malloc(sizeof(int) * kPatternCount);
+            memcpy(copy->gPatternsNewOrder, gPatternsNewOrder, sizeof(int) * kPatternCount);
+            copy->kPatternsReordered = true;
+        }
+
+        if (kAutoPartitioningEnabled) {
+            copy->gAutoPartitionOperations = (int*) malloc(sizeof(int) * kBufferCount * kPartitionCount * BEAGLE_PARTITION_OP_COUNT);
+            if (kAutoRootPartitioningEnabled) {
+                copy->gAutoPartitionIndices = (int*) malloc(sizeof(int) * kPartitionCount);
+                memcpy(copy->gAutoPartitionIndices, gAutoPartitionIndices, sizeof(int) * kPartitionCount);
+                copy->gAutoPartitionOutSumLogLikelihoods = (double*) malloc(sizeof(double) * kPartitionCount);
+                copy->kAutoRootPartitioningEnabled = true;
+            }
+            copy->kAutoPartitioningEnabled = true;
+        }
+    }
+
+    return copy;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::estimateMemoryUsage(int tipCount,
+                                                           int partialsBufferCount,
+                                                           int compactBufferCount,
+                                                           int stateCount,
+                                                           int patternCount,
+                                                           int eigenDecompositionCount,
+                                                           int matrixCount,
+                                                           int categoryCount,
+                                                           int scaleBufferCount,
+                                                           long preferenceFlags,
+                                                           long requirementFlags,
+                                                           BeagleMemoryUsage* outMemoryUsage) {
+    const long flags = preferenceFlags | requirementFlags;
+
+    // no CPU implementation currently pads patterns (see getPaddedPatternsModulus)
+    const int bufferCount = partialsBufferCount + compactBufferCount;
+    const int internalBufferCount = bufferCount - tipCount;
+    const int tipStatesCount = (compactBufferCount < tipCount ? compactBufferCount : tipCount);
+    const int tipPartialsCount = tipCount - tipStatesCount;
+
+    if (internalBufferCount <= 0)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+
+    const long long partialsBytes = (long long) sizeof(REALTYPE) * patternCount * (stateCount + P_PAD) * categoryCount;
+    const long long scaleBytes = (long long) sizeof(REALTYPE) * patternCount;
+    const long long matrixSize = (long long) (T_PAD + stateCount) * stateCount;
+
+    BeagleMemoryUsage usage;
+
+    usage.partials = sizeof(REALTYPE*) * bufferCount + partialsBytes * internalBufferCount;
+    usage.mapped = 0;
+#ifdef HAVE_SYS_MMAN_H
+    if (flags & BEAGLE_FLAG_PARTIALS_MAPPED) {
+        const long long pageSize = sysconf(_SC_PAGESIZE);
+        usage.mapped = ((partialsBytes + pageSize - 1) / pageSize) * pageSize * internalBufferCount;
+        usage.partials = sizeof(REALTYPE*) * bufferCount + usage.mapped;
+    }
+#endif
+
+    usage.tips = sizeof(int*) * bufferCount +
+                 (long long) sizeof(int) * patternCount * tipStatesCount +
+                 partialsBytes * tipPartialsCount;
+
+    usage.matrices = (sizeof(REALTYPE*) + sizeof(REALTYPE) * matrixSize * categoryCount) * matrixCount;
+
+    if (flags & BEAGLE_FLAG_SCALING_AUTO) {
+        usage.scaleBuffers = (sizeof(signed short*) + (long long) sizeof(signed short) * patternCount) * internalBufferCount +
+                             sizeof(int) * internalBufferCount +
+                             sizeof(REALTYPE*) + scaleBytes;
+    } else if (flags & BEAGLE_FLAG_SCALING_ALWAYS) {
+        usage.scaleBuffers = (sizeof(REALTYPE*) + scaleBytes) * (internalBufferCount + 1);
+    } else {
+        usage.scaleBuffers = (sizeof(REALTYPE*) + scaleBytes) * scaleBufferCount;
+    }
+
+    usage.model = getEigenDecompositionBytes(eigenDecompositionCount, stateCount, flags) +
+                  (sizeof(double*) + 2 * sizeof(REALTYPE*)) * eigenDecompositionCount +
+                  (long long) sizeof(double) * patternCount +
+                  (sizeof(double) * categoryCount + sizeof(REALTYPE) * (categoryCount + stateCount)) *
+                  eigenDecompositionCount;
+
+    usage.scratch = (long long) sizeof(REALTYPE) * (6LL * patternCount * stateCount + 2 * patternCount);
+
+    usage.threadLocal = 0;
+    if (flags & BEAGLE_FLAG_THREADING_CPP) {
+        int minPatternCount;
+        int partitionCount = getAutoPartitionCount(stateCount, patternCount, &minPatternCount);
+        if (partitionCount > 0) {
+            usage.threadLocal = getThreadingBytes(partitionCount, bufferCount, patternCount, partitionCount,
+                                                  true, (patternCount >= minPatternCount * 4));
+        }
+    }
+
+    usage.total = usage.partials + usage.tips + usage.matrices + usage.scaleBuffers +
+                  usage.model + usage.scratch + usage.threadLocal;
+
+    *outMemoryUsage = usage;
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getCPUThreadCount(int* outThreadCount) {
+    *outThreadCount = (kFlags & BEAGLE_FLAG_THREADING_CPP ? kCPUThreadCount : 0);
+
+    return BEAGLE_SUCCESS;
+}
+
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setCPUThreadCount(int threadCount) {
 
     if (threadCount < 1)
         return BEAGLE_ERROR_OUT_OF_RANGE;
 
+    kCPUThreadCount = threadCount;
+    if (kJobThreadCount != threadCount)
+        stopJobThreads();
+
     kThreadingEnabled = false;
     kAutoPartitioningEnabled = false;
     if (kFlags & BEAGLE_FLAG_THREADING_CPP) {
@@ -564,14 +1120,14 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setTipStates(int tipIndex,
                                 const int* inStates) {
     if (tipIndex < 0 || tipIndex >= kTipCount)
         return BEAGLE_ERROR_OUT_OF_RANGE;
+    if (gTipStates[tipIndex] != NULL && !isSharedTipBuffer(tipIndex, gTipStates[tipIndex]) &&
+        !releaseSharedBuffer(gTipStates[tipIndex]))
+        free(gTipStates[tipIndex]);
     gTipStates[tipIndex] = (int*) mallocAligned(sizeof(int) * kPaddedPatternCount);
     // TODO: What if this throws a memory full error?
-    for (int j = 0; j < kPatternCount; j++) {
-        gTipStates[tipIndex][j] = (inStates[j] < kStateCount ? inStates[j] : kStateCount);
-    }
-    for (int j = kPatternCount; j < kPaddedPatternCount; j++) {
-        gTipStates[tipIndex][j] = kStateCount;
-    }
+    fillTipStates(gTipStates[tipIndex], inStates);
+    if (kIncrementalUpdates)
+        touchBuffer(gPartials, tipIndex);
 
     return BEAGLE_SUCCESS;
 }
@@ -581,6 +1137,9 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setTipPartials(int tipIndex,
                                   const double* inPartials) {
     if (tipIndex < 0 || tipIndex >= kTipCount)
         return BEAGLE_ERROR_OUT_OF_RANGE;
+    unshareBuffer(gPartials, tipIndex, kPartialsSize, false);
+    if (isSharedTipBuffer(tipIndex, gPartials[tipIndex]))
+        gPartials[tipIndex] = NULL;
     if(gPartials[tipIndex] == NULL) {
         gPartials[tipIndex] = (REALTYPE*) mallocAligned(sizeof(REALTYPE) * kPartialsSize);
         // TODO: What if this throws a memory full error?
@@ -588,8 +1147,80 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setTipPartials(int tipIndex,
             return BEAGLE_ERROR_OUT_OF_MEMORY;
     }
 
+    fillTipPartials(gPartials[tipIndex], inPartials);
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::attachTipData(BeagleTipData* tipData) {
+    if (tipData->getStateCount() != kStateCount ||
+        tipData->getPatternCount() != kPatternCount ||
+        tipData->getTipCount() > kTipCount)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+
+    // only one shared tip data per instance, and shared buffers are in the original pattern order
+    if (gTipData != NULL || kPatternsReordered)
+        return BEAGLE_ERROR_GENERAL;
+
+    char layoutSuffix[64];
+    snprintf(layoutSuffix, sizeof(layoutSuffix), "%d/%d/%d/%d", (int) sizeof(REALTYPE),
+             kPartialsPaddedStateCount, kCategoryCount, kPaddedPatternCount);
+    const std::string statesLayout = std::string("cpu-states/") + layoutSuffix;
+    const std::string partialsLayout = std::string("cpu-partials/") + layoutSuffix;
+
+    std::lock_guard<std::mutex> lock(tipData->getMutex());
+
+    for (int i = 0; i < tipData->getTipCount(); i++) {
+        if (tipData->getTipStates(i) != NULL) {
+            int* states = (int*) tipData->getLayoutBuffer(statesLayout, i);
+            if (states == NULL) {
+                states = (int*) mallocAligned(sizeof(int) * kPaddedPatternCount);
+                fillTipStates(states, tipData->getTipStates(i));
+                tipData->setLayoutBuffer(statesLayout, i, states);
+            }
+            if (gTipStates[i] != NULL)
+                free(gTipStates[i]);
+            gTipStates[i] = states;
+            if (kIncrementalUpdates)
+                touchBuffer(gPartials, i);
+        } else if (tipData->getTipPartials(i) != NULL) {
+            REALTYPE* partials = (REALTYPE*) tipData->getLayoutBuffer(partialsLayout, i);
+            if (partials == NULL) {
+                partials = (REALTYPE*) mallocAligned(sizeof(REALTYPE) * kPartialsSize);
+                fillTipPartials(partials, tipData->getTipPartials(i));
+                tipData->setLayoutBuffer(partialsLayout, i, partials);
+            }
+            if (gPartials[i] != NULL)
+                free(gPartials[i]);
+            gPartials[i] = partials;
+            if (kIncrementalUpdates)
+                touchBuffer(gPartials, i);
+        }
+    }
+
+    tipData->retain();
+    gTipData = tipData;
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::fillTipStates(int* destination,
+                                                      const int* inStates) {
+    for (int j = 0; j < kPatternCount; j++) {
+        destination[j] = (inStates[j] < kStateCount ? inStates[j] : kStateCount);
+    }
+    for (int j = kPatternCount; j < kPaddedPatternCount; j++) {
+        destination[j] = kStateCount;
+    }
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::fillTipPartials(REALTYPE* destination,
+                                                        const double* inPartials) {
     const double* inPartialsOffset;
-    REALTYPE* tmpRealPartialsOffset = gPartials[tipIndex];
+    REALTYPE* tmpRealPartialsOffset = destination;
     for (int l = 0; l < kCategoryCount; l++) {
         inPartialsOffset = inPartials;
         for (int i = 0; i < kPatternCount; i++) {
@@ -606,8 +1237,6 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setTipPartials(int tipIndex,
             *tmpRealPartialsOffset++ = 0;
         }
     }
-
-    return BEAGLE_SUCCESS;
 }
 
 BEAGLE_CPU_TEMPLATE
@@ -615,6 +1244,9 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setPartials(int bufferIndex,
                                const double* inPartials) {
     if (bufferIndex < 0 || bufferIndex >= kBufferCount)
         return BEAGLE_ERROR_OUT_OF_RANGE;
+    unshareBuffer(gPartials, bufferIndex, kPartialsSize, false);
+    if (isSharedTipBuffer(bufferIndex, gPartials[bufferIndex]))
+        gPartials[bufferIndex] = NULL;
     if (gPartials[bufferIndex] == NULL) {
         gPartials[bufferIndex] = (REALTYPE*) malloc(sizeof(REALTYPE) * kPartialsSize);
         if (gPartials[bufferIndex] == 0L)
@@ -684,6 +1316,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setEigenDecomposition(int eigenIndex,
                                          const double* inEigenValues) {
 
     gEigenDecomposition->setEigenDecomposition(eigenIndex, inEigenVectors, inInverseEigenVectors, inEigenValues);
+    clearMatrixCache(eigenIndex);
     return BEAGLE_SUCCESS;
 }
 
@@ -696,6 +1329,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setCategoryRates(const double* inCategory
             return BEAGLE_ERROR_OUT_OF_MEMORY;
     }
     memcpy(gCategoryRates[categoryRatesIndex], inCategoryRates, sizeof(double) * kCategoryCount);
+    clearMatrixCache(BEAGLE_OP_NONE);
     return BEAGLE_SUCCESS;
 }
 
@@ -710,6 +1344,8 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setCategoryRatesWithIndex(int categoryRat
             return BEAGLE_ERROR_OUT_OF_MEMORY;
     }
     memcpy(gCategoryRates[categoryRatesIndex], inCategoryRates, sizeof(double) * kCategoryCount);
+    if (categoryRatesIndex == 0)
+        clearMatrixCache(BEAGLE_OP_NONE);
     return BEAGLE_SUCCESS;
 }
 
@@ -717,36 +1353,107 @@ BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setPatternWeights(const double* inPatternWeights) {
     assert(inPatternWeights != 0L);
     memcpy(gPatternWeights, inPatternWeights, sizeof(double) * kPatternCount);
+    if (kSkipZeroWeightPatterns)
+        updateActivePatterns();
     return BEAGLE_SUCCESS;
 }
 
 BEAGLE_CPU_TEMPLATE
-int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setPatternPartitions(int partitionCount,
-                                                            const int* inPatternPartitions) {
-    
-    int returnCode = BEAGLE_SUCCESS;
-
-    assert(partitionCount > 0);
-    assert(inPatternPartitions != 0L);
-
-    kPartitionCount = partitionCount;
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setZeroWeightPatternSkipping(bool enabled) {
+    kSkipZeroWeightPatterns = enabled;
+    updateActivePatterns();
+    return BEAGLE_SUCCESS;
+}
 
-    if (!kPartitionsInitialised) {
-        gPatternPartitions = (int*) malloc(sizeof(int) * kPatternCount);
-        if (gPatternPartitions == NULL)
-            throw std::bad_alloc();
+/*
+ * Collects the runs of consecutive patterns with nonzero weight. Partials
+ * computed while some patterns were skipped hold placeholders there, so
+ * incremental updates must not reuse them once the runs change.
+ */
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::updateActivePatterns() {
+    std::vector<int> runs;
 
-        if (kAutoPartitioningEnabled) {
-            free(gAutoPartitionOperations);
-            if (kAutoRootPartitioningEnabled) {
-                free(gAutoPartitionIndices);
-                free(gAutoPartitionOutSumLogLikelihoods);
-                kAutoRootPartitioningEnabled = false;
+    if (kSkipZeroWeightPatterns) {
+        for (int k = 0; k < kPatternCount; k++) {
+            if (gPatternWeights[k] == 0.0)
+                continue;
+            if (!runs.empty() && runs.back() == k)
+                runs.back() = k + 1;
+            else {
+                runs.push_back(k);
+                runs.push_back(k + 1);
             }
-            kAutoPartitioningEnabled = false;
         }
+        if (runs.size() == 2 && runs[0] == 0 && runs[1] == kPatternCount)
+            runs.clear();
     }
-    if (!kPartitionsInitialised || partitionCount > kMaxPartitionCount) {
+
+    if (runs != gActivePatternRuns) {
+        if (!gActivePatternRuns.empty())
+            forgetPartialsRecords();
+        gActivePatternRuns.swap(runs);
+    }
+}
+
+/*
+ * Sets the partials of skipped patterns from startPattern to endPattern to 1
+ * so that they integrate to a finite site log likelihood of 0.
+ */
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::fillInactivePatterns(REALTYPE* destP,
+                                                             int startPattern,
+                                                             int endPattern) {
+    const int runCount = gActivePatternRuns.size() / 2;
+    for (int l = 0; l < kCategoryCount; l++) {
+        REALTYPE* categoryP = destP + l * kPaddedPatternCount * kPartialsPaddedStateCount;
+        int gapStart = startPattern;
+        for (int run = 0; run <= runCount; run++) {
+            const int gapEnd = std::min(run < runCount ? gActivePatternRuns[2 * run] : kPatternCount, endPattern);
+            for (int k = gapStart; k < gapEnd; k++) {
+                REALTYPE* patternP = categoryP + k * kPartialsPaddedStateCount;
+                for (int i = 0; i < kStateCount; i++)
+                    patternP[i] = 1.0;
+                for (int i = kStateCount; i < kPartialsPaddedStateCount; i++)
+                    patternP[i] = 0.0;
+            }
+            if (run < runCount)
+                gapStart = std::max(gActivePatternRuns[2 * run + 1], startPattern);
+        }
+    }
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setPatternPartitions(int partitionCount,
+                                                            const int* inPatternPartitions) {
+    
+    int returnCode = BEAGLE_SUCCESS;
+
+    assert(partitionCount > 0);
+    assert(inPatternPartitions != 0L);
+
+    // reordering would move the checkpointed buffers out from under the checkpoint
+    if (kCheckpointActive)
+        return BEAGLE_ERROR_GENERAL;
+
+    kPartitionCount = partitionCount;
+
+    if (!kPartitionsInitialised) {
+        gPatternPartitions = (int*) malloc(sizeof(int) * kPatternCount);
+        if (gPatternPartitions == NULL)
+            throw std::bad_alloc();
+
+        if (kAutoPartitioningEnabled) {
+            free(gAutoPartitionOperations);
+            if (kAutoRootPartitioningEnabled) {
+                free(gAutoPartitionIndices);
+                free(gAutoPartitionOutSumLogLikelihoods);
+                kAutoRootPartitioningEnabled = false;
+            }
+            kAutoPartitioningEnabled = false;
+        }
+    }
+    if (!kPartitionsInitialised || partitionCount > kMaxPartitionCount) {
         if (kPartitionsInitialised) {
             free(gPatternPartitionsStartPatterns);
         }
@@ -958,6 +1665,8 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setTransitionMatrix(int matrixIndex,
                                        const double* inMatrix,
                                        double paddedValue) {
 
+    unshareBuffer(gTransitionMatrices, matrixIndex, kMatrixSize * kCategoryCount, false);
+
 if (T_PAD != 0) {
     const double* offsetInMatrix = inMatrix;
     REALTYPE* offsetBeagleMatrix = gTransitionMatrices[matrixIndex];
@@ -984,6 +1693,8 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setTransitionMatrices(const int* matrixIn
     for (int k = 0; k < count; k++) {
         const double* inMatrix = inMatrices + k*kStateCount*kStateCount*kCategoryCount;
         int matrixIndex = matrixIndices[k];
+
+        unshareBuffer(gTransitionMatrices, matrixIndex, kMatrixSize * kCategoryCount, false);
         
 if (T_PAD != 0) {
         const double* offsetInMatrix = inMatrix;
@@ -1036,6 +1747,8 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::convolveTransitionMatrices(const int* fir
 
         }//END: overwrite check
 
+        unshareBuffer(gTransitionMatrices, resultIndices[u], kMatrixSize * kCategoryCount, false);
+
         REALTYPE* C = gTransitionMatrices[resultIndices[u]];
         REALTYPE* A = gTransitionMatrices[firstIndices[u]];
         REALTYPE* B = gTransitionMatrices[secondIndices[u]];
@@ -1122,15 +1835,170 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::updateTransitionMatrices(int eigenIndex,
                                             const int* secondDerivativeIndices,
                                             const double* edgeLengths,
                                             int count) {
+    BeagleTraceScope traceScope(gTracer, "beagleUpdateTransitionMatrices", "api", count);
+
     // for (int i = 0; i < count; i++) {
     //     printf("uTM %d %d %f %d\n", eigenIndex, probabilityIndices[i], edgeLengths[i], 0);
     // }
 
+    double flops = 0.0, bytes = 0.0;
+    if (gCounters.isEnabled())
+        getKernelWork(BEAGLE_KERNEL_TRANSITION_MATRICES, count, &flops, &bytes);
+    BeagleCounterTimer counterTimer(gCounters, BEAGLE_KERNEL_TRANSITION_MATRICES, 0, flops, bytes);
+
+    if (!gMatrixCacheKeys.empty() && firstDerivativeIndices == NULL && secondDerivativeIndices == NULL)
+        return updateTransitionMatricesCached(eigenIndex, probabilityIndices, edgeLengths, count);
+
+    if (gSharedBuffers != NULL || kCheckpointActive || !gMatrixCacheKeys.empty() || kIncrementalUpdates) {
+        for (int i = 0; i < count; i++) {
+            unshareBuffer(gTransitionMatrices, probabilityIndices[i], kMatrixSize * kCategoryCount, false);
+            if (firstDerivativeIndices != NULL)
+                unshareBuffer(gTransitionMatrices, firstDerivativeIndices[i], kMatrixSize * kCategoryCount, false);
+            if (secondDerivativeIndices != NULL)
+                unshareBuffer(gTransitionMatrices, secondDerivativeIndices[i], kMatrixSize * kCategoryCount, false);
+        }
+    }
+
     gEigenDecomposition->updateTransitionMatrices(eigenIndex,probabilityIndices,firstDerivativeIndices,secondDerivativeIndices,
                                                   edgeLengths,gCategoryRates[0],gTransitionMatrices,count);
     return BEAGLE_SUCCESS;
 }
 
+/*
+ * Probability matrices are cached by eigen index and edge length. A matrix
+ * that already holds the requested key is left alone, a cached one is copied
+ * and the remaining ones are computed in a single batch and cached. Without
+ * a cache only the first check is made, which incremental updates rely on.
+ */
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::updateTransitionMatricesCached(int eigenIndex,
+                                                                      const int* probabilityIndices,
+                                                                      const double* edgeLengths,
+                                                                      int count) {
+    const int matrixSize = kMatrixSize * kCategoryCount;
+
+    std::vector<int> missIndices;
+    std::vector<double> missLengths;
+    std::vector<bool> visited(kMatrixCount, false);
+
+    // walk backwards so that only the last write to each matrix counts
+    for (int i = count - 1; i >= 0; i--) {
+        const int matrixIndex = probabilityIndices[i];
+        const MatrixCacheKey key(eigenIndex, edgeLengths[i]);
+
+        if (visited[matrixIndex])
+            continue;
+        visited[matrixIndex] = true;
+
+        if (gMatrixCacheKeys[matrixIndex] == key) {
+            kMatrixCacheHits++;
+            continue;
+        }
+
+        unshareBuffer(gTransitionMatrices, matrixIndex, matrixSize, false);
+
+        typename std::map<MatrixCacheKey, typename MatrixCacheList::iterator>::iterator found =
+            gMatrixCacheIndex.find(key);
+        if (found != gMatrixCacheIndex.end()) {
+            gMatrixCache.splice(gMatrixCache.begin(), gMatrixCache, found->second);
+            memcpy(gTransitionMatrices[matrixIndex], &(found->second->second[0]), sizeof(REALTYPE) * matrixSize);
+            gMatrixCacheKeys[matrixIndex] = key;
+            kMatrixCacheHits++;
+        } else {
+            missIndices.push_back(matrixIndex);
+            missLengths.push_back(edgeLengths[i]);
+        }
+    }
+
+    if (missIndices.empty())
+        return BEAGLE_SUCCESS;
+
+    const int missCount = missIndices.size();
+    gEigenDecomposition->updateTransitionMatrices(eigenIndex, &missIndices[0], NULL, NULL,
+                                                  &missLengths[0], gCategoryRates[0], gTransitionMatrices, missCount);
+    kMatrixCacheMisses += missCount;
+
+    for (int i = 0; i < missCount; i++) {
+        const MatrixCacheKey key(eigenIndex, missLengths[i]);
+        const REALTYPE* matrix = gTransitionMatrices[missIndices[i]];
+
+        gMatrixCacheKeys[missIndices[i]] = key;
+        if (kMatrixCacheSize == 0)
+            continue;
+
+        typename std::map<MatrixCacheKey, typename MatrixCacheList::iterator>::iterator found =
+            gMatrixCacheIndex.find(key);
+        if (found != gMatrixCacheIndex.end()) {
+            // the same edge length appeared twice in this batch
+            gMatrixCache.splice(gMatrixCache.begin(), gMatrixCache, found->second);
+        } else if ((int) gMatrixCache.size() < kMatrixCacheSize) {
+            gMatrixCache.push_front(std::make_pair(key, std::vector<REALTYPE>(matrix, matrix + matrixSize)));
+            gMatrixCacheIndex[key] = gMatrixCache.begin();
+        } else {
+            // reuse the storage of the least recently used entry
+            gMatrixCacheIndex.erase(gMatrixCache.back().first);
+            gMatrixCache.splice(gMatrixCache.begin(), gMatrixCache, --gMatrixCache.end());
+            gMatrixCache.front().first = key;
+            memcpy(&(gMatrixCache.front().second[0]), matrix, sizeof(REALTYPE) * matrixSize);
+            gMatrixCacheIndex[key] = gMatrixCache.begin();
+        }
+    }
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setTransitionMatrixCacheSize(int cacheSize) {
+    if (cacheSize < 0)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+
+    kMatrixCacheSize = cacheSize;
+    kMatrixCacheHits = 0;
+    kMatrixCacheMisses = 0;
+
+    clearMatrixCache(BEAGLE_OP_NONE);
+    if (cacheSize == 0 && !kIncrementalUpdates)
+        std::vector<MatrixCacheKey>().swap(gMatrixCacheKeys);
+    else
+        gMatrixCacheKeys.assign(kMatrixCount, MatrixCacheKey(BEAGLE_OP_NONE, 0.0));
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getTransitionMatrixCacheStatistics(long* outHitCount,
+                                                                          long* outMissCount) {
+    if (outHitCount != NULL)
+        *outHitCount = kMatrixCacheHits;
+    if (outMissCount != NULL)
+        *outMissCount = kMatrixCacheMisses;
+    return BEAGLE_SUCCESS;
+}
+
+/*
+ * Drops cached matrices for one eigen decomposition, or for all of them
+ * if eigenIndex is BEAGLE_OP_NONE.
+ */
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::clearMatrixCache(int eigenIndex) {
+    if (gMatrixCacheKeys.empty())
+        return;
+
+    for (typename MatrixCacheList::iterator it = gMatrixCache.begin(); it != gMatrixCache.end(); ) {
+        if (eigenIndex == BEAGLE_OP_NONE || it->first.first == eigenIndex) {
+            gMatrixCacheIndex.erase(it->first);
+            it = gMatrixCache.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (int i = 0; i < (int) gMatrixCacheKeys.size(); i++) {
+        if (eigenIndex == BEAGLE_OP_NONE || gMatrixCacheKeys[i].first == eigenIndex)
+            gMatrixCacheKeys[i] = MatrixCacheKey(BEAGLE_OP_NONE, 0.0);
+    }
+}
+
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::updateTransitionMatricesWithMultipleModels(const int* eigenIndices,
                                                                                   const int* categoryRateIndices,
@@ -1154,6 +2022,12 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::updateTransitionMatricesWithMultipleModel
             secondDeriv = &secondDerivativeIndices[i];
         }
 
+        unshareBuffer(gTransitionMatrices, probabilityIndices[i], kMatrixSize * kCategoryCount, false);
+        if (firstDeriv != NULL)
+            unshareBuffer(gTransitionMatrices, *firstDeriv, kMatrixSize * kCategoryCount, false);
+        if (secondDeriv != NULL)
+            unshareBuffer(gTransitionMatrices, *secondDeriv, kMatrixSize * kCategoryCount, false);
+
         gEigenDecomposition->updateTransitionMatrices(eigenIndices[i],
                                                       &probabilityIndices[i],
                                                       firstDeriv,
@@ -1172,9 +2046,16 @@ BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::updatePartials(const int* operations,
                                                       int count,
                                                       int cumulativeScaleIndex) {
+    BeagleTraceScope traceScope(gTracer, "beagleUpdatePartials", "api", count);
 
     int returnCode = BEAGLE_ERROR_GENERAL;
 
+    if (kIncrementalUpdates)
+        operations = skipUnchangedOperations(operations, &count, cumulativeScaleIndex);
+    const int executedCount = count;
+
+    unsharePartialsOperations(operations, count, cumulativeScaleIndex, false);
+
     if (kAutoPartitioningEnabled) {
         autoPartitionPartialsOperations(operations,
                                         gAutoPartitionOperations,
@@ -1182,7 +2063,8 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::updatePartials(const int* operations,
                                         cumulativeScaleIndex);
         count *= kPartitionCount;
         returnCode = upPartialsByPartitionAsync((const int*) gAutoPartitionOperations,
-                                                count); 
+                                                count,
+                                                false);
     } else {
         bool byPartition = false;
         returnCode = upPartials(byPartition,
@@ -1191,19 +2073,189 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::updatePartials(const int* operations,
                                 cumulativeScaleIndex);
     }
 
+    if (kIncrementalUpdates)
+        recordOperations(operations, executedCount);
+
     return returnCode;
 }
 
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setIncrementalUpdates(bool enabled) {
+    kIncrementalUpdates = enabled;
+    kIncrementalOperationCount = 0;
+    kIncrementalSkippedCount = 0;
+
+    if (enabled) {
+        PartialsRecord unknown;
+        unknown.operation[0] = BEAGLE_OP_NONE;
+        gPartialsVersions.assign(kBufferCount, 0);
+        gMatrixVersions.assign(kMatrixCount, 0);
+        gScaleVersions.assign(kScaleBufferCount, 0);
+        gPartialsRecords.assign(kBufferCount, unknown);
+        // unchanged edge lengths leave their matrices, and so their versions, alone
+        if (gMatrixCacheKeys.empty())
+            gMatrixCacheKeys.assign(kMatrixCount, MatrixCacheKey(BEAGLE_OP_NONE, 0.0));
+    } else {
+        if (kMatrixCacheSize == 0)
+            std::vector<MatrixCacheKey>().swap(gMatrixCacheKeys);
+        std::vector<unsigned long>().swap(gPartialsVersions);
+        std::vector<unsigned long>().swap(gMatrixVersions);
+        std::vector<unsigned long>().swap(gScaleVersions);
+        std::vector<PartialsRecord>().swap(gPartialsRecords);
+        std::vector<int>().swap(gIncrementalOperations);
+        std::vector<char>().swap(gIncrementalWritten);
+    }
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getIncrementalUpdateStatistics(int* outOperationCount,
+                                                                      int* outSkippedCount) {
+    if (outOperationCount != NULL)
+        *outOperationCount = kIncrementalOperationCount;
+    if (outSkippedCount != NULL)
+        *outSkippedCount = kIncrementalSkippedCount;
+    return BEAGLE_SUCCESS;
+}
+
+/*
+ * Drops the operations whose destination, inputs and scale buffers all carry
+ * the same versions as when the operation last ran. Scale factors of skipped
+ * operations are still added to the cumulative scale buffer. Returns the
+ * operations that must run and updates count accordingly.
+ */
+BEAGLE_CPU_TEMPLATE
+const int* BeagleCPUImpl<BEAGLE_CPU_GENERIC>::skipUnchangedOperations(const int* operations,
+                                                                      int* count,
+                                                                      int cumulativeScaleIndex) {
+    kIncrementalOperationCount = *count;
+    kIncrementalSkippedCount = 0;
+
+    // automatic scaling decides per call which buffers are rescaled
+    if (kFlags & (BEAGLE_FLAG_SCALING_AUTO | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_DYNAMIC))
+        return operations;
+
+    gIncrementalOperations.clear();
+
+    for (int op = 0; op < *count; op++) {
+        const int* operation = operations + op * BEAGLE_OP_COUNT;
+        const int parIndex = operation[0];
+        const int writeScalingIndex = operation[1];
+        const int readScalingIndex = operation[2];
+        const PartialsRecord& record = gPartialsRecords[parIndex];
+
+        bool unchanged = (memcmp(record.operation, operation, sizeof(int) * BEAGLE_OP_COUNT) == 0);
+        if (unchanged) {
+            const unsigned long versions[7] = {
+                gPartialsVersions[operation[3]],
+                gMatrixVersions[operation[4]],
+                gPartialsVersions[operation[5]],
+                gMatrixVersions[operation[6]],
+                (readScalingIndex >= 0 ? gScaleVersions[readScalingIndex] : 0),
+                gPartialsVersions[parIndex],
+                (writeScalingIndex >= 0 ? gScaleVersions[writeScalingIndex] : 0)};
+            unchanged = (memcmp(record.versions, versions, sizeof(versions)) == 0);
+        }
+
+        if (unchanged) {
+            kIncrementalSkippedCount++;
+            if (writeScalingIndex >= 0 && cumulativeScaleIndex != BEAGLE_OP_NONE)
+                accumulateScaleFactors(&writeScalingIndex, 1, cumulativeScaleIndex);
+        } else {
+            gIncrementalOperations.insert(gIncrementalOperations.end(), operation, operation + BEAGLE_OP_COUNT);
+            // later operations reading these buffers must run as well
+            gPartialsVersions[parIndex] = ++kVersionClock;
+            if (writeScalingIndex >= 0)
+                gScaleVersions[writeScalingIndex] = ++kVersionClock;
+        }
+    }
+
+    *count = kIncrementalOperationCount - kIncrementalSkippedCount;
+
+    return (*count > 0 ? &gIncrementalOperations[0] : operations);
+}
+
+/*
+ * Remembers the operations that just ran together with the versions of the
+ * buffers they used. A buffer overwritten later in the same call no longer
+ * holds what an earlier operation read, so such records are left unknown.
+ */
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::recordOperations(const int* operations,
+                                                         int count) {
+    if (kFlags & (BEAGLE_FLAG_SCALING_AUTO | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_DYNAMIC))
+        return;
+
+    gIncrementalWritten.assign(kBufferCount + kScaleBufferCount, 0);
+    char* written = &gIncrementalWritten[0];
+    char* writtenScale = written + kBufferCount;
+
+    for (int op = count - 1; op >= 0; op--) {
+        const int* operation = operations + op * BEAGLE_OP_COUNT;
+        const int parIndex = operation[0];
+        const int writeScalingIndex = operation[1];
+        const int readScalingIndex = operation[2];
+
+        if (written[parIndex])
+            continue;
+
+        PartialsRecord& record = gPartialsRecords[parIndex];
+        if (written[operation[3]] || written[operation[5]] ||
+            (readScalingIndex >= 0 && writtenScale[readScalingIndex]) ||
+            (writeScalingIndex >= 0 && writtenScale[writeScalingIndex])) {
+            record.operation[0] = BEAGLE_OP_NONE;
+        } else {
+            memcpy(record.operation, operation, sizeof(int) * BEAGLE_OP_COUNT);
+            record.versions[0] = gPartialsVersions[operation[3]];
+            record.versions[1] = gMatrixVersions[operation[4]];
+            record.versions[2] = gPartialsVersions[operation[5]];
+            record.versions[3] = gMatrixVersions[operation[6]];
+            record.versions[4] = (readScalingIndex >= 0 ? gScaleVersions[readScalingIndex] : 0);
+            record.versions[5] = gPartialsVersions[parIndex];
+            record.versions[6] = (writeScalingIndex >= 0 ? gScaleVersions[writeScalingIndex] : 0);
+        }
+
+        written[parIndex] = 1;
+        if (writeScalingIndex >= 0)
+            writtenScale[writeScalingIndex] = 1;
+    }
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::forgetPartialsRecords() {
+    for (int i = 0; i < (int) gPartialsRecords.size(); i++)
+        gPartialsRecords[i].operation[0] = BEAGLE_OP_NONE;
+}
+
+/*
+ * Stamps a buffer with a new version when it is about to be written.
+ */
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::touchBuffer(REALTYPE** buffers,
+                                                    int index) {
+    if (buffers == gPartials)
+        gPartialsVersions[index] = ++kVersionClock;
+    else if (buffers == gTransitionMatrices)
+        gMatrixVersions[index] = ++kVersionClock;
+    else if (buffers == gScaleBuffers)
+        gScaleVersions[index] = ++kVersionClock;
+}
+
 
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::updatePartialsByPartition(const int* operations,
                                                                  int count) {
+    BeagleTraceScope traceScope(gTracer, "beagleUpdatePartialsByPartition", "api", count);
     
     int returnCode = BEAGLE_ERROR_GENERAL;
 
+    unsharePartialsOperations(operations, count, BEAGLE_OP_NONE, true);
+
     if (kThreadingEnabled) {
         returnCode = upPartialsByPartitionAsync(operations,
-                                                count);            
+                                                count,
+                                                false);            
     } else {
         bool byPartition = true;
         returnCode = upPartials(byPartition,
@@ -1237,10 +2289,13 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::autoPartitionPartialsOperations(const in
 
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::upPartialsByPartitionAsync(const int* operations,
-                                                                  int count) {
+                                                                  int count,
+                                                                  bool preOrder) {
 
     int numOps = BEAGLE_PARTITION_OP_COUNT;
 
+    BeagleCounterTimer counterTimer(gCounters, BEAGLE_KERNEL_THREAD_DISPATCH, 0, 0.0, 0.0);
+
     memset(gThreadOpCounts, 0, sizeof(int) * kNumThreads);
 
     for (int i=0; i<count; i++) {
@@ -1251,13 +2306,17 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::upPartialsByPartitionAsync(const int* ope
         gThreadOpCounts[t]++;
     }
 
+    int (BeagleCPUImpl<BEAGLE_CPU_GENERIC>::*upFunction)(bool, const int*, int, int) =
+        (preOrder ? &BeagleCPUImpl<BEAGLE_CPU_GENERIC>::upPrePartials
+                  : &BeagleCPUImpl<BEAGLE_CPU_GENERIC>::upPartials);
+
     for (int i=0; i<kNumThreads; i++) {
-        std::packaged_task<void()> threadTask(
-            std::bind(&BeagleCPUImpl<BEAGLE_CPU_GENERIC>::upPartials, this,
+        std::packaged_task<void()> threadTask(makeTracedTask(gTracer, (preOrder ? "upPrePartials" : "upPartials"),
+            std::bind(upFunction, this,
                       true,
                       (const int*) gThreadOperations[i],
                       gThreadOpCounts[i],
-                      BEAGLE_OP_NONE));
+                      BEAGLE_OP_NONE)));
 
         gFutures[i] = threadTask.get_future();
         threadData* td = &gThreads[i];
@@ -1286,12 +2345,17 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::upPartials(bool byPartition,
     if (cumulativeScaleIndex != BEAGLE_OP_NONE)
         cumulativeScaleBuffer = gScaleBuffers[cumulativeScaleIndex];
 
+    BeagleCounterBlock counterBlock(gCounters);
+
     for (int op = 0; op < count; op++) {
 
         int numOps = BEAGLE_OP_COUNT;
         if (byPartition)
             numOps = BEAGLE_PARTITION_OP_COUNT;
 
+        if (kFlags & BEAGLE_FLAG_PARTIALS_MAPPED)
+            prefetchMappedPartials(operations, op, count, numOps);
+
         if (DEBUGGING_OUTPUT) {
             fprintf(stderr, "op[%d] = ", op);
             for (int j = 0; j < numOps; j++) {
@@ -1364,80 +2428,110 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::upPartials(bool byPartition,
                      << " readIndex = " << readScalingIndex << "\n";
         }
 
-        if (tipStates1 != NULL) {
-            if (tipStates2 != NULL ) {
-                if (rescale == 0) { // Use fixed scaleFactors
-                    calcStatesStatesFixedScaling(destPartials, tipStates1, matrices1, tipStates2,
-                                                 matrices2, scalingFactors, startPattern, endPattern);
+        // patterns of zero weight are left out, except under auto scaling, whose kernel always
+        // covers all patterns
+        int runCount = 1;
+        const int* patternRuns = NULL;
+        if (rescale != 2 && !gActivePatternRuns.empty()) {
+            runCount = gActivePatternRuns.size() / 2;
+            patternRuns = &gActivePatternRuns[0];
+        }
+        const int rangeStartPattern = startPattern;
+        const int rangeEndPattern = endPattern;
+
+        if (counterBlock.isActive())
+            counterBlock.start();
+
+        long processedPatterns = 0;
+        for (int run = 0; run < runCount; run++) {
+            if (patternRuns != NULL) {
+                // a partition only computes the part of each run in its own patterns
+                startPattern = std::max(patternRuns[2 * run], rangeStartPattern);
+                endPattern = std::min(patternRuns[2 * run + 1], rangeEndPattern);
+                if (startPattern >= endPattern)
+                    continue;
+            }
+            processedPatterns += endPattern - startPattern;
+
+            if (tipStates1 != NULL) {
+                if (tipStates2 != NULL ) {
+                    if (rescale == 0) { // Use fixed scaleFactors
+                        calcStatesStatesFixedScaling(destPartials, tipStates1, matrices1, tipStates2,
+                                                     matrices2, scalingFactors, startPattern, endPattern);
+                    } else {
+                        // First compute without any scaling
+                        calcStatesStates(destPartials, tipStates1, matrices1, tipStates2, matrices2,
+                                         startPattern, endPattern);
+                    }
                 } else {
-                    // First compute without any scaling
-                    calcStatesStates(destPartials, tipStates1, matrices1, tipStates2, matrices2,
-                                     startPattern, endPattern);
-                    if (rescale == 1) { // Recompute scaleFactors
-                        if (byPartition) {
-                            rescalePartialsByPartition(destPartials,scalingFactors,cumulativeScaleBuffer,0, currentPartition);
-                        } else {
-                            rescalePartials(destPartials,scalingFactors,cumulativeScaleBuffer,0);
-                        }
+                    if (rescale == 0) {
+                        calcStatesPartialsFixedScaling(destPartials, tipStates1, matrices1, partials2,
+                                                       matrices2, scalingFactors, startPattern, endPattern);
+                    } else {
+                        calcStatesPartials(destPartials, tipStates1, matrices1, partials2, matrices2,
+                                           startPattern, endPattern);
                     }
                 }
             } else {
-                if (rescale == 0) {
-                    calcStatesPartialsFixedScaling(destPartials, tipStates1, matrices1, partials2,
-                                                   matrices2, scalingFactors, startPattern, endPattern);
-                } else {
-                    calcStatesPartials(destPartials, tipStates1, matrices1, partials2, matrices2,
-                                       startPattern, endPattern);
-                    if (rescale == 1) { // Recompute scaleFactors
-                        if (byPartition) {
-                            rescalePartialsByPartition(destPartials,scalingFactors,cumulativeScaleBuffer,0, currentPartition);
-                        } else {
-                            rescalePartials(destPartials,scalingFactors,cumulativeScaleBuffer,0);
-                        }
+                if (tipStates2 != NULL) {
+                    if (rescale == 0) {
+                        calcStatesPartialsFixedScaling(destPartials,tipStates2,matrices2,partials1,matrices1,
+                                                       scalingFactors, startPattern, endPattern);
+                    } else {
+                        calcStatesPartials(destPartials, tipStates2, matrices2, partials1, matrices1,
+                                           startPattern, endPattern);
                     }
-                }
-            }
-        } else {
-            if (tipStates2 != NULL) {
-                if (rescale == 0) {
-                    calcStatesPartialsFixedScaling(destPartials,tipStates2,matrices2,partials1,matrices1,
-                                                   scalingFactors, startPattern, endPattern);
                 } else {
-                    calcStatesPartials(destPartials, tipStates2, matrices2, partials1, matrices1,
-                                       startPattern, endPattern);
-                    if (rescale == 1) {// Recompute scaleFactors
-                        if (byPartition) {
-                            rescalePartialsByPartition(destPartials,scalingFactors,cumulativeScaleBuffer,0, currentPartition);
-                        } else {
-                            rescalePartials(destPartials,scalingFactors,cumulativeScaleBuffer,0);
-                        }
+                    if (rescale == 2) {
+                        int sIndex = parIndex - kTipCount;
+                        calcPartialsPartialsAutoScaling(destPartials,partials1,matrices1,partials2,matrices2,
+                                                         &gActiveScalingFactors[sIndex]);
+                        if (gActiveScalingFactors[sIndex])
+                            autoRescalePartials(destPartials, gAutoScaleBuffers[sIndex]);
+
+                    } else if (rescale == 0) {
+                        calcPartialsPartialsFixedScaling(destPartials,partials1,matrices1,partials2,
+                                                         matrices2,scalingFactors,startPattern,endPattern);
+                    } else {
+                        calcPartialsPartials(destPartials, partials1, matrices1, partials2, matrices2,
+                                             startPattern, endPattern);
                     }
                 }
+            }
+        }
+
+        startPattern = rangeStartPattern;
+        endPattern = rangeEndPattern;
+        if (patternRuns != NULL)
+            fillInactivePatterns(destPartials, startPattern, endPattern);
+
+        if (counterBlock.isActive()) {
+            const int kernelType = (tipStates1 != NULL && tipStates2 != NULL ? BEAGLE_KERNEL_STATES_STATES :
+                                    tipStates1 != NULL || tipStates2 != NULL ? BEAGLE_KERNEL_STATES_PARTIALS :
+                                                                               BEAGLE_KERNEL_PARTIALS_PARTIALS);
+            double flops, bytes;
+            getKernelWork(kernelType, processedPatterns, &flops, &bytes);
+            counterBlock.stop(kernelType, processedPatterns, flops, bytes);
+        }
+
+        if (rescale == 1) { // Recompute scaleFactors
+            if (counterBlock.isActive())
+                counterBlock.start();
+
+            if (byPartition) {
+                rescalePartialsByPartition(destPartials,scalingFactors,cumulativeScaleBuffer,0, currentPartition);
             } else {
-                if (rescale == 2) {
-                    int sIndex = parIndex - kTipCount;
-                    calcPartialsPartialsAutoScaling(destPartials,partials1,matrices1,partials2,matrices2,
-                                                     &gActiveScalingFactors[sIndex]);
-                    if (gActiveScalingFactors[sIndex])
-                        autoRescalePartials(destPartials, gAutoScaleBuffers[sIndex]);
-
-                } else if (rescale == 0) {
-                    calcPartialsPartialsFixedScaling(destPartials,partials1,matrices1,partials2,
-                                                     matrices2,scalingFactors,startPattern,endPattern);
-                } else {
-                    calcPartialsPartials(destPartials, partials1, matrices1, partials2, matrices2,
-                                         startPattern, endPattern);
-                    if (rescale == 1) {// Recompute scaleFactors
-                        if (byPartition) {
-                            rescalePartialsByPartition(destPartials,scalingFactors,cumulativeScaleBuffer,0, currentPartition);
-                        } else {
-                            rescalePartials(destPartials,scalingFactors,cumulativeScaleBuffer,0);
-                        }
-                    }
-                }
+                rescalePartials(destPartials,scalingFactors,cumulativeScaleBuffer,0);
+            }
+
+            if (counterBlock.isActive()) {
+                const long rescaledPatterns = (byPartition ? endPattern - startPattern : kPatternCount);
+                double flops, bytes;
+                getKernelWork(BEAGLE_KERNEL_RESCALE, rescaledPatterns, &flops, &bytes);
+                counterBlock.stop(BEAGLE_KERNEL_RESCALE, rescaledPatterns, flops, bytes);
             }
         }
-        
+
         if (kFlags & BEAGLE_FLAG_SCALING_ALWAYS) {
             int parScalingIndex = parIndex - kTipCount;
             int child1ScalingIndex = child1Index - kTipCount;
@@ -1470,78 +2564,1008 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::upPartials(bool byPartition,
 
 
 BEAGLE_CPU_TEMPLATE
-int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::waitForPartials(const int* destinationPartials,
-                                   int destinationPartialsCount) {
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setRootPrePartials(const int* bufferIndices,
+                                                          const int* stateFrequenciesIndices,
+                                                          int count) {
+    for (int i = 0; i < count; i++) {
+        const int bufferIndex = bufferIndices[i];
+        const int frequenciesIndex = stateFrequenciesIndices[i];
+        if (bufferIndex < 0 || bufferIndex >= kBufferCount ||
+            frequenciesIndex < 0 || frequenciesIndex >= kEigenDecompCount ||
+            gStateFrequencies[frequenciesIndex] == NULL)
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+
+        unshareBuffer(gPartials, bufferIndex, kPartialsSize, false);
+        if (isSharedTipBuffer(bufferIndex, gPartials[bufferIndex]))
+            gPartials[bufferIndex] = NULL;
+        if (gPartials[bufferIndex] == NULL) {
+            gPartials[bufferIndex] = (REALTYPE*) mallocAligned(sizeof(REALTYPE) * kPartialsSize);
+            if (gPartials[bufferIndex] == NULL)
+                return BEAGLE_ERROR_OUT_OF_MEMORY;
+        }
+
+        const REALTYPE* freqs = gStateFrequencies[frequenciesIndex];
+        REALTYPE* destPtr = gPartials[bufferIndex];
+        for (int l = 0; l < kCategoryCount; l++) {
+            for (int k = 0; k < kPaddedPatternCount; k++) {
+                for (int j = 0; j < kStateCount; j++)
+                    *(destPtr++) = freqs[j];
+                for (int j = kStateCount; j < kPartialsPaddedStateCount; j++)
+                    *(destPtr++) = 0.0;
+            }
+        }
+    }
+
     return BEAGLE_SUCCESS;
 }
 
-
 BEAGLE_CPU_TEMPLATE
-    int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calculateRootLogLikelihoods(const int* bufferIndices,
-                                                             const int* categoryWeightsIndices,
-                                                             const int* stateFrequenciesIndices,
-                                                             const int* cumulativeScaleIndices,
-                                                             int count,
-                                                             double* outSumLogLikelihood) {
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::updatePrePartials(const int* operations,
+                                                         int count,
+                                                         int cumulativeScaleIndex) {
+    BeagleTraceScope traceScope(gTracer, "beagleUpdatePrePartials", "api", count);
 
-    if (count == 1) {
-        // We treat this as a special case so that we don't have convoluted logic
-        //      at the end of the loop over patterns
-        int cumulativeScalingFactorIndex;
-        if (kFlags & BEAGLE_FLAG_SCALING_AUTO) {
-            cumulativeScalingFactorIndex = 0;
-        } else if (kFlags & BEAGLE_FLAG_SCALING_ALWAYS) {
-            cumulativeScalingFactorIndex = bufferIndices[0] - kTipCount; 
-        } else {
-            cumulativeScalingFactorIndex = cumulativeScaleIndices[0];
-        }
+    // pre-order scaling is only driven by the explicit scale buffer indices
+    if (kFlags & (BEAGLE_FLAG_SCALING_AUTO | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_DYNAMIC))
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
 
-        if (kAutoRootPartitioningEnabled) {
-            calcRootLogLikelihoodsByAutoPartitionAsync(bufferIndices,
-                                                       categoryWeightsIndices,
-                                                       stateFrequenciesIndices,
-                                                       cumulativeScaleIndices,
-                                                       gAutoPartitionIndices,
-                                                       gAutoPartitionOutSumLogLikelihoods);
+    for (int op = 0; op < count; op++) {
+        const int* operation = operations + op * BEAGLE_OP_COUNT;
+        if (gPartials[operation[3]] == NULL ||
+            (gPartials[operation[5]] == NULL && gTipStates[operation[5]] == NULL))
+            return BEAGLE_ERROR_GENERAL;
+    }
 
-            *outSumLogLikelihood = 0.0;
+    int returnCode = BEAGLE_ERROR_GENERAL;
 
-            for (int i = 0; i < kPartitionCount; i++) {
-                *outSumLogLikelihood += gAutoPartitionOutSumLogLikelihoods[i];
-            }
+    unsharePartialsOperations(operations, count, cumulativeScaleIndex, false);
 
-            if (*outSumLogLikelihood != *outSumLogLikelihood) {
-                return BEAGLE_ERROR_FLOATING_POINT;
-            } else {
-                return BEAGLE_SUCCESS;
-            }
-        } else {
-            return calcRootLogLikelihoods(bufferIndices[0], categoryWeightsIndices[0], stateFrequenciesIndices[0],
-                                   cumulativeScalingFactorIndex, outSumLogLikelihood);
-        }
-    }
-    else
-    {
-        return calcRootLogLikelihoodsMulti(bufferIndices, categoryWeightsIndices, stateFrequenciesIndices,
-                                    cumulativeScaleIndices, count, outSumLogLikelihood);
+    if (kAutoPartitioningEnabled) {
+        autoPartitionPartialsOperations(operations,
+                                        gAutoPartitionOperations,
+                                        count,
+                                        cumulativeScaleIndex);
+        count *= kPartitionCount;
+        returnCode = upPartialsByPartitionAsync((const int*) gAutoPartitionOperations,
+                                                count,
+                                                true);
+    } else {
+        bool byPartition = false;
+        returnCode = upPrePartials(byPartition,
+                                   operations,
+                                   count,
+                                   cumulativeScaleIndex);
     }
+
+    return returnCode;
 }
 
 BEAGLE_CPU_TEMPLATE
-    int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calculateRootLogLikelihoodsByPartition(
-                                                                  const int* bufferIndices,
-                                                                  const int* categoryWeightsIndices,
-                                                                  const int* stateFrequenciesIndices,
-                                                                  const int* cumulativeScaleIndices,
-                                                                  const int* partitionIndices,
-                                                                  int partitionCount,
-                                                                  int count,
-                                                                  double* outSumLogLikelihoodByPartition,
-                                                                  double* outSumLogLikelihood) {
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::upPrePartials(bool byPartition,
+                                                     const int* operations,
+                                                     int count,
+                                                     int cumulativeScaleIndex) {
 
-    int returnCode = BEAGLE_SUCCESS;
+    REALTYPE* cumulativeScaleBuffer = NULL;
+    if (cumulativeScaleIndex != BEAGLE_OP_NONE)
+        cumulativeScaleBuffer = gScaleBuffers[cumulativeScaleIndex];
 
-    if (count == 1) {
+    const int numOps = (byPartition ? BEAGLE_PARTITION_OP_COUNT : BEAGLE_OP_COUNT);
+
+    for (int op = 0; op < count; op++) {
+
+        if (kFlags & BEAGLE_FLAG_PARTIALS_MAPPED)
+            prefetchMappedPartials(operations, op, count, numOps);
+
+        const int parIndex = operations[op * numOps];
+        const int writeScalingIndex = operations[op * numOps + 1];
+        const int preIndex = operations[op * numOps + 3];
+        const int preTransMatIndex = operations[op * numOps + 4];
+        const int siblingIndex = operations[op * numOps + 5];
+        const int siblingTransMatIndex = operations[op * numOps + 6];
+        int currentPartition = 0;
+        if (byPartition) {
+            currentPartition = operations[op * numOps + 7];
+            cumulativeScaleIndex = operations[op * numOps + 8];
+            if (cumulativeScaleIndex != BEAGLE_OP_NONE)
+                cumulativeScaleBuffer = gScaleBuffers[cumulativeScaleIndex];
+            else
+                cumulativeScaleBuffer = NULL;
+        }
+
+        const REALTYPE* prePartials = gPartials[preIndex];
+        const REALTYPE* siblingPartials = gPartials[siblingIndex];
+        const int* siblingStates = gTipStates[siblingIndex];
+
+        const REALTYPE* preMatrices = gTransitionMatrices[preTransMatIndex];
+        const REALTYPE* siblingMatrices = gTransitionMatrices[siblingTransMatIndex];
+
+        REALTYPE* destPartials = gPartials[parIndex];
+
+        int startPattern = 0;
+        int endPattern = kPatternCount;
+        if (byPartition) {
+            startPattern = gPatternPartitionsStartPatterns[currentPartition];
+            endPattern = gPatternPartitionsStartPatterns[currentPartition + 1];
+        }
+
+        if (siblingStates != NULL) {
+            calcPrePartialsStates(destPartials, prePartials, preMatrices, siblingStates,
+                                  siblingMatrices, startPattern, endPattern);
+        } else {
+            calcPrePartialsPartials(destPartials, prePartials, preMatrices, siblingPartials,
+                                    siblingMatrices, startPattern, endPattern);
+        }
+
+        if (writeScalingIndex >= 0) {
+            REALTYPE* scalingFactors = gScaleBuffers[writeScalingIndex];
+            if (byPartition) {
+                rescalePartialsByPartition(destPartials,scalingFactors,cumulativeScaleBuffer,0, currentPartition);
+            } else {
+                rescalePartials(destPartials,scalingFactors,cumulativeScaleBuffer,0);
+            }
+        }
+    }
+
+    return BEAGLE_SUCCESS;
+}
+
+/*
+ * With P(t) = V exp(Lambda r t) V^-1 the edge likelihood of a pattern is
+ *   L(t) = sum_l w_l sum_k s_lk exp(lambda_k r_l t),
+ *   s_lk = sum_i sum_j freqs_i parent_i V_ik Vinv_kj child_j,
+ * so once the s_lk are known every length costs O(categories x states) per pattern.
+ */
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calculateEdgeSumtable(int parentBufferIndex,
+                                                             int childBufferIndex,
+                                                             int eigenIndex,
+                                                             int categoryWeightsIndex,
+                                                             int stateFrequenciesIndex,
+                                                             int cumulativeScaleIndex) {
+    if (parentBufferIndex < 0 || parentBufferIndex >= kBufferCount ||
+        childBufferIndex < 0 || childBufferIndex >= kBufferCount ||
+        eigenIndex < 0 || eigenIndex >= kEigenDecompCount ||
+        categoryWeightsIndex < 0 || categoryWeightsIndex >= kEigenDecompCount ||
+        stateFrequenciesIndex < 0 || stateFrequenciesIndex >= kEigenDecompCount ||
+        cumulativeScaleIndex >= kScaleBufferCount)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+
+    if (gPartials[parentBufferIndex] == NULL ||
+        (gPartials[childBufferIndex] == NULL && gTipStates[childBufferIndex] == NULL) ||
+        gCategoryRates[0] == NULL ||
+        gCategoryWeights[categoryWeightsIndex] == NULL ||
+        gStateFrequencies[stateFrequenciesIndex] == NULL)
+        return BEAGLE_ERROR_GENERAL;
+
+    const REALTYPE* eigenValues;
+    const REALTYPE* cMatrix;
+    if (!gEigenDecomposition->getEigenSystem(eigenIndex, &eigenValues, &cMatrix))
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+
+    if (gSumtable == NULL) {
+        gSumtable = (REALTYPE*) malloc(sizeof(REALTYPE) * kPatternCount * kCategoryCount * kStateCount);
+        // scaled eigen values followed by room for their exponentials and derivatives
+        gSumtableRates = (REALTYPE*) malloc(sizeof(REALTYPE) * 4 * kCategoryCount * kStateCount);
+        if (gSumtable == NULL || gSumtableRates == NULL)
+            return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+
+    const REALTYPE* partialsParent = gPartials[parentBufferIndex];
+    const REALTYPE* partialsChild = gPartials[childBufferIndex];
+    const int* statesChild = gTipStates[childBufferIndex];
+    const REALTYPE* wt = gCategoryWeights[categoryWeightsIndex];
+    const REALTYPE* freqs = gStateFrequencies[stateFrequenciesIndex];
+    const double* rates = gCategoryRates[0];
+
+    const int stateCountSquared = kStateCount * kStateCount;
+
+    for (int l = 0; l < kCategoryCount; l++) {
+        for (int k = 0; k < kStateCount; k++)
+            gSumtableRates[l * kStateCount + k] = eigenValues[k] * (REALTYPE) rates[l];
+
+        const REALTYPE weight = wt[l];
+        int v = l*kPartialsPaddedStateCount*kPatternCount;
+        for (int p = 0; p < kPatternCount; p++) {
+            REALTYPE* sumtable = gSumtable + (p * kCategoryCount + l) * kStateCount;
+            for (int k = 0; k < kStateCount; k++)
+                sumtable[k] = 0.0;
+
+            for (int i = 0; i < kStateCount; i++) {
+                const REALTYPE parent = weight * freqs[i] * partialsParent[v + i];
+                if (parent == 0.0)
+                    continue;
+                const REALTYPE* cRow = cMatrix + i * stateCountSquared;
+                if (statesChild != NULL) {
+                    const int state = statesChild[p];
+                    if (state < kStateCount) {
+                        const REALTYPE* cPtr = cRow + state * kStateCount;
+                        for (int k = 0; k < kStateCount; k++)
+                            sumtable[k] += parent * cPtr[k];
+                    } else {
+                        for (int j = 0; j < kStateCount; j++) {
+                            const REALTYPE* cPtr = cRow + j * kStateCount;
+                            for (int k = 0; k < kStateCount; k++)
+                                sumtable[k] += parent * cPtr[k];
+                        }
+                    }
+                } else {
+                    for (int j = 0; j < kStateCount; j++) {
+                        const REALTYPE parentChild = parent * partialsChild[v + j];
+                        const REALTYPE* cPtr = cRow + j * kStateCount;
+                        for (int k = 0; k < kStateCount; k++)
+                            sumtable[k] += parentChild * cPtr[k];
+                    }
+                }
+            }
+            v += kPartialsPaddedStateCount;
+        }
+    }
+
+    kSumtableScaleIndex = cumulativeScaleIndex;
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calculateEdgeSumtableLogLikelihood(double edgeLength,
+                                                                          double* outSumLogLikelihood,
+                                                                          double* outSumFirstDerivative,
+                                                                          double* outSumSecondDerivative) {
+    if (gSumtable == NULL)
+        return BEAGLE_ERROR_GENERAL;
+
+    const int sumtableSize = kCategoryCount * kStateCount;
+
+    // exp(lambda r t) and its first two derivatives for every category and eigen value
+    REALTYPE* expTmp = gSumtableRates + sumtableSize;
+    REALTYPE* expD1Tmp = expTmp + sumtableSize;
+    REALTYPE* expD2Tmp = expD1Tmp + sumtableSize;
+    for (int m = 0; m < sumtableSize; m++) {
+        const REALTYPE rate = gSumtableRates[m];
+        expTmp[m] = exp(rate * (REALTYPE) edgeLength);
+        expD1Tmp[m] = rate * expTmp[m];
+        expD2Tmp[m] = rate * expD1Tmp[m];
+    }
+
+    const REALTYPE* sumtable = gSumtable;
+    for (int p = 0; p < kPatternCount; p++) {
+        REALTYPE sum = 0.0;
+        REALTYPE sumD1 = 0.0;
+        REALTYPE sumD2 = 0.0;
+        for (int m = 0; m < sumtableSize; m++) {
+            sum += sumtable[m] * expTmp[m];
+            sumD1 += sumtable[m] * expD1Tmp[m];
+            sumD2 += sumtable[m] * expD2Tmp[m];
+        }
+        sumtable += sumtableSize;
+
+        outLogLikelihoodsTmp[p] = log(sum);
+        outFirstDerivativesTmp[p] = sumD1 / sum;
+        outSecondDerivativesTmp[p] = sumD2 / sum - outFirstDerivativesTmp[p] * outFirstDerivativesTmp[p];
+    }
+
+    if (kSumtableScaleIndex != BEAGLE_OP_NONE) {
+        const REALTYPE* scalingFactors = gScaleBuffers[kSumtableScaleIndex];
+        for(int k=0; k < kPatternCount; k++)
+            outLogLikelihoodsTmp[k] += scalingFactors[k];
+    }
+
+    double sumLogLikelihood = 0.0;
+    double sumFirstDerivative = 0.0;
+    double sumSecondDerivative = 0.0;
+    for (int i = 0; i < kPatternCount; i++) {
+        sumLogLikelihood += outLogLikelihoodsTmp[i] * gPatternWeights[i];
+        sumFirstDerivative += outFirstDerivativesTmp[i] * gPatternWeights[i];
+        sumSecondDerivative += outSecondDerivativesTmp[i] * gPatternWeights[i];
+    }
+
+    *outSumLogLikelihood = sumLogLikelihood;
+    if (outSumFirstDerivative != NULL)
+        *outSumFirstDerivative = sumFirstDerivative;
+    if (outSumSecondDerivative != NULL)
+        *outSumSecondDerivative = sumSecondDerivative;
+
+    if (sumLogLikelihood != sumLogLikelihood)
+        return BEAGLE_ERROR_FLOATING_POINT;
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::optimizeEdgeLength(double* inOutEdgeLength,
+                                                          double minEdgeLength,
+                                                          double maxEdgeLength,
+                                                          double tolerance,
+                                                          int maxIterations,
+                                                          double* outSumLogLikelihood) {
+    int returnCode = maximizeEdgeLength(
+        [this](double t, double* lnL, double* d1, double* d2) {
+            return calculateEdgeSumtableLogLikelihood(t, lnL, d1, d2);
+        },
+        inOutEdgeLength, minEdgeLength, maxEdgeLength, tolerance, maxIterations, outSumLogLikelihood);
+    if (returnCode != BEAGLE_SUCCESS)
+        return returnCode;
+
+    // leave the site values of the returned length behind
+    return calculateEdgeSumtableLogLikelihood(*inOutEdgeLength, outSumLogLikelihood, NULL, NULL);
+}
+
+/*
+ * Newton-Raphson on an edge length, halving steps that do not increase the
+ * log likelihood. evaluate(t, &lnL, &d1, &d2) returns an error code.
+ */
+BEAGLE_CPU_TEMPLATE
+template <typename Evaluate>
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::maximizeEdgeLength(Evaluate evaluate,
+                                                          double* inOutEdgeLength,
+                                                          double minEdgeLength,
+                                                          double maxEdgeLength,
+                                                          double tolerance,
+                                                          int maxIterations,
+                                                          double* outSumLogLikelihood) {
+    if (minEdgeLength < 0.0 || maxEdgeLength < minEdgeLength || tolerance <= 0.0)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+
+    double t = std::min(std::max(*inOutEdgeLength, minEdgeLength), maxEdgeLength);
+    double lnL, d1, d2;
+    int returnCode = evaluate(t, &lnL, &d1, &d2);
+    if (returnCode != BEAGLE_SUCCESS)
+        return returnCode;
+
+    for (int iteration = 0; iteration < maxIterations; iteration++) {
+        double tNew;
+        if (d2 < 0.0) {
+            tNew = t - d1 / d2;
+        } else if (d1 > 0.0) {
+            // not concave here; move uphill
+            tNew = (t > 0.0 ? 2.0 * t : tolerance);
+        } else {
+            tNew = 0.5 * t;
+        }
+        tNew = std::min(std::max(tNew, minEdgeLength), maxEdgeLength);
+
+        double lnLNew, d1New, d2New;
+        returnCode = evaluate(tNew, &lnLNew, &d1New, &d2New);
+        while ((returnCode != BEAGLE_SUCCESS || lnLNew < lnL) && fabs(tNew - t) > tolerance) {
+            tNew = 0.5 * (t + tNew);
+            returnCode = evaluate(tNew, &lnLNew, &d1New, &d2New);
+        }
+        if (returnCode != BEAGLE_SUCCESS || lnLNew < lnL)
+            break;
+
+        const double step = fabs(tNew - t);
+        t = tNew;
+        lnL = lnLNew;
+        d1 = d1New;
+        d2 = d2New;
+        if (step < tolerance)
+            break;
+    }
+
+    *inOutEdgeLength = t;
+    *outSumLogLikelihood = lnL;
+
+    return BEAGLE_SUCCESS;
+}
+
+/*
+ * Regrafting a pruned subtree S onto edge e puts a new node at the bottom of e.
+ * With the pre-order partials at the bottom of e, the likelihood of a pattern is
+ *   L_e = sum_l w_l sum_i pre_eli post_eli x_li,  x_l = P_l(b) S_l,
+ * so x is computed once and each edge costs one product over states, where
+ * calcEdgeLogLikelihoodsMulti would need the partials of a new node per edge.
+ */
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calculateInsertionLogLikelihoods(const int* postBufferIndices,
+                                                                        const int* preBufferIndices,
+                                                                        const int* cumulativeScaleIndices,
+                                                                        int count,
+                                                                        int subtreeBufferIndex,
+                                                                        int subtreeMatrixIndex,
+                                                                        int categoryWeightsIndex,
+                                                                        double* outSumLogLikelihoods) {
+    BeagleTraceScope traceScope(gTracer, "beagleCalculateInsertionLogLikelihoods", "api", count);
+
+    int returnCode = checkInsertionEdges(postBufferIndices, preBufferIndices, cumulativeScaleIndices, count,
+                                         subtreeBufferIndex, categoryWeightsIndex);
+    if (returnCode != BEAGLE_SUCCESS)
+        return returnCode;
+
+    std::vector<REALTYPE> subtreeTable(kCategoryCount * kPatternCount * kStateCount, 1.0);
+
+    if (subtreeBufferIndex != BEAGLE_OP_NONE) {
+        if (subtreeMatrixIndex < 0 || subtreeMatrixIndex >= kMatrixCount)
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+
+        const REALTYPE* transMatrix = gTransitionMatrices[subtreeMatrixIndex];
+        const REALTYPE* partialsSubtree = gPartials[subtreeBufferIndex];
+        const int* statesSubtree = gTipStates[subtreeBufferIndex];
+
+        REALTYPE* x = &subtreeTable[0];
+        for (int l = 0; l < kCategoryCount; l++) {
+            int v = l * kPartialsPaddedStateCount * kPatternCount;
+            for (int p = 0; p < kPatternCount; p++) {
+                int w = l * kMatrixSize;
+                for (int i = 0; i < kStateCount; i++) {
+                    if (statesSubtree != NULL) {
+                        // the padded column holds 1.0 for ambiguous states
+                        x[i] = transMatrix[w + statesSubtree[p]];
+                    } else {
+                        REALTYPE sum = 0.0;
+                        for (int j = 0; j < kStateCount; j++)
+                            sum += transMatrix[w + j] * partialsSubtree[v + j];
+                        x[i] = sum;
+                    }
+                    w += kTransPaddedStateCount;
+                }
+                x += kStateCount;
+                v += kPartialsPaddedStateCount;
+            }
+        }
+    }
+
+    return runInsertionEdges(postBufferIndices, preBufferIndices, cumulativeScaleIndices, count,
+                             &subtreeTable[0], NULL, categoryWeightsIndex, NULL, NULL, 0,
+                             outSumLogLikelihoods);
+}
+
+/*
+ * As calculateInsertionLogLikelihoods, with P(b) = V exp(Lambda r b) V^-1 so
+ * that each edge has a sumtable over the pendant length b:
+ *   L_e(b) = sum_l w_l sum_k s_elk exp(lambda_k r_l b),
+ *   s_elk = sum_i pre_eli post_eli t_lik,  t_lik = sum_j C_ijk S_lj,
+ * where t depends only on the subtree and is computed once.
+ */
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::optimizeInsertionLogLikelihoods(const int* postBufferIndices,
+                                                                       const int* preBufferIndices,
+                                                                       const int* cumulativeScaleIndices,
+                                                                       int count,
+                                                                       int subtreeBufferIndex,
+                                                                       int eigenIndex,
+                                                                       int categoryWeightsIndex,
+                                                                       double* inOutPendantLengths,
+                                                                       double minEdgeLength,
+                                                                       double maxEdgeLength,
+                                                                       double tolerance,
+                                                                       int maxIterations,
+                                                                       double* outSumLogLikelihoods) {
+    BeagleTraceScope traceScope(gTracer, "beagleOptimizeInsertionLogLikelihoods", "api", count);
+
+    if (subtreeBufferIndex == BEAGLE_OP_NONE || eigenIndex < 0 || eigenIndex >= kEigenDecompCount ||
+        minEdgeLength < 0.0 || maxEdgeLength < minEdgeLength || tolerance <= 0.0)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+
+    int returnCode = checkInsertionEdges(postBufferIndices, preBufferIndices, cumulativeScaleIndices, count,
+                                         subtreeBufferIndex, categoryWeightsIndex);
+    if (returnCode != BEAGLE_SUCCESS)
+        return returnCode;
+
+    if (gCategoryRates[0] == NULL)
+        return BEAGLE_ERROR_GENERAL;
+
+    const REALTYPE* eigenValues;
+    const REALTYPE* cMatrix;
+    if (!gEigenDecomposition->getEigenSystem(eigenIndex, &eigenValues, &cMatrix))
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+
+    const double* rates = gCategoryRates[0];
+    std::vector<REALTYPE> scaledEigenValues(kCategoryCount * kStateCount);
+    for (int l = 0; l < kCategoryCount; l++) {
+        for (int k = 0; k < kStateCount; k++)
+            scaledEigenValues[l * kStateCount + k] = eigenValues[k] * (REALTYPE) rates[l];
+    }
+
+    const int stateCountSquared = kStateCount * kStateCount;
+
+    // sum_j C_ijk, the row of an ambiguous state
+    std::vector<REALTYPE> ambiguousTable(stateCountSquared, 0.0);
+    for (int i = 0; i < kStateCount; i++) {
+        for (int j = 0; j < kStateCount; j++) {
+            for (int k = 0; k < kStateCount; k++)
+                ambiguousTable[i * kStateCount + k] += cMatrix[(i * kStateCount + j) * kStateCount + k];
+        }
+    }
+
+    const REALTYPE* partialsSubtree = gPartials[subtreeBufferIndex];
+    const int* statesSubtree = gTipStates[subtreeBufferIndex];
+
+    std::vector<REALTYPE> subtreeTable(kCategoryCount * kPatternCount * stateCountSquared, 0.0);
+    REALTYPE* t = &subtreeTable[0];
+    for (int l = 0; l < kCategoryCount; l++) {
+        int v = l * kPartialsPaddedStateCount * kPatternCount;
+        for (int p = 0; p < kPatternCount; p++) {
+            for (int i = 0; i < kStateCount; i++) {
+                REALTYPE* tRow = t + i * kStateCount;
+                const REALTYPE* cRow = cMatrix + i * stateCountSquared;
+                if (statesSubtree != NULL) {
+                    const int state = statesSubtree[p];
+                    const REALTYPE* cPtr = (state < kStateCount ? cRow + state * kStateCount :
+                                                                  &ambiguousTable[i * kStateCount]);
+                    for (int k = 0; k < kStateCount; k++)
+                        tRow[k] = cPtr[k];
+                } else {
+                    for (int j = 0; j < kStateCount; j++) {
+                        const REALTYPE child = partialsSubtree[v + j];
+                        const REALTYPE* cPtr = cRow + j * kStateCount;
+                        for (int k = 0; k < kStateCount; k++)
+                            tRow[k] += child * cPtr[k];
+                    }
+                }
+            }
+            t += stateCountSquared;
+            v += kPartialsPaddedStateCount;
+        }
+    }
+
+    const double lengthBounds[3] = {minEdgeLength, maxEdgeLength, tolerance};
+
+    return runInsertionEdges(postBufferIndices, preBufferIndices, cumulativeScaleIndices, count,
+                             &subtreeTable[0], &scaledEigenValues[0], categoryWeightsIndex,
+                             inOutPendantLengths, lengthBounds, maxIterations, outSumLogLikelihoods);
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::checkInsertionEdges(const int* postBufferIndices,
+                                                           const int* preBufferIndices,
+                                                           const int* cumulativeScaleIndices,
+                                                           int count,
+                                                           int subtreeBufferIndex,
+                                                           int categoryWeightsIndex) {
+    if (count < 0 || categoryWeightsIndex < 0 || categoryWeightsIndex >= kEigenDecompCount)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    if (gCategoryWeights[categoryWeightsIndex] == NULL)
+        return BEAGLE_ERROR_GENERAL;
+
+    if (subtreeBufferIndex != BEAGLE_OP_NONE) {
+        if (subtreeBufferIndex < 0 || subtreeBufferIndex >= kBufferCount)
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+        if (gPartials[subtreeBufferIndex] == NULL && gTipStates[subtreeBufferIndex] == NULL)
+            return BEAGLE_ERROR_GENERAL;
+    }
+
+    for (int e = 0; e < count; e++) {
+        if (postBufferIndices[e] < 0 || postBufferIndices[e] >= kBufferCount ||
+            preBufferIndices[e] < 0 || preBufferIndices[e] >= kBufferCount)
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+        if (cumulativeScaleIndices != NULL && cumulativeScaleIndices[e] != BEAGLE_OP_NONE &&
+            (cumulativeScaleIndices[e] < 0 || cumulativeScaleIndices[e] >= kScaleBufferCount))
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+        if (gPartials[preBufferIndices[e]] == NULL ||
+            (gPartials[postBufferIndices[e]] == NULL && gTipStates[postBufferIndices[e]] == NULL))
+            return BEAGLE_ERROR_GENERAL;
+    }
+
+    return BEAGLE_SUCCESS;
+}
+
+/*
+ * Splits the edges into one contiguous block per thread when the instance has
+ * CPU threads, and returns the first error of any edge.
+ */
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::runInsertionEdges(const int* postBufferIndices,
+                                                         const int* preBufferIndices,
+                                                         const int* cumulativeScaleIndices,
+                                                         int count,
+                                                         const REALTYPE* subtreeTable,
+                                                         const REALTYPE* scaledEigenValues,
+                                                         int categoryWeightsIndex,
+                                                         double* inOutPendantLengths,
+                                                         const double* lengthBounds,
+                                                         int maxIterations,
+                                                         double* outSumLogLikelihoods) {
+    std::vector<int> returnCodes(count, BEAGLE_SUCCESS);
+
+    threadData* threads = NULL;
+    int threadCount = (count < 2 ? 0 : getJobThreads(&threads));
+    if (threadCount > count)
+        threadCount = count;
+
+    if (threadCount < 2) {
+        calcInsertionEdges(postBufferIndices, preBufferIndices, cumulativeScaleIndices, 0, count,
+                           subtreeTable, scaledEigenValues, categoryWeightsIndex, inOutPendantLengths,
+                           lengthBounds, maxIterations, outSumLogLikelihoods, &returnCodes[0]);
+    } else {
+        std::vector<std::future<void> > edgeFutures;
+        int startEdge = 0;
+        for (int i = 0; i < threadCount; i++) {
+            const int endEdge = startEdge + count / threadCount + (i < count % threadCount ? 1 : 0);
+
+            std::packaged_task<void()> threadTask(makeTracedTask(gTracer, "calcInsertionEdges",
+                std::bind(&BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcInsertionEdges, this,
+                          postBufferIndices, preBufferIndices, cumulativeScaleIndices, startEdge, endEdge,
+                          subtreeTable, scaledEigenValues, categoryWeightsIndex, inOutPendantLengths,
+                          lengthBounds, maxIterations, outSumLogLikelihoods, &returnCodes[0])));
+
+            edgeFutures.push_back(threadTask.get_future());
+            threadData* td = &threads[i];
+
+            std::unique_lock<std::mutex> l(td->m);
+            td->jobs.push(std::move(threadTask));
+            l.unlock();
+
+            td->cv.notify_one();
+
+            startEdge = endEdge;
+        }
+
+        for (size_t i = 0; i < edgeFutures.size(); i++) {
+            edgeFutures[i].wait();
+        }
+    }
+
+    for (int e = 0; e < count; e++) {
+        if (returnCodes[e] != BEAGLE_SUCCESS)
+            return returnCodes[e];
+    }
+
+    return BEAGLE_SUCCESS;
+}
+
+/*
+ * Thread task of the insertion likelihoods: edges startEdge to endEdge - 1,
+ * each with its own scratch. Without scaledEigenValues the subtree table holds
+ * x_l per pattern, otherwise t_l per pattern and the pendant length is optimized.
+ */
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcInsertionEdges(const int* postBufferIndices,
+                                                           const int* preBufferIndices,
+                                                           const int* cumulativeScaleIndices,
+                                                           int startEdge,
+                                                           int endEdge,
+                                                           const REALTYPE* subtreeTable,
+                                                           const REALTYPE* scaledEigenValues,
+                                                           int categoryWeightsIndex,
+                                                           double* inOutPendantLengths,
+                                                           const double* lengthBounds,
+                                                           int maxIterations,
+                                                           double* outSumLogLikelihoods,
+                                                           int* outReturnCodes) {
+    const REALTYPE* wt = gCategoryWeights[categoryWeightsIndex];
+    const int sumtableSize = kCategoryCount * kStateCount;
+    const int stateCountSquared = kStateCount * kStateCount;
+
+    std::vector<REALTYPE> siteLikelihoods(kPatternCount);
+    std::vector<REALTYPE> sumtable;
+    std::vector<REALTYPE> expTmp;
+    if (scaledEigenValues != NULL) {
+        sumtable.resize(kPatternCount * sumtableSize);
+        expTmp.resize(3 * sumtableSize);
+    }
+
+    for (int e = startEdge; e < endEdge; e++) {
+        const REALTYPE* partialsPre = gPartials[preBufferIndices[e]];
+        const REALTYPE* partialsPost = gPartials[postBufferIndices[e]];
+        const int* statesPost = gTipStates[postBufferIndices[e]];
+        const REALTYPE* scalingFactors = NULL;
+        if (cumulativeScaleIndices != NULL && cumulativeScaleIndices[e] != BEAGLE_OP_NONE)
+            scalingFactors = gScaleBuffers[cumulativeScaleIndices[e]];
+
+        if (scaledEigenValues == NULL) {
+            for (int p = 0; p < kPatternCount; p++)
+                siteLikelihoods[p] = 0.0;
+
+            const REALTYPE* x = subtreeTable;
+            for (int l = 0; l < kCategoryCount; l++) {
+                const REALTYPE weight = wt[l];
+                int v = l * kPartialsPaddedStateCount * kPatternCount;
+                for (int p = 0; p < kPatternCount; p++) {
+                    REALTYPE sum = 0.0;
+                    if (statesPost != NULL && statesPost[p] < kStateCount) {
+                        sum = partialsPre[v + statesPost[p]] * x[statesPost[p]];
+                    } else if (statesPost != NULL) {
+                        for (int i = 0; i < kStateCount; i++)
+                            sum += partialsPre[v + i] * x[i];
+                    } else {
+                        for (int i = 0; i < kStateCount; i++)
+                            sum += partialsPre[v + i] * partialsPost[v + i] * x[i];
+                    }
+                    siteLikelihoods[p] += weight * sum;
+                    x += kStateCount;
+                    v += kPartialsPaddedStateCount;
+                }
+            }
+
+            double sumLogLikelihood = 0.0;
+            for (int p = 0; p < kPatternCount; p++) {
+                double siteLogLikelihood = log(siteLikelihoods[p]);
+                if (scalingFactors != NULL)
+                    siteLogLikelihood += scalingFactors[p];
+                sumLogLikelihood += siteLogLikelihood * gPatternWeights[p];
+            }
+
+            outSumLogLikelihoods[e] = sumLogLikelihood;
+            if (sumLogLikelihood != sumLogLikelihood)
+                outReturnCodes[e] = BEAGLE_ERROR_FLOATING_POINT;
+        } else {
+            const REALTYPE* t = subtreeTable;
+            for (int l = 0; l < kCategoryCount; l++) {
+                const REALTYPE weight = wt[l];
+                int v = l * kPartialsPaddedStateCount * kPatternCount;
+                for (int p = 0; p < kPatternCount; p++) {
+                    REALTYPE* s = &sumtable[(p * kCategoryCount + l) * kStateCount];
+                    for (int k = 0; k < kStateCount; k++)
+                        s[k] = 0.0;
+                    for (int i = 0; i < kStateCount; i++) {
+                        REALTYPE prePost = weight * partialsPre[v + i];
+                        if (statesPost != NULL) {
+                            if (statesPost[p] < kStateCount && statesPost[p] != i)
+                                continue;
+                        } else {
+                            prePost *= partialsPost[v + i];
+                        }
+                        const REALTYPE* tRow = t + i * kStateCount;
+                        for (int k = 0; k < kStateCount; k++)
+                            s[k] += prePost * tRow[k];
+                    }
+                    t += stateCountSquared;
+                    v += kPartialsPaddedStateCount;
+                }
+            }
+
+            auto evaluate = [&](double length, double* lnL, double* d1, double* d2) {
+                REALTYPE* expD0 = &expTmp[0];
+                REALTYPE* expD1 = expD0 + sumtableSize;
+                REALTYPE* expD2 = expD1 + sumtableSize;
+                for (int m = 0; m < sumtableSize; m++) {
+                    const REALTYPE rate = scaledEigenValues[m];
+                    expD0[m] = exp(rate * (REALTYPE) length);
+                    expD1[m] = rate * expD0[m];
+                    expD2[m] = rate * expD1[m];
+                }
+
+                double sumLogLikelihood = 0.0;
+                double sumFirstDerivative = 0.0;
+                double sumSecondDerivative = 0.0;
+                const REALTYPE* s = &sumtable[0];
+                for (int p = 0; p < kPatternCount; p++) {
+                    REALTYPE sum = 0.0;
+                    REALTYPE sumD1 = 0.0;
+                    REALTYPE sumD2 = 0.0;
+                    for (int m = 0; m < sumtableSize; m++) {
+                        sum += s[m] * expD0[m];
+                        sumD1 += s[m] * expD1[m];
+                        sumD2 += s[m] * expD2[m];
+                    }
+                    s += sumtableSize;
+
+                    double siteLogLikelihood = log(sum);
+                    if (scalingFactors != NULL)
+                        siteLogLikelihood += scalingFactors[p];
+                    const double firstDerivative = sumD1 / sum;
+                    sumLogLikelihood += siteLogLikelihood * gPatternWeights[p];
+                    sumFirstDerivative += firstDerivative * gPatternWeights[p];
+                    sumSecondDerivative += (sumD2 / sum - firstDerivative * firstDerivative) * gPatternWeights[p];
+                }
+
+                *lnL = sumLogLikelihood;
+                *d1 = sumFirstDerivative;
+                *d2 = sumSecondDerivative;
+
+                return (sumLogLikelihood != sumLogLikelihood ? BEAGLE_ERROR_FLOATING_POINT : BEAGLE_SUCCESS);
+            };
+
+            outReturnCodes[e] = maximizeEdgeLength(evaluate, &inOutPendantLengths[e], lengthBounds[0],
+                                                   lengthBounds[1], lengthBounds[2], maxIterations,
+                                                   &outSumLogLikelihoods[e]);
+        }
+    }
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calculateEdgeDerivatives(const int* postBufferIndices,
+                                                                const int* preBufferIndices,
+                                                                const int* derivativeMatrixIndices,
+                                                                const int* categoryWeightsIndices,
+                                                                int count,
+                                                                double* outDerivatives,
+                                                                double* outSumDerivatives,
+                                                                double* outSumSquaredDerivatives) {
+    BeagleTraceScope traceScope(gTracer, "beagleCalculateEdgeDerivatives", "api", count);
+
+    for (int i = 0; i < count; i++) {
+        if (postBufferIndices[i] < 0 || postBufferIndices[i] >= kBufferCount ||
+            preBufferIndices[i] < 0 || preBufferIndices[i] >= kBufferCount ||
+            derivativeMatrixIndices[i] < 0 || derivativeMatrixIndices[i] >= kMatrixCount ||
+            categoryWeightsIndices[i] < 0 || categoryWeightsIndices[i] >= kEigenDecompCount)
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+        if (gPartials[preBufferIndices[i]] == NULL ||
+            (gPartials[postBufferIndices[i]] == NULL && gTipStates[postBufferIndices[i]] == NULL) ||
+            gCategoryWeights[categoryWeightsIndices[i]] == NULL)
+            return BEAGLE_ERROR_GENERAL;
+    }
+
+    if (kThreadingEnabled && kPartitionsInitialised) {
+        // one task per pattern partition, each filling its own row of partial sums
+        std::vector<double> partitionSums(kPartitionCount * count);
+        std::vector<double> partitionSquaredSums(kPartitionCount * count);
+
+        for (int p = 0; p < kPartitionCount; p += kNumThreads) {
+            int taskCount = std::min(kNumThreads, kPartitionCount - p);
+            for (int i = 0; i < taskCount; i++) {
+                std::packaged_task<void()> threadTask(makeTracedTask(gTracer, "calcEdgeDerivativesByPartition",
+                    std::bind(&BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeDerivativesByPartition, this,
+                              postBufferIndices, preBufferIndices, derivativeMatrixIndices,
+                              categoryWeightsIndices, count, p + i, outDerivatives,
+                              &partitionSums[(p + i) * count],
+                              &partitionSquaredSums[(p + i) * count])));
+
+                gFutures[i] = threadTask.get_future();
+                threadData* td = &gThreads[i];
+
+                std::unique_lock<std::mutex> l(td->m);
+                td->jobs.push(std::move(threadTask));
+                l.unlock();
+
+                gThreads[i].cv.notify_one();
+            }
+            for (int i = 0; i < taskCount; i++) {
+                gFutures[i].wait();
+            }
+        }
+
+        for (int e = 0; e < count; e++) {
+            outSumDerivatives[e] = 0.0;
+            if (outSumSquaredDerivatives != NULL)
+                outSumSquaredDerivatives[e] = 0.0;
+            for (int p = 0; p < kPartitionCount; p++) {
+                outSumDerivatives[e] += partitionSums[p * count + e];
+                if (outSumSquaredDerivatives != NULL)
+                    outSumSquaredDerivatives[e] += partitionSquaredSums[p * count + e];
+            }
+        }
+    } else {
+        calcEdgeDerivativesByPartition(postBufferIndices, preBufferIndices, derivativeMatrixIndices,
+                                       categoryWeightsIndices, count, BEAGLE_OP_NONE, outDerivatives,
+                                       outSumDerivatives, outSumSquaredDerivatives);
+    }
+
+    for (int e = 0; e < count; e++) {
+        if (outSumDerivatives[e] != outSumDerivatives[e])
+            return BEAGLE_ERROR_FLOATING_POINT;
+    }
+
+    return BEAGLE_SUCCESS;
+}
+
+/*
+ * Computes the per-pattern derivatives of all requested edges over the patterns
+ * of one partition (or all patterns if partitionIndex is BEAGLE_OP_NONE) and
+ * their pattern-weighted sums. Different partitions write disjoint parts of the
+ * per-pattern scratch buffer, so calls for different partitions may run
+ * concurrently.
+ */
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeDerivativesByPartition(const int* postBufferIndices,
+                                                                       const int* preBufferIndices,
+                                                                       const int* derivativeMatrixIndices,
+                                                                       const int* categoryWeightsIndices,
+                                                                       int count,
+                                                                       int partitionIndex,
+                                                                       double* outDerivatives,
+                                                                       double* outSumDerivatives,
+                                                                       double* outSumSquaredDerivatives) {
+    int startPattern = 0;
+    int endPattern = kPatternCount;
+    if (partitionIndex != BEAGLE_OP_NONE) {
+        startPattern = gPatternPartitionsStartPatterns[partitionIndex];
+        endPattern = gPatternPartitionsStartPatterns[partitionIndex + 1];
+    }
+
+    REALTYPE* siteDerivatives = outFirstDerivativesTmp;
+
+    for (int e = 0; e < count; e++) {
+        const int postIndex = postBufferIndices[e];
+        const REALTYPE* prePartials = gPartials[preBufferIndices[e]];
+        const REALTYPE* derivativeMatrices = gTransitionMatrices[derivativeMatrixIndices[e]];
+        const REALTYPE* wt = gCategoryWeights[categoryWeightsIndices[e]];
+
+        if (gTipStates[postIndex] != NULL) {
+            calcEdgeDerivativesStates(siteDerivatives, gTipStates[postIndex], prePartials,
+                                      derivativeMatrices, wt, startPattern, endPattern);
+        } else {
+            calcEdgeDerivativesPartials(siteDerivatives, gPartials[postIndex], prePartials,
+                                        derivativeMatrices, wt, startPattern, endPattern);
+        }
+
+        double sum = 0.0;
+        double sumSquared = 0.0;
+        for (int k = startPattern; k < endPattern; k++) {
+            const double derivative = siteDerivatives[k];
+            if (outDerivatives != NULL)
+                outDerivatives[e * kPatternCount + k] = derivative;
+            sum += gPatternWeights[k] * derivative;
+            sumSquared += gPatternWeights[k] * derivative * derivative;
+        }
+        outSumDerivatives[e] = sum;
+        if (outSumSquaredDerivatives != NULL)
+            outSumSquaredDerivatives[e] = sumSquared;
+    }
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::waitForPartials(const int* destinationPartials,
+                                   int destinationPartialsCount) {
+    return BEAGLE_SUCCESS;
+}
+
+
+BEAGLE_CPU_TEMPLATE
+    int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calculateRootLogLikelihoods(const int* bufferIndices,
+                                                             const int* categoryWeightsIndices,
+                                                             const int* stateFrequenciesIndices,
+                                                             const int* cumulativeScaleIndices,
+                                                             int count,
+                                                             double* outSumLogLikelihood) {
+    BeagleTraceScope traceScope(gTracer, "beagleCalculateRootLogLikelihoods", "api", count);
+
+    const long integratedPatterns = (long) kPatternCount * count;
+    double flops = 0.0, bytes = 0.0;
+    if (gCounters.isEnabled())
+        getKernelWork(BEAGLE_KERNEL_ROOT_INTEGRATION, integratedPatterns, &flops, &bytes);
+    BeagleCounterTimer counterTimer(gCounters, BEAGLE_KERNEL_ROOT_INTEGRATION, integratedPatterns, flops, bytes);
+
+    if (count == 1) {
+        // We treat this as a special case so that we don't have convoluted logic
+        //      at the end of the loop over patterns
+        int cumulativeScalingFactorIndex;
+        if (kFlags & BEAGLE_FLAG_SCALING_AUTO) {
+            cumulativeScalingFactorIndex = 0;
+        } else if (kFlags & BEAGLE_FLAG_SCALING_ALWAYS) {
+            cumulativeScalingFactorIndex = bufferIndices[0] - kTipCount; 
+        } else {
+            cumulativeScalingFactorIndex = cumulativeScaleIndices[0];
+        }
+
+        if (kAutoRootPartitioningEnabled) {
+            calcRootLogLikelihoodsByAutoPartitionAsync(bufferIndices,
+                                                       categoryWeightsIndices,
+                                                       stateFrequenciesIndices,
+                                                       cumulativeScaleIndices,
+                                                       gAutoPartitionIndices,
+                                                       gAutoPartitionOutSumLogLikelihoods);
+
+            *outSumLogLikelihood = 0.0;
+
+            for (int i = 0; i < kPartitionCount; i++) {
+                *outSumLogLikelihood += gAutoPartitionOutSumLogLikelihoods[i];
+            }
+
+            if (*outSumLogLikelihood != *outSumLogLikelihood) {
+                return BEAGLE_ERROR_FLOATING_POINT;
+            } else {
+                return BEAGLE_SUCCESS;
+            }
+        } else {
+            return calcRootLogLikelihoods(bufferIndices[0], categoryWeightsIndices[0], stateFrequenciesIndices[0],
+                                   cumulativeScalingFactorIndex, outSumLogLikelihood);
+        }
+    }
+    else
+    {
+        return calcRootLogLikelihoodsMulti(bufferIndices, categoryWeightsIndices, stateFrequenciesIndices,
+                                    cumulativeScaleIndices, count, outSumLogLikelihood);
+    }
+}
+
+BEAGLE_CPU_TEMPLATE
+    int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calculateRootLogLikelihoodsByPartition(
+                                                                  const int* bufferIndices,
+                                                                  const int* categoryWeightsIndices,
+                                                                  const int* stateFrequenciesIndices,
+                                                                  const int* cumulativeScaleIndices,
+                                                                  const int* partitionIndices,
+                                                                  int partitionCount,
+                                                                  int count,
+                                                                  double* outSumLogLikelihoodByPartition,
+                                                                  double* outSumLogLikelihood) {
+    BeagleTraceScope traceScope(gTracer, "beagleCalculateRootLogLikelihoodsByPartition", "api", count);
+
+    int returnCode = BEAGLE_SUCCESS;
+
+    if (count == 1) {
         if (kFlags & BEAGLE_FLAG_SCALING_AUTO) {
             returnCode = BEAGLE_ERROR_NO_IMPLEMENTATION;
         } else if (kFlags & BEAGLE_FLAG_SCALING_ALWAYS) {
@@ -1591,66 +3615,572 @@ BEAGLE_CPU_TEMPLATE
             partitionsRemainder--;
         }
 
-        std::packaged_task<void()> threadTask(
-            std::bind(&BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcRootLogLikelihoodsByPartition, this,
-                      &bufferIndices[currentPartitionIndex], &categoryWeightsIndices[currentPartitionIndex],
-                      &stateFrequenciesIndices[currentPartitionIndex], &cumulativeScaleIndices[currentPartitionIndex],
-                      &partitionIndices[currentPartitionIndex], partitionCountThread,
-                      &outSumLogLikelihoodByPartition[currentPartitionIndex]));
+        std::packaged_task<void()> threadTask(makeTracedTask(gTracer, "calcRootLogLikelihoodsByPartition",
+            std::bind(&BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcRootLogLikelihoodsByPartition, this,
+                      &bufferIndices[currentPartitionIndex], &categoryWeightsIndices[currentPartitionIndex],
+                      &stateFrequenciesIndices[currentPartitionIndex], &cumulativeScaleIndices[currentPartitionIndex],
+                      &partitionIndices[currentPartitionIndex], partitionCountThread,
+                      &outSumLogLikelihoodByPartition[currentPartitionIndex])));
+
+        gFutures[i] = threadTask.get_future();
+        threadData* td = &gThreads[i];
+
+        std::unique_lock<std::mutex> l(td->m);
+        td->jobs.push(std::move(threadTask));
+        l.unlock();
+
+        gThreads[i].cv.notify_one();
+
+        currentPartitionIndex += partitionCountThread;
+    }
+
+    for (int i=0; i<kNumThreads; i++) {
+        gFutures[i].wait();
+    }
+
+}
+
+BEAGLE_CPU_TEMPLATE
+    void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcRootLogLikelihoodsByAutoPartitionAsync(
+                                                        const int* bufferIndices,
+                                                        const int* categoryWeightsIndices,
+                                                        const int* stateFrequenciesIndices,
+                                                        const int* cumulativeScaleIndices,
+                                                        const int* partitionIndices,
+                                                        double* outSumLogLikelihoodByPartition) {
+
+    for (int i=0; i<kNumThreads; i++) {
+
+        std::packaged_task<void()> threadTask(makeTracedTask(gTracer, "calcRootLogLikelihoodsByPartition",
+            std::bind(&BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcRootLogLikelihoodsByPartition, this,
+                      bufferIndices, categoryWeightsIndices,
+                      stateFrequenciesIndices, cumulativeScaleIndices,
+                      &partitionIndices[i], 1,
+                      &outSumLogLikelihoodByPartition[i])));
+
+        gFutures[i] = threadTask.get_future();
+        threadData* td = &gThreads[i];
+
+        std::unique_lock<std::mutex> l(td->m);
+        td->jobs.push(std::move(threadTask));
+        l.unlock();
+
+        gThreads[i].cv.notify_one();
+
+    }
+
+    for (int i=0; i<kNumThreads; i++) {
+        gFutures[i].wait();
+    }
+
+}
+
+
+/*
+ * Runs the calls of a typical likelihood evaluation as one pass. Without
+ * threads each transition matrix is computed just before the first operation
+ * that reads it, and the root follows the last operation while its partials
+ * are still in cache. With pattern partitioning the matrices are computed
+ * first, and a single fork/join runs every operation and the root integration
+ * of each partition. Configurations these schedules do not cover fall back to
+ * the individual calls. The cumulative scale buffer is reset and receives the
+ * factors of every scale buffer the operations write or read.
+ */
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::evaluateRootLogLikelihood(int eigenIndex,
+                                                                 const int* probabilityIndices,
+                                                                 const double* edgeLengths,
+                                                                 int matrixCount,
+                                                                 const int* operations,
+                                                                 int operationCount,
+                                                                 int rootBufferIndex,
+                                                                 int categoryWeightsIndex,
+                                                                 int stateFrequenciesIndex,
+                                                                 int cumulativeScaleIndex,
+                                                                 double* outSumLogLikelihood) {
+    BeagleTraceScope traceScope(gTracer, "beagleEvaluateRootLogLikelihood", "api", operationCount);
+
+    const bool scaleByIndex = !(kFlags & (BEAGLE_FLAG_SCALING_AUTO | BEAGLE_FLAG_SCALING_ALWAYS |
+                                          BEAGLE_FLAG_SCALING_DYNAMIC));
+    const bool accumulateScaling = (scaleByIndex && cumulativeScaleIndex != BEAGLE_OP_NONE);
+
+    // the interleaved schedule looks matrices up by index
+    for (int i = 0; i < matrixCount; i++) {
+        if (probabilityIndices[i] < 0 || probabilityIndices[i] >= kMatrixCount)
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+
+    bool readScaling = false;
+    for (int op = 0; op < operationCount; op++) {
+        const int* operation = operations + op * BEAGLE_OP_COUNT;
+        if (operation[1] < 0 && operation[2] >= 0)
+            readScaling = true;
+    }
+
+    if (accumulateScaling)
+        resetScaleFactors(cumulativeScaleIndex);
+
+    int returnCode = BEAGLE_SUCCESS;
+
+    if (!scaleByIndex || kIncrementalUpdates || (kAutoPartitioningEnabled && readScaling)) {
+        returnCode = updateTransitionMatrices(eigenIndex, probabilityIndices, NULL, NULL, edgeLengths, matrixCount);
+        if (returnCode != BEAGLE_SUCCESS)
+            return returnCode;
+        returnCode = updatePartials(operations, operationCount, cumulativeScaleIndex);
+        if (returnCode != BEAGLE_SUCCESS)
+            return returnCode;
+        for (int op = 0; op < operationCount && accumulateScaling; op++) {
+            const int* operation = operations + op * BEAGLE_OP_COUNT;
+            if (operation[1] < 0 && operation[2] >= 0)
+                accumulateScaleFactors(&operation[2], 1, cumulativeScaleIndex);
+        }
+    } else if (!kAutoPartitioningEnabled) {
+        // the position in probabilityIndices of the last update of each pending matrix
+        std::vector<int> pendingMatrices(kMatrixCount, -1);
+        for (int i = 0; i < matrixCount; i++)
+            pendingMatrices[probabilityIndices[i]] = i;
+
+        unsharePartialsOperations(operations, operationCount, cumulativeScaleIndex, false);
+
+        for (int op = 0; op < operationCount; op++) {
+            const int* operation = operations + op * BEAGLE_OP_COUNT;
+            for (int c = 4; c <= 6; c += 2) {
+                const int matrixIndex = operation[c];
+                if (pendingMatrices[matrixIndex] >= 0) {
+                    returnCode = updateTransitionMatrices(eigenIndex, &matrixIndex, NULL, NULL,
+                                                          &edgeLengths[pendingMatrices[matrixIndex]], 1);
+                    if (returnCode != BEAGLE_SUCCESS)
+                        return returnCode;
+                    pendingMatrices[matrixIndex] = -1;
+                }
+            }
+
+            returnCode = upPartials(false, operation, 1, cumulativeScaleIndex);
+            if (returnCode != BEAGLE_SUCCESS)
+                return returnCode;
+
+            if (accumulateScaling && operation[1] < 0 && operation[2] >= 0)
+                accumulateScaleFactors(&operation[2], 1, cumulativeScaleIndex);
+        }
+
+        // matrices that no operation reads
+        for (int i = 0; i < matrixCount; i++) {
+            const int matrixIndex = probabilityIndices[i];
+            if (pendingMatrices[matrixIndex] == i) {
+                returnCode = updateTransitionMatrices(eigenIndex, &matrixIndex, NULL, NULL, &edgeLengths[i], 1);
+                if (returnCode != BEAGLE_SUCCESS)
+                    return returnCode;
+            }
+        }
+    } else {
+        returnCode = updateTransitionMatrices(eigenIndex, probabilityIndices, NULL, NULL, edgeLengths, matrixCount);
+        if (returnCode != BEAGLE_SUCCESS)
+            return returnCode;
+
+        unsharePartialsOperations(operations, operationCount, cumulativeScaleIndex, false);
+
+        autoPartitionPartialsOperations(operations,
+                                        gAutoPartitionOperations,
+                                        operationCount,
+                                        cumulativeScaleIndex);
+
+        const int numOps = BEAGLE_PARTITION_OP_COUNT;
+        const int count = operationCount * kPartitionCount;
+
+        memset(gThreadOpCounts, 0, sizeof(int) * kNumThreads);
+
+        for (int i=0; i<count; i++) {
+            int t = gAutoPartitionOperations[i * numOps + 7] % kNumThreads;
+            for (int j=0; j<numOps; j++) {
+                gThreadOperations[t][gThreadOpCounts[t]*numOps + j] = gAutoPartitionOperations[i*numOps + j];
+            }
+            gThreadOpCounts[t]++;
+        }
+
+        const int fusedRootIndex = (kAutoRootPartitioningEnabled ? rootBufferIndex : BEAGLE_OP_NONE);
+
+        for (int i=0; i<kNumThreads; i++) {
+            std::packaged_task<void()> threadTask(makeTracedTask(gTracer, "calcPartialsAndRootByPartition",
+                std::bind(&BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcPartialsAndRootByPartition, this,
+                          (const int*) gThreadOperations[i], gThreadOpCounts[i],
+                          fusedRootIndex, categoryWeightsIndex, stateFrequenciesIndex,
+                          cumulativeScaleIndex, i)));
+
+            gFutures[i] = threadTask.get_future();
+            threadData* td = &gThreads[i];
+
+            std::unique_lock<std::mutex> l(td->m);
+            td->jobs.push(std::move(threadTask));
+            l.unlock();
+
+            gThreads[i].cv.notify_one();
+        }
+
+        for (int i=0; i<kNumThreads; i++) {
+            gFutures[i].wait();
+        }
+
+        if (fusedRootIndex != BEAGLE_OP_NONE) {
+            *outSumLogLikelihood = 0.0;
+            for (int i = 0; i < kPartitionCount; i++)
+                *outSumLogLikelihood += gAutoPartitionOutSumLogLikelihoods[i];
+
+            if (*outSumLogLikelihood != *outSumLogLikelihood)
+                return BEAGLE_ERROR_FLOATING_POINT;
+            return BEAGLE_SUCCESS;
+        }
+    }
+
+    return calculateRootLogLikelihoods(&rootBufferIndex, &categoryWeightsIndex, &stateFrequenciesIndex,
+                                       &cumulativeScaleIndex, 1, outSumLogLikelihood);
+}
+
+/*
+ * Thread task of evaluateRootLogLikelihood: the operations of the partitions
+ * assigned to this thread, followed by their part of the root integration.
+ */
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcPartialsAndRootByPartition(const int* operations,
+                                                                       int count,
+                                                                       int rootBufferIndex,
+                                                                       int categoryWeightsIndex,
+                                                                       int stateFrequenciesIndex,
+                                                                       int cumulativeScaleIndex,
+                                                                       int threadIndex) {
+    upPartials(true, operations, count, BEAGLE_OP_NONE);
+
+    if (rootBufferIndex == BEAGLE_OP_NONE)
+        return;
+
+    for (int p = threadIndex; p < kPartitionCount; p += kNumThreads) {
+        calcRootLogLikelihoodsByPartition(&rootBufferIndex, &categoryWeightsIndex, &stateFrequenciesIndex,
+                                          &cumulativeScaleIndex, &p, 1, &gAutoPartitionOutSumLogLikelihoods[p]);
+    }
+}
+
+/*
+ * Evaluates a batch of trees on this instance. With threads, and when the jobs
+ * are independent, the matrices and scale buffers of every job are prepared
+ * first, the partials operations of each job run as one thread task, and the
+ * roots are integrated in turn. Otherwise the jobs are evaluated one after
+ * the other.
+ */
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::evaluateRootLogLikelihoods(const BeagleEvaluationJob* jobs,
+                                                                  int jobCount,
+                                                                  double* outSumLogLikelihoods,
+                                                                  int* outReturnCodes) {
+    BeagleTraceScope traceScope(gTracer, "beagleEvaluateRootLogLikelihoods", "api", jobCount);
+
+    if (jobCount < 0)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+
+    const bool scaleByIndex = !(kFlags & (BEAGLE_FLAG_SCALING_AUTO | BEAGLE_FLAG_SCALING_ALWAYS |
+                                          BEAGLE_FLAG_SCALING_DYNAMIC));
+
+    std::vector<int> returnCodes(jobCount, BEAGLE_SUCCESS);
+
+    threadData* threads = NULL;
+    const int threadCount = (jobCount < 2 ? 0 : getJobThreads(&threads));
+
+    if (threadCount < 2 || !scaleByIndex || kIncrementalUpdates ||
+        (kFlags & BEAGLE_FLAG_PARTIALS_MAPPED) || !jobsAreIndependent(jobs, jobCount)) {
+        for (int i = 0; i < jobCount; i++) {
+            const BeagleEvaluationJob& job = jobs[i];
+            returnCodes[i] = evaluateRootLogLikelihood(job.eigenIndex, job.probabilityIndices, job.edgeLengths,
+                                                       job.matrixCount, (const int*) job.operations,
+                                                       job.operationCount, job.rootBufferIndex,
+                                                       job.categoryWeightsIndex, job.stateFrequenciesIndex,
+                                                       job.cumulativeScaleIndex, &outSumLogLikelihoods[i]);
+        }
+    } else {
+        // the eigen decompositions, the matrix cache and buffer sharing are not thread safe
+        for (int i = 0; i < jobCount; i++) {
+            const BeagleEvaluationJob& job = jobs[i];
+            if (job.cumulativeScaleIndex != BEAGLE_OP_NONE)
+                resetScaleFactors(job.cumulativeScaleIndex);
+            returnCodes[i] = updateTransitionMatrices(job.eigenIndex, job.probabilityIndices, NULL, NULL,
+                                                      job.edgeLengths, job.matrixCount);
+            unsharePartialsOperations((const int*) job.operations, job.operationCount,
+                                      job.cumulativeScaleIndex, false);
+        }
+
+        {
+            BeagleCounterTimer counterTimer(gCounters, BEAGLE_KERNEL_THREAD_DISPATCH, 0, 0.0, 0.0);
+
+            std::vector<std::future<void> > jobFutures;
+            for (int i = 0; i < jobCount; i++) {
+                if (returnCodes[i] != BEAGLE_SUCCESS)
+                    continue;
+
+                std::packaged_task<void()> threadTask(makeTracedTask(gTracer, "upPartials",
+                    std::bind(&BeagleCPUImpl<BEAGLE_CPU_GENERIC>::upPartials, this, false,
+                              (const int*) jobs[i].operations, jobs[i].operationCount,
+                              jobs[i].cumulativeScaleIndex)));
+
+                jobFutures.push_back(threadTask.get_future());
+                threadData* td = &threads[i % threadCount];
+
+                std::unique_lock<std::mutex> l(td->m);
+                td->jobs.push(std::move(threadTask));
+                l.unlock();
+
+                td->cv.notify_one();
+            }
+
+            for (size_t i = 0; i < jobFutures.size(); i++) {
+                jobFutures[i].wait();
+            }
+        }
+
+        for (int i = 0; i < jobCount; i++) {
+            if (returnCodes[i] != BEAGLE_SUCCESS)
+                continue;
+
+            const BeagleEvaluationJob& job = jobs[i];
+            for (int op = 0; op < job.operationCount && job.cumulativeScaleIndex != BEAGLE_OP_NONE; op++) {
+                const BeagleOperation& operation = job.operations[op];
+                if (operation.destinationScaleWrite < 0 && operation.destinationScaleRead >= 0)
+                    accumulateScaleFactors(&operation.destinationScaleRead, 1, job.cumulativeScaleIndex);
+            }
+
+            returnCodes[i] = calculateRootLogLikelihoods(&job.rootBufferIndex, &job.categoryWeightsIndex,
+                                                         &job.stateFrequenciesIndex, &job.cumulativeScaleIndex,
+                                                         1, &outSumLogLikelihoods[i]);
+        }
+    }
+
+    int returnCode = BEAGLE_SUCCESS;
+    for (int i = 0; i < jobCount; i++) {
+        if (outReturnCodes != NULL)
+            outReturnCodes[i] = returnCodes[i];
+        if (returnCode == BEAGLE_SUCCESS)
+            returnCode = returnCodes[i];
+    }
+
+    return returnCode;
+}
+
+/*
+ * Whether every buffer that a job of the batch writes, i.e. its matrices,
+ * destination partials, scale buffers and cumulative scale buffer, is neither
+ * written nor read by any other job of the batch.
+ */
+BEAGLE_CPU_TEMPLATE
+bool BeagleCPUImpl<BEAGLE_CPU_GENERIC>::jobsAreIndependent(const BeagleEvaluationJob* jobs,
+                                                           int jobCount) {
+    std::vector<int> matrixOwners(kMatrixCount, -1);
+    std::vector<int> partialsOwners(kBufferCount, -1);
+    std::vector<int> scaleOwners(kScaleBufferCount, -1);
+
+    // unclaimed buffers, such as tips and eigen inputs, are shared by all jobs
+    auto ownedByOther = [](const std::vector<int>& owners, int index, int job) {
+        return (index < 0 || index >= (int) owners.size() ||
+                (owners[index] != -1 && owners[index] != job));
+    };
+    auto claim = [&ownedByOther](std::vector<int>& owners, int index, int job) {
+        if (ownedByOther(owners, index, job))
+            return false;
+        owners[index] = job;
+        return true;
+    };
+
+    for (int j = 0; j < jobCount; j++) {
+        const BeagleEvaluationJob& job = jobs[j];
+        for (int i = 0; i < job.matrixCount; i++) {
+            if (!claim(matrixOwners, job.probabilityIndices[i], j))
+                return false;
+        }
+        for (int op = 0; op < job.operationCount; op++) {
+            const BeagleOperation& operation = job.operations[op];
+            if (!claim(partialsOwners, operation.destinationPartials, j))
+                return false;
+            if (operation.destinationScaleWrite >= 0 &&
+                !claim(scaleOwners, operation.destinationScaleWrite, j))
+                return false;
+        }
+        if (job.cumulativeScaleIndex != BEAGLE_OP_NONE &&
+            !claim(scaleOwners, job.cumulativeScaleIndex, j))
+            return false;
+    }
+
+    for (int j = 0; j < jobCount; j++) {
+        const BeagleEvaluationJob& job = jobs[j];
+        for (int op = 0; op < job.operationCount; op++) {
+            const BeagleOperation& operation = job.operations[op];
+            if (ownedByOther(partialsOwners, operation.child1Partials, j) ||
+                ownedByOther(partialsOwners, operation.child2Partials, j) ||
+                ownedByOther(matrixOwners, operation.child1TransitionMatrix, j) ||
+                ownedByOther(matrixOwners, operation.child2TransitionMatrix, j))
+                return false;
+            if (operation.destinationScaleWrite < 0 && operation.destinationScaleRead >= 0 &&
+                ownedByOther(scaleOwners, operation.destinationScaleRead, j))
+                return false;
+        }
+        if (ownedByOther(partialsOwners, job.rootBufferIndex, j))
+            return false;
+    }
+
+    return true;
+}
+
+/*
+ * The threads that run the jobs of a batch: the partition threads if there
+ * are any, otherwise, since trees with few patterns are not partitioned, a
+ * pool of the CPU thread count that is created on first use. Returns 0
+ * without BEAGLE_FLAG_THREADING_CPP.
+ */
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getJobThreads(threadData** threads) {
+    if (kThreadingEnabled) {
+        *threads = gThreads;
+        return kNumThreads;
+    }
+
+    if (!(kFlags & BEAGLE_FLAG_THREADING_CPP))
+        return 0;
+
+    if (gJobThreads == NULL) {
+        int threadCount = kCPUThreadCount;
+        if (threadCount == 0)
+            threadCount = std::thread::hardware_concurrency();
+        if (threadCount < 2)
+            return 0;
+
+        gJobThreads = new threadData[threadCount];
+        for (int i = 0; i < threadCount; i++) {
+            gJobThreads[i].t = std::thread(&BeagleCPUImpl<BEAGLE_CPU_GENERIC>::threadWaiting, this, &gJobThreads[i]);
+        }
+        kJobThreadCount = threadCount;
+    }
+
+    *threads = gJobThreads;
+    return kJobThreadCount;
+}
 
-        gFutures[i] = threadTask.get_future();
-        threadData* td = &gThreads[i];
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::stopJobThreads() {
+    if (gJobThreads == NULL)
+        return;
 
+    for (int i = 0; i < kJobThreadCount; i++) {
+        threadData* td = &gJobThreads[i];
         std::unique_lock<std::mutex> l(td->m);
-        td->jobs.push(std::move(threadTask));
-        l.unlock();
-
-        gThreads[i].cv.notify_one();
-
-        currentPartitionIndex += partitionCountThread;
+        td->stop = true;
+        td->cv.notify_one();
     }
 
-    for (int i=0; i<kNumThreads; i++) {
-        gFutures[i].wait();
+    for (int i = 0; i < kJobThreadCount; i++) {
+        gJobThreads[i].t.join();
     }
 
+    delete[] gJobThreads;
+    gJobThreads = NULL;
+    kJobThreadCount = 0;
 }
 
+/*
+ * Integrates the root once and weights the site log likelihoods by each of
+ * weightVectorCount pattern weight vectors, given in the original pattern order.
+ */
 BEAGLE_CPU_TEMPLATE
-    void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcRootLogLikelihoodsByAutoPartitionAsync(
-                                                        const int* bufferIndices,
-                                                        const int* categoryWeightsIndices,
-                                                        const int* stateFrequenciesIndices,
-                                                        const int* cumulativeScaleIndices,
-                                                        const int* partitionIndices,
-                                                        double* outSumLogLikelihoodByPartition) {
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calculateRootLogLikelihoodsForWeights(int bufferIndex,
+                                                                             int categoryWeightsIndex,
+                                                                             int stateFrequenciesIndex,
+                                                                             int cumulativeScaleIndex,
+                                                                             const double* inPatternWeights,
+                                                                             int weightVectorCount,
+                                                                             double* outSumLogLikelihoods) {
+    if (weightVectorCount < 0)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
 
-    for (int i=0; i<kNumThreads; i++) {
+    double sumLogLikelihood;
+    int returnCode = calculateRootLogLikelihoods(&bufferIndex, &categoryWeightsIndex, &stateFrequenciesIndex,
+                                                 &cumulativeScaleIndex, 1, &sumLogLikelihood);
+    if (returnCode != BEAGLE_SUCCESS && returnCode != BEAGLE_ERROR_FLOATING_POINT)
+        return returnCode;
 
-        std::packaged_task<void()> threadTask(
-            std::bind(&BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcRootLogLikelihoodsByPartition, this,
-                      bufferIndices, categoryWeightsIndices,
-                      stateFrequenciesIndices, cumulativeScaleIndices,
-                      &partitionIndices[i], 1,
-                      &outSumLogLikelihoodByPartition[i]));
+    std::vector<double> siteLogLikelihoods(kPatternCount);
+    getSiteLogLikelihoods(&siteLogLikelihoods[0]);
 
-        gFutures[i] = threadTask.get_future();
-        threadData* td = &gThreads[i];
+    if (kThreadingEnabled && weightVectorCount >= 2 * kNumThreads) {
+        int rowsPerThreadFloor = weightVectorCount / kNumThreads;
+        int rowsRemainder = weightVectorCount % kNumThreads;
+        int currentRow = 0;
+        for (int i = 0; i < kNumThreads; i++) {
+            int rowCountThread = rowsPerThreadFloor + (i < rowsRemainder ? 1 : 0);
 
-        std::unique_lock<std::mutex> l(td->m);
-        td->jobs.push(std::move(threadTask));
-        l.unlock();
+            std::packaged_task<void()> threadTask(makeTracedTask(gTracer, "calcWeightedSiteSums",
+                std::bind(&BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcWeightedSiteSums, this,
+                          (const double*) &siteLogLikelihoods[0],
+                          inPatternWeights + (long) currentRow * kPatternCount,
+                          rowCountThread,
+                          outSumLogLikelihoods + currentRow)));
 
-        gThreads[i].cv.notify_one();
+            gFutures[i] = threadTask.get_future();
+            threadData* td = &gThreads[i];
 
+            std::unique_lock<std::mutex> l(td->m);
+            td->jobs.push(std::move(threadTask));
+            l.unlock();
+
+            gThreads[i].cv.notify_one();
+
+            currentRow += rowCountThread;
+        }
+
+        for (int i = 0; i < kNumThreads; i++) {
+            gFutures[i].wait();
+        }
+    } else {
+        calcWeightedSiteSums(&siteLogLikelihoods[0], inPatternWeights, weightVectorCount, outSumLogLikelihoods);
     }
 
-    for (int i=0; i<kNumThreads; i++) {
-        gFutures[i].wait();
+    returnCode = BEAGLE_SUCCESS;
+    for (int k = 0; k < weightVectorCount; k++) {
+        if (outSumLogLikelihoods[k] != outSumLogLikelihoods[k])
+            returnCode = BEAGLE_ERROR_FLOATING_POINT;
     }
 
+    return returnCode;
 }
 
+/*
+ * outSums = patternWeights * siteLogLikelihoods for a row-major block of
+ * weight vectors. Four rows share each load of the site log likelihoods.
+ */
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcWeightedSiteSums(const double* siteLogLikelihoods,
+                                                             const double* patternWeights,
+                                                             int weightVectorCount,
+                                                             double* outSums) {
+    int k = 0;
+    for (; k + 4 <= weightVectorCount; k += 4) {
+        const double* w0 = patternWeights + (long) k * kPatternCount;
+        const double* w1 = w0 + kPatternCount;
+        const double* w2 = w1 + kPatternCount;
+        const double* w3 = w2 + kPatternCount;
+        double sum0 = 0.0, sum1 = 0.0, sum2 = 0.0, sum3 = 0.0;
+        for (int i = 0; i < kPatternCount; i++) {
+            const double siteLogLikelihood = siteLogLikelihoods[i];
+            sum0 += w0[i] * siteLogLikelihood;
+            sum1 += w1[i] * siteLogLikelihood;
+            sum2 += w2[i] * siteLogLikelihood;
+            sum3 += w3[i] * siteLogLikelihood;
+        }
+        outSums[k] = sum0;
+        outSums[k + 1] = sum1;
+        outSums[k + 2] = sum2;
+        outSums[k + 3] = sum3;
+    }
+    for (; k < weightVectorCount; k++) {
+        const double* w = patternWeights + (long) k * kPatternCount;
+        double sum = 0.0;
+        for (int i = 0; i < kPatternCount; i++)
+            sum += w[i] * siteLogLikelihoods[i];
+        outSums[k] = sum;
+    }
+}
 
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcRootLogLikelihoodsMulti(const int* bufferIndices,
@@ -1919,6 +4449,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::accumulateScaleFactors(const int* scaling
         }
                 
     } else {
+        unshareBuffer(gScaleBuffers, cumulativeScalingIndex, kPaddedPatternCount, true);
         REALTYPE* cumulativeScaleBuffer = gScaleBuffers[cumulativeScalingIndex];
         for(int i=0; i<count; i++) {
             const REALTYPE* scaleBuffer = gScaleBuffers[scalingIndices[i]];
@@ -1953,6 +4484,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::accumulateScaleFactorsByPartition(const i
         int startPattern = gPatternPartitionsStartPatterns[partitionIndex];
         int endPattern = gPatternPartitionsStartPatterns[partitionIndex + 1];
 
+        unshareBuffer(gScaleBuffers, cumulativeScalingIndex, kPaddedPatternCount, true);
         REALTYPE* cumulativeScaleBuffer = gScaleBuffers[cumulativeScalingIndex];
         for(int i=0; i<count; i++) {
             const REALTYPE* scaleBuffer = gScaleBuffers[scalingIndices[i]];
@@ -1973,6 +4505,7 @@ BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::removeScaleFactors(const int* scalingIndices,
                                             int  count,
                                             int  cumulativeScalingIndex) {
+    unshareBuffer(gScaleBuffers, cumulativeScalingIndex, kPaddedPatternCount, true);
     REALTYPE* cumulativeScaleBuffer = gScaleBuffers[cumulativeScalingIndex];
     for(int i=0; i<count; i++) {
         const REALTYPE* scaleBuffer = gScaleBuffers[scalingIndices[i]];
@@ -1996,6 +4529,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::removeScaleFactorsByPartition(const int*
     int startPattern = gPatternPartitionsStartPatterns[partitionIndex];
     int endPattern = gPatternPartitionsStartPatterns[partitionIndex + 1];
 
+    unshareBuffer(gScaleBuffers, cumulativeScalingIndex, kPaddedPatternCount, true);
     REALTYPE* cumulativeScaleBuffer = gScaleBuffers[cumulativeScalingIndex];
     for(int i=0; i<count; i++) {
         const REALTYPE* scaleBuffer = gScaleBuffers[scalingIndices[i]];
@@ -2018,6 +4552,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::resetScaleFactors(int cumulativeScalingIn
      if (kFlags & BEAGLE_FLAG_SCALING_AUTO) {
          memset(gScaleBuffers[cumulativeScalingIndex], 0, sizeof(signed short) * kPaddedPatternCount);
      } else {           
+         unshareBuffer(gScaleBuffers, cumulativeScalingIndex, kPaddedPatternCount, false);
          memset(gScaleBuffers[cumulativeScalingIndex], 0, sizeof(REALTYPE) * kPaddedPatternCount);
      }
     return BEAGLE_SUCCESS;
@@ -2033,6 +4568,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::resetScaleFactorsByPartition(int cumulati
         int startPattern = gPatternPartitionsStartPatterns[partitionIndex];
         int endPattern = gPatternPartitionsStartPatterns[partitionIndex + 1];
 
+        unshareBuffer(gScaleBuffers, cumulativeScalingIndex, kPaddedPatternCount, true);
         REALTYPE* cumulativeBuffer = gScaleBuffers[cumulativeScalingIndex]; 
 
         memset(&cumulativeBuffer[startPattern], 0, sizeof(REALTYPE) * (endPattern - startPattern));
@@ -2043,6 +4579,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::resetScaleFactorsByPartition(int cumulati
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::copyScaleFactors(int destScalingIndex,
                                                         int srcScalingIndex) {
+    unshareBuffer(gScaleBuffers, destScalingIndex, kPaddedPatternCount, false);
     memcpy(gScaleBuffers[destScalingIndex],gScaleBuffers[srcScalingIndex],sizeof(REALTYPE) * kPatternCount);
 
     return BEAGLE_SUCCESS;
@@ -2068,8 +4605,16 @@ BEAGLE_CPU_TEMPLATE
                                                              double* outSumLogLikelihood,
                                                              double* outSumFirstDerivative,
                                                              double* outSumSecondDerivative) {
+    BeagleTraceScope traceScope(gTracer, "beagleCalculateEdgeLogLikelihoods", "api", count);
+
     // TODO: implement for count > 1
 
+    const long integratedPatterns = (long) kPatternCount * count;
+    double flops = 0.0, bytes = 0.0;
+    if (gCounters.isEnabled())
+        getKernelWork(BEAGLE_KERNEL_EDGE_INTEGRATION, integratedPatterns, &flops, &bytes);
+    BeagleCounterTimer counterTimer(gCounters, BEAGLE_KERNEL_EDGE_INTEGRATION, integratedPatterns, flops, bytes);
+
     if (count == 1) {
         int cumulativeScalingFactorIndex;
         if (kFlags & BEAGLE_FLAG_SCALING_AUTO) {
@@ -2164,6 +4709,7 @@ BEAGLE_CPU_TEMPLATE
                                                     double* outSumFirstDerivative,
                                                     double* outSumSecondDerivativeByPartition,
                                                     double* outSumSecondDerivative) {
+    BeagleTraceScope traceScope(gTracer, "beagleCalculateEdgeLogLikelihoodsByPartition", "api", count);
 
     int returnCode = BEAGLE_SUCCESS;
 
@@ -2273,7 +4819,7 @@ BEAGLE_CPU_TEMPLATE
             partitionsRemainder--;
         }
 
-        std::packaged_task<void()> threadTask(
+        std::packaged_task<void()> threadTask(makeTracedTask(gTracer, "calcEdgeLogLikelihoodsByPartition",
             std::bind(&BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoodsByPartition, this,
                       &parentBufferIndices[currentPartitionIndex],
                       &childBufferIndices[currentPartitionIndex],
@@ -2283,7 +4829,7 @@ BEAGLE_CPU_TEMPLATE
                       &cumulativeScaleIndices[currentPartitionIndex],
                       &partitionIndices[currentPartitionIndex],
                       partitionCountThread,
-                      &outSumLogLikelihoodByPartition[currentPartitionIndex]));
+                      &outSumLogLikelihoodByPartition[currentPartitionIndex])));
 
         gFutures[i] = threadTask.get_future();
         threadData* td = &gThreads[i];
@@ -2316,7 +4862,7 @@ BEAGLE_CPU_TEMPLATE
 
     for (int i=0; i<kNumThreads; i++) {
 
-        std::packaged_task<void()> threadTask(
+        std::packaged_task<void()> threadTask(makeTracedTask(gTracer, "calcEdgeLogLikelihoodsByPartition",
             std::bind(&BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoodsByPartition, this,
                       parentBufferIndices,
                       childBufferIndices,
@@ -2326,7 +4872,7 @@ BEAGLE_CPU_TEMPLATE
                       cumulativeScaleIndices,
                       &partitionIndices[i],
                       1,
-                      &outSumLogLikelihoodByPartition[i]));
+                      &outSumLogLikelihoodByPartition[i])));
 
         gFutures[i] = threadTask.get_future();
         threadData* td = &gThreads[i];
@@ -3336,7 +5882,10 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::reorderPatternsByPartition() {
                 }
             }
             gPartials[tip] = sortedPartials;
-            sortedPartials = unsortedPartials;
+            if (isSharedTipBuffer(tip, unsortedPartials) || releaseSharedBuffer(unsortedPartials))
+                sortedPartials = (REALTYPE*) mallocAligned(sizeof(REALTYPE) * kPartialsSize);
+            else
+                sortedPartials = unsortedPartials;
         } else {
             int* unsortedTips = gTipStates[tip];
             for (int i=0; i < kPatternCount; i++) {
@@ -3345,7 +5894,10 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::reorderPatternsByPartition() {
                 sortedTips[sortIndex] = unsortedTips[pIndex];
             }
             gTipStates[tip] = sortedTips;
-            sortedTips = unsortedTips;
+            if (isSharedTipBuffer(tip, unsortedTips) || releaseSharedBuffer(unsortedTips))
+                sortedTips = (int*) mallocAligned(sizeof(int) * kPaddedPatternCount);
+            else
+                sortedTips = unsortedTips;
         }        
     }
 
@@ -3353,6 +5905,9 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::reorderPatternsByPartition() {
     free(sortedTips);
 
     kPatternsReordered = true;
+    forgetPartialsRecords();
+    if (kSkipZeroWeightPatterns)
+        updateActivePatterns();
 
     return BEAGLE_SUCCESS;
 }
@@ -3609,6 +6164,174 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcPartialsPartials(REALTYPE* destP,
     }
 }
 
+/*
+ * Pre-order partials are stored at the bottom of the branch above the
+ * destination node:
+ *   destP[j] = sum_i matrices1[i][j] * partials1[i] * (sum_k matrices2[i][k] * partials2[k])
+ * where partials1 are the pre-order partials of the parent, matrices1 the
+ * destination's own branch, and partials2/matrices2 the post-order sibling.
+ */
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcPrePartialsPartials(REALTYPE* destP,
+                                                                const REALTYPE* partials1,
+                                                                const REALTYPE* matrices1,
+                                                                const REALTYPE* partials2,
+                                                                const REALTYPE* matrices2,
+                                                                int startPattern,
+                                                                int endPattern) {
+    int matrixIncr = kStateCount;
+
+    // increment for the extra column at the end
+    matrixIncr += T_PAD;
+
+    std::vector<REALTYPE> siblingSums(kStateCount);
+
+    for (int l = 0; l < kCategoryCount; l++) {
+        int v = l*kPartialsPaddedStateCount*kPatternCount + kPartialsPaddedStateCount*startPattern;
+        int matrixOffset = l*kMatrixSize;
+        for (int k = startPattern; k < endPattern; k++) {
+            for (int i = 0; i < kStateCount; i++) {
+                const REALTYPE* matrices2Ptr = matrices2 + matrixOffset + i * matrixIncr;
+                REALTYPE sum = 0.0;
+                for (int j = 0; j < kStateCount; j++) {
+                    sum += matrices2Ptr[j] * partials2[v + j];
+                }
+                siblingSums[i] = sum * partials1[v + i];
+            }
+            for (int j = 0; j < kStateCount; j++) {
+                const REALTYPE* matrices1Ptr = matrices1 + matrixOffset + j;
+                REALTYPE sum = 0.0;
+                for (int i = 0; i < kStateCount; i++) {
+                    sum += matrices1Ptr[i * matrixIncr] * siblingSums[i];
+                }
+                destP[v + j] = sum;
+            }
+            for (int j = kStateCount; j < kPartialsPaddedStateCount; j++) {
+                destP[v + j] = 0.0;
+            }
+            v += kPartialsPaddedStateCount;
+        }
+    }
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcPrePartialsStates(REALTYPE* destP,
+                                                              const REALTYPE* partials1,
+                                                              const REALTYPE* matrices1,
+                                                              const int* states2,
+                                                              const REALTYPE* matrices2,
+                                                              int startPattern,
+                                                              int endPattern) {
+    int matrixIncr = kStateCount;
+
+    // increment for the extra column at the end
+    matrixIncr += T_PAD;
+
+    std::vector<REALTYPE> siblingSums(kStateCount);
+
+    for (int l = 0; l < kCategoryCount; l++) {
+        int v = l*kPartialsPaddedStateCount*kPatternCount + kPartialsPaddedStateCount*startPattern;
+        int matrixOffset = l*kMatrixSize;
+        for (int k = startPattern; k < endPattern; k++) {
+            // ambiguous states pick up the padded column of ones
+            const int state2 = states2[k];
+            for (int i = 0; i < kStateCount; i++) {
+                siblingSums[i] = matrices2[matrixOffset + i * matrixIncr + state2] * partials1[v + i];
+            }
+            for (int j = 0; j < kStateCount; j++) {
+                const REALTYPE* matrices1Ptr = matrices1 + matrixOffset + j;
+                REALTYPE sum = 0.0;
+                for (int i = 0; i < kStateCount; i++) {
+                    sum += matrices1Ptr[i * matrixIncr] * siblingSums[i];
+                }
+                destP[v + j] = sum;
+            }
+            for (int j = kStateCount; j < kPartialsPaddedStateCount; j++) {
+                destP[v + j] = 0.0;
+            }
+            v += kPartialsPaddedStateCount;
+        }
+    }
+}
+
+/*
+ * Per-pattern derivative of the site log likelihood with respect to the
+ * length of an edge, given the post-order partials below and the pre-order
+ * partials above it and the differential matrices D (dP/dt = D P):
+ *   d = sum_l w_l pre_l' D_l post_l / sum_l w_l pre_l' post_l
+ * Scale factors are constant across categories and cancel in the ratio.
+ */
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeDerivativesPartials(REALTYPE* outDerivatives,
+                                                                    const REALTYPE* postPartials,
+                                                                    const REALTYPE* prePartials,
+                                                                    const REALTYPE* derivativeMatrices,
+                                                                    const REALTYPE* categoryWeights,
+                                                                    int startPattern,
+                                                                    int endPattern) {
+    int matrixIncr = kStateCount;
+
+    // increment for the extra column at the end
+    matrixIncr += T_PAD;
+
+    for (int k = startPattern; k < endPattern; k++) {
+        REALTYPE numerator = 0.0;
+        REALTYPE denominator = 0.0;
+        for (int l = 0; l < kCategoryCount; l++) {
+            int v = l*kPartialsPaddedStateCount*kPatternCount + kPartialsPaddedStateCount*k;
+            const REALTYPE* matricesPtr = derivativeMatrices + l*kMatrixSize;
+            REALTYPE sumNumerator = 0.0;
+            REALTYPE sumDenominator = 0.0;
+            for (int i = 0; i < kStateCount; i++) {
+                REALTYPE sum = 0.0;
+                for (int j = 0; j < kStateCount; j++) {
+                    sum += matricesPtr[j] * postPartials[v + j];
+                }
+                sumNumerator += prePartials[v + i] * sum;
+                sumDenominator += prePartials[v + i] * postPartials[v + i];
+                matricesPtr += matrixIncr;
+            }
+            numerator += categoryWeights[l] * sumNumerator;
+            denominator += categoryWeights[l] * sumDenominator;
+        }
+        outDerivatives[k] = numerator / denominator;
+    }
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeDerivativesStates(REALTYPE* outDerivatives,
+                                                                  const int* postStates,
+                                                                  const REALTYPE* prePartials,
+                                                                  const REALTYPE* derivativeMatrices,
+                                                                  const REALTYPE* categoryWeights,
+                                                                  int startPattern,
+                                                                  int endPattern) {
+    int matrixIncr = kStateCount;
+
+    // increment for the extra column at the end
+    matrixIncr += T_PAD;
+
+    for (int k = startPattern; k < endPattern; k++) {
+        const int state = postStates[k];
+        REALTYPE numerator = 0.0;
+        REALTYPE denominator = 0.0;
+        for (int l = 0; l < kCategoryCount; l++) {
+            int v = l*kPartialsPaddedStateCount*kPatternCount + kPartialsPaddedStateCount*k;
+            const REALTYPE* matricesPtr = derivativeMatrices + l*kMatrixSize;
+            REALTYPE sumNumerator = 0.0;
+            REALTYPE sumDenominator = 0.0;
+            for (int i = 0; i < kStateCount; i++) {
+                sumNumerator += prePartials[v + i] * matricesPtr[i * matrixIncr + state];
+                if (state == i || state >= kStateCount)
+                    sumDenominator += prePartials[v + i];
+            }
+            numerator += categoryWeights[l] * sumNumerator;
+            denominator += categoryWeights[l] * sumDenominator;
+        }
+        outDerivatives[k] = numerator / denominator;
+    }
+}
+
 BEAGLE_CPU_TEMPLATE
 void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcPartialsPartialsFixedScaling(REALTYPE* destP,
                                                                          const REALTYPE* partials1,
@@ -3748,6 +6471,318 @@ void* BeagleCPUImpl<BEAGLE_CPU_GENERIC>::mallocAligned(size_t size) {
     return ptr;
 }
 
+/*
+ * True if the buffer belongs to the attached shared tip data and so must be
+ * neither written to nor freed by this instance.
+ */
+BEAGLE_CPU_TEMPLATE
+bool BeagleCPUImpl<BEAGLE_CPU_GENERIC>::isSharedTipBuffer(int bufferIndex,
+                                                          const void* buffer) {
+    if (gTipData == NULL || buffer == NULL || bufferIndex >= gTipData->getTipCount())
+        return false;
+    return gTipData->isLayoutBuffer(buffer);
+}
+
+/*
+ * Moves the checkpointed buffer of a slot aside on the first write after
+ * setCheckpoint and puts a spare buffer in its place. Returns false if the
+ * slot was already written since the checkpoint.
+ */
+BEAGLE_CPU_TEMPLATE
+bool BeagleCPUImpl<BEAGLE_CPU_GENERIC>::checkpointBuffer(REALTYPE** buffers,
+                                                         int index,
+                                                         int size,
+                                                         bool copyContents) {
+    BufferSlot slot(buffers, index);
+    if (gCheckpointBuffers.find(slot) != gCheckpointBuffers.end())
+        return false;
+
+    REALTYPE* spare;
+    std::vector<REALTYPE*>& spares = gSpareBuffers[buffers];
+    if (!spares.empty()) {
+        spare = spares.back();
+        spares.pop_back();
+    } else {
+        spare = (REALTYPE*) mallocAligned(sizeof(REALTYPE) * size);
+        if (spare == NULL)
+            throw std::bad_alloc();
+    }
+
+    if (copyContents && buffers[index] != NULL)
+        memcpy(spare, buffers[index], sizeof(REALTYPE) * size);
+
+    gCheckpointBuffers[slot] = buffers[index];
+    buffers[index] = spare;
+
+    return true;
+}
+
+/*
+ * Keeps a buffer that left a table for the next checkpoint, unless it is
+ * still used by shared tip data or a clone.
+ */
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::recycleBuffer(REALTYPE** buffers,
+                                                      int index,
+                                                      REALTYPE* buffer) {
+    if (buffer == NULL)
+        return;
+    if (buffers == gPartials && isSharedTipBuffer(index, buffer))
+        return;
+    if (releaseSharedBuffer(buffer))
+        return;
+    gSpareBuffers[buffers].push_back(buffer);
+}
+
+/*
+ * Gives up this instance's claim on a buffer shared with clones; returns true
+ * if a clone still uses it, in which case it must not be freed.
+ */
+BEAGLE_CPU_TEMPLATE
+bool BeagleCPUImpl<BEAGLE_CPU_GENERIC>::releaseSharedBuffer(const void* buffer) {
+    return (gSharedBuffers != NULL && gSharedBuffers->release(buffer));
+}
+
+/*
+ * Gives this instance a private copy of buffers[index] before it is written,
+ * if the buffer is still shared with a clone or belongs to the checkpoint.
+ * copyContents can be false when the caller overwrites the whole buffer.
+ */
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::unshareBuffer(REALTYPE** buffers,
+                                                      int index,
+                                                      int size,
+                                                      bool copyContents) {
+    if (buffers == gTransitionMatrices && !gMatrixCacheKeys.empty())
+        gMatrixCacheKeys[index] = MatrixCacheKey(BEAGLE_OP_NONE, 0.0);
+
+    if (kIncrementalUpdates)
+        touchBuffer(buffers, index);
+
+    if (kCheckpointActive && checkpointBuffer(buffers, index, size, copyContents))
+        return;
+
+    if (gSharedBuffers == NULL || buffers[index] == NULL || !gSharedBuffers->isShared(buffers[index]))
+        return;
+
+    REALTYPE* privateBuffer = (REALTYPE*) mallocAligned(sizeof(REALTYPE) * size);
+    if (gSharedBuffers->release(buffers[index], (copyContents ? privateBuffer : NULL), sizeof(REALTYPE) * size))
+        buffers[index] = privateBuffer;
+    else
+        free(privateBuffer); // the clones gave the buffer up in the meantime
+}
+
+/*
+ * Unshares everything a list of partials operations writes, before the
+ * operations are handed out to threads.
+ */
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::unsharePartialsOperations(const int* operations,
+                                                                  int count,
+                                                                  int cumulativeScaleIndex,
+                                                                  bool byPartition) {
+    if (gSharedBuffers == NULL && !kCheckpointActive && !kIncrementalUpdates)
+        return;
+
+    const int numOps = (byPartition ? BEAGLE_PARTITION_OP_COUNT : BEAGLE_OP_COUNT);
+
+    if (cumulativeScaleIndex != BEAGLE_OP_NONE && !(kFlags & BEAGLE_FLAG_SCALING_AUTO))
+        unshareBuffer(gScaleBuffers, cumulativeScaleIndex, kPaddedPatternCount, true);
+
+    for (int op = 0; op < count; op++) {
+        const int parIndex = operations[op * numOps];
+        const int writeScalingIndex = operations[op * numOps + 1];
+
+        // partition operations only write part of each buffer
+        unshareBuffer(gPartials, parIndex, kPartialsSize, byPartition);
+
+        if (kFlags & BEAGLE_FLAG_SCALING_AUTO)
+            continue;
+
+        if (kFlags & BEAGLE_FLAG_SCALING_ALWAYS)
+            unshareBuffer(gScaleBuffers, parIndex - kTipCount, kPaddedPatternCount, byPartition);
+        else if (writeScalingIndex >= 0)
+            unshareBuffer(gScaleBuffers, writeScalingIndex, kPaddedPatternCount, byPartition);
+
+        if (byPartition && operations[op * numOps + 8] != BEAGLE_OP_NONE)
+            unshareBuffer(gScaleBuffers, operations[op * numOps + 8], kPaddedPatternCount, true);
+    }
+}
+
+/*
+ * Backs all internal partials buffers with a single unlinked scratch file so
+ * that the kernel can page them to disk when they do not fit in memory.
+ * Each buffer starts on a page boundary, which also satisfies mallocAligned().
+ */
+BEAGLE_CPU_TEMPLATE
+bool BeagleCPUImpl<BEAGLE_CPU_GENERIC>::mapPartialsBuffers() {
+#ifdef HAVE_SYS_MMAN_H
+    const size_t pageSize = (size_t) sysconf(_SC_PAGESIZE);
+    const size_t bufferBytes = sizeof(REALTYPE) * kPartialsSize;
+    kMappedPartialsStride = ((bufferBytes + pageSize - 1) / pageSize) * pageSize;
+    kMappedPartialsBytes = kMappedPartialsStride * kInternalPartialsBufferCount;
+
+    if (kMappedPartialsBytes == 0)
+        return false;
+
+    const char* scratchDir = getenv("BEAGLE_SCRATCH_DIR");
+    if (scratchDir == NULL)
+        scratchDir = getenv("TMPDIR");
+    if (scratchDir == NULL)
+        scratchDir = "/tmp";
+
+    std::string scratchFile = std::string(scratchDir) + "/beagle-partials-XXXXXX";
+    std::vector<char> scratchName(scratchFile.begin(), scratchFile.end());
+    scratchName.push_back('\0');
+
+    int fd = mkstemp(&scratchName[0]);
+    if (fd == -1)
+        return false;
+
+    // the file lives on only through the mapping, so nothing is left behind on exit
+    unlink(&scratchName[0]);
+
+    if (ftruncate(fd, (off_t) kMappedPartialsBytes) != 0) {
+        close(fd);
+        return false;
+    }
+
+    void* map = mmap(NULL, kMappedPartialsBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED)
+        return false;
+
+#ifdef HAVE_MADVISE
+    madvise(map, kMappedPartialsBytes, MADV_SEQUENTIAL);
+#endif
+
+    gMappedPartials = (char*) map;
+
+    for (int i = kTipCount; i < kBufferCount; i++)
+        gPartials[i] = (REALTYPE*) (gMappedPartials + (i - kTipCount) * kMappedPartialsStride);
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::unmapPartialsBuffers() {
+#ifdef HAVE_SYS_MMAN_H
+    for (int i = kTipCount; i < kBufferCount; i++)
+        gPartials[i] = NULL;
+
+    munmap(gMappedPartials, kMappedPartialsBytes);
+    gMappedPartials = NULL;
+#endif
+}
+
+/*
+ * Hints the kernel to page in the child partials of the next
+ * BEAGLE_CPU_MAPPED_PREFETCH_DEPTH operations, so that reading them from the
+ * scratch file overlaps with computing the current operation.
+ */
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::prefetchMappedPartials(const int* operations,
+                                                               int op,
+                                                               int count,
+                                                               int numOps) {
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MADVISE)
+    int firstOp = (op == 0 ? 0 : op + BEAGLE_CPU_MAPPED_PREFETCH_DEPTH);
+    int lastOp = op + BEAGLE_CPU_MAPPED_PREFETCH_DEPTH;
+    if (lastOp >= count)
+        lastOp = count - 1;
+
+    for (int i = firstOp; i <= lastOp; i++) {
+        const int children[2] = { operations[i * numOps + 3], operations[i * numOps + 5] };
+        for (int c = 0; c < 2; c++) {
+            if (children[c] >= kTipCount && children[c] < kBufferCount) {
+                madvise(gMappedPartials + (children[c] - kTipCount) * kMappedPartialsStride,
+                        kMappedPartialsStride, MADV_WILLNEED);
+            }
+        }
+    }
+#endif
+}
+
+/*
+ * Number of pattern partitions used for automatic C++ threading, or 0 if the
+ * problem is too small to benefit from it.
+ */
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getAutoPartitionCount(int stateCount,
+                                                             int patternCount,
+                                                             int* minPatternCount) {
+    int hardwareThreads = std::thread::hardware_concurrency();
+    if (stateCount <= 4) {
+        *minPatternCount = BEAGLE_CPU_ASYNC_MIN_PATTERN_COUNT_LOW;
+        if (hardwareThreads < BEAGLE_CPU_ASYNC_HW_THREAD_COUNT_THRESHOLD) {
+            *minPatternCount = BEAGLE_CPU_ASYNC_MIN_PATTERN_COUNT_HIGH;
+        } else if (patternCount < BEAGLE_CPU_ASYNC_LIMIT_PATTERN_COUNT) {
+            hardwareThreads = BEAGLE_CPU_ASYNC_HW_THREAD_COUNT_THRESHOLD;
+        }
+    } else {
+        // todo: assess minimum pattern count for efficient auto-threading
+        //       for higher state-count values
+        *minPatternCount = 2;
+    }
+
+    int partitionCount = 0;
+    if (patternCount >= *minPatternCount && hardwareThreads > 2) {
+        partitionCount = patternCount/(*minPatternCount/2);
+        if (partitionCount > hardwareThreads/2) {
+            partitionCount = hardwareThreads/2;
+        }
+    }
+
+    return partitionCount;
+}
+
+BEAGLE_CPU_TEMPLATE
+long long BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getEigenDecompositionBytes(int eigenDecompositionCount,
+                                                                        int stateCount,
+                                                                        long flags) {
+    const long long stateBytes = (long long) sizeof(REALTYPE) * stateCount;
+    if (flags & BEAGLE_FLAG_EIGEN_COMPLEX) {
+        // EigenDecompositionSquare: eigenvectors, inverse eigenvectors and (complex) eigenvalues
+        const long long eigenValuesBytes = stateBytes * 2;
+        return (3 * sizeof(REALTYPE*) + 2 * stateBytes * stateCount + eigenValuesBytes) * eigenDecompositionCount +
+               stateBytes * stateCount;
+    } else {
+        // EigenDecompositionCube: precomputed eigenvector products and eigenvalues
+        return (2 * sizeof(REALTYPE*) + stateBytes * stateCount * stateCount + stateBytes) * eigenDecompositionCount +
+               3 * stateBytes;
+    }
+}
+
+BEAGLE_CPU_TEMPLATE
+long long BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getThreadingBytes(int threadCount,
+                                                               int bufferCount,
+                                                               int patternCount,
+                                                               int partitionCount,
+                                                               bool autoPartitioning,
+                                                               bool autoRootPartitioning) {
+    long long bytes = 0;
+
+    if (partitionCount > 0)
+        bytes += (long long) sizeof(int) * (patternCount + partitionCount + 1);
+
+    if (threadCount > 0) {
+        bytes += (sizeof(threadData) + sizeof(std::shared_future<void>) + sizeof(int*) + sizeof(int) +
+                  (long long) sizeof(int) * BEAGLE_PARTITION_OP_COUNT * bufferCount * partitionCount) * threadCount;
+    }
+
+    if (autoPartitioning) {
+        bytes += (long long) sizeof(int) * bufferCount * partitionCount * BEAGLE_PARTITION_OP_COUNT;
+        if (autoRootPartitioning)
+            bytes += (sizeof(int) + sizeof(double)) * partitionCount;
+    }
+
+    return bytes;
+}
+
 BEAGLE_CPU_TEMPLATE
 void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::threadWaiting(threadData* tData)
 {
@@ -3821,6 +6856,25 @@ BeagleImpl* BeagleCPUImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::createImpl(int tip
 }
 
 
+BEAGLE_CPU_FACTORY_TEMPLATE
+int BeagleCPUImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::estimateMemoryUsage(int tipCount,
+                                                                          int partialsBufferCount,
+                                                                          int compactBufferCount,
+                                                                          int stateCount,
+                                                                          int patternCount,
+                                                                          int eigenBufferCount,
+                                                                          int matrixBufferCount,
+                                                                          int categoryCount,
+                                                                          int scaleBufferCount,
+                                                                          long preferenceFlags,
+                                                                          long requirementFlags,
+                                                                          BeagleMemoryUsage* outMemoryUsage) {
+    return BeagleCPUImpl<REALTYPE, T_PAD_DEFAULT, P_PAD_DEFAULT>::estimateMemoryUsage(tipCount,
+                partialsBufferCount, compactBufferCount, stateCount, patternCount, eigenBufferCount,
+                matrixBufferCount, categoryCount, scaleBufferCount, preferenceFlags, requirementFlags,
+                outMemoryUsage);
+}
+
 BEAGLE_CPU_FACTORY_TEMPLATE
 const char* BeagleCPUImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getName() {
     return getBeagleCPUName<BEAGLE_CPU_FACTORY_GENERIC>();
@@ -3837,6 +6891,9 @@ const long BeagleCPUImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getFlags() {
                  BEAGLE_FLAG_EIGEN_COMPLEX | BEAGLE_FLAG_EIGEN_REAL |
                  BEAGLE_FLAG_INVEVEC_STANDARD | BEAGLE_FLAG_INVEVEC_TRANSPOSED |
                  BEAGLE_FLAG_FRAMEWORK_CPU;
+#ifdef HAVE_SYS_MMAN_H
+    flags |= BEAGLE_FLAG_PARTIALS_MAPPED;
+#endif
     if (DOUBLE_PRECISION)
         flags |= BEAGLE_FLAG_PRECISION_DOUBLE;
     else
@@ -29,6 +29,9 @@ Plugin("CPU", "CPU")
                                          BEAGLE_FLAG_EIGEN_COMPLEX | BEAGLE_FLAG_EIGEN_REAL |
                                          BEAGLE_FLAG_INVEVEC_STANDARD | BEAGLE_FLAG_INVEVEC_TRANSPOSED |
                                          BEAGLE_FLAG_FRAMEWORK_CPU;
+#ifdef HAVE_SYS_MMAN_H
+        resource.supportFlags |= BEAGLE_FLAG_PARTIALS_MAPPED;
+#endif
         resource.requiredFlags = BEAGLE_FLAG_FRAMEWORK_CPU;
 	beagleResources.push_back(resource);
 
@@ -97,6 +97,8 @@ public:
 protected:
     virtual int getPaddedPatternsModulus();
 
+    virtual BeagleCPUImpl<BEAGLE_CPU_SSE_FLOAT>* newCopy();
+
 private:
 	virtual void calcStatesStates(float* destP,
                                      const int* states1,
@@ -171,6 +173,8 @@ public:
 protected:
     virtual int getPaddedPatternsModulus();
 
+    virtual BeagleCPUImpl<BEAGLE_CPU_SSE_DOUBLE>* newCopy();
+
 private:
 	virtual void calcStatesStates(double* destP,
                                 const int* states1,
@@ -240,6 +244,19 @@ public:
                                    long requirementFlags,
                                    int* errorCode);
 
+    virtual int estimateMemoryUsage(int tipCount,
+                                    int partialsBufferCount,
+                                    int compactBufferCount,
+                                    int stateCount,
+                                    int patternCount,
+                                    int eigenBufferCount,
+                                    int matrixBufferCount,
+                                    int categoryCount,
+                                    int scaleBufferCount,
+                                    long preferenceFlags,
+                                    long requirementFlags,
+                                    BeagleMemoryUsage* outMemoryUsage);
+
     virtual const char* getName();
     virtual const long getFlags();
 };
@@ -537,11 +537,21 @@ int BeagleCPUSSEImpl<BEAGLE_CPU_SSE_DOUBLE>::getPaddedPatternsModulus() {
 	return 1;  // We currently do not vectorize across patterns
 }
     
+BEAGLE_CPU_SSE_TEMPLATE
+BeagleCPUImpl<BEAGLE_CPU_SSE_FLOAT>* BeagleCPUSSEImpl<BEAGLE_CPU_SSE_FLOAT>::newCopy() {
+    return new BeagleCPUSSEImpl<BEAGLE_CPU_SSE_FLOAT>(*this);
+}
+
 BEAGLE_CPU_SSE_TEMPLATE
 const char* BeagleCPUSSEImpl<BEAGLE_CPU_SSE_FLOAT>::getName() {
 	return  getBeagleCPUSSEName<float>();
 }
 
+BEAGLE_CPU_SSE_TEMPLATE
+BeagleCPUImpl<BEAGLE_CPU_SSE_DOUBLE>* BeagleCPUSSEImpl<BEAGLE_CPU_SSE_DOUBLE>::newCopy() {
+    return new BeagleCPUSSEImpl<BEAGLE_CPU_SSE_DOUBLE>(*this);
+}
+
 BEAGLE_CPU_SSE_TEMPLATE
 const char* BeagleCPUSSEImpl<BEAGLE_CPU_SSE_DOUBLE>::getName() {
     return  getBeagleCPUSSEName<double>();
@@ -635,6 +645,36 @@ BeagleImpl* BeagleCPUSSEImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::createImpl(int
     return NULL;
 }
 
+BEAGLE_CPU_FACTORY_TEMPLATE
+int BeagleCPUSSEImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::estimateMemoryUsage(int tipCount,
+                                             int partialsBufferCount,
+                                             int compactBufferCount,
+                                             int stateCount,
+                                             int patternCount,
+                                             int eigenBufferCount,
+                                             int matrixBufferCount,
+                                             int categoryCount,
+                                             int scaleBufferCount,
+                                             long preferenceFlags,
+                                             long requirementFlags,
+                                             BeagleMemoryUsage* outMemoryUsage) {
+
+    if (!CPUSupportsSSE())
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+
+    if (stateCount & 1) { // is odd
+        return BeagleCPUSSEImpl<REALTYPE, T_PAD_SSE_ODD, P_PAD_SSE_ODD>::estimateMemoryUsage(tipCount,
+                partialsBufferCount, compactBufferCount, stateCount, patternCount, eigenBufferCount,
+                matrixBufferCount, categoryCount, scaleBufferCount, preferenceFlags, requirementFlags,
+                outMemoryUsage);
+    } else {
+        return BeagleCPUSSEImpl<REALTYPE, T_PAD_SSE_EVEN, P_PAD_SSE_EVEN>::estimateMemoryUsage(tipCount,
+                partialsBufferCount, compactBufferCount, stateCount, patternCount, eigenBufferCount,
+                matrixBufferCount, categoryCount, scaleBufferCount, preferenceFlags, requirementFlags,
+                outMemoryUsage);
+    }
+}
+
 BEAGLE_CPU_FACTORY_TEMPLATE
 const char* BeagleCPUSSEImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getName() {
 	return getBeagleCPUSSEName<BEAGLE_CPU_FACTORY_GENERIC>();
@@ -49,6 +49,9 @@ public:
 					   	};
 	
 	virtual ~EigenDecomposition() {};
+
+    // returns an independent copy holding the same decompositions
+    virtual EigenDecomposition<BEAGLE_CPU_EIGEN_GENERIC>* clone() = 0;
 	
     // sets the Eigen decomposition for a given matrix
     //
@@ -76,6 +79,12 @@ public:
                                  REALTYPE** transitionMatrices,
                                  int count) = 0;
 
+    // returns the eigen values and C[i][j][k] = V[i][k] * Vinv[k][j] of a decomposition,
+    // or false if the decomposition is not stored in this form
+    virtual bool getEigenSystem(int eigenIndex,
+                                const REALTYPE** outEigenValues,
+                                const REALTYPE** outCMatrix) { return false; }
+
 };
 
 }
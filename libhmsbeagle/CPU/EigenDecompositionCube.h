@@ -35,6 +35,8 @@ public:
                            long flags);
 	
 	virtual ~EigenDecompositionCube();
+
+    virtual EigenDecomposition<BEAGLE_CPU_EIGEN_GENERIC>* clone();
 	
     virtual void setEigenDecomposition(int eigenIndex,
                               const double* inEigenVectors,
@@ -49,6 +51,10 @@ public:
                                  const double* categoryRates,
                                  REALTYPE** transitionMatrices,
                                  int count);
+
+    virtual bool getEigenSystem(int eigenIndex,
+                                const REALTYPE** outEigenValues,
+                                const REALTYPE** outCMatrix);
 	
 };
 
@@ -65,6 +65,18 @@ EigenDecompositionCube<BEAGLE_CPU_EIGEN_GENERIC>::~EigenDecompositionCube() {
 	free(secondDerivTmp);
 }
 
+BEAGLE_CPU_EIGEN_TEMPLATE
+EigenDecomposition<BEAGLE_CPU_EIGEN_GENERIC>* EigenDecompositionCube<BEAGLE_CPU_EIGEN_GENERIC>::clone() {
+    EigenDecompositionCube<BEAGLE_CPU_EIGEN_GENERIC>* copy =
+        new EigenDecompositionCube<BEAGLE_CPU_EIGEN_GENERIC>(kEigenDecompCount, kStateCount,
+                                                             kCategoryCount, kFlags);
+    for (int i = 0; i < kEigenDecompCount; i++) {
+        memcpy(copy->gCMatrices[i], gCMatrices[i], sizeof(REALTYPE) * kStateCount * kStateCount * kStateCount);
+        memcpy(copy->gEigenValues[i], gEigenValues[i], sizeof(REALTYPE) * kStateCount);
+    }
+    return copy;
+}
+
 BEAGLE_CPU_EIGEN_TEMPLATE
 void EigenDecompositionCube<BEAGLE_CPU_EIGEN_GENERIC>::setEigenDecomposition(int eigenIndex,
 										           const double* inEigenVectors,
@@ -252,6 +264,15 @@ if (T_PAD != 0) {
 	}
 }
 
+BEAGLE_CPU_EIGEN_TEMPLATE
+bool EigenDecompositionCube<BEAGLE_CPU_EIGEN_GENERIC>::getEigenSystem(int eigenIndex,
+                                                                    const REALTYPE** outEigenValues,
+                                                                    const REALTYPE** outCMatrix) {
+    *outEigenValues = gEigenValues[eigenIndex];
+    *outCMatrix = gCMatrices[eigenIndex];
+    return true;
+}
+
 } // cpu
 } // beagle
 
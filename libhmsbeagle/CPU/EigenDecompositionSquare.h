@@ -37,6 +37,8 @@ public:
 
 	virtual ~EigenDecompositionSquare();
 
+    virtual EigenDecomposition<BEAGLE_CPU_EIGEN_GENERIC>* clone();
+
     virtual void setEigenDecomposition(int eigenIndex,
                               const double* inEigenVectors,
                               const double* inInverseEigenVectors,
@@ -76,6 +76,19 @@ EigenDecompositionSquare<BEAGLE_CPU_EIGEN_GENERIC>::~EigenDecompositionSquare()
 	free(gEigenValues);
 	free(matrixTmp);
 }
+
+BEAGLE_CPU_EIGEN_TEMPLATE
+EigenDecomposition<BEAGLE_CPU_EIGEN_GENERIC>* EigenDecompositionSquare<BEAGLE_CPU_EIGEN_GENERIC>::clone() {
+    EigenDecompositionSquare<BEAGLE_CPU_EIGEN_GENERIC>* copy =
+        new EigenDecompositionSquare<BEAGLE_CPU_EIGEN_GENERIC>(kEigenDecompCount, kStateCount,
+                                                               kCategoryCount, kFlags);
+    for (int i = 0; i < kEigenDecompCount; i++) {
+        memcpy(copy->gEMatrices[i], gEMatrices[i], sizeof(REALTYPE) * kStateCount * kStateCount);
+        memcpy(copy->gIMatrices[i], gIMatrices[i], sizeof(REALTYPE) * kStateCount * kStateCount);
+        memcpy(copy->gEigenValues[i], gEigenValues[i], sizeof(REALTYPE) * kEigenValuesSize);
+    }
+    return copy;
+}
     
 /**
  * @brief Transposes a square matrix in place
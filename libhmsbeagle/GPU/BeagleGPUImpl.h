@@ -229,13 +229,41 @@ public:
     
     int getInstanceDetails(BeagleInstanceDetails* retunInfo);
 
+    int getMemoryUsage(BeagleMemoryUsage* outMemoryUsage);
+
+    int setPerformanceCounters(bool enabled);
+
+    int getPerformanceCounters(BeagleKernelCounters* outCounters,
+                               int count);
+
+    int resetPerformanceCounters();
+
+    int startTrace(const char* fileName,
+                   int eventsPerThread);
+
+    int writeTrace();
+
+    int stopTrace();
+
+    BeagleImpl* clone();
+
+    int setCheckpoint();
+
+    int commitCheckpoint();
+
+    int rollbackCheckpoint();
+
     int setCPUThreadCount(int threadCount);
 
+    int getCPUThreadCount(int* outThreadCount);
+
     int setTipStates(int tipIndex,
                      const int* inStates);
 
     int setTipPartials(int tipIndex,
                        const double* inPartials);
+
+    int attachTipData(BeagleTipData* tipData);
     
     int setPartials(int bufferIndex,
                     const double* inPartials);
@@ -257,6 +285,8 @@ public:
     
     int setPatternWeights(const double* inPatternWeights);
 
+    int setZeroWeightPatternSkipping(bool enabled);
+
     int setPatternPartitions(int partitionCount,
                              const int* inPatternPartitions);
     
@@ -298,6 +328,11 @@ public:
                                                    const int* probabilityIndices,
                                                    const int* firstDerivativeIndices,
                                                    const int* secondDerivativeIndices,
+    int setTransitionMatrixCacheSize(int cacheSize);
+
+    int getTransitionMatrixCacheStatistics(long* outHitCount,
+                                           long* outMissCount);
+
                                                    const double* edgeLengths,
                                                    int count);
     
@@ -307,6 +342,70 @@ public:
 
     int updatePartialsByPartition(const int* operations,
                                   int operationCount);
+
+    int setIncrementalUpdates(bool enabled);
+
+    int getIncrementalUpdateStatistics(int* outOperationCount,
+                                       int* outSkippedCount);
+
+    int setRootPrePartials(const int* bufferIndices,
+                           const int* stateFrequenciesIndices,
+                           int count);
+
+    int updatePrePartials(const int* operations,
+                          int operationCount,
+                          int cumulativeScalingIndex);
+
+    int calculateEdgeSumtable(int parentBufferIndex,
+                              int childBufferIndex,
+                              int eigenIndex,
+                              int categoryWeightsIndex,
+                              int stateFrequenciesIndex,
+                              int cumulativeScaleIndex);
+
+    int calculateEdgeSumtableLogLikelihood(double edgeLength,
+                                           double* outSumLogLikelihood,
+                                           double* outSumFirstDerivative,
+                                           double* outSumSecondDerivative);
+
+    int optimizeEdgeLength(double* inOutEdgeLength,
+                           double minEdgeLength,
+                           double maxEdgeLength,
+                           double tolerance,
+                           int maxIterations,
+                           double* outSumLogLikelihood);
+
+    int calculateInsertionLogLikelihoods(const int* postBufferIndices,
+                                         const int* preBufferIndices,
+                                         const int* cumulativeScaleIndices,
+                                         int count,
+                                         int subtreeBufferIndex,
+                                         int subtreeMatrixIndex,
+                                         int categoryWeightsIndex,
+                                         double* outSumLogLikelihoods);
+
+    int optimizeInsertionLogLikelihoods(const int* postBufferIndices,
+                                        const int* preBufferIndices,
+                                        const int* cumulativeScaleIndices,
+                                        int count,
+                                        int subtreeBufferIndex,
+                                        int eigenIndex,
+                                        int categoryWeightsIndex,
+                                        double* inOutPendantLengths,
+                                        double minEdgeLength,
+                                        double maxEdgeLength,
+                                        double tolerance,
+                                        int maxIterations,
+                                        double* outSumLogLikelihoods);
+
+    int calculateEdgeDerivatives(const int* postBufferIndices,
+                                 const int* preBufferIndices,
+                                 const int* derivativeMatrixIndices,
+                                 const int* categoryWeightsIndices,
+                                 int count,
+                                 double* outDerivatives,
+                                 double* outSumDerivatives,
+                                 double* outSumSquaredDerivatives);
     
     int waitForPartials(const int* destinationPartials,
                         int destinationPartialsCount);
@@ -355,6 +454,31 @@ public:
                                                int count,
                                                double* outSumLogLikelihoodByPartition,
                                                double* outSumLogLikelihood);
+
+    int evaluateRootLogLikelihood(int eigenIndex,
+                                  const int* probabilityIndices,
+                                  const double* edgeLengths,
+                                  int matrixCount,
+                                  const int* operations,
+                                  int operationCount,
+                                  int rootBufferIndex,
+                                  int categoryWeightsIndex,
+                                  int stateFrequenciesIndex,
+                                  int cumulativeScaleIndex,
+                                  double* outSumLogLikelihood);
+
+    int evaluateRootLogLikelihoods(const BeagleEvaluationJob* jobs,
+                                   int jobCount,
+                                   double* outSumLogLikelihoods,
+                                   int* outReturnCodes);
+
+    int calculateRootLogLikelihoodsForWeights(int bufferIndex,
+                                              int categoryWeightsIndex,
+                                              int stateFrequenciesIndex,
+                                              int cumulativeScaleIndex,
+                                              const double* inPatternWeights,
+                                              int weightVectorCount,
+                                              double* outSumLogLikelihoods);
     
     int calculateEdgeLogLikelihoods(const int* parentBufferIndices,
                                     const int* childBufferIndices,
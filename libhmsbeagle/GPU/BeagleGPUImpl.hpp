@@ -829,6 +829,151 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::getInstanceDetails(BeagleInstanceDetails*
     return BEAGLE_SUCCESS;
 }
 
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::getMemoryUsage(BeagleMemoryUsage* outMemoryUsage) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tEntering BeagleGPUImpl::getMemoryUsage\n");
+#endif
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tLeaving  BeagleGPUImpl::getMemoryUsage\n");
+#endif
+
+    return BEAGLE_ERROR_NO_IMPLEMENTATION;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setPerformanceCounters(bool /*enabled*/) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tEntering BeagleGPUImpl::setPerformanceCounters\n");
+#endif
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tLeaving  BeagleGPUImpl::setPerformanceCounters\n");
+#endif
+
+    return BEAGLE_ERROR_NO_IMPLEMENTATION;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::getPerformanceCounters(BeagleKernelCounters* /*outCounters*/,
+                                                              int /*count*/) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tEntering BeagleGPUImpl::getPerformanceCounters\n");
+#endif
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tLeaving  BeagleGPUImpl::getPerformanceCounters\n");
+#endif
+
+    return BEAGLE_ERROR_NO_IMPLEMENTATION;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::resetPerformanceCounters() {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tEntering BeagleGPUImpl::resetPerformanceCounters\n");
+#endif
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tLeaving  BeagleGPUImpl::resetPerformanceCounters\n");
+#endif
+
+    return BEAGLE_ERROR_NO_IMPLEMENTATION;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::startTrace(const char* /*fileName*/,
+                                                  int /*eventsPerThread*/) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tEntering BeagleGPUImpl::startTrace\n");
+#endif
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tLeaving  BeagleGPUImpl::startTrace\n");
+#endif
+
+    return BEAGLE_ERROR_NO_IMPLEMENTATION;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::writeTrace() {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tEntering BeagleGPUImpl::writeTrace\n");
+#endif
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tLeaving  BeagleGPUImpl::writeTrace\n");
+#endif
+
+    return BEAGLE_ERROR_NO_IMPLEMENTATION;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::stopTrace() {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tEntering BeagleGPUImpl::stopTrace\n");
+#endif
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tLeaving  BeagleGPUImpl::stopTrace\n");
+#endif
+
+    return BEAGLE_ERROR_NO_IMPLEMENTATION;
+}
+
+BEAGLE_GPU_TEMPLATE
+BeagleImpl* BeagleGPUImpl<BEAGLE_GPU_GENERIC>::clone() {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tEntering BeagleGPUImpl::clone\n");
+#endif
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tLeaving  BeagleGPUImpl::clone\n");
+#endif
+
+    return NULL;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setCheckpoint() {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tEntering BeagleGPUImpl::setCheckpoint\n");
+#endif
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tLeaving  BeagleGPUImpl::setCheckpoint\n");
+#endif
+
+    return BEAGLE_ERROR_NO_IMPLEMENTATION;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::commitCheckpoint() {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tEntering BeagleGPUImpl::commitCheckpoint\n");
+#endif
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tLeaving  BeagleGPUImpl::commitCheckpoint\n");
+#endif
+
+    return BEAGLE_ERROR_NO_IMPLEMENTATION;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::rollbackCheckpoint() {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tEntering BeagleGPUImpl::rollbackCheckpoint\n");
+#endif
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tLeaving  BeagleGPUImpl::rollbackCheckpoint\n");
+#endif
+
+    return BEAGLE_ERROR_NO_IMPLEMENTATION;
+}
+
 BEAGLE_GPU_TEMPLATE
 int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setCPUThreadCount(int threadCount) {
 #ifdef BEAGLE_DEBUG_FLOW
@@ -842,6 +987,13 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setCPUThreadCount(int threadCount) {
     return BEAGLE_SUCCESS;
 }
 
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::getCPUThreadCount(int* outThreadCount) {
+    *outThreadCount = 0;
+
+    return BEAGLE_SUCCESS;
+}
+
 BEAGLE_GPU_TEMPLATE
 int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setTipStates(int tipIndex,
                                 const int* inStates) {
@@ -923,6 +1075,33 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setTipPartials(int tipIndex,
     return BEAGLE_SUCCESS;
 }
 
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::attachTipData(BeagleTipData* tipData) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tEntering BeagleGPUImpl::attachTipData\n");
+#endif
+
+    if (tipData->getStateCount() != kStateCount ||
+        tipData->getPatternCount() != kPatternCount ||
+        tipData->getTipCount() > kTipCount)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+
+    // Device buffers belong to a single instance, so the shared host copy is uploaded
+    int returnCode = BEAGLE_SUCCESS;
+    for (int i = 0; i < tipData->getTipCount() && returnCode == BEAGLE_SUCCESS; i++) {
+        if (tipData->getTipStates(i) != NULL)
+            returnCode = setTipStates(i, tipData->getTipStates(i));
+        else if (tipData->getTipPartials(i) != NULL)
+            returnCode = setTipPartials(i, tipData->getTipPartials(i));
+    }
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tLeaving  BeagleGPUImpl::attachTipData\n");
+#endif
+
+    return returnCode;
+}
+
 BEAGLE_GPU_TEMPLATE
 int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setPartials(int bufferIndex,
                                const double* inPartials) {
@@ -1222,6 +1401,19 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setPatternWeights(const double* inPattern
     return BEAGLE_SUCCESS;
 }
 
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setZeroWeightPatternSkipping(bool /*enabled*/) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tEntering BeagleGPUImpl::setZeroWeightPatternSkipping\n");
+#endif
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tLeaving  BeagleGPUImpl::setZeroWeightPatternSkipping\n");
+#endif
+
+    return BEAGLE_ERROR_NO_IMPLEMENTATION;
+}
+
 BEAGLE_GPU_TEMPLATE
 int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setPatternPartitions(int partitionCount,
                                                             const int* inPatternPartitions) {
@@ -1856,6 +2048,33 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::updateTransitionMatrices(int eigenIndex,
     return BEAGLE_SUCCESS;
 }
 
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setTransitionMatrixCacheSize(int /*cacheSize*/) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tEntering BeagleGPUImpl::setTransitionMatrixCacheSize\n");
+#endif
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tLeaving  BeagleGPUImpl::setTransitionMatrixCacheSize\n");
+#endif
+
+    return BEAGLE_ERROR_NO_IMPLEMENTATION;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::getTransitionMatrixCacheStatistics(long* /*outHitCount*/,
+                                                                          long* /*outMissCount*/) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tEntering BeagleGPUImpl::getTransitionMatrixCacheStatistics\n");
+#endif
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tLeaving  BeagleGPUImpl::getTransitionMatrixCacheStatistics\n");
+#endif
+
+    return BEAGLE_ERROR_NO_IMPLEMENTATION;
+}
+
 BEAGLE_GPU_TEMPLATE
 int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::updateTransitionMatricesWithMultipleModels(const int* eigenIndices,
                                                                                   const int* categoryRateIndices,
@@ -2435,6 +2654,180 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::upPartials(bool byPartition,
     return BEAGLE_SUCCESS;
 }
 
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setIncrementalUpdates(bool /*enabled*/) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tEntering BeagleGPUImpl::setIncrementalUpdates\n");
+#endif
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tLeaving  BeagleGPUImpl::setIncrementalUpdates\n");
+#endif
+
+    return BEAGLE_ERROR_NO_IMPLEMENTATION;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::getIncrementalUpdateStatistics(int* /*outOperationCount*/,
+                                                                      int* /*outSkippedCount*/) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tEntering BeagleGPUImpl::getIncrementalUpdateStatistics\n");
+#endif
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tLeaving  BeagleGPUImpl::getIncrementalUpdateStatistics\n");
+#endif
+
+    return BEAGLE_ERROR_NO_IMPLEMENTATION;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setRootPrePartials(const int* /*bufferIndices*/,
+                                                          const int* /*stateFrequenciesIndices*/,
+                                                          int /*count*/) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tEntering BeagleGPUImpl::setRootPrePartials\n");
+#endif
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tLeaving  BeagleGPUImpl::setRootPrePartials\n");
+#endif
+
+    return BEAGLE_ERROR_NO_IMPLEMENTATION;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::updatePrePartials(const int* /*operations*/,
+                                                         int /*operationCount*/,
+                                                         int /*cumulativeScalingIndex*/) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tEntering BeagleGPUImpl::updatePrePartials\n");
+#endif
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tLeaving  BeagleGPUImpl::updatePrePartials\n");
+#endif
+
+    return BEAGLE_ERROR_NO_IMPLEMENTATION;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::calculateEdgeDerivatives(const int* /*postBufferIndices*/,
+                                                                const int* /*preBufferIndices*/,
+                                                                const int* /*derivativeMatrixIndices*/,
+                                                                const int* /*categoryWeightsIndices*/,
+                                                                int /*count*/,
+                                                                double* /*outDerivatives*/,
+                                                                double* /*outSumDerivatives*/,
+                                                                double* /*outSumSquaredDerivatives*/) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tEntering BeagleGPUImpl::calculateEdgeDerivatives\n");
+#endif
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tLeaving  BeagleGPUImpl::calculateEdgeDerivatives\n");
+#endif
+
+    return BEAGLE_ERROR_NO_IMPLEMENTATION;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::calculateEdgeSumtable(int /*parentBufferIndex*/,
+                                                             int /*childBufferIndex*/,
+                                                             int /*eigenIndex*/,
+                                                             int /*categoryWeightsIndex*/,
+                                                             int /*stateFrequenciesIndex*/,
+                                                             int /*cumulativeScaleIndex*/) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tEntering BeagleGPUImpl::calculateEdgeSumtable\n");
+#endif
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tLeaving  BeagleGPUImpl::calculateEdgeSumtable\n");
+#endif
+
+    return BEAGLE_ERROR_NO_IMPLEMENTATION;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::calculateEdgeSumtableLogLikelihood(double /*edgeLength*/,
+                                                                          double* /*outSumLogLikelihood*/,
+                                                                          double* /*outSumFirstDerivative*/,
+                                                                          double* /*outSumSecondDerivative*/) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tEntering BeagleGPUImpl::calculateEdgeSumtableLogLikelihood\n");
+#endif
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tLeaving  BeagleGPUImpl::calculateEdgeSumtableLogLikelihood\n");
+#endif
+
+    return BEAGLE_ERROR_NO_IMPLEMENTATION;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::optimizeEdgeLength(double* /*inOutEdgeLength*/,
+                                                          double /*minEdgeLength*/,
+                                                          double /*maxEdgeLength*/,
+                                                          double /*tolerance*/,
+                                                          int /*maxIterations*/,
+                                                          double* /*outSumLogLikelihood*/) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tEntering BeagleGPUImpl::optimizeEdgeLength\n");
+#endif
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tLeaving  BeagleGPUImpl::optimizeEdgeLength\n");
+#endif
+
+    return BEAGLE_ERROR_NO_IMPLEMENTATION;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::calculateInsertionLogLikelihoods(const int* /*postBufferIndices*/,
+                                                                        const int* /*preBufferIndices*/,
+                                                                        const int* /*cumulativeScaleIndices*/,
+                                                                        int /*count*/,
+                                                                        int /*subtreeBufferIndex*/,
+                                                                        int /*subtreeMatrixIndex*/,
+                                                                        int /*categoryWeightsIndex*/,
+                                                                        double* /*outSumLogLikelihoods*/) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tEntering BeagleGPUImpl::calculateInsertionLogLikelihoods\n");
+#endif
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tLeaving  BeagleGPUImpl::calculateInsertionLogLikelihoods\n");
+#endif
+
+    return BEAGLE_ERROR_NO_IMPLEMENTATION;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::optimizeInsertionLogLikelihoods(const int* /*postBufferIndices*/,
+                                                                       const int* /*preBufferIndices*/,
+                                                                       const int* /*cumulativeScaleIndices*/,
+                                                                       int /*count*/,
+                                                                       int /*subtreeBufferIndex*/,
+                                                                       int /*eigenIndex*/,
+                                                                       int /*categoryWeightsIndex*/,
+                                                                       double* /*inOutPendantLengths*/,
+                                                                       double /*minEdgeLength*/,
+                                                                       double /*maxEdgeLength*/,
+                                                                       double /*tolerance*/,
+                                                                       int /*maxIterations*/,
+                                                                       double* /*outSumLogLikelihoods*/) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tEntering BeagleGPUImpl::optimizeInsertionLogLikelihoods\n");
+#endif
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tLeaving  BeagleGPUImpl::optimizeInsertionLogLikelihoods\n");
+#endif
+
+    return BEAGLE_ERROR_NO_IMPLEMENTATION;
+}
+
 BEAGLE_GPU_TEMPLATE
 int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::waitForPartials(const int* /*destinationPartials*/,
                                    int /*destinationPartialsCount*/) {
@@ -3076,6 +3469,99 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::calculateRootLogLikelihoodsByPartition(
     return returnCode;
 }
 
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::evaluateRootLogLikelihood(int eigenIndex,
+                                                                 const int* probabilityIndices,
+                                                                 const double* edgeLengths,
+                                                                 int matrixCount,
+                                                                 const int* operations,
+                                                                 int operationCount,
+                                                                 int rootBufferIndex,
+                                                                 int categoryWeightsIndex,
+                                                                 int stateFrequenciesIndex,
+                                                                 int cumulativeScaleIndex,
+                                                                 double* outSumLogLikelihood) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tEntering BeagleGPUImpl::evaluateRootLogLikelihood\n");
+#endif
+
+    // the device queue already overlaps these calls, so they are issued in turn
+    const bool accumulateScaling = (cumulativeScaleIndex != BEAGLE_OP_NONE &&
+                                    !(kFlags & (BEAGLE_FLAG_SCALING_AUTO | BEAGLE_FLAG_SCALING_ALWAYS |
+                                                BEAGLE_FLAG_SCALING_DYNAMIC)));
+    if (accumulateScaling)
+        resetScaleFactors(cumulativeScaleIndex);
+
+    int returnCode = updateTransitionMatrices(eigenIndex, probabilityIndices, NULL, NULL, edgeLengths, matrixCount);
+    if (returnCode == BEAGLE_SUCCESS)
+        returnCode = updatePartials(operations, operationCount, cumulativeScaleIndex);
+
+    for (int op = 0; op < operationCount && accumulateScaling && returnCode == BEAGLE_SUCCESS; op++) {
+        const int* operation = operations + op * BEAGLE_OP_COUNT;
+        if (operation[1] < 0 && operation[2] >= 0)
+            returnCode = accumulateScaleFactors(&operation[2], 1, cumulativeScaleIndex);
+    }
+
+    if (returnCode == BEAGLE_SUCCESS)
+        returnCode = calculateRootLogLikelihoods(&rootBufferIndex, &categoryWeightsIndex, &stateFrequenciesIndex,
+                                                 &cumulativeScaleIndex, 1, outSumLogLikelihood);
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tLeaving  BeagleGPUImpl::evaluateRootLogLikelihood\n");
+#endif
+
+    return returnCode;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::evaluateRootLogLikelihoods(const BeagleEvaluationJob* jobs,
+                                                                  int jobCount,
+                                                                  double* outSumLogLikelihoods,
+                                                                  int* outReturnCodes) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tEntering BeagleGPUImpl::evaluateRootLogLikelihoods\n");
+#endif
+
+    int returnCode = BEAGLE_SUCCESS;
+    for (int i = 0; i < jobCount; i++) {
+        const BeagleEvaluationJob& job = jobs[i];
+        int jobReturnCode = evaluateRootLogLikelihood(job.eigenIndex, job.probabilityIndices, job.edgeLengths,
+                                                      job.matrixCount, (const int*) job.operations,
+                                                      job.operationCount, job.rootBufferIndex,
+                                                      job.categoryWeightsIndex, job.stateFrequenciesIndex,
+                                                      job.cumulativeScaleIndex, &outSumLogLikelihoods[i]);
+        if (outReturnCodes != NULL)
+            outReturnCodes[i] = jobReturnCode;
+        if (returnCode == BEAGLE_SUCCESS)
+            returnCode = jobReturnCode;
+    }
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tLeaving  BeagleGPUImpl::evaluateRootLogLikelihoods\n");
+#endif
+
+    return returnCode;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::calculateRootLogLikelihoodsForWeights(int /*bufferIndex*/,
+                                                                             int /*categoryWeightsIndex*/,
+                                                                             int /*stateFrequenciesIndex*/,
+                                                                             int /*cumulativeScaleIndex*/,
+                                                                             const double* /*inPatternWeights*/,
+                                                                             int /*weightVectorCount*/,
+                                                                             double* /*outSumLogLikelihoods*/) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tEntering BeagleGPUImpl::calculateRootLogLikelihoodsForWeights\n");
+#endif
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tLeaving  BeagleGPUImpl::calculateRootLogLikelihoodsForWeights\n");
+#endif
+
+    return BEAGLE_ERROR_NO_IMPLEMENTATION;
+}
+
 BEAGLE_GPU_TEMPLATE
 int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::calculateEdgeLogLikelihoods(const int* parentBufferIndices,
                                                const int* childBufferIndices,
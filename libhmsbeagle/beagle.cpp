@@ -39,14 +39,21 @@
 #include <cstring>
 #include <exception>    // for exception, bad_exception
 #include <stdexcept>    // for std exception hierarchy
+#include <algorithm>
+#include <atomic>
 #include <list>
+#include <map>
+#include <thread>
 #include <utility>
 #include <vector>
 #include <iostream>
 
 #include "libhmsbeagle/beagle.h"
 #include "libhmsbeagle/BeagleImpl.h"
+#include "libhmsbeagle/BeagleRecorder.h"
+#include "libhmsbeagle/BeagleTree.h"
 #include "libhmsbeagle/benchmark/BeagleBenchmark.h"
+#include "libhmsbeagle/benchmark/BenchmarkCache.h"
 
 #include "libhmsbeagle/plugin/Plugin.h"
 
@@ -88,13 +95,33 @@ double debugGetTime() {
 int debugPatternCount;
 #endif
 
+// calibration problem of BEAGLE_FLAG_AUTOTUNE: tips of the tree and timed likelihood evaluations
+#define BEAGLE_AUTOTUNE_TAXON_COUNT 8
+#define BEAGLE_AUTOTUNE_REPLICATES  3
+
 //@CHANGED make this a std::vector<BeagleImpl *> and use at to reference.
 std::vector<beagle::BeagleImpl*> *instances = NULL;
 
+/// shared tip data handles; entries are NULL once finalized
+std::vector<beagle::BeagleTipData*> *tipDataList = NULL;
+
+/// trees set with beagleSetTree, indexed by instance; entries are NULL until set
+std::vector<beagle::BeagleTree*> *treeList = NULL;
+
 /// returns an initialized instance or NULL if the index refers to an invalid instance
 namespace beagle {
 BeagleImpl* getBeagleInstance(int instanceIndex);
 
+/// returns live shared tip data or NULL if the index refers to invalid tip data
+BeagleTipData* getBeagleTipData(int tipDataIndex);
+
+/// returns the tree of an instance, or NULL if none was set
+BeagleTree* getBeagleTree(int instanceIndex);
+
+/// returns the recorder of the API calls, or NULL unless BEAGLE_RECORD_FILE names a file or
+/// during an internal call (see BeagleInternalCall)
+BeagleRecorder* getBeagleRecorder();
+
 
 BeagleImpl* getBeagleInstance(int instanceIndex) {
     if (instanceIndex > instances->size())
@@ -102,6 +129,23 @@ BeagleImpl* getBeagleInstance(int instanceIndex) {
     return (*instances)[instanceIndex];
 }
 
+BeagleTipData* getBeagleTipData(int tipDataIndex) {
+    if (tipDataList == NULL || tipDataIndex < 0 || tipDataIndex >= (int) tipDataList->size())
+        return NULL;
+    return (*tipDataList)[tipDataIndex];
+}
+
+BeagleTree* getBeagleTree(int instanceIndex) {
+    if (treeList == NULL || instanceIndex < 0 || instanceIndex >= (int) treeList->size())
+        return NULL;
+    return (*treeList)[instanceIndex];
+}
+
+BeagleRecorder* getBeagleRecorder() {
+    static BeagleRecorder recorder(getenv("BEAGLE_RECORD_FILE"));
+    return (recorder.isOpen() && getBeagleInternalCallDepth() == 0 ? &recorder : NULL);
+}
+
 }   // end namespace beagle
 
 
@@ -341,6 +385,12 @@ int filterResources(int* resourceList,
                     long requirementFlags,
                     PairedList* possibleResources) {
 
+#if LONG_MAX <= INT_MAX
+    // bit 31 is the sign bit of a 32-bit long and stands for a flag these builds do not offer
+    if (requirementFlags < 0)
+        return BEAGLE_ERROR_NO_RESOURCE;
+#endif
+
     // First determine a list of possible resources
     if (resourceList == NULL || resourceCount == 0) { // No list given
         for(int i=0; i<rsrcList->length; i++)
@@ -511,8 +561,17 @@ BeagleBenchmarkedResourceList* beagleGetBenchmarkedResourceList(int tipCount,
     double benchmarkResultCPU;
 
     bool instOnly = false;
-    
-    errorCode = beagle::benchmark::benchmarkResource(0,
+
+    // results are kept across processes when BEAGLE_BENCHMARK_CACHE names a file
+    const char* cacheFileName = getenv("BEAGLE_BENCHMARK_CACHE");
+    beagle::benchmark::BenchmarkCache* cache = NULL;
+    if (cacheFileName != NULL && cacheFileName[0] != '\0')
+        cache = new beagle::benchmark::BenchmarkCache(cacheFileName);
+    bool refreshCache = (benchmarkFlags & BEAGLE_BENCHFLAG_CACHE_REFRESH ? true : false);
+
+    errorCode = beagle::benchmark::benchmarkResourceCached(cache,
+                                  refreshCache,
+                                  0,
                                   stateCount,
                                   tipCount,
                                   patternCount,
@@ -534,6 +593,8 @@ BeagleBenchmarkedResourceList* beagleGetBenchmarkedResourceList(int tipCount,
                                   instOnly);
 
     if (errorCode != BEAGLE_SUCCESS) {
+        delete cache;
+        delete filteredRsrcBenchList;
         return NULL;
     }
 
@@ -548,7 +609,9 @@ BeagleBenchmarkedResourceList* beagleGetBenchmarkedResourceList(int tipCount,
 
         double itBenchmarkResult;
 
-        (*it).returnCode = beagle::benchmark::benchmarkResource((*it).number,
+        (*it).returnCode = beagle::benchmark::benchmarkResourceCached(cache,
+                                                     refreshCache,
+                                                     (*it).number,
                                                      stateCount,
                                                      tipCount,
                                                      patternCount,
@@ -582,6 +645,12 @@ BeagleBenchmarkedResourceList* beagleGetBenchmarkedResourceList(int tipCount,
         }
     }
 
+    if (cache != NULL) {
+        if (!cache->write())
+            fprintf(stderr, "BEAGLE: cannot write the benchmark cache %s\n", cacheFileName);
+        delete cache;
+    }
+
     filteredRsrcBenchList->sort(compareBenchmarkResult); // order from fastest to slowest
 
    if (rsrcBenchList != NULL) {
@@ -614,6 +683,132 @@ BeagleBenchmarkedResourceList* beagleGetBenchmarkedResourceList(int tipCount,
     return rsrcBenchList;
 }
 
+/*
+ * Times the implementations that could run an instance on the best ranked
+ * resource, each without threads and with doubling C++ thread counts, on a
+ * small tree with the instance's pattern, state and category counts. Returns
+ * the flags that select the fastest, or 0 if none could be timed, and its
+ * thread count (0 unless C++ threading is selected).
+ */
+long autotuneImplementation(int tipCount,
+                            int compactBufferCount,
+                            int stateCount,
+                            int patternCount,
+                            int categoryCount,
+                            int scaleBufferCount,
+                            long preferenceFlags,
+                            long requirementFlags,
+                            RsrcImplList* possibleResourceImplementations,
+                            int* tunedResource,
+                            int* tunedThreadCount) {
+    const long precisionMask = BEAGLE_FLAG_PRECISION_SINGLE | BEAGLE_FLAG_PRECISION_DOUBLE;
+    const long selectionMask = BEAGLE_FLAG_VECTOR_SSE | BEAGLE_FLAG_VECTOR_AVX | BEAGLE_FLAG_VECTOR_NONE |
+                               BEAGLE_FLAG_FRAMEWORK_CPU | BEAGLE_FLAG_FRAMEWORK_CUDA |
+                               BEAGLE_FLAG_FRAMEWORK_OPENCL;
+    const long threadingMask = BEAGLE_FLAG_THREADING_CPP | BEAGLE_FLAG_THREADING_OPENMP |
+                               BEAGLE_FLAG_THREADING_NONE;
+
+    if (possibleResourceImplementations->empty())
+        return 0;
+
+    // the benchmark instances are not part of the client's calls
+    beagle::BeagleInternalCall internalCall;
+
+    // the resource and precision the instance would get untuned are kept
+    int resource = possibleResourceImplementations->front().second.first;
+    long precision = (requirementFlags | preferenceFlags) & precisionMask;
+    if (precision == 0 || precision == precisionMask)
+        precision = possibleResourceImplementations->front().second.second->getFlags() & precisionMask;
+    if (precision == precisionMask)
+        precision = 0;
+
+    int taxonCount = std::min(tipCount, BEAGLE_AUTOTUNE_TAXON_COUNT);
+    if (taxonCount < 2)
+        taxonCount = 2;
+    int compactTipCount = 0;
+    if (compactBufferCount > 0 && tipCount > 0)
+        compactTipCount = std::min(taxonCount, std::max(1, compactBufferCount * taxonCount / tipCount));
+
+    int hardwareThreads = std::thread::hardware_concurrency();
+
+    long bestFlags = 0;
+    int bestThreadCount = 0;
+    double bestTime = 0.0;
+    std::vector<long> timedFlags;
+
+    for (RsrcImplList::iterator it = possibleResourceImplementations->begin();
+         it != possibleResourceImplementations->end(); ++it) {
+        long factoryFlags = (*it).second.second->getFlags();
+        if ((*it).second.first != resource || (factoryFlags & precision) != precision)
+            continue;
+
+        long threadings[3] = {BEAGLE_FLAG_THREADING_NONE, BEAGLE_FLAG_THREADING_OPENMP,
+                              BEAGLE_FLAG_THREADING_CPP};
+        for (int t = 0; t < 3; t++) {
+            long threading = threadings[t];
+            if (!(factoryFlags & threading)) {
+                // implementations without threading flags are timed once, as they come
+                if (threading != BEAGLE_FLAG_THREADING_NONE || (factoryFlags & threadingMask))
+                    continue;
+                threading = 0;
+            }
+            if ((requirementFlags & threadingMask) && !(requirementFlags & threading))
+                continue;
+            if (threading == BEAGLE_FLAG_THREADING_CPP && hardwareThreads < 2)
+                continue;
+
+            long flags = (factoryFlags & selectionMask) | precision | threading;
+            if (std::find(timedFlags.begin(), timedFlags.end(), flags) != timedFlags.end())
+                continue;
+            timedFlags.push_back(flags);
+
+            double previousTime = 0.0;
+            for (int threadCount = (threading == BEAGLE_FLAG_THREADING_CPP ? 2 : 0); ;
+                 threadCount = std::min(threadCount * 2, hardwareThreads)) {
+                int resourceNumber;
+                char* implName;
+                long benchedFlags;
+                double time;
+                int errorCode = beagle::benchmark::benchmarkResource(resource, stateCount,
+                                                                     taxonCount, patternCount,
+                                                                     (scaleBufferCount > 0),
+                                                                     categoryCount,
+                                                                     BEAGLE_AUTOTUNE_REPLICATES,
+                                                                     compactTipCount, 1,
+                                                                     false, false, 1, 1,
+                                                                     (preferenceFlags & ~threadingMask) | flags,
+                                                                     requirementFlags | flags,
+                                                                     &resourceNumber, &implName,
+                                                                     &benchedFlags, &time, false,
+                                                                     threadCount);
+#ifdef BEAGLE_DEBUG_FLOW
+                if (errorCode == BEAGLE_SUCCESS)
+                    fprintf(stderr, "\tAutotune: %s with %d threads: %f\n", implName, threadCount, time);
+#endif
+                if (errorCode != BEAGLE_SUCCESS)
+                    break;
+
+                if (bestFlags == 0 || time < bestTime) {
+                    bestFlags = flags;
+                    bestThreadCount = threadCount;
+                    bestTime = time;
+                }
+
+                // more threads are tried until they stop paying off
+                if (threadCount == 0 || threadCount >= hardwareThreads ||
+                    (previousTime > 0.0 && time >= previousTime))
+                    break;
+                previousTime = time;
+            }
+        }
+    }
+
+    *tunedResource = resource;
+    *tunedThreadCount = bestThreadCount;
+
+    return bestFlags;
+}
+
 int beagleCreateInstance(int tipCount,
                          int partialsBufferCount,
                          int compactBufferCount,
@@ -643,12 +838,17 @@ int beagleCreateInstance(int tipCount,
         
         int errorCode = BEAGLE_SUCCESS;
 
+        // the autotuner picks the flags the instance is created with
+        const bool autotune = (preferenceFlags & BEAGLE_FLAG_AUTOTUNE) != 0;
+        long implPreferenceFlags = preferenceFlags & ~BEAGLE_FLAG_AUTOTUNE;
+        long implRequirementFlags = requirementFlags;
+
         PairedList* possibleResources = new PairedList;
 
         errorCode = filterResources(resourceList,
                                     resourceCount,
-                                    preferenceFlags,
-                                    requirementFlags,
+                                    implPreferenceFlags,
+                                    implRequirementFlags,
                                     possibleResources);
 
         if (errorCode != BEAGLE_SUCCESS) {
@@ -658,8 +858,8 @@ int beagleCreateInstance(int tipCount,
 
         RsrcImplList* possibleResourceImplementations = new RsrcImplList;
 
-        errorCode = rankResourceImplementationPairs(preferenceFlags,
-                                                    requirementFlags,
+        errorCode = rankResourceImplementationPairs(implPreferenceFlags,
+                                                    implRequirementFlags,
                                                     possibleResources,
                                                     possibleResourceImplementations);
 
@@ -670,6 +870,31 @@ int beagleCreateInstance(int tipCount,
             return errorCode;
         }
 
+        int tunedThreadCount = 0;
+        if (autotune) {
+            int tunedResource;
+            long tunedFlags = autotuneImplementation(tipCount, compactBufferCount, stateCount,
+                                                     patternCount, categoryCount, scaleBufferCount,
+                                                     implPreferenceFlags, implRequirementFlags,
+                                                     possibleResourceImplementations,
+                                                     &tunedResource, &tunedThreadCount);
+            if (tunedFlags != 0) {
+                // only the pairs that can give the tuned implementation are left to try
+                const long threadingMask = BEAGLE_FLAG_THREADING_CPP | BEAGLE_FLAG_THREADING_OPENMP |
+                                           BEAGLE_FLAG_THREADING_NONE;
+                implPreferenceFlags = (implPreferenceFlags & ~threadingMask) | tunedFlags;
+                implRequirementFlags |= tunedFlags;
+                for (RsrcImplList::iterator it = possibleResourceImplementations->begin();
+                     it != possibleResourceImplementations->end(); ) {
+                    long factoryFlags = (*it).second.second->getFlags();
+                    if ((*it).second.first != tunedResource || (factoryFlags & tunedFlags) != tunedFlags)
+                        it = possibleResourceImplementations->erase(it);
+                    else
+                        ++it;
+                }
+            }
+        }
+
         beagle::BeagleImpl* bestBeagle = NULL;
         errorCode = BEAGLE_ERROR_NO_RESOURCE;
 
@@ -684,8 +909,8 @@ int beagleCreateInstance(int tipCount,
                                                                 scaleBufferCount,
                                                                 resource,
                                                                 ResourceMap[resource],
-                                                                preferenceFlags,
-                                                                requirementFlags,
+                                                                implPreferenceFlags,
+                                                                implRequirementFlags,
                                                                 &errorCode);
             
             if (bestBeagle != NULL)
@@ -697,14 +922,55 @@ int beagleCreateInstance(int tipCount,
         if (bestBeagle != NULL) {
             int instance = instances->size();
             instances->push_back(bestBeagle);
+
+            if (tunedThreadCount > 0)
+                bestBeagle->setCPUThreadCount(tunedThreadCount);
             
             int returnValue = bestBeagle->getInstanceDetails(returnInfo);
             if (returnValue == BEAGLE_SUCCESS) {
+                if (autotune)
+                    returnInfo->flags |= BEAGLE_FLAG_AUTOTUNE;
                 returnInfo->resourceName = rsrcList->list[returnInfo->resourceNumber].name;
                 // TODO: move implDescription to inside the implementation
                 returnInfo->implDescription = (char*) "none";
                 
                 returnValue = instance;
+
+                if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+                    const int eigenValueCount = (returnInfo->flags & BEAGLE_FLAG_EIGEN_COMPLEX ? 2 : 1) * stateCount;
+                    const beagle::BeagleRecordedDimensions dims = {tipCount, stateCount, patternCount,
+                                                                   categoryCount, eigenValueCount};
+                    recorder->setInstanceDimensions(instance, dims);
+                    beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_CREATE_INSTANCE);
+                    record.putInt(instance);
+                    record.putInt(tipCount);
+                    record.putInt(partialsBufferCount);
+                    record.putInt(compactBufferCount);
+                    record.putInt(stateCount);
+                    record.putInt(patternCount);
+                    record.putInt(eigenBufferCount);
+                    record.putInt(matrixBufferCount);
+                    record.putInt(categoryCount);
+                    record.putInt(scaleBufferCount);
+                    // an autotuned instance is recorded as the implementation it got, so that a
+                    // replay does not tune again and possibly choose differently
+                    if (autotune) {
+                        record.putInts(&returnInfo->resourceNumber, 1);
+                        record.putInt(1);
+                    } else {
+                        record.putInts(resourceList, resourceCount);
+                        record.putInt(resourceCount);
+                    }
+                    record.putLong(implPreferenceFlags);
+                    record.putLong(implRequirementFlags);
+                }
+                if (tunedThreadCount > 0) {
+                    if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+                        beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_SET_CPU_THREAD_COUNT);
+                        record.putInt(instance);
+                        record.putInt(tunedThreadCount);
+                    }
+                }
             }
             return returnValue;
         }   
@@ -725,15 +991,107 @@ int beagleCreateInstance(int tipCount,
 
 }
 
-int beagleFinalizeInstance(int instance) {
-    DEBUG_FINALIZE_TIME();
+int beagleEstimateMemoryUsage(int tipCount,
+                              int partialsBufferCount,
+                              int compactBufferCount,
+                              int stateCount,
+                              int patternCount,
+                              int eigenBufferCount,
+                              int matrixBufferCount,
+                              int categoryCount,
+                              int scaleBufferCount,
+                              int* resourceList,
+                              int resourceCount,
+                              long preferenceFlags,
+                              long requirementFlags,
+                              BeagleMemoryUsage* outMemoryUsage,
+                              BeagleInstanceDetails* returnInfo) {
+    try {
+        if (rsrcList == NULL)
+            beagleGetResourceList();
+
+        if (implFactory == NULL)
+            beagleGetFactoryList();
+
+        int errorCode = BEAGLE_SUCCESS;
+
+        PairedList* possibleResources = new PairedList;
+
+        errorCode = filterResources(resourceList,
+                                    resourceCount,
+                                    preferenceFlags,
+                                    requirementFlags,
+                                    possibleResources);
+
+        if (errorCode != BEAGLE_SUCCESS) {
+            delete possibleResources;
+            return errorCode;
+        }
+
+        RsrcImplList* possibleResourceImplementations = new RsrcImplList;
+
+        errorCode = rankResourceImplementationPairs(preferenceFlags,
+                                                    requirementFlags,
+                                                    possibleResources,
+                                                    possibleResourceImplementations);
+
+        delete possibleResources;
+
+        if (errorCode != BEAGLE_SUCCESS) {
+            delete possibleResourceImplementations;
+            return errorCode;
+        }
+
+        errorCode = BEAGLE_ERROR_NO_RESOURCE;
+
+        for(RsrcImplList::iterator it = possibleResourceImplementations->begin(); it != possibleResourceImplementations->end(); ++it) {
+            int resource = (*it).second.first;
+            beagle::BeagleImplFactory* factory = (*it).second.second;
+
+            errorCode = factory->estimateMemoryUsage(tipCount, partialsBufferCount,
+                                                     compactBufferCount, stateCount,
+                                                     patternCount, eigenBufferCount,
+                                                     matrixBufferCount, categoryCount,
+                                                     scaleBufferCount,
+                                                     preferenceFlags,
+                                                     requirementFlags,
+                                                     outMemoryUsage);
+
+            if (errorCode == BEAGLE_SUCCESS) {
+                if (returnInfo != NULL) {
+                    returnInfo->resourceNumber = resource;
+                    returnInfo->resourceName = rsrcList->list[resource].name;
+                    returnInfo->implName = (char*) factory->getName();
+                    returnInfo->implDescription = (char*) "none";
+                    returnInfo->flags = factory->getFlags();
+                }
+                break;
+            }
+        }
+
+        delete possibleResourceImplementations;
+
+        // No implementations found or appropriate, return last error code
+        return errorCode;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleGetInstanceMemoryUsage(int instance,
+                                 BeagleMemoryUsage* outMemoryUsage) {
     try {
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
-        delete beagleInstance;
-        (*instances)[instance] = NULL;
-        return BEAGLE_SUCCESS;
+        return beagleInstance->getMemoryUsage(outMemoryUsage);
     }
     catch (std::bad_alloc &) {
         return BEAGLE_ERROR_OUT_OF_MEMORY;
@@ -746,28 +1104,33 @@ int beagleFinalizeInstance(int instance) {
     }
 }
 
-int beagleSetCPUThreadCount(int instance,
-                            int threadCount) {
-    DEBUG_START_TIME();
-    beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
-    if (beagleInstance == NULL)
-        return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
-    int returnValue = beagleInstance->setCPUThreadCount(threadCount);
-    DEBUG_END_TIME();
-    return returnValue;
+int beagleSetPerformanceCounters(int instance,
+                                 int enabled) {
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        return beagleInstance->setPerformanceCounters(enabled != 0);
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
 }
 
-int beagleSetTipStates(int instance,
-                 int tipIndex,
-                 const int* inStates) {
-    DEBUG_START_TIME();
+int beagleGetPerformanceCounters(int instance,
+                                 BeagleKernelCounters* outCounters,
+                                 int count) {
     try {
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
-        int returnValue = beagleInstance->setTipStates(tipIndex, inStates);
-        DEBUG_END_TIME();
-        return returnValue;
+        return beagleInstance->getPerformanceCounters(outCounters, count);
     }
     catch (std::bad_alloc &) {
         return BEAGLE_ERROR_OUT_OF_MEMORY;
@@ -780,17 +1143,12 @@ int beagleSetTipStates(int instance,
     }
 }
 
-int beagleSetTipPartials(int instance,
-                   int tipIndex,
-                   const double* inPartials) {
-    DEBUG_START_TIME();
+int beagleResetPerformanceCounters(int instance) {
     try {
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
-        int returnValue = beagleInstance->setTipPartials(tipIndex, inPartials);
-        DEBUG_END_TIME();
-        return returnValue;
+        return beagleInstance->resetPerformanceCounters();
     }
     catch (std::bad_alloc &) {
         return BEAGLE_ERROR_OUT_OF_MEMORY;
@@ -803,17 +1161,14 @@ int beagleSetTipPartials(int instance,
     }
 }
 
-int beagleSetPartials(int instance,
-                int bufferIndex,
-                const double* inPartials) {
-    DEBUG_START_TIME();
+int beagleStartTrace(int instance,
+                     const char* fileName,
+                     int eventsPerThread) {
     try {
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
-        int returnValue = beagleInstance->setPartials(bufferIndex, inPartials);
-        DEBUG_END_TIME();
-        return returnValue;
+        return beagleInstance->startTrace(fileName, eventsPerThread);
     }
     catch (std::bad_alloc &) {
         return BEAGLE_ERROR_OUT_OF_MEMORY;
@@ -826,15 +1181,12 @@ int beagleSetPartials(int instance,
     }
 }
 
-int beagleGetPartials(int instance, int bufferIndex, int scaleIndex, double* outPartials) {
-    DEBUG_START_TIME();
+int beagleWriteTrace(int instance) {
     try {
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
-        int returnValue = beagleInstance->getPartials(bufferIndex, scaleIndex, outPartials);
-        DEBUG_END_TIME();
-        return returnValue;
+        return beagleInstance->writeTrace();
     }
     catch (std::bad_alloc &) {
         return BEAGLE_ERROR_OUT_OF_MEMORY;
@@ -847,20 +1199,12 @@ int beagleGetPartials(int instance, int bufferIndex, int scaleIndex, double* out
     }
 }
 
-int beagleSetEigenDecomposition(int instance,
-                          int eigenIndex,
-                          const double* inEigenVectors,
-                          const double* inInverseEigenVectors,
-                          const double* inEigenValues) {
-    DEBUG_START_TIME();
+int beagleStopTrace(int instance) {
     try {
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
-        int returnValue = beagleInstance->setEigenDecomposition(eigenIndex, inEigenVectors,
-                                                     inInverseEigenVectors, inEigenValues);
-        DEBUG_END_TIME();
-        return returnValue;
+        return beagleInstance->stopTrace();
     }
     catch (std::bad_alloc &) {
         return BEAGLE_ERROR_OUT_OF_MEMORY;
@@ -873,68 +1217,546 @@ int beagleSetEigenDecomposition(int instance,
     }
 }
 
-int beagleSetStateFrequencies(int instance,
-                              int stateFrequenciesIndex,
-                              const double* inStateFrequencies) {
-    DEBUG_START_TIME();
-    beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
-    if (beagleInstance == NULL)
-        return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
-    int returnValue = beagleInstance->setStateFrequencies(stateFrequenciesIndex, inStateFrequencies);
-    DEBUG_END_TIME();
-    return returnValue;
-}
+int beagleCloneInstance(int instance,
+                        BeagleInstanceDetails* returnInfo) {
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
 
-int beagleSetCategoryWeights(int instance,
-                             int categoryWeightsIndex,
-                             const double* inCategoryWeights) {
-    DEBUG_START_TIME();
-    beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
-    if (beagleInstance == NULL)
-        return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
-    int returnValue = beagleInstance->setCategoryWeights(categoryWeightsIndex, inCategoryWeights);
-    DEBUG_END_TIME();
-    return returnValue;
-}
+        beagle::BeagleImpl* copy = beagleInstance->clone();
+        if (copy == NULL)
+            return BEAGLE_ERROR_NO_IMPLEMENTATION;
 
-int beagleSetPatternWeights(int instance,
-                            const double* inPatternWeights) {
-    DEBUG_START_TIME();
-    beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
-    if (beagleInstance == NULL)
-        return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
-    int returnValue = beagleInstance->setPatternWeights(inPatternWeights);
-    DEBUG_END_TIME();
-    return returnValue;
-}
+        int newInstance = instances->size();
+        instances->push_back(copy);
 
-int beagleSetPatternPartitions(int instance,
-                               int partitionCount,
-                               const int* inPatternPartitions) {
-    DEBUG_START_TIME();
-    beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
-    if (beagleInstance == NULL)
-        return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
-    int returnValue = beagleInstance->setPatternPartitions(partitionCount, inPatternPartitions);
-    DEBUG_END_TIME();
-    return returnValue;
+        int returnValue = copy->getInstanceDetails(returnInfo);
+        if (returnValue == BEAGLE_SUCCESS) {
+            returnInfo->resourceName = rsrcList->list[returnInfo->resourceNumber].name;
+            returnInfo->implDescription = (char*) "none";
+
+            returnValue = newInstance;
+
+            if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+                recorder->setInstanceDimensions(newInstance, recorder->getInstanceDimensions(instance));
+                beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_CLONE_INSTANCE);
+                record.putInt(newInstance);
+                record.putInt(instance);
+            }
+        }
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
 }
 
-int beagleSetCategoryRates(int instance,
-                     const double* inCategoryRates) {
-    DEBUG_START_TIME();
-//    try {
+int beagleSetCheckpoint(int instance) {
+    try {
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
-        int returnValue = beagleInstance->setCategoryRates(inCategoryRates);
-        DEBUG_END_TIME();
-        return returnValue;
-//    }
-//    catch (std::bad_alloc &) {
-//        return BEAGLE_ERROR_OUT_OF_MEMORY;
-//    }
-//    catch (std::out_of_range &) {
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_SET_CHECKPOINT);
+            record.putInt(instance);
+        }
+        return beagleInstance->setCheckpoint();
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleCommitCheckpoint(int instance) {
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_COMMIT_CHECKPOINT);
+            record.putInt(instance);
+        }
+        return beagleInstance->commitCheckpoint();
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleRollbackCheckpoint(int instance) {
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_ROLLBACK_CHECKPOINT);
+            record.putInt(instance);
+        }
+        return beagleInstance->rollbackCheckpoint();
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleFinalizeInstance(int instance) {
+    DEBUG_FINALIZE_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_FINALIZE_INSTANCE);
+            record.putInt(instance);
+        }
+        delete beagleInstance;
+        (*instances)[instance] = NULL;
+        beagle::BeagleTree* beagleTree = beagle::getBeagleTree(instance);
+        if (beagleTree != NULL) {
+            delete beagleTree;
+            (*treeList)[instance] = NULL;
+        }
+        return BEAGLE_SUCCESS;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleSetCPUThreadCount(int instance,
+                            int threadCount) {
+    DEBUG_START_TIME();
+    beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+    if (beagleInstance == NULL)
+        return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+        beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_SET_CPU_THREAD_COUNT);
+        record.putInt(instance);
+        record.putInt(threadCount);
+    }
+    int returnValue = beagleInstance->setCPUThreadCount(threadCount);
+    DEBUG_END_TIME();
+    return returnValue;
+}
+
+int beagleGetCPUThreadCount(int instance,
+                            int* outThreadCount) {
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        return beagleInstance->getCPUThreadCount(outThreadCount);
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleSetTipStates(int instance,
+                 int tipIndex,
+                 const int* inStates) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            const beagle::BeagleRecordedDimensions dims = recorder->getInstanceDimensions(instance);
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_SET_TIP_STATES);
+            record.putInt(instance);
+            record.putInt(tipIndex);
+            record.putInts(inStates, dims.patternCount);
+        }
+        int returnValue = beagleInstance->setTipStates(tipIndex, inStates);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleSetTipPartials(int instance,
+                   int tipIndex,
+                   const double* inPartials) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            const beagle::BeagleRecordedDimensions dims = recorder->getInstanceDimensions(instance);
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_SET_TIP_PARTIALS);
+            record.putInt(instance);
+            record.putInt(tipIndex);
+            record.putDoubles(inPartials, (long) dims.stateCount * dims.patternCount);
+        }
+        int returnValue = beagleInstance->setTipPartials(tipIndex, inPartials);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleCreateTipData(int tipCount,
+                        int stateCount,
+                        int patternCount) {
+    try {
+        if (tipCount < 1 || stateCount < 1 || patternCount < 1)
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+        if (tipDataList == NULL)
+            tipDataList = new std::vector<beagle::BeagleTipData*>;
+        int tipData = tipDataList->size();
+        tipDataList->push_back(new beagle::BeagleTipData(tipCount, stateCount, patternCount));
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            const beagle::BeagleRecordedDimensions dims = {tipCount, stateCount, patternCount, 1, stateCount};
+            recorder->setTipDataDimensions(tipData, dims);
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_CREATE_TIP_DATA);
+            record.putInt(tipData);
+            record.putInt(tipCount);
+            record.putInt(stateCount);
+            record.putInt(patternCount);
+        }
+        return tipData;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleSetTipDataStates(int tipData,
+                           int tipIndex,
+                           const int* inStates) {
+    beagle::BeagleTipData* beagleTipData = beagle::getBeagleTipData(tipData);
+    if (beagleTipData == NULL)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+        beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_SET_TIP_DATA_STATES);
+        record.putInt(tipData);
+        record.putInt(tipIndex);
+        record.putInts(inStates, beagleTipData->getPatternCount());
+    }
+    return beagleTipData->setTipStates(tipIndex, inStates);
+}
+
+int beagleSetTipDataPartials(int tipData,
+                             int tipIndex,
+                             const double* inPartials) {
+    beagle::BeagleTipData* beagleTipData = beagle::getBeagleTipData(tipData);
+    if (beagleTipData == NULL)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+        beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_SET_TIP_DATA_PARTIALS);
+        record.putInt(tipData);
+        record.putInt(tipIndex);
+        record.putDoubles(inPartials, (long) beagleTipData->getStateCount() * beagleTipData->getPatternCount());
+    }
+    return beagleTipData->setTipPartials(tipIndex, inPartials);
+}
+
+int beagleAttachTipData(int instance,
+                        int tipData) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_ATTACH_TIP_DATA);
+            record.putInt(instance);
+            record.putInt(tipData);
+        }
+        beagle::BeagleTipData* beagleTipData = beagle::getBeagleTipData(tipData);
+        if (beagleTipData == NULL)
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+        beagleTipData->seal();
+        int returnValue = beagleInstance->attachTipData(beagleTipData);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleFinalizeTipData(int tipData) {
+    beagle::BeagleTipData* beagleTipData = beagle::getBeagleTipData(tipData);
+    if (beagleTipData == NULL)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+        beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_FINALIZE_TIP_DATA);
+        record.putInt(tipData);
+    }
+    (*tipDataList)[tipData] = NULL;
+    beagleTipData->release();
+    return BEAGLE_SUCCESS;
+}
+
+int beagleSetPartials(int instance,
+                int bufferIndex,
+                const double* inPartials) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            const beagle::BeagleRecordedDimensions dims = recorder->getInstanceDimensions(instance);
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_SET_PARTIALS);
+            record.putInt(instance);
+            record.putInt(bufferIndex);
+            record.putDoubles(inPartials, (long) dims.stateCount * dims.patternCount * dims.categoryCount);
+        }
+        int returnValue = beagleInstance->setPartials(bufferIndex, inPartials);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleGetPartials(int instance, int bufferIndex, int scaleIndex, double* outPartials) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            const beagle::BeagleRecordedDimensions dims = recorder->getInstanceDimensions(instance);
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_GET_PARTIALS);
+            record.putInt(instance);
+            record.putInt(bufferIndex);
+            record.putInt(scaleIndex);
+            record.putOutput(outPartials, (long) dims.stateCount * dims.patternCount * dims.categoryCount);
+        }
+        int returnValue = beagleInstance->getPartials(bufferIndex, scaleIndex, outPartials);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleSetEigenDecomposition(int instance,
+                          int eigenIndex,
+                          const double* inEigenVectors,
+                          const double* inInverseEigenVectors,
+                          const double* inEigenValues) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            const beagle::BeagleRecordedDimensions dims = recorder->getInstanceDimensions(instance);
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_SET_EIGEN_DECOMPOSITION);
+            record.putInt(instance);
+            record.putInt(eigenIndex);
+            record.putDoubles(inEigenVectors, dims.stateCount * dims.stateCount);
+            record.putDoubles(inInverseEigenVectors, dims.stateCount * dims.stateCount);
+            record.putDoubles(inEigenValues, dims.eigenValueCount);
+        }
+        int returnValue = beagleInstance->setEigenDecomposition(eigenIndex, inEigenVectors,
+                                                     inInverseEigenVectors, inEigenValues);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleSetStateFrequencies(int instance,
+                              int stateFrequenciesIndex,
+                              const double* inStateFrequencies) {
+    DEBUG_START_TIME();
+    beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+    if (beagleInstance == NULL)
+        return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+        const beagle::BeagleRecordedDimensions dims = recorder->getInstanceDimensions(instance);
+        beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_SET_STATE_FREQUENCIES);
+        record.putInt(instance);
+        record.putInt(stateFrequenciesIndex);
+        record.putDoubles(inStateFrequencies, dims.stateCount);
+    }
+    int returnValue = beagleInstance->setStateFrequencies(stateFrequenciesIndex, inStateFrequencies);
+    DEBUG_END_TIME();
+    return returnValue;
+}
+
+int beagleSetCategoryWeights(int instance,
+                             int categoryWeightsIndex,
+                             const double* inCategoryWeights) {
+    DEBUG_START_TIME();
+    beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+    if (beagleInstance == NULL)
+        return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+        const beagle::BeagleRecordedDimensions dims = recorder->getInstanceDimensions(instance);
+        beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_SET_CATEGORY_WEIGHTS);
+        record.putInt(instance);
+        record.putInt(categoryWeightsIndex);
+        record.putDoubles(inCategoryWeights, dims.categoryCount);
+    }
+    int returnValue = beagleInstance->setCategoryWeights(categoryWeightsIndex, inCategoryWeights);
+    DEBUG_END_TIME();
+    return returnValue;
+}
+
+int beagleSetPatternWeights(int instance,
+                            const double* inPatternWeights) {
+    DEBUG_START_TIME();
+    beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+    if (beagleInstance == NULL)
+        return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+        const beagle::BeagleRecordedDimensions dims = recorder->getInstanceDimensions(instance);
+        beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_SET_PATTERN_WEIGHTS);
+        record.putInt(instance);
+        record.putDoubles(inPatternWeights, dims.patternCount);
+    }
+    int returnValue = beagleInstance->setPatternWeights(inPatternWeights);
+    DEBUG_END_TIME();
+    return returnValue;
+}
+
+int beagleSetZeroWeightPatternSkipping(int instance,
+                                       int enabled) {
+    DEBUG_START_TIME();
+    beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+    if (beagleInstance == NULL)
+        return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+        beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_SET_ZERO_WEIGHT_PATTERN_SKIPPING);
+        record.putInt(instance);
+        record.putInt(enabled);
+    }
+    int returnValue = beagleInstance->setZeroWeightPatternSkipping(enabled != 0);
+    DEBUG_END_TIME();
+    return returnValue;
+}
+
+int beagleSetPatternPartitions(int instance,
+                               int partitionCount,
+                               const int* inPatternPartitions) {
+    DEBUG_START_TIME();
+    beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+    if (beagleInstance == NULL)
+        return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+        const beagle::BeagleRecordedDimensions dims = recorder->getInstanceDimensions(instance);
+        beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_SET_PATTERN_PARTITIONS);
+        record.putInt(instance);
+        record.putInt(partitionCount);
+        record.putInts(inPatternPartitions, dims.patternCount);
+    }
+    int returnValue = beagleInstance->setPatternPartitions(partitionCount, inPatternPartitions);
+    DEBUG_END_TIME();
+    return returnValue;
+}
+
+int beagleSetCategoryRates(int instance,
+                     const double* inCategoryRates) {
+    DEBUG_START_TIME();
+//    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            const beagle::BeagleRecordedDimensions dims = recorder->getInstanceDimensions(instance);
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_SET_CATEGORY_RATES);
+            record.putInt(instance);
+            record.putDoubles(inCategoryRates, dims.categoryCount);
+        }
+        int returnValue = beagleInstance->setCategoryRates(inCategoryRates);
+        DEBUG_END_TIME();
+        return returnValue;
+//    }
+//    catch (std::bad_alloc &) {
+//        return BEAGLE_ERROR_OUT_OF_MEMORY;
+//    }
+//    catch (std::out_of_range &) {
 //        return BEAGLE_ERROR_OUT_OF_RANGE;
 //    }
 //    catch (...) {
@@ -949,6 +1771,13 @@ int beagleSetCategoryRatesWithIndex(int instance,
     beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
     if (beagleInstance == NULL)
         return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+        const beagle::BeagleRecordedDimensions dims = recorder->getInstanceDimensions(instance);
+        beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_SET_CATEGORY_RATES_WITH_INDEX);
+        record.putInt(instance);
+        record.putInt(categoryRatesIndex);
+        record.putDoubles(inCategoryRates, dims.categoryCount);
+    }
     int returnValue = beagleInstance->setCategoryRatesWithIndex(categoryRatesIndex, inCategoryRates);
     DEBUG_END_TIME();
     return returnValue;
@@ -963,6 +1792,14 @@ int beagleSetTransitionMatrix(int instance,
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            const beagle::BeagleRecordedDimensions dims = recorder->getInstanceDimensions(instance);
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_SET_TRANSITION_MATRIX);
+            record.putInt(instance);
+            record.putInt(matrixIndex);
+            record.putDoubles(inMatrix, dims.stateCount * dims.stateCount * dims.categoryCount);
+            record.putDouble(paddedValue);
+        }
         int returnValue = beagleInstance->setTransitionMatrix(matrixIndex, inMatrix, paddedValue);
         DEBUG_END_TIME();
         return returnValue;
@@ -988,6 +1825,15 @@ int beagleSetTransitionMatrices(int instance,
     beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
     if (beagleInstance == NULL)
         return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+        const beagle::BeagleRecordedDimensions dims = recorder->getInstanceDimensions(instance);
+        beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_SET_TRANSITION_MATRICES);
+        record.putInt(instance);
+        record.putInts(matrixIndices, count);
+        record.putDoubles(inMatrices, (long) dims.stateCount * dims.stateCount * dims.categoryCount * count);
+        record.putDoubles(paddedValues, count);
+        record.putInt(count);
+    }
     int returnValue = beagleInstance->setTransitionMatrices(matrixIndices, inMatrices, paddedValues, count);
     DEBUG_END_TIME();
     return returnValue;
@@ -1010,6 +1856,13 @@ int beagleGetTransitionMatrix(int instance,
     beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
     if (beagleInstance == NULL)
         return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+        const beagle::BeagleRecordedDimensions dims = recorder->getInstanceDimensions(instance);
+        beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_GET_TRANSITION_MATRIX);
+        record.putInt(instance);
+        record.putInt(matrixIndex);
+        record.putOutput(outMatrix, dims.stateCount * dims.stateCount * dims.categoryCount);
+    }
     int returnValue = beagleInstance->getTransitionMatrix(matrixIndex,outMatrix);
     DEBUG_END_TIME();
     return returnValue;
@@ -1030,6 +1883,14 @@ int beagleConvolveTransitionMatrices(int instance,
     if (beagleInstance == NULL) {
         return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
     } else {
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_CONVOLVE_TRANSITION_MATRICES);
+            record.putInt(instance);
+            record.putInts(firstIndices, matrixCount);
+            record.putInts(secondIndices, matrixCount);
+            record.putInts(resultIndices, matrixCount);
+            record.putInt(matrixCount);
+        }
         int returnValue = beagleInstance->convolveTransitionMatrices(firstIndices,
                                            secondIndices, resultIndices, matrixCount);
         DEBUG_END_TIME();
@@ -1050,6 +1911,16 @@ int beagleUpdateTransitionMatrices(int instance,
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_UPDATE_TRANSITION_MATRICES);
+            record.putInt(instance);
+            record.putInt(eigenIndex);
+            record.putInts(probabilityIndices, count);
+            record.putInts(firstDerivativeIndices, count);
+            record.putInts(secondDerivativeIndices, count);
+            record.putDoubles(edgeLengths, count);
+            record.putInt(count);
+        }
         int returnValue = beagleInstance->updateTransitionMatrices(eigenIndex, probabilityIndices,
                                                         firstDerivativeIndices,
                                                         secondDerivativeIndices, edgeLengths, count);
@@ -1079,6 +1950,17 @@ int beagleUpdateTransitionMatricesWithMultipleModels(int instance,
     beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
     if (beagleInstance == NULL)
         return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+        beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_UPDATE_TRANSITION_MATRICES_MULTIPLE_MODELS);
+        record.putInt(instance);
+        record.putInts(eigenIndices, count);
+        record.putInts(categoryRateIndices, count);
+        record.putInts(probabilityIndices, count);
+        record.putInts(firstDerivativeIndices, count);
+        record.putInts(secondDerivativeIndices, count);
+        record.putDoubles(edgeLengths, count);
+        record.putInt(count);
+    }
     int returnValue = beagleInstance->updateTransitionMatricesWithMultipleModels(eigenIndices, categoryRateIndices,
                                                                                  probabilityIndices, firstDerivativeIndices,
                                                                                  secondDerivativeIndices, edgeLengths, count);
@@ -1086,6 +1968,45 @@ int beagleUpdateTransitionMatricesWithMultipleModels(int instance,
     return returnValue;
 }
 
+int beagleSetTransitionMatrixCacheSize(int instance,
+                                       int cacheSize) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_SET_TRANSITION_MATRIX_CACHE_SIZE);
+            record.putInt(instance);
+            record.putInt(cacheSize);
+        }
+        int returnValue = beagleInstance->setTransitionMatrixCacheSize(cacheSize);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleGetTransitionMatrixCacheStatistics(int instance,
+                                             long* outHitCount,
+                                             long* outMissCount) {
+    DEBUG_START_TIME();
+    beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+    if (beagleInstance == NULL)
+        return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    int returnValue = beagleInstance->getTransitionMatrixCacheStatistics(outHitCount, outMissCount);
+    DEBUG_END_TIME();
+    return returnValue;
+}
+
 
 int beagleUpdatePartials(const int instance,
                    const BeagleOperation* operations,
@@ -1096,6 +2017,13 @@ int beagleUpdatePartials(const int instance,
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_UPDATE_PARTIALS);
+            record.putInt(instance);
+            record.putInts((const int*) operations, (long) BEAGLE_OP_COUNT * operationCount);
+            record.putInt(operationCount);
+            record.putInt(cumulativeScalingIndex);
+        }
         int returnValue = beagleInstance->updatePartials((const int*)operations, operationCount, cumulativeScalingIndex);
         DEBUG_END_TIME();
         return returnValue;
@@ -1118,11 +2046,164 @@ int beagleUpdatePartialsByPartition(const int instance,
     beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
     if (beagleInstance == NULL)
         return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+        beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_UPDATE_PARTIALS_BY_PARTITION);
+        record.putInt(instance);
+        record.putInts((const int*) operations, (long) BEAGLE_PARTITION_OP_COUNT * operationCount);
+        record.putInt(operationCount);
+    }
     int returnValue = beagleInstance->updatePartialsByPartition((const int*)operations, operationCount);
     DEBUG_END_TIME();
     return returnValue;
 }
 
+int beagleSetIncrementalUpdates(int instance,
+                                int enabled) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_SET_INCREMENTAL_UPDATES);
+            record.putInt(instance);
+            record.putInt(enabled);
+        }
+        int returnValue = beagleInstance->setIncrementalUpdates(enabled != 0);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleGetIncrementalUpdateStatistics(int instance,
+                                         int* outOperationCount,
+                                         int* outSkippedCount) {
+    DEBUG_START_TIME();
+    beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+    if (beagleInstance == NULL)
+        return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    int returnValue = beagleInstance->getIncrementalUpdateStatistics(outOperationCount, outSkippedCount);
+    DEBUG_END_TIME();
+    return returnValue;
+}
+
+int beagleSetRootPrePartials(int instance,
+                             const int* bufferIndices,
+                             const int* stateFrequenciesIndices,
+                             int count) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_SET_ROOT_PRE_PARTIALS);
+            record.putInt(instance);
+            record.putInts(bufferIndices, count);
+            record.putInts(stateFrequenciesIndices, count);
+            record.putInt(count);
+        }
+        int returnValue = beagleInstance->setRootPrePartials(bufferIndices, stateFrequenciesIndices, count);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleUpdatePrePartials(const int instance,
+                            const BeagleOperation* operations,
+                            int operationCount,
+                            int cumulativeScaleIndex) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_UPDATE_PRE_PARTIALS);
+            record.putInt(instance);
+            record.putInts((const int*) operations, (long) BEAGLE_OP_COUNT * operationCount);
+            record.putInt(operationCount);
+            record.putInt(cumulativeScaleIndex);
+        }
+        int returnValue = beagleInstance->updatePrePartials((const int*)operations, operationCount,
+                                                            cumulativeScaleIndex);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleCalculateEdgeDerivatives(int instance,
+                                   const int* postBufferIndices,
+                                   const int* preBufferIndices,
+                                   const int* derivativeMatrixIndices,
+                                   const int* categoryWeightsIndices,
+                                   int count,
+                                   double* outDerivatives,
+                                   double* outSumDerivatives,
+                                   double* outSumSquaredDerivatives) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            const beagle::BeagleRecordedDimensions dims = recorder->getInstanceDimensions(instance);
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_CALCULATE_EDGE_DERIVATIVES);
+            record.putInt(instance);
+            record.putInts(postBufferIndices, count);
+            record.putInts(preBufferIndices, count);
+            record.putInts(derivativeMatrixIndices, count);
+            record.putInts(categoryWeightsIndices, count);
+            record.putInt(count);
+            record.putOutput(outDerivatives, (long) count * dims.patternCount);
+            record.putOutput(outSumDerivatives, count);
+            record.putOutput(outSumSquaredDerivatives, count);
+        }
+        int returnValue = beagleInstance->calculateEdgeDerivatives(postBufferIndices, preBufferIndices,
+                                                                   derivativeMatrixIndices, categoryWeightsIndices,
+                                                                   count, outDerivatives, outSumDerivatives,
+                                                                   outSumSquaredDerivatives);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
 int beagleWaitForPartials(const int instance,
                     const int* destinationPartials,
                     int destinationPartialsCount) {
@@ -1131,6 +2212,12 @@ int beagleWaitForPartials(const int instance,
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_WAIT_FOR_PARTIALS);
+            record.putInt(instance);
+            record.putInts(destinationPartials, destinationPartialsCount);
+            record.putInt(destinationPartialsCount);
+        }
         int returnValue = beagleInstance->waitForPartials(destinationPartials,
                                                   destinationPartialsCount);
         DEBUG_END_TIME();
@@ -1156,6 +2243,13 @@ int beagleAccumulateScaleFactors(int instance,
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
          return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_ACCUMULATE_SCALE_FACTORS);
+            record.putInt(instance);
+            record.putInts(scalingIndices, count);
+            record.putInt(count);
+            record.putInt(cumulativeScalingIndex);
+        }
         int returnValue = beagleInstance->accumulateScaleFactors(scalingIndices, count, cumulativeScalingIndex);
         DEBUG_END_TIME();
         return returnValue;
@@ -1181,6 +2275,14 @@ int beagleAccumulateScaleFactorsByPartition(int instance,
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
          return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_ACCUMULATE_SCALE_FACTORS_BY_PARTITION);
+            record.putInt(instance);
+            record.putInts(scalingIndices, count);
+            record.putInt(count);
+            record.putInt(cumulativeScalingIndex);
+            record.putInt(partitionIndex);
+        }
         int returnValue = beagleInstance->accumulateScaleFactorsByPartition(scalingIndices, count, cumulativeScalingIndex, partitionIndex);
         DEBUG_END_TIME();
         return returnValue;
@@ -1205,6 +2307,13 @@ int beagleRemoveScaleFactors(int instance,
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_REMOVE_SCALE_FACTORS);
+            record.putInt(instance);
+            record.putInts(scalingIndices, count);
+            record.putInt(count);
+            record.putInt(cumulativeScalingIndex);
+        }
         int returnValue = beagleInstance->removeScaleFactors(scalingIndices, count, cumulativeScalingIndex);
         DEBUG_END_TIME();
         return returnValue;
@@ -1230,6 +2339,14 @@ int beagleRemoveScaleFactorsByPartition(int instance,
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_REMOVE_SCALE_FACTORS_BY_PARTITION);
+            record.putInt(instance);
+            record.putInts(scalingIndices, count);
+            record.putInt(count);
+            record.putInt(cumulativeScalingIndex);
+            record.putInt(partitionIndex);
+        }
         int returnValue = beagleInstance->removeScaleFactorsByPartition(scalingIndices, count, cumulativeScalingIndex, partitionIndex);
         DEBUG_END_TIME();
         return returnValue;
@@ -1252,6 +2369,11 @@ int beagleResetScaleFactors(int instance,
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_RESET_SCALE_FACTORS);
+            record.putInt(instance);
+            record.putInt(cumulativeScalingIndex);
+        }
         int returnValue = beagleInstance->resetScaleFactors(cumulativeScalingIndex);
         DEBUG_END_TIME();
         return returnValue;
@@ -1275,6 +2397,12 @@ int beagleResetScaleFactorsByPartition(int instance,
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_RESET_SCALE_FACTORS_BY_PARTITION);
+            record.putInt(instance);
+            record.putInt(cumulativeScalingIndex);
+            record.putInt(partitionIndex);
+        }
         int returnValue = beagleInstance->resetScaleFactorsByPartition(cumulativeScalingIndex, partitionIndex);
         DEBUG_END_TIME();
         return returnValue;
@@ -1298,6 +2426,12 @@ int beagleCopyScaleFactors(int instance,
     beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
     if (beagleInstance == NULL)
         return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+        beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_COPY_SCALE_FACTORS);
+        record.putInt(instance);
+        record.putInt(destScalingIndex);
+        record.putInt(srcScalingIndex);
+    }
     int returnValue = beagleInstance->copyScaleFactors(destScalingIndex, srcScalingIndex);
     DEBUG_END_TIME();
     return returnValue;
@@ -1321,6 +2455,13 @@ int beagleGetScaleFactors(int instance,
     beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
     if (beagleInstance == NULL)
         return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+        const beagle::BeagleRecordedDimensions dims = recorder->getInstanceDimensions(instance);
+        beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_GET_SCALE_FACTORS);
+        record.putInt(instance);
+        record.putInt(srcScalingIndex);
+        record.putOutput(scaleFactors, dims.patternCount);
+    }
     int returnValue = beagleInstance->getScaleFactors(srcScalingIndex, scaleFactors);
     DEBUG_END_TIME();
     return returnValue;
@@ -1348,6 +2489,16 @@ int beagleCalculateRootLogLikelihoods(int instance,
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_CALCULATE_ROOT_LOG_LIKELIHOODS);
+            record.putInt(instance);
+            record.putInts(bufferIndices, count);
+            record.putInts(categoryWeightsIndices, count);
+            record.putInts(stateFrequenciesIndices, count);
+            record.putInts(cumulativeScaleIndices, count);
+            record.putInt(count);
+            record.putOutput(outSumLogLikelihood, count);
+        }
         int returnValue = beagleInstance->calculateRootLogLikelihoods(bufferIndices, categoryWeightsIndices,
                                                            stateFrequenciesIndices,
                                                            cumulativeScaleIndices,
@@ -1392,6 +2543,19 @@ int beagleCalculateRootLogLikelihoodsByPartition(int instance,
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_CALCULATE_ROOT_LOG_LIKELIHOODS_BY_PARTITION);
+            record.putInt(instance);
+            record.putInts(bufferIndices, (long) partitionCount * count);
+            record.putInts(categoryWeightsIndices, (long) partitionCount * count);
+            record.putInts(stateFrequenciesIndices, (long) partitionCount * count);
+            record.putInts(cumulativeScaleIndices, (long) partitionCount * count);
+            record.putInts(partitionIndices, (long) partitionCount * count);
+            record.putInt(partitionCount);
+            record.putInt(count);
+            record.putOutput(outSumLogLikelihoodByPartition, (long) partitionCount * count);
+            record.putOutput(outSumLogLikelihood, count);
+        }
         int returnValue = beagleInstance->calculateRootLogLikelihoodsByPartition(bufferIndices,
                                                                                  categoryWeightsIndices,
                                                                                  stateFrequenciesIndices,
@@ -1431,6 +2595,383 @@ int beagleCalculateRootLogLikelihoodsByPartition(int instance,
 
 }
 
+int beagleEvaluateRootLogLikelihood(int instance,
+                                    int eigenIndex,
+                                    const int* probabilityIndices,
+                                    const double* edgeLengths,
+                                    int matrixCount,
+                                    const BeagleOperation* operations,
+                                    int operationCount,
+                                    int rootBufferIndex,
+                                    int categoryWeightsIndex,
+                                    int stateFrequenciesIndex,
+                                    int cumulativeScaleIndex,
+                                    double* outSumLogLikelihood) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_EVALUATE_ROOT_LOG_LIKELIHOOD);
+            record.putInt(instance);
+            record.putInt(eigenIndex);
+            record.putInts(probabilityIndices, matrixCount);
+            record.putDoubles(edgeLengths, matrixCount);
+            record.putInt(matrixCount);
+            record.putInts((const int*) operations, (long) BEAGLE_OP_COUNT * operationCount);
+            record.putInt(operationCount);
+            record.putInt(rootBufferIndex);
+            record.putInt(categoryWeightsIndex);
+            record.putInt(stateFrequenciesIndex);
+            record.putInt(cumulativeScaleIndex);
+            record.putOutput(outSumLogLikelihood, 1);
+        }
+        int returnValue = beagleInstance->evaluateRootLogLikelihood(eigenIndex, probabilityIndices, edgeLengths,
+                                                                    matrixCount, (const int*) operations,
+                                                                    operationCount, rootBufferIndex,
+                                                                    categoryWeightsIndex, stateFrequenciesIndex,
+                                                                    cumulativeScaleIndex, outSumLogLikelihood);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleSetTree(int instance,
+                  const int* parentIndices,
+                  const int* matrixIndices,
+                  int nodeCount,
+                  int useScaling) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_SET_TREE);
+            record.putInt(instance);
+            record.putInts(parentIndices, nodeCount);
+            record.putInts(matrixIndices, nodeCount);
+            record.putInt(nodeCount);
+            record.putInt(useScaling);
+        }
+        beagle::BeagleTree* beagleTree = beagle::getBeagleTree(instance);
+        if (beagleTree == NULL) {
+            if (treeList == NULL)
+                treeList = new std::vector<beagle::BeagleTree*>;
+            if ((int) treeList->size() <= instance)
+                treeList->resize(instance + 1, NULL);
+            beagleTree = new beagle::BeagleTree();
+            (*treeList)[instance] = beagleTree;
+        }
+        int returnValue = beagleTree->setTopology(parentIndices, matrixIndices, nodeCount, useScaling != 0);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleGetTreeOperations(int instance,
+                            BeagleOperation* outOperations,
+                            int* outOperationCount,
+                            int* outLevelCounts,
+                            int* outRootIndex,
+                            int* outCumulativeScaleIndex) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleTree* beagleTree = beagle::getBeagleTree(instance);
+        if (beagleTree == NULL || !beagleTree->hasTopology())
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (outOperations == NULL || outOperationCount == NULL || outRootIndex == NULL ||
+            outCumulativeScaleIndex == NULL)
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            const int nodeCount = beagleTree->getNodeCount();
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_GET_TREE_OPERATIONS);
+            record.putInt(instance);
+            record.putOutput(outOperations, (long) BEAGLE_OP_COUNT * nodeCount);
+            record.putOutput(outOperationCount, 1);
+            // outLevelCounts is optional; a NULL array is recorded as absent and replayed as NULL
+            if (outLevelCounts != NULL)
+                record.putOutput(outLevelCounts, nodeCount);
+            else
+                record.putOutput(NULL, 0);
+            record.putOutput(outRootIndex, 1);
+            record.putOutput(outCumulativeScaleIndex, 1);
+        }
+        const int operationCount = beagleTree->getOperationCount();
+        memcpy(outOperations, beagleTree->getOperations(), sizeof(int) * BEAGLE_OP_COUNT * operationCount);
+        *outOperationCount = operationCount;
+        if (outLevelCounts != NULL) {
+            const std::vector<int>& levelCounts = beagleTree->getLevelCounts();
+            std::copy(levelCounts.begin(), levelCounts.end(), outLevelCounts);
+        }
+        *outRootIndex = beagleTree->getRootIndex();
+        *outCumulativeScaleIndex = beagleTree->getCumulativeScaleIndex();
+        DEBUG_END_TIME();
+        return BEAGLE_SUCCESS;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleEvaluateTree(int instance,
+                       int eigenIndex,
+                       const double* edgeLengths,
+                       int categoryWeightsIndex,
+                       int stateFrequenciesIndex,
+                       double* outSumLogLikelihood) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        beagle::BeagleTree* beagleTree = beagle::getBeagleTree(instance);
+        if (beagleTree == NULL || !beagleTree->hasTopology())
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_EVALUATE_TREE);
+            record.putInt(instance);
+            record.putInt(eigenIndex);
+            record.putDoubles(edgeLengths, beagleTree->getNodeCount());
+            record.putInt(categoryWeightsIndex);
+            record.putInt(stateFrequenciesIndex);
+            record.putOutput(outSumLogLikelihood, 1);
+        }
+
+        const std::vector<int>& branchMatrices = beagleTree->getBranchMatrices();
+        const std::vector<int>& branchNodes = beagleTree->getBranchNodes();
+        std::vector<double> branchLengths(branchNodes.size());
+        for (size_t i = 0; i < branchNodes.size(); i++)
+            branchLengths[i] = edgeLengths[branchNodes[i]];
+
+        int returnValue = beagleInstance->evaluateRootLogLikelihood(eigenIndex, branchMatrices.data(),
+                                                                    branchLengths.data(), branchMatrices.size(),
+                                                                    beagleTree->getOperations(),
+                                                                    beagleTree->getOperationCount(),
+                                                                    beagleTree->getRootIndex(),
+                                                                    categoryWeightsIndex, stateFrequenciesIndex,
+                                                                    beagleTree->getCumulativeScaleIndex(),
+                                                                    outSumLogLikelihood);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+/// evaluates the jobs of one instance, reporting an exception as the error code of every job
+int evaluateInstanceJobs(int instance,
+                         const BeagleEvaluationJob* jobs,
+                         int jobCount,
+                         double* outSumLogLikelihoods,
+                         int* outReturnCodes) {
+    int returnValue;
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            returnValue = BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        else
+            return beagleInstance->evaluateRootLogLikelihoods(jobs, jobCount, outSumLogLikelihoods,
+                                                              outReturnCodes);
+    }
+    catch (std::bad_alloc &) {
+        returnValue = BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        returnValue = BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        returnValue = BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+    for (int i = 0; i < jobCount; i++)
+        outReturnCodes[i] = returnValue;
+    return returnValue;
+}
+
+int beagleEvaluateRootLogLikelihoods(const BeagleEvaluationJob* jobs,
+                                     int jobCount,
+                                     int threadCount,
+                                     double* outSumLogLikelihoods,
+                                     int* outReturnCodes) {
+    DEBUG_START_TIME();
+    try {
+        if (jobCount < 0 || threadCount < 0)
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_EVALUATE_ROOT_LOG_LIKELIHOODS);
+            record.putInt(jobCount);
+            record.putInt(threadCount);
+            for (int i = 0; i < jobCount; i++) {
+                const BeagleEvaluationJob& job = jobs[i];
+                record.putInt(job.instance);
+                record.putInt(job.eigenIndex);
+                record.putInts(job.probabilityIndices, job.matrixCount);
+                record.putDoubles(job.edgeLengths, job.matrixCount);
+                record.putInt(job.matrixCount);
+                record.putInts((const int*) job.operations, (long) BEAGLE_OP_COUNT * job.operationCount);
+                record.putInt(job.operationCount);
+                record.putInt(job.rootBufferIndex);
+                record.putInt(job.categoryWeightsIndex);
+                record.putInt(job.stateFrequenciesIndex);
+                record.putInt(job.cumulativeScaleIndex);
+            }
+            record.putOutput(outSumLogLikelihoods, jobCount);
+            record.putOutput(outReturnCodes, jobCount);
+        }
+
+        // jobs are grouped by instance and keep their order within an instance
+        std::map<int, int> groupOfInstance;
+        std::vector<int> groupInstances;
+        std::vector<std::vector<int> > groupJobIndices;
+        for (int i = 0; i < jobCount; i++) {
+            std::map<int, int>::iterator it = groupOfInstance.find(jobs[i].instance);
+            if (it == groupOfInstance.end()) {
+                it = groupOfInstance.insert(std::make_pair(jobs[i].instance, (int) groupInstances.size())).first;
+                groupInstances.push_back(jobs[i].instance);
+                groupJobIndices.push_back(std::vector<int>());
+            }
+            groupJobIndices[it->second].push_back(i);
+        }
+
+        const int groupCount = groupInstances.size();
+        std::vector<std::vector<BeagleEvaluationJob> > groupJobs(groupCount);
+        std::vector<std::vector<double> > groupSums(groupCount);
+        std::vector<std::vector<int> > groupReturnCodes(groupCount);
+        for (int g = 0; g < groupCount; g++) {
+            for (size_t j = 0; j < groupJobIndices[g].size(); j++)
+                groupJobs[g].push_back(jobs[groupJobIndices[g][j]]);
+            groupSums[g].resize(groupJobs[g].size(), 0.0);
+            groupReturnCodes[g].resize(groupJobs[g].size(), BEAGLE_SUCCESS);
+        }
+
+        // instances do not share state, so each worker takes whole instances
+        std::atomic<int> nextGroup(0);
+        auto evaluateGroups = [&]() {
+            for (int g = nextGroup++; g < groupCount; g = nextGroup++) {
+                evaluateInstanceJobs(groupInstances[g], &groupJobs[g][0], groupJobs[g].size(),
+                                     &groupSums[g][0], &groupReturnCodes[g][0]);
+            }
+        };
+
+        int workerCount = (threadCount > 0 ? threadCount : (int) std::thread::hardware_concurrency());
+        workerCount = std::max(1, std::min(workerCount, groupCount));
+
+        std::vector<std::thread> workers;
+        for (int t = 1; t < workerCount; t++)
+            workers.push_back(std::thread(evaluateGroups));
+        evaluateGroups();
+        for (size_t t = 0; t < workers.size(); t++)
+            workers[t].join();
+
+        std::vector<int> returnCodes(jobCount);
+        for (int g = 0; g < groupCount; g++) {
+            for (size_t j = 0; j < groupJobIndices[g].size(); j++) {
+                const int i = groupJobIndices[g][j];
+                outSumLogLikelihoods[i] = groupSums[g][j];
+                returnCodes[i] = groupReturnCodes[g][j];
+            }
+        }
+
+        int returnValue = BEAGLE_SUCCESS;
+        for (int i = 0; i < jobCount; i++) {
+            if (outReturnCodes != NULL)
+                outReturnCodes[i] = returnCodes[i];
+            if (returnValue == BEAGLE_SUCCESS)
+                returnValue = returnCodes[i];
+        }
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleCalculateRootLogLikelihoodsForWeights(int instance,
+                                                int bufferIndex,
+                                                int categoryWeightsIndex,
+                                                int stateFrequenciesIndex,
+                                                int cumulativeScaleIndex,
+                                                const double* inPatternWeights,
+                                                int weightVectorCount,
+                                                double* outSumLogLikelihoods) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            const beagle::BeagleRecordedDimensions dims = recorder->getInstanceDimensions(instance);
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_CALCULATE_ROOT_LOG_LIKELIHOODS_FOR_WEIGHTS);
+            record.putInt(instance);
+            record.putInt(bufferIndex);
+            record.putInt(categoryWeightsIndex);
+            record.putInt(stateFrequenciesIndex);
+            record.putInt(cumulativeScaleIndex);
+            record.putDoubles(inPatternWeights, (long) dims.patternCount * weightVectorCount);
+            record.putInt(weightVectorCount);
+            record.putOutput(outSumLogLikelihoods, weightVectorCount);
+        }
+        int returnValue = beagleInstance->calculateRootLogLikelihoodsForWeights(bufferIndex,
+                                                                                categoryWeightsIndex,
+                                                                                stateFrequenciesIndex,
+                                                                                cumulativeScaleIndex,
+                                                                                inPatternWeights,
+                                                                                weightVectorCount,
+                                                                                outSumLogLikelihoods);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
 int beagleCalculateEdgeLogLikelihoods(int instance,
                                       const int* parentBufferIndices,
                                       const int* childBufferIndices,
@@ -1449,6 +2990,22 @@ int beagleCalculateEdgeLogLikelihoods(int instance,
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_CALCULATE_EDGE_LOG_LIKELIHOODS);
+            record.putInt(instance);
+            record.putInts(parentBufferIndices, count);
+            record.putInts(childBufferIndices, count);
+            record.putInts(probabilityIndices, count);
+            record.putInts(firstDerivativeIndices, count);
+            record.putInts(secondDerivativeIndices, count);
+            record.putInts(categoryWeightsIndices, count);
+            record.putInts(stateFrequenciesIndices, count);
+            record.putInts(cumulativeScaleIndices, count);
+            record.putInt(count);
+            record.putOutput(outSumLogLikelihood, count);
+            record.putOutput(outSumFirstDerivative, count);
+            record.putOutput(outSumSecondDerivative, count);
+        }
         int returnValue = beagleInstance->calculateEdgeLogLikelihoods(parentBufferIndices, childBufferIndices,
                                                            probabilityIndices,
                                                            firstDerivativeIndices,
@@ -1508,6 +3065,27 @@ int beagleCalculateEdgeLogLikelihoodsByPartition(int instance,
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_CALCULATE_EDGE_LOG_LIKELIHOODS_BY_PARTITION);
+            record.putInt(instance);
+            record.putInts(parentBufferIndices, (long) partitionCount * count);
+            record.putInts(childBufferIndices, (long) partitionCount * count);
+            record.putInts(probabilityIndices, (long) partitionCount * count);
+            record.putInts(firstDerivativeIndices, (long) partitionCount * count);
+            record.putInts(secondDerivativeIndices, (long) partitionCount * count);
+            record.putInts(categoryWeightsIndices, (long) partitionCount * count);
+            record.putInts(stateFrequenciesIndices, (long) partitionCount * count);
+            record.putInts(cumulativeScaleIndices, (long) partitionCount * count);
+            record.putInts(partitionIndices, (long) partitionCount * count);
+            record.putInt(partitionCount);
+            record.putInt(count);
+            record.putOutput(outSumLogLikelihoodByPartition, (long) partitionCount * count);
+            record.putOutput(outSumLogLikelihood, count);
+            record.putOutput(outSumFirstDerivativeByPartition, (long) partitionCount * count);
+            record.putOutput(outSumFirstDerivative, count);
+            record.putOutput(outSumSecondDerivativeByPartition, (long) partitionCount * count);
+            record.putOutput(outSumSecondDerivative, count);
+        }
         int returnValue = beagleInstance->calculateEdgeLogLikelihoodsByPartition(
                                                         parentBufferIndices,
                                                         childBufferIndices,
@@ -1560,12 +3138,230 @@ int beagleCalculateEdgeLogLikelihoodsByPartition(int instance,
 //    }
 }
 
+int beagleCalculateEdgeSumtable(int instance,
+                                int parentBufferIndex,
+                                int childBufferIndex,
+                                int eigenIndex,
+                                int categoryWeightsIndex,
+                                int stateFrequenciesIndex,
+                                int cumulativeScaleIndex) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_CALCULATE_EDGE_SUMTABLE);
+            record.putInt(instance);
+            record.putInt(parentBufferIndex);
+            record.putInt(childBufferIndex);
+            record.putInt(eigenIndex);
+            record.putInt(categoryWeightsIndex);
+            record.putInt(stateFrequenciesIndex);
+            record.putInt(cumulativeScaleIndex);
+        }
+        int returnValue = beagleInstance->calculateEdgeSumtable(parentBufferIndex, childBufferIndex, eigenIndex,
+                                                                categoryWeightsIndex, stateFrequenciesIndex,
+                                                                cumulativeScaleIndex);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleCalculateEdgeSumtableLogLikelihood(int instance,
+                                             double edgeLength,
+                                             double* outSumLogLikelihood,
+                                             double* outSumFirstDerivative,
+                                             double* outSumSecondDerivative) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_CALCULATE_EDGE_SUMTABLE_LOG_LIKELIHOOD);
+            record.putInt(instance);
+            record.putDouble(edgeLength);
+            record.putOutput(outSumLogLikelihood, 1);
+            record.putOutput(outSumFirstDerivative, 1);
+            record.putOutput(outSumSecondDerivative, 1);
+        }
+        int returnValue = beagleInstance->calculateEdgeSumtableLogLikelihood(edgeLength, outSumLogLikelihood,
+                                                                             outSumFirstDerivative,
+                                                                             outSumSecondDerivative);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleOptimizeEdgeLength(int instance,
+                             double* inOutEdgeLength,
+                             double minEdgeLength,
+                             double maxEdgeLength,
+                             double tolerance,
+                             int maxIterations,
+                             double* outSumLogLikelihood) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_OPTIMIZE_EDGE_LENGTH);
+            record.putInt(instance);
+            record.putDoubles(inOutEdgeLength, 1);
+            record.putDouble(minEdgeLength);
+            record.putDouble(maxEdgeLength);
+            record.putDouble(tolerance);
+            record.putInt(maxIterations);
+            record.putOutput(outSumLogLikelihood, 1);
+        }
+        int returnValue = beagleInstance->optimizeEdgeLength(inOutEdgeLength, minEdgeLength, maxEdgeLength,
+                                                             tolerance, maxIterations, outSumLogLikelihood);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleCalculateInsertionLogLikelihoods(int instance,
+                                           const int* postBufferIndices,
+                                           const int* preBufferIndices,
+                                           const int* cumulativeScaleIndices,
+                                           int count,
+                                           int subtreeBufferIndex,
+                                           int subtreeMatrixIndex,
+                                           int categoryWeightsIndex,
+                                           double* outSumLogLikelihoods) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_CALCULATE_INSERTION_LOG_LIKELIHOODS);
+            record.putInt(instance);
+            record.putInts(postBufferIndices, count);
+            record.putInts(preBufferIndices, count);
+            record.putInts(cumulativeScaleIndices, count);
+            record.putInt(count);
+            record.putInt(subtreeBufferIndex);
+            record.putInt(subtreeMatrixIndex);
+            record.putInt(categoryWeightsIndex);
+            record.putOutput(outSumLogLikelihoods, count);
+        }
+        int returnValue = beagleInstance->calculateInsertionLogLikelihoods(postBufferIndices, preBufferIndices,
+                                                                           cumulativeScaleIndices, count,
+                                                                           subtreeBufferIndex, subtreeMatrixIndex,
+                                                                           categoryWeightsIndex,
+                                                                           outSumLogLikelihoods);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleOptimizeInsertionLogLikelihoods(int instance,
+                                          const int* postBufferIndices,
+                                          const int* preBufferIndices,
+                                          const int* cumulativeScaleIndices,
+                                          int count,
+                                          int subtreeBufferIndex,
+                                          int eigenIndex,
+                                          int categoryWeightsIndex,
+                                          double* inOutPendantLengths,
+                                          double minEdgeLength,
+                                          double maxEdgeLength,
+                                          double tolerance,
+                                          int maxIterations,
+                                          double* outSumLogLikelihoods) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+            beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_OPTIMIZE_INSERTION_LOG_LIKELIHOODS);
+            record.putInt(instance);
+            record.putInts(postBufferIndices, count);
+            record.putInts(preBufferIndices, count);
+            record.putInts(cumulativeScaleIndices, count);
+            record.putInt(count);
+            record.putInt(subtreeBufferIndex);
+            record.putInt(eigenIndex);
+            record.putInt(categoryWeightsIndex);
+            record.putDoubles(inOutPendantLengths, count);
+            record.putDouble(minEdgeLength);
+            record.putDouble(maxEdgeLength);
+            record.putDouble(tolerance);
+            record.putInt(maxIterations);
+            record.putOutput(outSumLogLikelihoods, count);
+        }
+        int returnValue = beagleInstance->optimizeInsertionLogLikelihoods(postBufferIndices, preBufferIndices,
+                                                                          cumulativeScaleIndices, count,
+                                                                          subtreeBufferIndex, eigenIndex,
+                                                                          categoryWeightsIndex, inOutPendantLengths,
+                                                                          minEdgeLength, maxEdgeLength, tolerance,
+                                                                          maxIterations, outSumLogLikelihoods);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
 int beagleGetLogLikelihood(int instance,
                             double* outSumLogLikelihood) {
     DEBUG_START_TIME();
     beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
     if (beagleInstance == NULL)
         return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+        beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_GET_LOG_LIKELIHOOD);
+        record.putInt(instance);
+        record.putOutput(outSumLogLikelihood, 1);
+    }
     int returnValue = beagleInstance->getLogLikelihood(outSumLogLikelihood);
     DEBUG_END_TIME();
 
@@ -1586,6 +3382,12 @@ int beagleGetDerivatives(int instance,
     beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
     if (beagleInstance == NULL)
         return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+        beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_GET_DERIVATIVES);
+        record.putInt(instance);
+        record.putOutput(outSumFirstDerivative, 1);
+        record.putOutput(outSumSecondDerivative, 1);
+    }
     int returnValue = beagleInstance->getDerivatives(outSumFirstDerivative,
                                                      outSumSecondDerivative);
     DEBUG_END_TIME();
@@ -1609,6 +3411,12 @@ int beagleGetSiteLogLikelihoods(int instance,
     beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
     if (beagleInstance == NULL)
         return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+        const beagle::BeagleRecordedDimensions dims = recorder->getInstanceDimensions(instance);
+        beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_GET_SITE_LOG_LIKELIHOODS);
+        record.putInt(instance);
+        record.putOutput(outLogLikelihoods, dims.patternCount);
+    }
     int returnValue = beagleInstance->getSiteLogLikelihoods(outLogLikelihoods);
     DEBUG_END_TIME();
 
@@ -1631,6 +3439,13 @@ int beagleGetSiteDerivatives(int instance,
     beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
     if (beagleInstance == NULL)
         return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    if (beagle::BeagleRecorder* recorder = beagle::getBeagleRecorder()) {
+        const beagle::BeagleRecordedDimensions dims = recorder->getInstanceDimensions(instance);
+        beagle::BeagleRecord record(*recorder, beagle::BEAGLE_RECORD_GET_SITE_DERIVATIVES);
+        record.putInt(instance);
+        record.putOutput(outFirstDerivatives, dims.patternCount);
+        record.putOutput(outSecondDerivatives, dims.patternCount);
+    }
     int returnValue = beagleInstance->getSiteDerivatives(outFirstDerivatives, outSecondDerivatives);
     DEBUG_END_TIME();
 
@@ -108,6 +108,8 @@
 #ifndef __beagle__
 #define __beagle__
 
+#include <limits.h>
+
 #include "libhmsbeagle/platform.h"
 
 /**
@@ -183,6 +185,18 @@ enum BeagleFlags {
     BEAGLE_FLAG_PARALLELOPS_GRID    = 1 << 29    /**< Operations in updatePartials may be folded into single kernel launch (necessary for partitions; typically performs better for problems with fewer pattern sites) */
 };
 
+/*
+ * Flags above bit 30. Enumerators are limited to the range of int, so these
+ * are macros, and they only exist where long is wider than 32 bits (not on
+ * 32-bit or LLP64 Windows builds). Elsewhere no implementation offers them,
+ * requiring bit 31 fails with BEAGLE_ERROR_NO_RESOURCE, and instances are
+ * never autotuned.
+ */
+#if LONG_MAX > INT_MAX
+#define BEAGLE_FLAG_PARTIALS_MAPPED     (1L << 31)   /**< Internal partials buffers are stored in a memory-mapped scratch file in $BEAGLE_SCRATCH_DIR or $TMPDIR (out-of-core computation) */
+#define BEAGLE_FLAG_AUTOTUNE            (1L << 32)   /**< Preference only: choose the implementation, vector extensions and thread count by timing the candidates on the problem when the instance is created */
+#endif
+
 
 /**
  * @anchor BEAGLE_BENCHFLAGS
@@ -196,6 +210,7 @@ enum BeagleBenchmarkFlags {
     BEAGLE_BENCHFLAG_SCALING_NONE        = 1 << 0,    /**< No scaling */
     BEAGLE_BENCHFLAG_SCALING_ALWAYS      = 1 << 1,    /**< Scale at every iteration */
     BEAGLE_BENCHFLAG_SCALING_DYNAMIC     = 1 << 2,    /**< Scale every fixed number of iterations or when a numerical error occurs, and re-use scale factors for subsequent iterations */
+    BEAGLE_BENCHFLAG_CACHE_REFRESH       = 1 << 3,    /**< Benchmark again instead of using cached results, and replace the cached results of the problem */
 };
 
 /**
@@ -225,6 +240,59 @@ typedef struct {
                          *   capabilities of the resource and implementation for this instance */
 } BeagleInstanceDetails;
 
+/**
+ * @brief Memory footprint of an instance, in bytes
+ */
+typedef struct {
+    long long partials;     /**< Internal partials buffers */
+    long long tips;         /**< Tip partials and compact tip state buffers */
+    long long matrices;     /**< Transition probability matrix buffers */
+    long long scaleBuffers; /**< Scale factor buffers */
+    long long model;        /**< Eigen decompositions, category rates and weights, state frequencies
+                             *   and pattern weights */
+    long long scratch;      /**< Temporary buffers used during integration */
+    long long threadLocal;  /**< Operation queues and partition bookkeeping for worker threads
+                             *   (excluding thread stacks) */
+    long long mapped;       /**< Part of partials held in a memory-mapped scratch file rather than in memory
+                             *   (see BEAGLE_FLAG_PARTIALS_MAPPED) */
+    long long total;        /**< Sum of all categories above except mapped */
+} BeagleMemoryUsage;
+
+/**
+ * @brief Kernel types of the performance counters
+ *
+ * This enumerates the kinds of work counted by beagleGetPerformanceCounters.
+ */
+enum BeagleKernelTypes {
+    BEAGLE_KERNEL_STATES_STATES       = 0, /**< Partials of two compact tip state children */
+    BEAGLE_KERNEL_STATES_PARTIALS     = 1, /**< Partials of a compact tip state child and a partials child */
+    BEAGLE_KERNEL_PARTIALS_PARTIALS   = 2, /**< Partials of two partials children */
+    BEAGLE_KERNEL_RESCALE             = 3, /**< Rescaling of partials and computing their scale factors */
+    BEAGLE_KERNEL_ROOT_INTEGRATION    = 4, /**< Root log likelihoods */
+    BEAGLE_KERNEL_EDGE_INTEGRATION    = 5, /**< Edge log likelihoods and their derivatives */
+    BEAGLE_KERNEL_TRANSITION_MATRICES = 6, /**< Transition probability matrices */
+    BEAGLE_KERNEL_THREAD_DISPATCH     = 7, /**< Handing partials operations to worker threads and
+                                            *   waiting for them to finish */
+    BEAGLE_KERNEL_TYPE_COUNT          = 8  /**< Number of kernel types */
+};
+
+/**
+ * @brief Performance counters of one kernel type
+ *
+ * Floating-point operation and byte counts are estimates from the dimensions of the instance
+ * (states, patterns and categories), not hardware counts. Bytes are those the kernel reads and
+ * writes in buffers, counting each buffer once per call.
+ */
+typedef struct {
+    long callCount;     /**< Number of kernel calls */
+    long patternCount;  /**< Site patterns processed, summed over calls */
+    double flops;       /**< Estimated floating-point operations */
+    double bytes;       /**< Estimated bytes moved */
+    double wallTime;    /**< Elapsed time in seconds, summed over the threads running the kernel */
+    double threadTime;  /**< CPU time in seconds of the threads running the kernel; falls short of
+                         *   wallTime when they wait or are descheduled */
+} BeagleKernelCounters;
+
 /**
  * @brief Description of a hardware resource
  */
@@ -315,6 +383,13 @@ BEAGLE_DLLEXPORT BeagleResourceList* beagleGetResourceList(void);
  * benchmark times and CPU performance ratios for each resource. Resources are benchmarked
  * with the given analysis parameters and the array is ordered from fastest to slowest.
  * If there is an error the function returns NULL.
+ *
+ * If the environment variable BEAGLE_BENCHMARK_CACHE names a file, benchmark results are kept
+ * in it, keyed by library version, CPU model, resource, flags and problem shape, and reused by
+ * later calls. A result for a pattern count not in the cache is interpolated between cached
+ * results at nearby pattern counts (within a factor of 4). Setting
+ * BEAGLE_BENCHFLAG_CACHE_REFRESH in benchmarkFlags discards the cached results of the problem
+ * and benchmarks again.
  * 
  * @param tipCount              Number of tip data elements (input)
  * @param compactBufferCount    Number of compact state representation tips (input)
@@ -358,6 +433,15 @@ BEAGLE_DLLEXPORT BeagleBenchmarkedResourceList* beagleGetBenchmarkedResourceList
  * multiple times to create multiple data partition instances each returning a unique
  * identifier.
  *
+ * With BEAGLE_FLAG_AUTOTUNE in preferenceFlags, the implementations on the resource the
+ * instance would be created on are timed on a small tree with the instance's pattern, state
+ * and category counts, without threads and with increasing numbers of C++ threads, and the
+ * fastest is created. The choice is reported in returnInfo: its flags include
+ * BEAGLE_FLAG_AUTOTUNE and the chosen vector and threading flags. beagleGetCPUThreadCount
+ * returns the chosen thread count. Precision and user requirements are kept. The calibration
+ * runs for every such call, so it is meant for instances that are used for long. The flag only
+ * exists where long is wider than 32 bits.
+ *
  * @param tipCount              Number of tip data elements (input)
  * @param partialsBufferCount   Number of partials buffers to create (input)
  * @param compactBufferCount    Number of compact state representation buffers to create (input)
@@ -397,6 +481,209 @@ BEAGLE_DLLEXPORT int beagleCreateInstance(int tipCount,
                          long requirementFlags,
                          BeagleInstanceDetails* returnInfo);
 
+/**
+ * @brief Estimate the memory footprint of an instance before creating it
+ *
+ * This function selects an implementation exactly as beagleCreateInstance would, but instead
+ * of allocating an instance it reports the memory the instance would hold once all tip data
+ * and model parameters have been set.
+ *
+ * @param tipCount              Number of tip data elements (input)
+ * @param partialsBufferCount   Number of partials buffers to create (input)
+ * @param compactBufferCount    Number of compact state representation buffers to create (input)
+ * @param stateCount            Number of states in the continuous-time Markov chain (input)
+ * @param patternCount          Number of site patterns to be handled by the instance (input)
+ * @param eigenBufferCount      Number of rate matrix eigen-decomposition, category weight,
+ *                               category rates, and state frequency buffers to allocate (input)
+ * @param matrixBufferCount     Number of transition probability matrix buffers (input)
+ * @param categoryCount         Number of rate categories (input)
+ * @param scaleBufferCount      Number of scale buffers to create, ignored for auto scale or always scale (input)
+ * @param resourceList          List of potential resources on which this instance is allowed
+ *                               (input, NULL implies no restriction)
+ * @param resourceCount         Length of resourceList list (input)
+ * @param preferenceFlags       Bit-flags indicating preferred implementation characteristics,
+ *                               see BeagleFlags (input)
+ * @param requirementFlags      Bit-flags indicating required implementation characteristics,
+ *                               see BeagleFlags (input)
+ * @param outMemoryUsage        Pointer to destination for the estimated footprint (output)
+ * @param returnInfo            Pointer to return implementation and resource details, may be NULL (output)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleEstimateMemoryUsage(int tipCount,
+                                               int partialsBufferCount,
+                                               int compactBufferCount,
+                                               int stateCount,
+                                               int patternCount,
+                                               int eigenBufferCount,
+                                               int matrixBufferCount,
+                                               int categoryCount,
+                                               int scaleBufferCount,
+                                               int* resourceList,
+                                               int resourceCount,
+                                               long preferenceFlags,
+                                               long requirementFlags,
+                                               BeagleMemoryUsage* outMemoryUsage,
+                                               BeagleInstanceDetails* returnInfo);
+
+/**
+ * @brief Get the memory footprint of an instance
+ *
+ * This function reports the memory currently held by an instance, broken down by purpose.
+ *
+ * @param instance          Instance number (input)
+ * @param outMemoryUsage    Pointer to destination for the footprint (output)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleGetInstanceMemoryUsage(int instance,
+                                                  BeagleMemoryUsage* outMemoryUsage);
+
+/**
+ * @brief Enable or disable the performance counters of an instance
+ *
+ * While enabled, the instance counts the calls, patterns, estimated floating-point operations and
+ * bytes, and the wall and CPU time of each kernel type (see BeagleKernelTypes). Counting is
+ * disabled when an instance is created; disabling it keeps the counts collected so far.
+ *
+ * @param instance      Instance number (input)
+ * @param enabled       1 to enable counting, 0 to disable it (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleSetPerformanceCounters(int instance,
+                                                  int enabled);
+
+/**
+ * @brief Get the performance counters of an instance
+ *
+ * This function copies the counters of the first count kernel types, indexed by
+ * BeagleKernelTypes, accumulated since the instance was created or the counters were last reset.
+ *
+ * @param instance      Instance number (input)
+ * @param outCounters   Pointer to destination for the counters of each kernel type (output)
+ * @param count         Number of kernel types to copy, at most BEAGLE_KERNEL_TYPE_COUNT (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleGetPerformanceCounters(int instance,
+                                                  BeagleKernelCounters* outCounters,
+                                                  int count);
+
+/**
+ * @brief Reset the performance counters of an instance to zero
+ *
+ * @param instance      Instance number (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleResetPerformanceCounters(int instance);
+
+/**
+ * @brief Start recording a timeline of an instance
+ *
+ * While tracing, the instance records the begin and end of its main calls (category "api") on the
+ * calling thread and of every task run by its worker threads (category "task"), such as the
+ * pattern partitions of beagleUpdatePartials and of root and edge integration. Each thread records
+ * into its own ring buffer of eventsPerThread events without locking; once a ring is full its oldest
+ * events are overwritten. The timeline is written to fileName in the Chrome trace event format,
+ * which chrome://tracing and Perfetto display, by beagleWriteTrace, beagleStopTrace and
+ * beagleFinalizeInstance. A trace already being recorded is written and stopped first.
+ *
+ * Tracing and writing the trace must not overlap with other calls on the instance.
+ *
+ * @param instance          Instance number (input)
+ * @param fileName          Path of the trace file as a NULL-terminated character string (input)
+ * @param eventsPerThread   Number of events kept for each thread (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleStartTrace(int instance,
+                                      const char* fileName,
+                                      int eventsPerThread);
+
+/**
+ * @brief Write the timeline recorded so far and continue recording
+ *
+ * @param instance          Instance number (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleWriteTrace(int instance);
+
+/**
+ * @brief Write the timeline and stop recording
+ *
+ * @param instance          Instance number (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleStopTrace(int instance);
+
+/**
+ * @brief Create a copy-on-write clone of an instance
+ *
+ * This function creates a new instance holding the same state as an existing one: tip data,
+ * partials, scale factors, transition matrices, eigen-decompositions, rates, weights and
+ * pattern partitions. Partials, tip states, transition matrices and scale buffers are shared
+ * between the two instances until one of them writes to a buffer, at which point the writer
+ * receives a private copy of that buffer, so a clone costs little more than the memory its
+ * proposals actually touch. Both instances are otherwise independent and must each be
+ * finalized. Threads are not shared; a threaded instance yields a clone with its own threads.
+ *
+ * The clone is not supported for instances with memory-mapped partials
+ * (BEAGLE_FLAG_PARTIALS_MAPPED) or by the GPU implementations; BEAGLE_ERROR_NO_IMPLEMENTATION
+ * is returned in these cases.
+ *
+ * @param instance      Instance number to clone (input)
+ * @param returnInfo    Pointer to return implementation and resource details of the clone
+ *
+ * @return the number of the new instance (if >= 0) or an error code (if < 0)
+ */
+BEAGLE_DLLEXPORT int beagleCloneInstance(int instance,
+                                         BeagleInstanceDetails* returnInfo);
+
+/**
+ * @brief Set a checkpoint on an instance
+ *
+ * This function marks the current contents of the partials, transition matrix and scale
+ * buffers of an instance so that later updates can be undone with beagleRollbackCheckpoint
+ * or kept with beagleCommitCheckpoint. While a checkpoint is set, the first write to a buffer
+ * moves the checkpointed buffer aside and writes into a spare one, so a client does not need
+ * to double-buffer partials and matrices itself. Committing or rolling back costs a pointer
+ * swap per buffer written since the checkpoint; no data is copied, except for the parts of a
+ * buffer kept by partition-wise updates. Spare buffers are kept for later checkpoints.
+ *
+ * Tip states, eigen-decompositions, category rates and weights, state frequencies and pattern
+ * weights are not part of the checkpoint. beagleSetPatternPartitions returns
+ * BEAGLE_ERROR_GENERAL while a checkpoint is set.
+ *
+ * @param instance  Instance number (input)
+ *
+ * @return error code; BEAGLE_ERROR_GENERAL if a checkpoint is already set and
+ * BEAGLE_ERROR_NO_IMPLEMENTATION for instances with memory-mapped partials or
+ * BEAGLE_FLAG_SCALING_AUTO and for GPU implementations
+ */
+BEAGLE_DLLEXPORT int beagleSetCheckpoint(int instance);
+
+/**
+ * @brief Keep all updates made since the checkpoint
+ *
+ * @param instance  Instance number (input)
+ *
+ * @return error code; BEAGLE_ERROR_GENERAL if no checkpoint is set
+ */
+BEAGLE_DLLEXPORT int beagleCommitCheckpoint(int instance);
+
+/**
+ * @brief Restore the partials, transition matrices and scale buffers of the checkpoint
+ *
+ * @param instance  Instance number (input)
+ *
+ * @return error code; BEAGLE_ERROR_GENERAL if no checkpoint is set
+ */
+BEAGLE_DLLEXPORT int beagleRollbackCheckpoint(int instance);
+
 /**
  * @brief Finalize this instance
  *
@@ -436,6 +723,21 @@ BEAGLE_DLLEXPORT int beagleFinalize(void);
 BEAGLE_DLLEXPORT int beagleSetCPUThreadCount(int instance,
                                              int threadCount);
 
+/**
+ * @brief Get the number of threads of a native CPU implementation
+ *
+ * This function returns the thread count set with beagleSetCPUThreadCount, or chosen by
+ * BEAGLE_FLAG_AUTOTUNE, for an instance with BEAGLE_FLAG_THREADING_CPP. It returns 0 if
+ * BEAGLE uses its heuristic thread count, and for all other instances.
+ *
+ * @param instance             Instance number (input)
+ * @param outThreadCount       Pointer to destination for the number of threads (output)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleGetCPUThreadCount(int instance,
+                                             int* outThreadCount);
+
 /**
  * @brief Set the compact state representation for tip node
  *
@@ -472,6 +774,84 @@ BEAGLE_DLLEXPORT int beagleSetTipPartials(int instance,
                          int tipIndex,
                          const double* inPartials);
 
+/**
+ * @brief Create shared tip data
+ *
+ * This function creates a read-only set of tip states and partials that can be attached to
+ * any number of instances with the same stateCount and patternCount. Instances point at a
+ * single copy of the data instead of each keeping their own, which reduces memory and
+ * set-up time when many instances analyse the same alignment.
+ *
+ * @param tipCount      Number of tips (input)
+ * @param stateCount    Number of states (input)
+ * @param patternCount  Number of site patterns (input)
+ *
+ * @return the index of the tip data (tipData >= 0) or an error code (tipData < 0)
+ */
+BEAGLE_DLLEXPORT int beagleCreateTipData(int tipCount,
+                                         int stateCount,
+                                         int patternCount);
+
+/**
+ * @brief Set compact states for a tip in shared tip data
+ *
+ * The data can only be modified until it is first attached to an instance.
+ *
+ * @param tipData   Index of tip data (input)
+ * @param tipIndex  Index of tip (input)
+ * @param inStates  Pointer to patternCount compact states (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleSetTipDataStates(int tipData,
+                                            int tipIndex,
+                                            const int* inStates);
+
+/**
+ * @brief Set partials for a tip in shared tip data
+ *
+ * The data can only be modified until it is first attached to an instance.
+ *
+ * @param tipData     Index of tip data (input)
+ * @param tipIndex    Index of tip (input)
+ * @param inPartials  Pointer to stateCount * patternCount partials (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleSetTipDataPartials(int tipData,
+                                              int tipIndex,
+                                              const double* inPartials);
+
+/**
+ * @brief Attach shared tip data to an instance
+ *
+ * This function sets the tips of an instance from shared tip data, as if beagleSetTipStates or
+ * beagleSetTipPartials had been called for every tip that was set. Where the implementation
+ * allows it, the instance refers to the shared buffers rather than copying them; a later call
+ * to beagleSetTipStates or beagleSetTipPartials for that tip gives the instance a private copy.
+ * Tip data must be attached before beagleSetPatternPartitions, and at most once per instance.
+ * Attaching seals the tip data against further modification.
+ *
+ * @param instance  Instance number (input)
+ * @param tipData   Index of tip data (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleAttachTipData(int instance,
+                                         int tipData);
+
+/**
+ * @brief Finalize shared tip data
+ *
+ * This function releases the handle to shared tip data. The data itself is freed once all
+ * instances it is attached to have been finalized.
+ *
+ * @param tipData  Index of tip data (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleFinalizeTipData(int tipData);
+
 /**
  * @brief Set an instance partials buffer
  *
@@ -587,7 +967,9 @@ BEAGLE_DLLEXPORT int beagleSetCategoryRatesWithIndex(int instance,
 /**
  * @brief Set pattern weights
  *
- * This function sets the vector of pattern weights for an instance.
+ * This function sets the vector of pattern weights for an instance. With
+ * beagleSetZeroWeightPatternSkipping enabled, patterns of weight 0 are left out of later
+ * beagleUpdatePartials calls, except with BEAGLE_FLAG_SCALING_AUTO.
  *
  * @param instance              Instance number (input)
  * @param inPatternWeights      Array containing patternCount weights (input)
@@ -596,6 +978,24 @@ BEAGLE_DLLEXPORT int beagleSetCategoryRatesWithIndex(int instance,
  */
 BEAGLE_DLLEXPORT int beagleSetPatternWeights(int instance,
                                        const double* inPatternWeights);
+
+/**
+ * @brief Skip patterns of zero weight when updating partials
+ *
+ * When enabled, beagleUpdatePartials only computes partials for runs of patterns with nonzero
+ * weight, as set by beagleSetPatternWeights. The partials of the other patterns are set to 1, so
+ * their site log likelihoods are reported as 0. This speeds up bootstrap replicates that reuse one
+ * instance and only change the pattern weights. Skipping also applies to
+ * beagleUpdatePartialsByPartition and to operations split across threads by pattern partition, but
+ * not to BEAGLE_FLAG_SCALING_AUTO, which always computes all patterns.
+ *
+ * @param instance      Instance number (input)
+ * @param enabled       1 to skip zero-weight patterns, 0 to compute all patterns (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleSetZeroWeightPatternSkipping(int instance,
+                                                        int enabled);
    
 /**
  * @brief Set pattern partition assignments
@@ -709,6 +1109,41 @@ BEAGLE_DLLEXPORT int beagleUpdateTransitionMatricesWithMultipleModels(int instan
                                                                       const double* edgeLengths,
                                                                       int count);
 
+/**
+ * @brief Set the size of the transition probability matrix cache
+ *
+ * This function enables a least-recently-used cache of probability matrices computed by
+ * beagleUpdateTransitionMatrices, keyed by eigen-decomposition index and edge length. Repeated
+ * requests for the same edge length are then served by copying a cached matrix, or skipped
+ * entirely when the destination buffer already holds it. The cache is only consulted when no
+ * derivative matrices are requested. It is emptied by beagleSetEigenDecomposition and
+ * beagleSetCategoryRates. A size of 0 disables and frees the cache. Setting the size also resets
+ * the hit and miss counters.
+ *
+ * @param instance      Instance number (input)
+ * @param cacheSize     Maximum number of cached matrices, including all rate categories (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleSetTransitionMatrixCacheSize(int instance,
+                                                        int cacheSize);
+
+/**
+ * @brief Get the transition probability matrix cache statistics
+ *
+ * This function returns how many probability matrices were served from the cache and how many
+ * had to be computed since the cache size was last set.
+ *
+ * @param instance      Instance number (input)
+ * @param outHitCount   Pointer to destination for the number of cache hits (output)
+ * @param outMissCount  Pointer to destination for the number of cache misses (output)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleGetTransitionMatrixCacheStatistics(int instance,
+                                                              long* outHitCount,
+                                                              long* outMissCount);
+
 /**
  * @brief Set a finite-time transition probability matrix
  *
@@ -833,6 +1268,122 @@ BEAGLE_DLLEXPORT int beagleUpdatePartialsByPartition(const int instance,
                                                      const BeagleOperationByPartition* operations,
                                                      int operationCount);
 
+/**
+ * @brief Enable or disable incremental partials updates
+ *
+ * In incremental mode the instance stamps every partials buffer, transition matrix and scale buffer
+ * with a version when it is written, and remembers the operation and input versions each partials
+ * buffer was computed from. beagleUpdatePartials then skips any operation whose destination, inputs
+ * and scale buffers are unchanged since it last ran, so that a full traversal only recomputes the
+ * partials affected by the parameters changed since the previous call. Scale factors of skipped
+ * operations are still accumulated into the cumulative scale buffer. Operations are never skipped
+ * with automatic scaling (BEAGLE_FLAG_SCALING_AUTO, ALWAYS or DYNAMIC) or by
+ * beagleUpdatePartialsByPartition.
+ *
+ * @param instance      Instance number (input)
+ * @param enabled       1 to enable incremental updates, 0 to disable them (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleSetIncrementalUpdates(int instance,
+                                                 int enabled);
+
+/**
+ * @brief Get the savings of the last incremental partials update
+ *
+ * This function returns how many operations were passed to the last beagleUpdatePartials call and
+ * how many of them were skipped because their inputs were unchanged.
+ *
+ * @param instance              Instance number (input)
+ * @param outOperationCount     Pointer to destination for the number of operations (output)
+ * @param outSkippedCount       Pointer to destination for the number of skipped operations (output)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleGetIncrementalUpdateStatistics(int instance,
+                                                          int* outOperationCount,
+                                                          int* outSkippedCount);
+
+/**
+ * @brief Set the pre-order partials of the root
+ *
+ * This function fills each root pre-order partials buffer with the given state frequencies for
+ * every rate category and site pattern. It starts a pre-order traversal with
+ * beagleUpdatePrePartials.
+ *
+ * @param instance                  Instance number (input)
+ * @param bufferIndices             List of indices of pre-order partials buffers to fill (input)
+ * @param stateFrequenciesIndices   List of indices of state frequencies for each buffer (input)
+ * @param count                     Number of buffers (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleSetRootPrePartials(int instance,
+                                              const int* bufferIndices,
+                                              const int* stateFrequenciesIndices,
+                                              int count);
+
+/**
+ * @brief Calculate pre-order partials using a list of operations
+ *
+ * Pre-order partials hold the likelihood of all data outside the subtree below a node, given the
+ * state at the bottom of the branch above that node. Operations must be ordered from the root
+ * towards the tips. Each BeagleOperation is interpreted as follows:
+ * destinationPartials is the pre-order buffer of node v, child1Partials is the pre-order buffer of
+ * the parent of v, child1TransitionMatrix is the transition matrix of the branch above v,
+ * child2Partials is the post-order partials (or tip states) of the sibling of v and
+ * child2TransitionMatrix is the transition matrix of the branch above the sibling.
+ *
+ * Pre-order partials can only be rescaled with explicit scale buffer indices
+ * (BEAGLE_FLAG_SCALING_MANUAL); destinationScaleRead is ignored.
+ *
+ * @param instance                  Instance number (input)
+ * @param operations                BeagleOperation list specifying operations (input)
+ * @param operationCount            Number of operations (input)
+ * @param cumulativeScaleIndex      Index number of scaleBuffer to store accumulated factors (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleUpdatePrePartials(const int instance,
+                                             const BeagleOperation* operations,
+                                             int operationCount,
+                                             int cumulativeScaleIndex);
+
+/**
+ * @brief Calculate the derivative of the log likelihood with respect to the length of many edges
+ *
+ * This function computes, for each edge, the derivative of the site log likelihoods with respect to
+ * the edge length from the post-order partials below and the pre-order partials above the edge.
+ * Together with beagleUpdatePrePartials this yields the gradient over all branches of a tree from
+ * one post-order and one pre-order traversal. The derivative matrices must hold dP(t)/dt = D P(t);
+ * for a reversible model this is the rate-scaled instantaneous rate matrix, which
+ * beagleUpdateTransitionMatrices writes to a first derivative index at an edge length of zero.
+ *
+ * @param instance                  Instance number (input)
+ * @param postBufferIndices         List of indices of post-order partials or tip states below each edge (input)
+ * @param preBufferIndices          List of indices of pre-order partials above each edge (input)
+ * @param derivativeMatrixIndices   List of indices of derivative matrices for each edge (input)
+ * @param categoryWeightsIndices    List of weights to apply to each partialsBuffer (input)
+ * @param count                     Number of edges (input)
+ * @param outDerivatives            Pointer to destination for per-site derivatives, count * patternCount
+ *                                  entries, may be NULL (output)
+ * @param outSumDerivatives         Pointer to destination for the pattern-weighted sum of derivatives
+ *                                  for each edge (output)
+ * @param outSumSquaredDerivatives  Pointer to destination for the pattern-weighted sum of squared site
+ *                                  derivatives for each edge, may be NULL (output)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleCalculateEdgeDerivatives(int instance,
+                                                    const int* postBufferIndices,
+                                                    const int* preBufferIndices,
+                                                    const int* derivativeMatrixIndices,
+                                                    const int* categoryWeightsIndices,
+                                                    int count,
+                                                    double* outDerivatives,
+                                                    double* outSumDerivatives,
+                                                    double* outSumSquaredDerivatives);
+
 /**
  * @brief Block until all calculations that write to the specified partials have completed.
  *
@@ -1043,6 +1594,194 @@ BEAGLE_DLLEXPORT int beagleCalculateRootLogLikelihoodsByPartition(int instance,
                                                                   double* outSumLogLikelihoodByPartition,
                                                                   double* outSumLogLikelihood);
 
+/**
+ * @brief Update transition matrices and partials and calculate the root log likelihood in one call
+ *
+ * This function combines beagleUpdateTransitionMatrices, beagleUpdatePartials,
+ * beagleAccumulateScaleFactors and beagleCalculateRootLogLikelihoods for a single eigen
+ * decomposition and root. The CPU implementation schedules them as one pass: each transition
+ * matrix is computed just before the first operation that reads it and the root is integrated
+ * right after the last operation. With CPU threading, all operations and the root integration of
+ * a pattern partition run in one thread task. Unless BEAGLE_FLAG_SCALING_AUTO, ALWAYS or DYNAMIC is
+ * set, the cumulative scale buffer is reset and receives the factors of every scale buffer the
+ * operations write or read.
+ *
+ * @param instance                  Instance number (input)
+ * @param eigenIndex                Index of eigen-decomposition buffer (input)
+ * @param probabilityIndices        List of indices of transition probability matrices to update (input)
+ * @param edgeLengths               List of edge lengths with which to update the matrices (input)
+ * @param matrixCount               Length of lists (input)
+ * @param operations                BeagleOperation list specifying operations (input)
+ * @param operationCount            Number of operations (input)
+ * @param rootBufferIndex           Index of root partials buffer (input)
+ * @param categoryWeightsIndex      Index of category weights (input)
+ * @param stateFrequenciesIndex     Index of state frequencies (input)
+ * @param cumulativeScaleIndex      Index of scale buffer to accumulate factors into, or BEAGLE_OP_NONE (input)
+ * @param outSumLogLikelihood       Pointer to destination for the resulting log likelihood (output)
+ *
+ * @return error code; BEAGLE_ERROR_OUT_OF_RANGE if a probability index is out of range
+ */
+BEAGLE_DLLEXPORT int beagleEvaluateRootLogLikelihood(int instance,
+                                                     int eigenIndex,
+                                                     const int* probabilityIndices,
+                                                     const double* edgeLengths,
+                                                     int matrixCount,
+                                                     const BeagleOperation* operations,
+                                                     int operationCount,
+                                                     int rootBufferIndex,
+                                                     int categoryWeightsIndex,
+                                                     int stateFrequenciesIndex,
+                                                     int cumulativeScaleIndex,
+                                                     double* outSumLogLikelihood);
+
+/**
+ * @brief The arguments of one beagleEvaluateRootLogLikelihood call, as evaluated by
+ * beagleEvaluateRootLogLikelihoods.
+ */
+typedef struct {
+    int instance;                       /**< instance number */
+    int eigenIndex;                     /**< index of eigen-decomposition buffer */
+    const int* probabilityIndices;      /**< list of indices of transition probability matrices to update */
+    const double* edgeLengths;          /**< list of edge lengths with which to update the matrices */
+    int matrixCount;                    /**< length of probabilityIndices and edgeLengths */
+    const BeagleOperation* operations;  /**< BeagleOperation list specifying operations */
+    int operationCount;                 /**< number of operations */
+    int rootBufferIndex;                /**< index of root partials buffer */
+    int categoryWeightsIndex;           /**< index of category weights */
+    int stateFrequenciesIndex;          /**< index of state frequencies */
+    int cumulativeScaleIndex;           /**< index of scale buffer to accumulate factors into, or BEAGLE_OP_NONE */
+} BeagleEvaluationJob;
+
+/**
+ * @brief Evaluate the root log likelihoods of many trees in one call
+ *
+ * This function performs beagleEvaluateRootLogLikelihood for each of jobCount jobs, such as the
+ * candidate trees of a search or the loci of a multi-gene analysis, and runs independent jobs
+ * concurrently. Jobs on different instances are distributed over up to threadCount threads, while
+ * the jobs of one instance are evaluated in the given order. If an instance uses
+ * BEAGLE_FLAG_THREADING_CPP and its jobs write disjoint matrix, partials and scale buffers and
+ * read no buffer another of its jobs writes, the partials operations of its jobs run as separate
+ * tasks on the instance's CPU threads (see beagleSetCPUThreadCount). This keeps the threads busy
+ * on trees with too few patterns to be split by pattern. Jobs that share buffers are evaluated
+ * one after the other.
+ *
+ * @param jobs                  List of jobs (input)
+ * @param jobCount              Number of jobs (input)
+ * @param threadCount           Maximum number of instances to evaluate at once, or 0 to use
+ *                               the number of hardware threads (input)
+ * @param outSumLogLikelihoods  Pointer to destination for the log likelihood of each job (output)
+ * @param outReturnCodes        Pointer to destination for the error code of each job, or NULL (output)
+ *
+ * @return error code, the first error of any job
+ */
+BEAGLE_DLLEXPORT int beagleEvaluateRootLogLikelihoods(const BeagleEvaluationJob* jobs,
+                                                      int jobCount,
+                                                      int threadCount,
+                                                      double* outSumLogLikelihoods,
+                                                      int* outReturnCodes);
+
+/**
+ * @brief Set the tree of an instance
+ *
+ * This function describes a rooted binary tree from which BEAGLE generates the partials operations,
+ * so that clients do not need their own traversal. Nodes are identified by their partials buffer
+ * index: leaves are tip buffers or partials set by the client, and every other node has exactly
+ * two children. Operations are ordered level by level from the leaves, so that each level consists
+ * of independent operations, and by post-order within a level. If useScaling is set, internal
+ * nodes write scale buffers 0, 1, ... in increasing node order, and the next scale buffer receives
+ * the cumulative factors. The instance then needs a scale buffer count of at least the internal
+ * node count plus one. Setting the same tree again keeps the existing operations, so the tree can
+ * be set before every evaluation.
+ *
+ * @param instance          Instance number (input)
+ * @param parentIndices     Parent of each node, BEAGLE_OP_NONE for the root (input)
+ * @param matrixIndices     Transition matrix of the branch above each node, or NULL to use the node
+ *                           index (input)
+ * @param nodeCount         Number of nodes (input)
+ * @param useScaling        Whether the operations rescale partials (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleSetTree(int instance,
+                                   const int* parentIndices,
+                                   const int* matrixIndices,
+                                   int nodeCount,
+                                   int useScaling);
+
+/**
+ * @brief Get the operations generated for the tree of an instance
+ *
+ * @param instance                  Instance number (input)
+ * @param outOperations             Pointer to destination for the operations, one for each internal
+ *                                   node (output)
+ * @param outOperationCount         Pointer to destination for the number of operations (output)
+ * @param outLevelCounts            Pointer to destination for the number of operations in each level,
+ *                                   one for each level up to the root, or NULL (output)
+ * @param outRootIndex              Pointer to destination for the root partials buffer index (output)
+ * @param outCumulativeScaleIndex   Pointer to destination for the cumulative scale buffer index, or
+ *                                   BEAGLE_OP_NONE without scaling (output)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleGetTreeOperations(int instance,
+                                             BeagleOperation* outOperations,
+                                             int* outOperationCount,
+                                             int* outLevelCounts,
+                                             int* outRootIndex,
+                                             int* outCumulativeScaleIndex);
+
+/**
+ * @brief Calculate the root log likelihood of the tree of an instance
+ *
+ * This function updates the transition matrix of every branch of the tree set by beagleSetTree
+ * and evaluates the tree as beagleEvaluateRootLogLikelihood does.
+ *
+ * @param instance                  Instance number (input)
+ * @param eigenIndex                Index of eigen-decomposition buffer (input)
+ * @param edgeLengths               Length of the branch above each node, indexed by node; the entry
+ *                                   of the root is ignored (input)
+ * @param categoryWeightsIndex      Index of category weights (input)
+ * @param stateFrequenciesIndex     Index of state frequencies (input)
+ * @param outSumLogLikelihood       Pointer to destination for the resulting log likelihood (output)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleEvaluateTree(int instance,
+                                        int eigenIndex,
+                                        const double* edgeLengths,
+                                        int categoryWeightsIndex,
+                                        int stateFrequenciesIndex,
+                                        double* outSumLogLikelihood);
+
+/**
+ * @brief Calculate the root log likelihood for many pattern weight vectors
+ *
+ * This function integrates a root partials buffer over states and rate categories once, and then
+ * returns the sum of the site log likelihoods weighted by each of weightVectorCount pattern weight
+ * vectors. It is meant for RELL bootstraps and other reweightings of the same sites, and replaces
+ * a call to beagleCalculateRootLogLikelihoods followed by beagleGetSiteLogLikelihoods and client
+ * side sums. The site log likelihoods are kept as by beagleCalculateRootLogLikelihoods.
+ *
+ * @param instance                  Instance number (input)
+ * @param bufferIndex               Index of root partials buffer (input)
+ * @param categoryWeightsIndex      Index of category weights (input)
+ * @param stateFrequenciesIndex     Index of state frequencies (input)
+ * @param cumulativeScaleIndex      Index of scale buffer containing accumulated factors (input)
+ * @param inPatternWeights          Weight vectors, weightVectorCount rows of patternCount weights (input)
+ * @param weightVectorCount         Number of weight vectors (input)
+ * @param outSumLogLikelihoods      Pointer to destination for one log likelihood per weight vector (output)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleCalculateRootLogLikelihoodsForWeights(int instance,
+                                                                 int bufferIndex,
+                                                                 int categoryWeightsIndex,
+                                                                 int stateFrequenciesIndex,
+                                                                 int cumulativeScaleIndex,
+                                                                 const double* inPatternWeights,
+                                                                 int weightVectorCount,
+                                                                 double* outSumLogLikelihoods);
+
 /**
  * @brief Calculate site log likelihoods and derivatives along an edge
  *
@@ -1139,6 +1878,171 @@ BEAGLE_DLLEXPORT int beagleCalculateEdgeLogLikelihoodsByPartition(
                                                     double* outSumSecondDerivativeByPartition,
                                                     double* outSumSecondDerivative);
 
+/**
+ * @brief Precompute the sumtable of an edge for fast branch-length evaluation
+ *
+ * This function projects the partials at a parent and child node into the eigenbasis of an
+ * eigen decomposition and stores the per-pattern result (the sumtable) in the instance. The
+ * likelihood of the edge and its first and second derivatives can then be evaluated for any
+ * edge length with beagleCalculateEdgeSumtableLogLikelihood or optimized with
+ * beagleOptimizeEdgeLength without recomputing transition matrices or partials. Category rates
+ * are taken from beagleSetCategoryRates. An instance holds one sumtable at a time; it is not
+ * updated when the partials change.
+ *
+ * Implementations that do not store the eigen decomposition in real form (e.g.
+ * BEAGLE_FLAG_EIGEN_COMPLEX) return BEAGLE_ERROR_NO_IMPLEMENTATION.
+ *
+ * @param instance                  Instance number (input)
+ * @param parentBufferIndex         Index of parent partialsBuffer (input)
+ * @param childBufferIndex          Index of child partialsBuffer or compact tip buffer (input)
+ * @param eigenIndex                Index of eigen-decomposition buffer (input)
+ * @param categoryWeightsIndex      Index of weights to apply to each category (input)
+ * @param stateFrequenciesIndex     Index of state frequencies (input)
+ * @param cumulativeScaleIndex      Index of scaleBuffer containing accumulated factors, or
+ *                                   BEAGLE_OP_NONE (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleCalculateEdgeSumtable(int instance,
+                                                 int parentBufferIndex,
+                                                 int childBufferIndex,
+                                                 int eigenIndex,
+                                                 int categoryWeightsIndex,
+                                                 int stateFrequenciesIndex,
+                                                 int cumulativeScaleIndex);
+
+/**
+ * @brief Calculate the log likelihood and derivatives of the sumtable edge at a given length
+ *
+ * Site log likelihoods and derivatives are available afterwards through
+ * beagleGetSiteLogLikelihoods and beagleGetSiteDerivatives.
+ *
+ * @param instance                  Instance number (input)
+ * @param edgeLength                Length of the edge (input)
+ * @param outSumLogLikelihood       Pointer to destination for resulting log likelihood (output)
+ * @param outSumFirstDerivative     Pointer to destination for resulting first derivative, may be
+ *                                   NULL (output)
+ * @param outSumSecondDerivative    Pointer to destination for resulting second derivative, may be
+ *                                   NULL (output)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleCalculateEdgeSumtableLogLikelihood(int instance,
+                                                              double edgeLength,
+                                                              double* outSumLogLikelihood,
+                                                              double* outSumFirstDerivative,
+                                                              double* outSumSecondDerivative);
+
+/**
+ * @brief Optimize the length of the sumtable edge
+ *
+ * This function runs Newton-Raphson iterations on the sumtable edge, halving steps that do not
+ * increase the log likelihood, until a step is shorter than the tolerance or the iteration limit
+ * is reached.
+ *
+ * @param instance                  Instance number (input)
+ * @param inOutEdgeLength           Pointer to starting edge length, replaced by the optimized
+ *                                   length (input/output)
+ * @param minEdgeLength             Lower bound on the edge length (input)
+ * @param maxEdgeLength             Upper bound on the edge length (input)
+ * @param tolerance                 Convergence tolerance on the edge length (input)
+ * @param maxIterations             Maximum number of Newton-Raphson iterations (input)
+ * @param outSumLogLikelihood       Pointer to destination for the log likelihood at the optimized
+ *                                   length (output)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleOptimizeEdgeLength(int instance,
+                                              double* inOutEdgeLength,
+                                              double minEdgeLength,
+                                              double maxEdgeLength,
+                                              double tolerance,
+                                              int maxIterations,
+                                              double* outSumLogLikelihood);
+
+/**
+ * @brief Calculate the log likelihood of regrafting a subtree onto each of many edges
+ *
+ * This function scores the SPR candidates of a pruned subtree in one call. Each edge is given by
+ * the post-order partials below it and the pre-order partials at its bottom (see
+ * beagleUpdatePrePartials) of the tree without the subtree. The subtree is attached to a new node
+ * at the bottom of the edge through a pendant branch with the given transition matrix, so no
+ * partials are recomputed and the candidates differ only in where the subtree is attached. If
+ * subtreeBufferIndex is BEAGLE_OP_NONE, the log likelihood of the tree itself is evaluated at
+ * each edge. With CPU threading (BEAGLE_FLAG_THREADING_CPP) the edges are distributed over the
+ * instance's threads.
+ *
+ * @param instance                  Instance number (input)
+ * @param postBufferIndices         List of indices of post-order partials or tip states below each edge (input)
+ * @param preBufferIndices          List of indices of pre-order partials at the bottom of each edge (input)
+ * @param cumulativeScaleIndices    List of scale buffers holding the summed factors of the
+ *                                   pre-order, post-order and subtree partials of each edge, or
+ *                                   NULL (input)
+ * @param count                     Number of edges (input)
+ * @param subtreeBufferIndex        Index of partials or tip states at the root of the pruned
+ *                                   subtree, or BEAGLE_OP_NONE (input)
+ * @param subtreeMatrixIndex        Index of the transition matrix of the pendant branch (input)
+ * @param categoryWeightsIndex      Index of weights to apply to each category (input)
+ * @param outSumLogLikelihoods      Pointer to destination for the log likelihood of each edge (output)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleCalculateInsertionLogLikelihoods(int instance,
+                                                            const int* postBufferIndices,
+                                                            const int* preBufferIndices,
+                                                            const int* cumulativeScaleIndices,
+                                                            int count,
+                                                            int subtreeBufferIndex,
+                                                            int subtreeMatrixIndex,
+                                                            int categoryWeightsIndex,
+                                                            double* outSumLogLikelihoods);
+
+/**
+ * @brief Optimize the pendant branch of a subtree regrafted onto each of many edges
+ *
+ * This function scores the same candidates as beagleCalculateInsertionLogLikelihoods, but
+ * optimizes the length of the pendant branch for each edge as in lazy SPR searches, with the
+ * Newton-Raphson iterations of beagleOptimizeEdgeLength on a sumtable of each edge. All other
+ * branches keep their lengths. It uses the real (cube) eigen decomposition and the rates of
+ * beagleSetCategoryRates, and holds categoryCount * patternCount * stateCount * stateCount
+ * temporary values. Other implementations return BEAGLE_ERROR_NO_IMPLEMENTATION.
+ *
+ * @param instance                  Instance number (input)
+ * @param postBufferIndices         List of indices of post-order partials or tip states below each edge (input)
+ * @param preBufferIndices          List of indices of pre-order partials at the bottom of each edge (input)
+ * @param cumulativeScaleIndices    List of scale buffers holding the summed factors of the
+ *                                   pre-order, post-order and subtree partials of each edge, or
+ *                                   NULL (input)
+ * @param count                     Number of edges (input)
+ * @param subtreeBufferIndex        Index of partials or tip states at the root of the pruned subtree (input)
+ * @param eigenIndex                Index of eigen-decomposition buffer (input)
+ * @param categoryWeightsIndex      Index of weights to apply to each category (input)
+ * @param inOutPendantLengths       Pointer to the starting pendant length for each edge, replaced
+ *                                   by the optimized lengths (input/output)
+ * @param minEdgeLength             Lower bound on the pendant length (input)
+ * @param maxEdgeLength             Upper bound on the pendant length (input)
+ * @param tolerance                 Convergence tolerance on the pendant length (input)
+ * @param maxIterations             Maximum number of Newton-Raphson iterations per edge (input)
+ * @param outSumLogLikelihoods      Pointer to destination for the log likelihood of each edge at
+ *                                   its optimized pendant length (output)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleOptimizeInsertionLogLikelihoods(int instance,
+                                                           const int* postBufferIndices,
+                                                           const int* preBufferIndices,
+                                                           const int* cumulativeScaleIndices,
+                                                           int count,
+                                                           int subtreeBufferIndex,
+                                                           int eigenIndex,
+                                                           int categoryWeightsIndex,
+                                                           double* inOutPendantLengths,
+                                                           double minEdgeLength,
+                                                           double maxEdgeLength,
+                                                           double tolerance,
+                                                           int maxIterations,
+                                                           double* outSumLogLikelihoods);
+
 
 /**
  * @brief Returns log likelihood sum and subsequent to an asynchronous integration call.
@@ -25,6 +25,7 @@
  */
 
 #include "libhmsbeagle/benchmark/BeagleBenchmark.h"
+#include "libhmsbeagle/BeagleRecorder.h"
 
 namespace beagle {
 namespace benchmark {
@@ -137,7 +138,11 @@ int benchmarkResource(int resource,
                          char** implName,
                          long* benchedFlags,
                          double* benchmarkResult,
-                         bool instOnly) {
+                         bool instOnly,
+                         int threadCount) {
+
+    // the benchmark instances are not part of the client's calls
+    BeagleInternalCall internalCall;
 
     int edgeCount = ntaxa*2-2;
     int internalCount = ntaxa-1;
@@ -169,6 +174,11 @@ int benchmarkResource(int resource,
         return BEAGLE_ERROR_NO_IMPLEMENTATION;
     } 
         
+    if (threadCount > 0 && beagleSetCPUThreadCount(instance, threadCount) != BEAGLE_SUCCESS) {
+        beagleFinalizeInstance(instance);
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    }
+
     *resourceNumber = instDetails.resourceNumber;
     *benchedFlags = instDetails.flags;
     *implName = instDetails.implName;
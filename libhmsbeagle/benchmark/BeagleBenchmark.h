@@ -75,7 +75,8 @@ int benchmarkResource(int resource,
                          char** implName,
                          long* benchedFlags,
                          double* benchmarkResult,
-                         bool instOnly);
+                         bool instOnly,
+                         int threadCount = 0);
 
 #endif // __beagle_benchmark__
 
@@ -0,0 +1,336 @@
+/*
+ *  BenchmarkCache.cpp
+ *  Persistent cache of resource benchmark results
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <set>
+#include <sstream>
+
+#ifdef _WIN32
+    #include <process.h>
+    #define getpid _getpid
+#else
+    #include <unistd.h>
+#endif
+
+#ifdef __APPLE__
+    #include <sys/sysctl.h>
+#endif
+
+#include "libhmsbeagle/beagle.h"
+#include "libhmsbeagle/benchmark/BeagleBenchmark.h"
+#include "libhmsbeagle/benchmark/BenchmarkCache.h"
+
+#define BENCHMARK_CACHE_HEADER "# BEAGLE benchmark cache"
+#define BENCHMARK_CACHE_FIELD_COUNT 19
+
+namespace beagle {
+namespace benchmark {
+
+// tabs and line breaks would split a field
+static std::string sanitize(const char* text) {
+    std::string field(text != NULL ? text : "");
+    for (size_t i = 0; i < field.size(); i++) {
+        if (field[i] == '\t' || field[i] == '\n' || field[i] == '\r')
+            field[i] = ' ';
+    }
+    return field;
+}
+
+bool BenchmarkCacheKey::operator==(const BenchmarkCacheKey& other) const {
+    return (version == other.version && cpuModel == other.cpuModel &&
+            resourceName == other.resourceName && resourceDescription == other.resourceDescription &&
+            preferenceFlags == other.preferenceFlags && requirementFlags == other.requirementFlags &&
+            tipCount == other.tipCount && compactTipCount == other.compactTipCount &&
+            stateCount == other.stateCount && categoryCount == other.categoryCount &&
+            eigenCount == other.eigenCount && partitionCount == other.partitionCount &&
+            manualScaling == other.manualScaling && rescaleFrequency == other.rescaleFrequency &&
+            calcderivs == other.calcderivs);
+}
+
+BenchmarkCache::BenchmarkCache(const char* fileName) : fileName(fileName) {
+    read(this->fileName, entries);
+}
+
+std::string BenchmarkCache::getCPUModel() {
+    std::string model;
+#ifdef __APPLE__
+    char brand[256];
+    size_t size = sizeof(brand);
+    if (sysctlbyname("machdep.cpu.brand_string", brand, &size, NULL, 0) == 0)
+        model = brand;
+#else
+    std::ifstream cpuInfo("/proc/cpuinfo");
+    std::string line;
+    while (model.empty() && std::getline(cpuInfo, line)) {
+        // "model name" on x86, "Processor" or "CPU part" elsewhere
+        if (line.compare(0, 10, "model name") == 0 || line.compare(0, 9, "Processor") == 0 ||
+            line.compare(0, 8, "CPU part") == 0) {
+            size_t colon = line.find(':');
+            if (colon != std::string::npos)
+                model = line.substr(line.find_first_not_of(" \t", colon + 1));
+        }
+    }
+#endif
+    return (model.empty() ? std::string("unknown") : sanitize(model.c_str()));
+}
+
+void BenchmarkCache::read(const std::string& fileName,
+                          std::vector<BenchmarkCacheEntry>& entries) {
+    std::ifstream file(fileName.c_str());
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        std::vector<std::string> fields;
+        std::stringstream ss(line);
+        std::string field;
+        while (std::getline(ss, field, '\t'))
+            fields.push_back(field);
+        if (fields.size() != BENCHMARK_CACHE_FIELD_COUNT)
+            continue;
+
+        BenchmarkCacheEntry entry;
+        entry.key.version             = fields[0];
+        entry.key.cpuModel            = fields[1];
+        entry.key.resourceName        = fields[2];
+        entry.key.resourceDescription = fields[3];
+        entry.key.preferenceFlags     = strtol(fields[4].c_str(), NULL, 10);
+        entry.key.requirementFlags    = strtol(fields[5].c_str(), NULL, 10);
+        entry.key.tipCount            = atoi(fields[6].c_str());
+        entry.key.compactTipCount     = atoi(fields[7].c_str());
+        entry.key.stateCount          = atoi(fields[8].c_str());
+        entry.key.categoryCount       = atoi(fields[9].c_str());
+        entry.key.eigenCount          = atoi(fields[10].c_str());
+        entry.key.partitionCount      = atoi(fields[11].c_str());
+        entry.key.manualScaling       = atoi(fields[12].c_str());
+        entry.key.rescaleFrequency    = atoi(fields[13].c_str());
+        entry.key.calcderivs          = atoi(fields[14].c_str());
+        entry.patternCount            = atoi(fields[15].c_str());
+        entry.implName                = fields[16];
+        entry.benchedFlags            = strtol(fields[17].c_str(), NULL, 10);
+        entry.benchmarkResult         = strtod(fields[18].c_str(), NULL);
+
+        if (entry.patternCount > 0 && entry.benchmarkResult >= 0.0)
+            entries.push_back(entry);
+    }
+}
+
+bool BenchmarkCache::find(const BenchmarkCacheKey& key,
+                          int patternCount,
+                          std::string* implName,
+                          long* benchedFlags,
+                          double* benchmarkResult) const {
+    const BenchmarkCacheEntry* below = NULL;
+    const BenchmarkCacheEntry* above = NULL;
+
+    for (size_t i = 0; i < entries.size(); i++) {
+        const BenchmarkCacheEntry& entry = entries[i];
+        if (!(entry.key == key))
+            continue;
+        if (entry.patternCount == patternCount) {
+            *implName = entry.implName;
+            *benchedFlags = entry.benchedFlags;
+            *benchmarkResult = entry.benchmarkResult;
+            return true;
+        }
+        if (entry.patternCount < patternCount && (below == NULL || entry.patternCount > below->patternCount))
+            below = &entry;
+        if (entry.patternCount > patternCount && (above == NULL || entry.patternCount < above->patternCount))
+            above = &entry;
+    }
+
+    // interpolate only between results of the same implementation that are close enough
+    if (below == NULL || above == NULL || below->implName != above->implName ||
+        below->benchedFlags != above->benchedFlags ||
+        above->patternCount > (long) below->patternCount * BENCHMARK_CACHE_INTERPOLATION_RANGE)
+        return false;
+
+    const double fraction = (double) (patternCount - below->patternCount) /
+                            (above->patternCount - below->patternCount);
+    *implName = below->implName;
+    *benchedFlags = below->benchedFlags;
+    *benchmarkResult = below->benchmarkResult + fraction * (above->benchmarkResult - below->benchmarkResult);
+
+    return true;
+}
+
+void BenchmarkCache::removeKey(std::vector<BenchmarkCacheEntry>& entries,
+                               const BenchmarkCacheKey& key,
+                               int patternCount) {
+    for (size_t i = 0; i < entries.size(); ) {
+        if (entries[i].key == key && (patternCount < 0 || entries[i].patternCount == patternCount))
+            entries.erase(entries.begin() + i);
+        else
+            i++;
+    }
+}
+
+void BenchmarkCache::insert(const BenchmarkCacheEntry& entry) {
+    removeKey(entries, entry.key, entry.patternCount);
+    removeKey(addedEntries, entry.key, entry.patternCount);
+    entries.push_back(entry);
+    addedEntries.push_back(entry);
+}
+
+void BenchmarkCache::invalidate(const BenchmarkCacheKey& key) {
+    removeKey(entries, key, -1);
+    removeKey(addedEntries, key, -1);
+    invalidatedKeys.push_back(key);
+}
+
+bool BenchmarkCache::write() {
+    if (addedEntries.empty() && invalidatedKeys.empty())
+        return true;
+
+    // other jobs may have written the file since it was read
+    std::vector<BenchmarkCacheEntry> merged;
+    read(fileName, merged);
+    for (size_t i = 0; i < invalidatedKeys.size(); i++)
+        removeKey(merged, invalidatedKeys[i], -1);
+    for (size_t i = 0; i < addedEntries.size(); i++) {
+        removeKey(merged, addedEntries[i].key, addedEntries[i].patternCount);
+        merged.push_back(addedEntries[i]);
+    }
+
+    std::stringstream tempName;
+    tempName << fileName << ".tmp." << getpid();
+
+    FILE* file = fopen(tempName.str().c_str(), "w");
+    if (file == NULL)
+        return false;
+
+    fprintf(file, "%s\n", BENCHMARK_CACHE_HEADER);
+    for (size_t i = 0; i < merged.size(); i++) {
+        const BenchmarkCacheEntry& entry = merged[i];
+        fprintf(file, "%s\t%s\t%s\t%s\t%ld\t%ld\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%s\t%ld\t%.17g\n",
+                entry.key.version.c_str(), entry.key.cpuModel.c_str(), entry.key.resourceName.c_str(),
+                entry.key.resourceDescription.c_str(), entry.key.preferenceFlags, entry.key.requirementFlags,
+                entry.key.tipCount, entry.key.compactTipCount, entry.key.stateCount, entry.key.categoryCount,
+                entry.key.eigenCount, entry.key.partitionCount, entry.key.manualScaling,
+                entry.key.rescaleFrequency, entry.key.calcderivs, entry.patternCount, entry.implName.c_str(),
+                entry.benchedFlags, entry.benchmarkResult);
+    }
+
+    bool written = (fclose(file) == 0);
+#ifdef _WIN32
+    // rename does not replace an existing file on Windows
+    if (written)
+        remove(fileName.c_str());
+#endif
+    if (!written || rename(tempName.str().c_str(), fileName.c_str()) != 0) {
+        remove(tempName.str().c_str());
+        return false;
+    }
+
+    addedEntries.clear();
+    invalidatedKeys.clear();
+
+    return true;
+}
+
+int benchmarkResourceCached(BenchmarkCache* cache,
+                            bool refresh,
+                            int resource,
+                            int stateCount,
+                            int ntaxa,
+                            int nsites,
+                            bool manualScaling,
+                            int rateCategoryCount,
+                            int nreps,
+                            int compactTipCount,
+                            int rescaleFrequency,
+                            bool unrooted,
+                            bool calcderivs,
+                            int eigenCount,
+                            int partitionCount,
+                            long preferenceFlags,
+                            long requirementFlags,
+                            int* resourceNumber,
+                            char** implName,
+                            long* benchedFlags,
+                            double* benchmarkResult,
+                            bool instOnly) {
+    BeagleResourceList* resourceList = beagleGetResourceList();
+
+    // creating an instance without timing it is not worth caching
+    if (cache == NULL || instOnly || resourceList == NULL || resource < 0 || resource >= resourceList->length)
+        return benchmarkResource(resource, stateCount, ntaxa, nsites, manualScaling, rateCategoryCount, nreps,
+                                 compactTipCount, rescaleFrequency, unrooted, calcderivs, eigenCount,
+                                 partitionCount, preferenceFlags, requirementFlags, resourceNumber, implName,
+                                 benchedFlags, benchmarkResult, instOnly);
+
+    static std::string cpuModel = BenchmarkCache::getCPUModel();
+
+    BenchmarkCacheKey key;
+    key.version             = beagleGetVersion();
+    key.cpuModel            = cpuModel;
+    key.resourceName        = sanitize(resourceList->list[resource].name);
+    key.resourceDescription = sanitize(resourceList->list[resource].description);
+    key.preferenceFlags     = preferenceFlags;
+    key.requirementFlags    = requirementFlags;
+    key.tipCount            = ntaxa;
+    key.compactTipCount     = compactTipCount;
+    key.stateCount          = stateCount;
+    key.categoryCount       = rateCategoryCount;
+    key.eigenCount          = eigenCount;
+    key.partitionCount      = partitionCount;
+    key.manualScaling       = (manualScaling ? 1 : 0);
+    key.rescaleFrequency    = rescaleFrequency;
+    key.calcderivs          = (calcderivs ? 1 : 0);
+
+    // the names handed out must outlive the cache, like those of the implementations
+    static std::set<std::string> implNames;
+
+    std::string cachedImplName;
+    if (!refresh && cache->find(key, nsites, &cachedImplName, benchedFlags, benchmarkResult)) {
+        *resourceNumber = resource;
+        *implName = (char*) implNames.insert(cachedImplName).first->c_str();
+        return BEAGLE_SUCCESS;
+    }
+
+    int returnCode = benchmarkResource(resource, stateCount, ntaxa, nsites, manualScaling, rateCategoryCount,
+                                       nreps, compactTipCount, rescaleFrequency, unrooted, calcderivs,
+                                       eigenCount, partitionCount, preferenceFlags, requirementFlags,
+                                       resourceNumber, implName, benchedFlags, benchmarkResult, instOnly);
+
+    if (refresh)
+        cache->invalidate(key);
+
+    if (returnCode == BEAGLE_SUCCESS) {
+        BenchmarkCacheEntry entry;
+        entry.key             = key;
+        entry.patternCount    = nsites;
+        entry.implName        = sanitize(*implName);
+        entry.benchedFlags    = *benchedFlags;
+        entry.benchmarkResult = *benchmarkResult;
+        cache->insert(entry);
+    }
+
+    return returnCode;
+}
+
+}   // namespace benchmark
+}   // namespace beagle
@@ -0,0 +1,140 @@
+/*
+ *  BenchmarkCache.h
+ *  Persistent cache of resource benchmark results
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __beagle_benchmark_cache__
+#define __beagle_benchmark_cache__
+
+#include <string>
+#include <vector>
+
+// cached results at pattern counts within this factor of each other are interpolated
+#define BENCHMARK_CACHE_INTERPOLATION_RANGE 4
+
+namespace beagle {
+namespace benchmark {
+
+/*
+ * What a benchmark result depends on, apart from the pattern count: the
+ * library version, the host CPU model, the resource and the problem shape.
+ */
+struct BenchmarkCacheKey {
+    std::string version;
+    std::string cpuModel;
+    std::string resourceName;
+    std::string resourceDescription;
+    long preferenceFlags;
+    long requirementFlags;
+    int tipCount;
+    int compactTipCount;
+    int stateCount;
+    int categoryCount;
+    int eigenCount;
+    int partitionCount;
+    int manualScaling;
+    int rescaleFrequency;
+    int calcderivs;
+
+    bool operator==(const BenchmarkCacheKey& other) const;
+};
+
+struct BenchmarkCacheEntry {
+    BenchmarkCacheKey key;
+    int patternCount;
+    std::string implName;
+    long benchedFlags;
+    double benchmarkResult;
+};
+
+/*
+ * Benchmark results kept in a text file, one tab-separated entry per line.
+ * Entries added or invalidated are merged into the file as it is when
+ * written, which is replaced by renaming, so that jobs sharing the file can
+ * update it concurrently without corrupting it.
+ */
+class BenchmarkCache {
+public:
+    BenchmarkCache(const char* fileName);
+
+    // finds the result at patternCount, or interpolates it between nearby pattern counts
+    bool find(const BenchmarkCacheKey& key,
+              int patternCount,
+              std::string* implName,
+              long* benchedFlags,
+              double* benchmarkResult) const;
+
+    void insert(const BenchmarkCacheEntry& entry);
+
+    // drops the results of key at every pattern count
+    void invalidate(const BenchmarkCacheKey& key);
+
+    // merges the changes into the file; returns false if it cannot be written
+    bool write();
+
+    static std::string getCPUModel();
+
+private:
+    static void read(const std::string& fileName,
+                     std::vector<BenchmarkCacheEntry>& entries);
+
+    static void removeKey(std::vector<BenchmarkCacheEntry>& entries,
+                          const BenchmarkCacheKey& key,
+                          int patternCount);
+
+    std::string fileName;
+    std::vector<BenchmarkCacheEntry> entries;
+    std::vector<BenchmarkCacheEntry> addedEntries;
+    std::vector<BenchmarkCacheKey> invalidatedKeys;
+};
+
+/*
+ * benchmarkResource, answered from the cache when it holds the result (or
+ * nearby results) unless refresh is set. New results are added to the
+ * cache; with refresh the previous results of the problem are invalidated.
+ */
+int benchmarkResourceCached(BenchmarkCache* cache,
+                            bool refresh,
+                            int resource,
+                            int stateCount,
+                            int ntaxa,
+                            int nsites,
+                            bool manualScaling,
+                            int rateCategoryCount,
+                            int nreps,
+                            int compactTipCount,
+                            int rescaleFrequency,
+                            bool unrooted,
+                            bool calcderivs,
+                            int eigenCount,
+                            int partitionCount,
+                            long preferenceFlags,
+                            long requirementFlags,
+                            int* resourceNumber,
+                            char** implName,
+                            long* benchedFlags,
+                            double* benchmarkResult,
+                            bool instOnly);
+
+}   // namespace benchmark
+}   // namespace beagle
+
+#endif // __beagle_benchmark_cache__
@@ -0,0 +1,123 @@
+#!/usr/bin/env python
+
+# Compares synthetictest results written with --json against a baseline
+
+from __future__ import print_function
+
+import sys
+import argparse
+import json
+
+# configuration keys that identify a benchmark, in the order they are printed
+KEY_FIELDS = ['states', 'taxa', 'sites', 'rates', 'precision', 'scaling', 'compacttips', 'eigencount',
+              'partitions', 'unrooted', 'calcderivs', 'enablethreads', 'threads', 'disablevector', 'autotune']
+
+def read_results(file_names):
+    results = {}
+    for file_name in file_names:
+        with open(file_name) as results_file:
+            for line_number, line in enumerate(results_file, 1):
+                line = line.strip()
+                if not line:
+                    continue
+                try:
+                    result = json.loads(line)
+                except ValueError:
+                    sys.exit('%s:%d: not a JSON result' % (file_name, line_number))
+                configuration = result['configuration']
+                key = (result['implementation']['implName'],) + \
+                      tuple(configuration.get(field) for field in KEY_FIELDS)
+                # repeated runs of a benchmark are pooled
+                results.setdefault(key, []).append(result)
+    return results
+
+def describe(key):
+    return key[0] + ' ' + ' '.join('%s=%s' % (field, value) for field, value in zip(KEY_FIELDS, key[1:])
+                                   if value not in (None, False, 'none'))
+
+def pooled_times(runs, phase):
+    times = []
+    for run in runs:
+        times.extend(run['timings'][phase]['runs'])
+    return sorted(times)
+
+def median(values):
+    middle = len(values) // 2
+    if len(values) % 2 == 1:
+        return values[middle]
+    return (values[middle - 1] + values[middle]) / 2.0
+
+def is_cpu(key, runs):
+    return runs[0]['implementation']['resourceName'] == 'CPU' or key[0].startswith('CPU')
+
+def main():
+    parser = argparse.ArgumentParser(description='compare synthetictest --json results against a baseline')
+    parser.add_argument('baseline', help='JSON results of the baseline library')
+    parser.add_argument('current', nargs='+', help='JSON results of the library under test')
+    parser.add_argument('--phase', default='total',
+                        help='timing phase to compare (total, setPartitions, transMats, partials, accScalers, rootLnL)')
+    parser.add_argument('--tolerance', type=float, default=0.10,
+                        help='relative slowdown allowed beyond the noise of the baseline (default 0.10)')
+    parser.add_argument('--lnl-tolerance', type=float, default=0.01,
+                        help='absolute lnL difference allowed (default 0.01)')
+    parser.add_argument('--all-resources', action='store_true',
+                        help='fail on regressions of non-CPU implementations too')
+    args = parser.parse_args()
+
+    baseline = read_results([args.baseline])
+    current = read_results(args.current)
+
+    failures = 0
+    print('%-8s %12s %12s %12s %12s %8s  %s' % ('status', 'base min', 'min', 'base median', 'median', 'limit',
+                                                 'benchmark'))
+    for key in sorted(current, key=describe):
+        runs = current[key]
+        if key not in baseline:
+            print('%-8s %12s %12s %12s %12s %8s  %s' % ('new', '-', '-', '-', '-', '-', describe(key)))
+            continue
+        base_runs = baseline[key]
+        base_times = pooled_times(base_runs, args.phase)
+        times = pooled_times(runs, args.phase)
+        if not base_times or not times:
+            continue
+
+        base_min, base_median = base_times[0], median(base_times)
+        cur_min, cur_median = times[0], median(times)
+
+        # the spread of the baseline reps widens the allowed slowdown, so
+        # noisy benchmarks need a larger change to be flagged
+        noise = (base_median - base_min) / base_min if base_min > 0 else 0.0
+        limit = 1.0 + args.tolerance + noise
+
+        # a regression must show in both the best and the typical rep
+        regressed = cur_min > base_min * limit and cur_median > base_median * limit
+        lnl_changed = abs(runs[-1]['logL'] - base_runs[-1]['logL']) > args.lnl_tolerance
+
+        status = 'ok'
+        if lnl_changed:
+            status = 'LNL'
+        elif regressed:
+            status = 'SLOWER'
+        elif cur_min * limit < base_min and cur_median * limit < base_median:
+            status = 'faster'
+
+        gating = is_cpu(key, runs) or args.all_resources
+        if status in ('LNL', 'SLOWER') and gating:
+            failures += 1
+        elif status in ('LNL', 'SLOWER'):
+            status = status.lower()
+
+        print('%-8s %12.4f %12.4f %12.4f %12.4f %8.3f  %s' % (status, base_min, cur_min, base_median,
+                                                              cur_median, limit, describe(key)))
+
+    for key in sorted(baseline, key=describe):
+        if key not in current:
+            print('%-8s %12s %12s %12s %12s %8s  %s' % ('missing', '-', '-', '-', '-', '-', describe(key)))
+
+    if failures > 0:
+        print('%d benchmark%s regressed' % (failures, 's' if failures > 1 else ''))
+        return 1
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main())
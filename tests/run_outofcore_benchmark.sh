@@ -0,0 +1,49 @@
+#!/bin/bash
+
+# Compares in-memory and memory-mapped (out-of-core) partials buffers on the
+# same synthetic problem. Set BEAGLE_SCRATCH_DIR to place the scratch file on
+# the device under test. Vectorized implementations are disabled so that both
+# runs use the same kernels.
+#
+# Usage: run_outofcore_benchmark.sh [resource_number] [states] [taxa] [sites] [rates] [reps]
+
+R=${1:-0}
+STATES=${2:-4}
+TAXA=${3:-128}
+SITES=${4:-100000}
+RATES=${5:-4}
+REPS=${6:-10}
+
+SYNTHETICTEST=../examples/synthetictest/synthetictest
+FLAGS="--rsrc $R --states $STATES --taxa $TAXA --sites $SITES --rates $RATES --reps $REPS --doubleprecision --manualscale --disablevector"
+
+function best_run {
+    grep "best run" $1 | cut -f 3 -d " "
+}
+
+function log_likelihood {
+    grep "logL" $1 | cut -f 3 -d " "
+}
+
+$SYNTHETICTEST $FLAGS > screen_incore 2>&1
+$SYNTHETICTEST $FLAGS --outofcore > screen_outofcore 2>&1
+
+if [ -z "`grep PARTIALS_MAPPED screen_outofcore`" ]
+then
+    echo "*** ERROR: resource $R did not use memory-mapped partials" 1>&2;
+fi
+
+TIME_INCORE=`best_run screen_incore`
+TIME_OUTOFCORE=`best_run screen_outofcore`
+SLOWDOWN=`awk "BEGIN { printf \"%.3f\", $TIME_OUTOFCORE / $TIME_INCORE }"`
+
+if [ ! -f outofcore_results.csv ]
+then
+    echo "rsrc,states,taxa,sites,rates,reps,lnl_incore,lnl_outofcore,time_incore,time_outofcore,slowdown,date" >> outofcore_results.csv
+fi
+
+echo "$R,$STATES,$TAXA,$SITES,$RATES,$REPS,`log_likelihood screen_incore`,`log_likelihood screen_outofcore`,$TIME_INCORE,$TIME_OUTOFCORE,$SLOWDOWN,`date "+%Y-%m-%d %H:%M:%S"`" >> outofcore_results.csv
+
+echo "in-core best run: ${TIME_INCORE}ms  out-of-core best run: ${TIME_OUTOFCORE}ms  slowdown: ${SLOWDOWN}x"
+
+rm screen_incore screen_outofcore
@@ -0,0 +1,45 @@
+#!/bin/bash
+
+# Times the CPU implementations on a fixed set of synthetic problems and
+# compares them with a baseline. Record the baseline with the library in use,
+# then run again with the candidate library and the baseline file; the script
+# fails when an implementation is slower beyond the tolerance of
+# compare_benchmarks.py or its lnL changed.
+#
+# Usage: run_regression_benchmark.sh <results_file> [baseline_file] [resource_number] [runs]
+
+if [ -z "${1}" ]
+then
+    echo "Usage: run_regression_benchmark.sh <results_file> [baseline_file] [resource_number] [runs]" 1>&2;
+    exit 1
+fi
+
+RESULTS=${1}
+BASELINE=${2}
+R=${3:-0}
+RUNS=${4:-3}
+
+SYNTHETICTEST=../examples/synthetictest/synthetictest
+COMMON="--rsrc $R --reps 10 --seed 1 --json $RESULTS"
+
+rm -f $RESULTS
+
+# repeated runs are pooled by the comparator, so one slow process is not taken for a regression
+for run in `seq 1 $RUNS`
+do
+    for PRECISION in "" "--doubleprecision"
+    do
+        for VECTOR in "" "--disablevector"
+        do
+            $SYNTHETICTEST $COMMON $PRECISION $VECTOR --states 4 --taxa 20 --sites 10000 --rates 4 --compacttips 10 --manualscale > /dev/null || exit 1
+            $SYNTHETICTEST $COMMON $PRECISION $VECTOR --states 4 --taxa 16 --sites 10000 --rates 4 --unrooted --calcderivs > /dev/null || exit 1
+            $SYNTHETICTEST $COMMON $PRECISION $VECTOR --states 20 --taxa 16 --sites 2000 --rates 4 --manualscale > /dev/null || exit 1
+            $SYNTHETICTEST $COMMON $PRECISION $VECTOR --states 64 --taxa 10 --sites 1000 --rates 4 --compacttips 5 > /dev/null || exit 1
+        done
+    done
+done
+
+if [ -n "$BASELINE" ]
+then
+    python `dirname $0`/compare_benchmarks.py $BASELINE $RESULTS
+fi